@@ -0,0 +1,62 @@
+#pragma once
+#include "ceres/ceres.h"
+#include <swarm_msgs/swarm_types.hpp>
+#include <functional>
+#include <vector>
+#include <tuple>
+#include <map>
+#include <set>
+
+//Kinds of residual blocks in ResidualKey, the ones from RES_LOOP on are rebuilt every solve
+#define RES_DISTANCE 0
+#define RES_EGO_MOTION 1
+#define RES_PRIOR 2
+#define RES_LOOP 3
+
+//Residual block of the persistent problem: kind, measurement index, ts of the two poses and the two pose blocks
+typedef std::tuple<int, int, TsType, TsType, double*, double*> ResidualKey;
+
+//Residual blocks of a ceres::Problem kept over solves. Each setup declares all its residuals with add_residual,
+//only the ones not in the problem yet are created, and remove_unused removes the ones not declared since the
+//last call together with their orphaned poses, so the setup creates residuals for new frames only.
+class IncrementalResiduals {
+    std::map<ResidualKey, ceres::ResidualBlockId> residual_blocks;
+    std::set<ResidualKey> residuals_in_use;
+    std::set<double*> constant_poses, constant_poses_now;
+    std::map<int, int> residual_num;
+    int created_num = 0;
+
+    std::map<ResidualKey, ceres::ResidualBlockId>::iterator remove_residual(ceres::Problem &problem,
+        std::map<ResidualKey, ceres::ResidualBlockId>::iterator it);
+
+public:
+    //Robust residuals get a HuberLoss when set
+    bool robust_loss = true;
+
+    //Start the setup of a solve, clears the counts
+    void begin_setup();
+
+    //Poses default to the two pose blocks of the key. create_cost is only called if the key is not in the problem.
+    void add_residual(ceres::Problem &problem, const ResidualKey & key, std::function<ceres::CostFunction*()> create_cost, bool robust,
+        std::vector<double*> poses = std::vector<double*>());
+
+    //Constant in this setup, made variable again by the remove_unused of a setup without it
+    void set_constant(double * pose);
+
+    //Remove all residuals of kind or a later kind, return the number removed
+    int remove_from_kind(ceres::Problem &problem, int kind);
+
+    //Remove the residuals not added since the last call and apply the constant poses, return the number removed
+    int remove_unused(ceres::Problem &problem);
+
+    //Forget all blocks, for a new problem
+    void clear();
+
+    //Residuals of kind added in this setup
+    int count(int kind) const;
+
+    //Residuals created in this setup, the others were already in the problem
+    int created() const {
+        return created_num;
+    }
+};
@@ -200,6 +200,169 @@ inline void EigenTanbase2T(const Eigen::Matrix<double, 2, 3> & _tan_base, T *tan
     tan_base[5] = T(_tan_base(1, 2));
 }
 
+inline Eigen::Matrix3d YawRotation(double yaw) {
+    Eigen::Matrix3d R;
+    R << cos(yaw), -sin(yaw), 0,
+         sin(yaw), cos(yaw), 0,
+         0, 0, 1;
+    return R;
+}
+
+//d YawRotation(yaw) / d yaw
+inline Eigen::Matrix3d YawRotationDerivative(double yaw) {
+    Eigen::Matrix3d dR;
+    dR << -sin(yaw), -cos(yaw), 0,
+          cos(yaw), -sin(yaw), 0,
+          0, 0, 0;
+    return dR;
+}
+
+//The factors below are the same as DistanceMeasurementFactor, RelativePoseFactor4d and DroneDetection4dFactor
+//with closed form jacobians, used by their Create when ANALYTIC_JACOBIAN is set.
+class DistanceMeasurementFactorAnalytic : public SizedCostFunction<1, 4, 4> {
+    double distance_measurement;
+    double distance_sqrt_inf;
+public:
+    DistanceMeasurementFactorAnalytic(double _distance_measurement, double _distance_sqrt_inf): 
+        distance_measurement(_distance_measurement), distance_sqrt_inf(_distance_sqrt_inf)
+    {}
+
+    virtual bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const {
+        Eigen::Map<const Eigen::Vector3d> T_a(parameters[0]);
+        Eigen::Map<const Eigen::Vector3d> T_b(parameters[1]);
+        Eigen::Vector3d dp = T_a - T_b;
+        double norm = dp.norm();
+        residuals[0] = (norm - distance_measurement)*distance_sqrt_inf;
+        if (jacobians) {
+            Eigen::Vector3d d_dp = Eigen::Vector3d::Zero();
+            if (norm > 1e-10) {
+                d_dp = dp/norm*distance_sqrt_inf;
+            }
+            if (jacobians[0]) {
+                Eigen::Map<Eigen::Matrix<double, 1, 4>> J(jacobians[0]);
+                J << d_dp.transpose(), 0;
+            }
+            if (jacobians[1]) {
+                Eigen::Map<Eigen::Matrix<double, 1, 4>> J(jacobians[1]);
+                J << -d_dp.transpose(), 0;
+            }
+        }
+        return true;
+    }
+};
+
+class RelativePoseFactor4dAnalytic : public SizedCostFunction<4, 4, 4> {
+    Eigen::Vector4d relative_pose_4d;
+    Eigen::Matrix4d sqrt_inf;
+public:
+    RelativePoseFactor4dAnalytic(const Swarm::Pose & _relative_pose, const Eigen::Matrix4d & _sqrt_inf):
+        sqrt_inf(_sqrt_inf)
+    {
+        _relative_pose.to_vector_xyzyaw(relative_pose_4d.data());
+    }
+
+    virtual bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const {
+        const double * pose_a = parameters[0];
+        const double * pose_b = parameters[1];
+        Eigen::Vector4d relpose_est;
+        DeltaPose(pose_a, pose_b, relpose_est.data());
+        pose_error_4d(relpose_est, relative_pose_4d, sqrt_inf, residuals);
+        if (jacobians) {
+            //The error is relative - est, so the jacobians are -sqrt_inf * d est
+            Eigen::Matrix3d R = YawRotation(-pose_a[3]);
+            Eigen::Vector3d dp(pose_b[0] - pose_a[0], pose_b[1] - pose_a[1], pose_b[2] - pose_a[2]);
+            if (jacobians[0]) {
+                Eigen::Map<Eigen::Matrix<double, 4, 4, Eigen::RowMajor>> J(jacobians[0]);
+                Eigen::Matrix4d d_est = Eigen::Matrix4d::Zero();
+                d_est.block<3, 3>(0, 0) = -R;
+                d_est.block<3, 1>(0, 3) = -YawRotationDerivative(-pose_a[3])*dp;
+                d_est(3, 3) = -1;
+                J = -sqrt_inf*d_est;
+            }
+            if (jacobians[1]) {
+                Eigen::Map<Eigen::Matrix<double, 4, 4, Eigen::RowMajor>> J(jacobians[1]);
+                Eigen::Matrix4d d_est = Eigen::Matrix4d::Zero();
+                d_est.block<3, 3>(0, 0) = R;
+                d_est(3, 3) = 1;
+                J = -sqrt_inf*d_est;
+            }
+        }
+        return true;
+    }
+};
+
+//RES_NUM is 3 with depth, 2 without
+template<int RES_NUM>
+class DroneDetection4dFactorAnalytic : public SizedCostFunction<RES_NUM, 4, 4> {
+    Eigen::Vector3d dir;
+    double inv_dep;
+    double dep;
+    bool use_inv_dep = true;
+    //Without dpose, pose a is moved up by the extrinsic
+    Eigen::Vector4d dposea = Eigen::Vector4d::Zero();
+    Eigen::Vector4d dposeb = Eigen::Vector4d::Zero();
+    Eigen::Matrix<double, 2, 3> tan_base;
+public:
+    DroneDetection4dFactorAnalytic(const Swarm::DroneDetection & det) {
+        dir = det.p;
+        inv_dep = det.inv_dep;
+        dep = 1/inv_dep;
+        if (det.enable_dpose) {
+            det.dpose_self_a.to_vector_xyzyaw(dposea.data());
+            det.dpose_self_b.to_vector_xyzyaw(dposeb.data());
+        } else {
+            dposea(2) = det.extrinsic.pos().z();
+        }
+        //Same order as unit_position_error reads it
+        tan_base = Eigen::Map<const Eigen::Matrix<double, 2, 3, Eigen::RowMajor>>(det.detect_tan_base.data());
+    }
+
+    virtual bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const {
+        Eigen::Map<const Eigen::Vector4d> pose_a(parameters[0]);
+        Eigen::Map<const Eigen::Vector4d> pose_b(parameters[1]);
+        Eigen::Vector3d dpa = YawRotation(pose_a(3))*dposea.head<3>();
+        Eigen::Vector3d dpb = YawRotation(pose_b(3))*dposeb.head<3>();
+        Eigen::Vector3d dp = pose_b.head<3>() + dpb - pose_a.head<3>() - dpa;
+        double yaw_a = pose_a(3) + dposea(3);
+        Eigen::Matrix3d R = YawRotation(-yaw_a);
+        Eigen::Vector3d p = R*dp;
+        double norm = p.norm();
+        Eigen::Vector3d u = p/norm;
+
+        Eigen::Map<Eigen::Matrix<double, RES_NUM, 1>> res(residuals);
+        Eigen::Matrix<double, RES_NUM, 3> d_p;
+        res.template head<2>() = tan_base*(u - dir)/DETECTION_SPHERE_STD;
+        d_p.template topRows<2>() = tan_base*(Eigen::Matrix3d::Identity() - u*u.transpose())/(norm*DETECTION_SPHERE_STD);
+        if (RES_NUM == 3) {
+            if (use_inv_dep) {
+                res(2) = (inv_dep - 1/norm)/DETECTION_INV_DEP_STD;
+                d_p.row(2) = u.transpose()/(norm*norm*DETECTION_INV_DEP_STD);
+            } else {
+                res(2) = (norm - dep)/DETECTION_DEP_STD;
+                d_p.row(2) = u.transpose()/DETECTION_DEP_STD;
+            }
+        }
+
+        if (jacobians) {
+            if (jacobians[0]) {
+                Eigen::Map<Eigen::Matrix<double, RES_NUM, 4, Eigen::RowMajor>> J(jacobians[0]);
+                Eigen::Matrix<double, 3, 4> d_pa;
+                d_pa.block<3, 3>(0, 0) = -R;
+                d_pa.col(3) = -YawRotationDerivative(-yaw_a)*dp - R*YawRotationDerivative(pose_a(3))*dposea.head<3>();
+                J = d_p*d_pa;
+            }
+            if (jacobians[1]) {
+                Eigen::Map<Eigen::Matrix<double, RES_NUM, 4, Eigen::RowMajor>> J(jacobians[1]);
+                Eigen::Matrix<double, 3, 4> d_pb;
+                d_pb.block<3, 3>(0, 0) = R;
+                d_pb.col(3) = R*YawRotationDerivative(pose_b(3))*dposeb.head<3>();
+                J = d_p*d_pb;
+            }
+        }
+        return true;
+    }
+};
+
 struct DistanceMeasurementFactor {
     double distance_measurement;
     double distance_sqrt_inf;
@@ -218,6 +381,9 @@ public:
 
     static ceres::CostFunction* Create(double _distance_measurement, double _distance_sqrt_inf) {
         // std::cout << "Loop" << "sqrt_inf\n" << loop->get_sqrt_information_4d() << std::endl;
+        if (ANALYTIC_JACOBIAN) {
+            return new DistanceMeasurementFactorAnalytic(_distance_measurement, _distance_sqrt_inf);
+        }
         return new ceres::AutoDiffCostFunction<DistanceMeasurementFactor, 1, 4, 4>(
             new DistanceMeasurementFactor(_distance_measurement, _distance_sqrt_inf));
     }
@@ -248,6 +414,9 @@ public:
     }
 
     static ceres::CostFunction* Create(const Swarm::Pose & _relative_pose, const Eigen::Matrix4d & _sqrt_inf) {
+        if (ANALYTIC_JACOBIAN) {
+            return new RelativePoseFactor4dAnalytic(_relative_pose, _sqrt_inf);
+        }
         return new ceres::AutoDiffCostFunction<RelativePoseFactor4d, 4, 4, 4>(
             new RelativePoseFactor4d(_relative_pose, _sqrt_inf));
     }
@@ -256,17 +425,15 @@ public:
         Matrix4d cov4d = Matrix4d::Zero();
         cov4d.block<3, 3>(0, 0) = cov.block<3, 3>(0, 0);
         cov4d(3, 3) = cov(5, 5);
-        auto _sqrt_inf_4d = cov4d.inverse().cwiseAbs().cwiseSqrt();;
+        Matrix4d _sqrt_inf_4d = cov4d.inverse().cwiseAbs().cwiseSqrt();;
         // std::cout << "Odom" << "sqrt_inf\n" << _sqrt_inf_4d << std::endl;
-        return new ceres::AutoDiffCostFunction<RelativePoseFactor4d, 4, 4, 4>(
-            new RelativePoseFactor4d(_relative_pose, _sqrt_inf_4d));
+        return Create(_relative_pose, _sqrt_inf_4d);
     }
 
     static ceres::CostFunction* Create(const Swarm::GeneralMeasurement2Drones* _loc) {
         auto loop = static_cast<const Swarm::LoopEdge*>(_loc);
         // std::cout << "Loop" << "sqrt_inf\n" << loop->get_sqrt_information_4d() << std::endl;
-        return new ceres::AutoDiffCostFunction<RelativePoseFactor4d, 4, 4, 4>(
-            new RelativePoseFactor4d(loop->relative_pose, loop->get_sqrt_information_4d()));
+        return Create(loop->relative_pose, loop->get_sqrt_information_4d());
     }
 };
 
@@ -346,13 +513,7 @@ public:
     static ceres::CostFunction* Create(const Swarm::GeneralMeasurement2Drones* _loc) {
         auto det = static_cast<const Swarm::DroneDetection*>(_loc);
         // std::cout << "Loop" << "sqrt_inf\n" << loop->get_sqrt_information_4d() << std::endl;
-        int res_count = 2;
-        if (det->enable_depth) {
-            res_count = 3;
-        }
-
-        return new ceres::AutoDiffCostFunction<DroneDetection4dFactor, ceres::DYNAMIC, 4, 4>(
-            new DroneDetection4dFactor(*det), res_count);
+        return Create(*det);
     }
 
     static ceres::CostFunction* Create(const Swarm::DroneDetection & _det) {
@@ -361,6 +522,12 @@ public:
         if (_det.enable_depth) {
             res_count = 3;
         }
+        if (ANALYTIC_JACOBIAN) {
+            if (_det.enable_depth) {
+                return new DroneDetection4dFactorAnalytic<3>(_det);
+            }
+            return new DroneDetection4dFactorAnalytic<2>(_det);
+        }
         return new ceres::AutoDiffCostFunction<DroneDetection4dFactor, ceres::DYNAMIC, 4, 4>(
             new DroneDetection4dFactor(_det), res_count);
     }
@@ -7,6 +7,8 @@ extern float DETECTION_SPHERE_STD;
 extern float DETECTION_INV_DEP_STD;
 extern float DETECTION_DEP_STD;
 extern Eigen::Vector3d CG;
+//Closed form jacobians for the localization factors instead of autodiff
+extern bool ANALYTIC_JACOBIAN;
 
 struct swarm_localization_solver_params {
     int max_frame_number = 100;
@@ -42,11 +44,19 @@ struct swarm_localization_solver_params {
     float vo_cov_yaw_per_meter = 0.1;
     float distance_measurement_cov = 0.1;
     bool enable_random_keyframe_deletetion = false;
+    bool incremental_solve = true;
+    bool enable_marginalization = true;
+    //Random init hypotheses solved in parallel, the rest are cancelled once one is below init_cancel_cost
+    int init_trial_num = 3;
+    int init_thread_num = 3;
+    float init_cancel_cost = 10;
     SwarmLocalOutlierRejectionParams outlier_rejection_params;
 
     //Debug 
     bool debug_loop_initial_only = false;
     bool debug_no_relocalization = false;
+    //Compare the prediction of each published state with the lookup of the saved estimates
+    bool debug_check_prediction = false;
     bool enable_data_association = true;
 };
 
@@ -10,9 +10,12 @@
 #include <functional>
 #include <swarm_msgs/swarm_types.hpp>
 #include <mutex>
+#include <atomic>
 #include <swarm_msgs/LoopEdge.h>
 #include <swarm_localization/swarm_outlier_rejection.hpp>
 #include <swarm_localization/swarm_localization_params.hpp>
+#include <swarm_localization/swarm_marginalization.hpp>
+#include <swarm_localization/swarm_incremental_residuals.hpp>
 
 
 using namespace Swarm;
@@ -49,11 +52,20 @@ typedef std::map<int, std::map<TsType,double*>> EstimatePosesIDTS;
 typedef std::vector<std::pair<TsType, int>> TSIDArray;
 typedef std::map<int, std::map<TsType, int>>  IDTSIndex;
 
+//What prediction needs from the last solve. Made after each solve and swapped in whole,
+//so the prediction never reads the poses being optimized.
+struct PredictState {
+    bool finish_init = false;
+    std::set<int> enable_to_init;
+    //Newest saved estimated pose of each drone and its yaw only VO pose at the same keyframe
+    std::map<int, std::pair<Pose, Pose>> est_and_vo;
+};
 
 class SwarmLocalizationSolver {
 
     std::mutex solve_lock;
-    std::mutex predict_lock;
+    mutable std::mutex predict_lock;
+    std::shared_ptr<const PredictState> predict_state;
     std::vector<SwarmFrame> sf_sld_win;
     std::map<TsType, SwarmFrame> all_sf;
     TsType last_kf_ts = 0;
@@ -95,8 +107,23 @@ class SwarmLocalizationSolver {
 
     bool enable_cgraph_generation;
 
+    //Kept over solves, residuals of new frames are added and the ones of frames left the window removed
+    Problem * persistent_problem = nullptr;
+    IncrementalResiduals residuals;
+    double sum_setup_time = 0;
+    double count_setup_time = 0;
+
+    //Priors left by the frames marginalized out of the sliding window
+    std::map<int, std::shared_ptr<MarginalizationInfo>> priors;
+    int prior_count = 0;
+
     void delete_frame_i(int i);
 
+    //Frames leave the window unmarginalized until the next init, which also moves the poses the priors are linearized at
+    void reset_init();
+
+    void marginalize_frame(int i);
+
     bool is_frame_useful(unsigned int i) const;
 
     void process_frame_clear();
@@ -111,6 +138,14 @@ class SwarmLocalizationSolver {
 
     void sync_est_poses(const EstimatePoses &_est_poses_tsid, bool is_init_solve);
 
+    void publish_predict_state();
+
+    //Prediction by the newest saved estimate of the drone, as read by the solver thread
+    bool predict_by_saved_est(const NodeFrame & nf, Pose & _pose, Pose & base_coor) const;
+
+    //Return false if PredictSwarm on the published state differs from predict_by_saved_est
+    bool check_predict_state(const SwarmFrame & sf) const;
+
 
     std::vector<Swarm::GeneralMeasurement2Drones*> find_available_loops_detections(std::map<int, std::set<int>> & loop_edges);
 
@@ -123,11 +158,22 @@ class SwarmLocalizationSolver {
 
 
     void
-    setup_problem_with_sferror(const EstimatePoses &swarm_est_poses, Problem &problem, const SwarmFrame &sf, TSIDArray & param_indexs, bool is_lastest_frame);
+    setup_problem_with_sferror(const EstimatePoses &swarm_est_poses, const EstimatePosesIDTS & est_poses_idts, Problem &problem, const SwarmFrame &sf, TSIDArray & param_indexs, bool is_lastest_frame);
 
-    void setup_problem_with_ego_motion(const EstimatePosesIDTS & est_poses_idts, Problem &problem, int _id) const;
+    void setup_problem_with_ego_motion(const EstimatePosesIDTS & est_poses_idts, Problem &problem, int _id);
     
-    void setup_problem_with_loops_and_detections(const EstimatePosesIDTS & est_poses_idts, Problem &problem) const;
+    void setup_problem_with_loops_and_detections(const EstimatePosesIDTS & est_poses_idts, Problem &problem);
+
+    void setup_problem_with_priors(Problem &problem);
+
+    Problem & reset_problem();
+
+    //Add the residuals on the poses to problem, return the number of distance and loop residual blocks
+    int setup_problem(EstimatePoses & swarm_est_poses, EstimatePosesIDTS & est_poses_idts, Problem & problem);
+
+    //Return the cost of the solution, or -1 if cancel was set during the solve. Ceres uses num_threads, thread_num if 0
+    double solve_problem(Problem & problem, int num_res_blks, Solver::Summary & summary, const std::atomic<bool> * cancel = nullptr,
+        int num_threads = 0) const;
     
     
     void cutting_edges();
@@ -201,12 +247,18 @@ public:
     void add_new_detection(const swarm_msgs::node_detected_xyzyaw & detected);
     void add_new_detection(const swarm_msgs::node_detected & detected);
 
+    //Prediction uses only the state published by the last solve, it is safe to call while solving
     SwarmFrameState PredictSwarm(const SwarmFrame &sf) const;
 
-    bool PredictNode(const NodeFrame & nf, Pose & _pose, Eigen::Matrix4d & cov) const;
-    bool NodeCooridnateOffset(int _id, Pose & _pose, Eigen::Matrix4d & cov) const;
-    bool CanPredictSwarm() {
-        return finish_init;
+    bool PredictNode(const PredictState & state, const NodeFrame & nf, Pose & _pose, Eigen::Matrix4d & cov) const;
+    bool NodeCooridnateOffset(const PredictState & state, int _id, Pose & _pose, Eigen::Matrix4d & cov) const;
+    bool CanPredictSwarm() const {
+        return get_predict_state()->finish_init;
+    }
+
+    std::shared_ptr<const PredictState> get_predict_state() const {
+        std::lock_guard<std::mutex> lk(predict_lock);
+        return predict_state;
     }
 
     const std::vector<int64_t> get_good_loops() const { 
@@ -218,6 +270,8 @@ public:
     double sum_opti_time = 0;
 
     double count_solve_time = 0;
+    //Wall time of the first frame, for the time to the first estimate
+    ros::WallTime t_first_frame;
     double sum_solve_time = 0;
 
     double count_outlier_rejection_time  = 0;
@@ -0,0 +1,37 @@
+#pragma once
+#include <eigen3/Eigen/Dense>
+#include "ceres/ceres.h"
+#include <vector>
+#include <memory>
+#include <map>
+#include <set>
+
+// Pose in this file use only x, y, z, yaw like swarm_localization_factors.hpp
+
+//Linear prior left by marginalizing poses out of a problem with the Schur complement, as the sliding window of VINS.
+//The prior is on the other poses of the problem, linearized at their values when marginalized.
+class MarginalizationInfo {
+public:
+    std::vector<double*> kept_poses;
+    std::vector<Eigen::Vector4d> linearized_poses;
+    Eigen::MatrixXd linearized_jacobians;
+    Eigen::VectorXd linearized_residuals;
+
+    //Linearize all residuals of problem at the current poses and marginalize out drop_poses.
+    //Return false if no information is left on the kept poses.
+    bool marginalize(ceres::Problem & problem, const std::vector<double*> & drop_poses);
+
+    bool has_pose(const double * pose) const;
+};
+
+//Remove the priors on a pose not in window_poses, left by frames dropped from the window without marginalization.
+//Return the number of priors removed.
+int remove_stale_priors(std::map<int, std::shared_ptr<MarginalizationInfo>> & priors, const std::set<double*> & window_poses);
+
+class MarginalizationFactor : public ceres::CostFunction {
+    std::shared_ptr<MarginalizationInfo> info;
+public:
+    MarginalizationFactor(std::shared_ptr<MarginalizationInfo> _info);
+
+    virtual bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const;
+};
@@ -26,6 +26,7 @@ class SwarmLocalOutlierRejection {
     std::set<int64_t> all_loops_set;
 public:
     std::map<int, std::map<int, std::set<int64_t>>> all_loops_set_by_pair;
+    //Written by the solver and the lcm threads, read by the prediction. Guarded by lcm_mutex
     std::map<int, std::map<int, std::set<int64_t>>> good_loops_set;
     std::map<int64_t, Swarm::LoopEdge> all_loop_map;
     int self_id = -1;
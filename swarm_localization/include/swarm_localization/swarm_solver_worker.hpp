@@ -0,0 +1,136 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <chrono>
+
+struct SolverWorkerStats {
+    long pushed = 0;
+    long consumed = 0;
+    long solves = 0;
+    int queue_max = 0;
+    //Milliseconds of the solves
+    double solve_sum = 0;
+    double solve_max = 0;
+};
+
+//Runs the solve of the swarm localization on its own thread.
+//Frames and measurements are pushed as intake jobs by the subscribers and run on the worker between solves,
+//so a subscriber only waits for the queue lock, never for a solve.
+//After the jobs queued so far are run, solve is called if the newest frame is more than solve_interval seconds
+//after the frame of the last solve, with the stamp of the newest frame.
+class SolverWorker {
+    typedef std::chrono::steady_clock Clock;
+
+    double solve_interval;
+    std::function<void(double)> solve;
+
+    //Job and the frame stamp of it, negative for measurements
+    std::deque<std::pair<std::function<void()>, double>> jobs;
+    mutable std::mutex lock;
+    std::condition_variable not_empty;
+    bool stopped = false;
+    SolverWorkerStats _stats;
+    std::thread worker;
+
+    double t_last_solve = 0;
+    double t_newest_frame = -1;
+
+    void run() {
+        while (true) {
+            std::deque<std::pair<std::function<void()>, double>> _jobs;
+            {
+                std::unique_lock<std::mutex> lk(lock);
+                not_empty.wait(lk, [&] { return stopped || !jobs.empty(); });
+                if (stopped) {
+                    return;
+                }
+                //Take all, the frames came during the last solve are solved together
+                _jobs.swap(jobs);
+            }
+
+            for (auto & job : _jobs) {
+                job.first();
+                if (job.second >= 0) {
+                    t_newest_frame = job.second;
+                }
+            }
+
+            bool to_solve = t_newest_frame >= 0 && t_newest_frame - t_last_solve > solve_interval;
+            double dt = 0;
+            if (to_solve) {
+                t_last_solve = t_newest_frame;
+                auto t_start = Clock::now();
+                solve(t_newest_frame);
+                dt = std::chrono::duration<double, std::milli>(Clock::now() - t_start).count();
+            }
+
+            std::lock_guard<std::mutex> lk(lock);
+            _stats.consumed += _jobs.size();
+            if (to_solve) {
+                _stats.solves ++;
+                _stats.solve_sum += dt;
+                _stats.solve_max = std::max(_stats.solve_max, dt);
+            }
+        }
+    }
+
+    void push(std::function<void()> job, double stamp) {
+        {
+            std::lock_guard<std::mutex> lk(lock);
+            if (stopped) {
+                return;
+            }
+            jobs.emplace_back(std::move(job), stamp);
+            _stats.pushed ++;
+            _stats.queue_max = std::max(_stats.queue_max, (int) jobs.size());
+        }
+        not_empty.notify_one();
+    }
+
+public:
+    SolverWorker(double _solve_interval, std::function<void(double)> _solve):
+        solve_interval(_solve_interval), solve(_solve) {
+        worker = std::thread([&] { run(); });
+    }
+
+    ~SolverWorker() {
+        stop();
+    }
+
+    //Jobs still queued are discarded
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lk(lock);
+            stopped = true;
+        }
+        not_empty.notify_all();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    //Queue the intake of a frame of stamp in seconds
+    void push_frame(std::function<void()> job, double stamp) {
+        push(job, stamp);
+    }
+
+    //Queue the intake of a loop or a detection, it doesn't trigger a solve
+    void push_measurement(std::function<void()> job) {
+        push(job, -1);
+    }
+
+    int size() const {
+        std::lock_guard<std::mutex> lk(lock);
+        return jobs.size();
+    }
+
+    SolverWorkerStats stats() const {
+        std::lock_guard<std::mutex> lk(lock);
+        return _stats;
+    }
+};
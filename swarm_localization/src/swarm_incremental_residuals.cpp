@@ -0,0 +1,96 @@
+#include "swarm_localization/swarm_incremental_residuals.hpp"
+
+void IncrementalResiduals::begin_setup() {
+    residual_num.clear();
+    created_num = 0;
+}
+
+void IncrementalResiduals::add_residual(ceres::Problem &problem, const ResidualKey & key, std::function<ceres::CostFunction*()> create_cost, bool robust,
+        std::vector<double*> poses) {
+    residuals_in_use.insert(key);
+    residual_num[std::get<0>(key)] ++;
+    if (residual_blocks.find(key) != residual_blocks.end()) {
+        return;
+    }
+    ceres::LossFunction *loss_function = nullptr;
+    if (robust && robust_loss) {
+        loss_function = new ceres::HuberLoss(1.0);
+    }
+    if (poses.empty()) {
+        poses = {std::get<4>(key), std::get<5>(key)};
+    }
+    residual_blocks[key] = problem.AddResidualBlock(create_cost(), loss_function, poses);
+    created_num ++;
+}
+
+void IncrementalResiduals::set_constant(double * pose) {
+    constant_poses_now.insert(pose);
+}
+
+std::map<ResidualKey, ceres::ResidualBlockId>::iterator IncrementalResiduals::remove_residual(ceres::Problem &problem,
+        std::map<ResidualKey, ceres::ResidualBlockId>::iterator it) {
+    std::vector<double*> poses;
+    problem.GetParameterBlocksForResidualBlock(it->second, &poses);
+    problem.RemoveResidualBlock(it->second);
+    //Poses without residuals left are removed too
+    for (double * pose : poses) {
+        std::vector<ceres::ResidualBlockId> blocks;
+        if (problem.HasParameterBlock(pose)) {
+            problem.GetResidualBlocksForParameterBlock(pose, &blocks);
+            if (blocks.empty()) {
+                problem.RemoveParameterBlock(pose);
+            }
+        }
+    }
+    return residual_blocks.erase(it);
+}
+
+int IncrementalResiduals::remove_from_kind(ceres::Problem &problem, int kind) {
+    int count = 0;
+    auto it = residual_blocks.lower_bound(ResidualKey(kind, -1, 0, 0, nullptr, nullptr));
+    while (it != residual_blocks.end()) {
+        it = remove_residual(problem, it);
+        count ++;
+    }
+    return count;
+}
+
+int IncrementalResiduals::remove_unused(ceres::Problem &problem) {
+    int count = 0;
+    auto it = residual_blocks.begin();
+    while (it != residual_blocks.end()) {
+        if (residuals_in_use.find(it->first) == residuals_in_use.end()) {
+            it = remove_residual(problem, it);
+            count ++;
+        } else {
+            it ++;
+        }
+    }
+    residuals_in_use.clear();
+
+    for (auto pose : constant_poses) {
+        if (constant_poses_now.find(pose) == constant_poses_now.end() && problem.HasParameterBlock(pose)) {
+            problem.SetParameterBlockVariable(pose);
+        }
+    }
+    for (auto pose : constant_poses_now) {
+        if (problem.HasParameterBlock(pose)) {
+            problem.SetParameterBlockConstant(pose);
+        }
+    }
+    constant_poses = constant_poses_now;
+    constant_poses_now.clear();
+    return count;
+}
+
+void IncrementalResiduals::clear() {
+    residual_blocks.clear();
+    residuals_in_use.clear();
+    constant_poses.clear();
+    constant_poses_now.clear();
+}
+
+int IncrementalResiduals::count(int kind) const {
+    auto it = residual_num.find(kind);
+    return it == residual_num.end() ? 0 : it->second;
+}
@@ -13,6 +13,7 @@
 #include <thread>
 #include <unistd.h>
 #include "swarm_localization/swarm_localization_solver.hpp"
+#include "swarm_localization/swarm_solver_worker.hpp"
 #include "swarm_msgs/swarm_fused.h"
 #include "swarm_msgs/swarm_fused_relative.h"
 #include <geometry_msgs/Point.h>
@@ -136,21 +137,27 @@ class SwarmLocalizationNode {
     }
 
 
+    //The subscribers only queue the data to the solver thread, the solver is used by that thread only
     void on_loop_connection_received(const swarm_msgs::LoopEdge & loop_conn) {
         ROS_INFO("Add new loop connection from %d to %d", loop_conn.drone_id_a, loop_conn.drone_id_b);
-        this->swarm_localization_solver->add_new_loop_connection(loop_conn);
+        solver_worker->push_measurement([this, loop_conn] {
+            this->swarm_localization_solver->add_new_loop_connection(loop_conn);
+        });
     }
 
-    double t_last = 0;
 protected:
     void on_swarm_detected(const swarm_msgs::node_detected_xyzyaw & sd) {
         // ROS_INFO("Add new detection %ld from %d->%d", sd.id, sd.self_drone_id, sd.remote_drone_id);
-        this->swarm_localization_solver->add_new_detection(sd);
+        solver_worker->push_measurement([this, sd] {
+            this->swarm_localization_solver->add_new_detection(sd);
+        });
     }
     
     void on_swarm_detected_6d(const swarm_msgs::node_detected & sd) {
         // ROS_INFO("Add new detection 4d %ld from %d->%d", sd.id, sd.self_drone_id, sd.remote_drone_id);
-        this->swarm_localization_solver->add_new_detection(sd);
+        solver_worker->push_measurement([this, sd] {
+            this->swarm_localization_solver->add_new_detection(sd);
+        });
     }
 
     void on_swarmframe_recv(const swarm_msgs::swarm_frame &_sf) {
@@ -162,9 +169,8 @@ protected:
         assert(self_id == _self_id && "self_id must be equal!");
 
         if (remote_ids_arr.empty()) {
-            //This is first time of receive data
-            this->self_id = _self_id;
-            swarm_localization_solver->self_id = self_id;
+            //This is first time of receive data. self_id is set once from the param before the solver and
+            //prediction threads start, and only read by them
             ROS_INFO("self id %d", self_id);
             add_drone_id(self_id);
         }
@@ -176,19 +182,21 @@ protected:
 
         double t_now = _sf.header.stamp.toSec();
 
-        swarm_localization_solver->add_new_swarm_frame(sf);
-        // printf("Tnow %f DT %f\n", t_now, t_now - t_last);
-        // For some bags if (t_now - t_last > 1 / force_freq && (t_now - t_last < 10 || t_last <1e-4)) {
-        if (t_now - t_last > 1 / force_freq) {// && (t_now - t_last < 10 || t_last <1e-4)) {
-            std_msgs::Float32 cost;
-            // ROS_INFO("Try to solve");
-            cost.data = this->swarm_localization_solver->solve();
-            t_last = t_now;
-            if (cost.data >= 0) {
-                solving_cost_pub.publish(cost);
-                pub_full_path();
-                publish_goodloops(_sf.header.stamp);
-            }
+        //Solved by the worker once the frame is 1/force_freq after the last solved one
+        solver_worker->push_frame([this, sf] {
+            this->swarm_localization_solver->add_new_swarm_frame(sf);
+        }, t_now);
+    }
+
+    //On the solver thread, with the stamp of the newest frame added
+    void solve_and_publish(double t_frame) {
+        std_msgs::Float32 cost;
+        // ROS_INFO("Try to solve");
+        cost.data = this->swarm_localization_solver->solve();
+        if (cost.data >= 0) {
+            solving_cost_pub.publish(cost);
+            pub_full_path();
+            publish_goodloops(ros::Time(t_frame));
         }
     }
 
@@ -279,6 +287,7 @@ private:
     std::map<int, ros::Publisher> remote_drone_odom_pubs;
     std::map<int, ros::Publisher> pathes_pubs;
     SwarmLocalizationSolver *swarm_localization_solver = nullptr;
+    SolverWorker *solver_worker = nullptr;
 
     std::vector<int> remote_ids_arr;
     std::set<int> remote_ids_set;
@@ -490,6 +499,7 @@ public:
         nh.param<bool>("enable_data_association", solver_params.enable_data_association, true);
         nh.param<bool>("debug_loop_initial_only", solver_params.debug_loop_initial_only, false);
         nh.param<bool>("debug_no_relocalization", solver_params.debug_no_relocalization, false);
+        nh.param<bool>("debug_check_prediction", solver_params.debug_check_prediction, false);
         nh.param<bool>("enable_distance", solver_params.enable_distance, true);
         nh.param<bool>("enable_detection_depth", solver_params.enable_detection_depth, true);
         nh.param<bool>("publish_full_path", publish_full_path, false);
@@ -500,6 +510,11 @@ public:
         nh.param<bool>("debug_publish_goodloops", debug_publish_goodloops, false);
         nh.param<std::string>("cgraph_path", solver_params.cgraph_path, "/home/xuhao/cgraph.dot");
         nh.param<float>("max_solver_time", solver_params.max_solver_time, 0.05f);
+        nh.param<bool>("incremental_solve", solver_params.incremental_solve, true);
+        nh.param<bool>("enable_marginalization", solver_params.enable_marginalization, true);
+        nh.param<int>("init_trial_num", solver_params.init_trial_num, 3);
+        nh.param<int>("init_thread_num", solver_params.init_thread_num, 3);
+        nh.param<float>("init_cancel_cost", solver_params.init_cancel_cost, solver_params.acpt_cost);
         nh.param<float>("distance_measurement_outlier_threshold", solver_params.distance_measurement_outlier_threshold, 0.3f);
         nh.param<float>("distance_measurement_outlier_elevation_threshold", solver_params.distance_measurement_outlier_elevation_threshold, 0.5f);
 
@@ -512,6 +527,7 @@ public:
         nh.param<float>("DETECTION_SPHERE_STD", DETECTION_SPHERE_STD, 0.1f);
         nh.param<float>("DETECTION_INV_DEP_STD", DETECTION_INV_DEP_STD, 0.5f);
         nh.param<float>("DETECTION_DEP_STD", DETECTION_DEP_STD, 0.5f);
+        nh.param<bool>("analytic_jacobian", ANALYTIC_JACOBIAN, true);
         nh.param<double>("cg/x", CG.x(), 0);
         nh.param<double>("cg/y", CG.y(), 0);
         nh.param<double>("cg/z", CG.z(), 0);
@@ -520,6 +536,9 @@ public:
 
         load_nodes_from_file(swarm_node_config);
         swarm_localization_solver = new SwarmLocalizationSolver(solver_params);
+        solver_worker = new SolverWorker(1 / force_freq, [&](double t_frame) {
+            solve_and_publish(t_frame);
+        });
         fused_drone_data_pub = nh.advertise<swarm_msgs::swarm_fused>("/swarm_drones/swarm_drone_fused", 10);
         fused_drone_basecoor_pub = nh.advertise<swarm_msgs::swarm_drone_basecoor>("/swarm_drones/swarm_drone_basecoor", 10);
         fused_drone_rel_data_pub = nh.advertise<swarm_msgs::swarm_fused_relative>(
@@ -546,6 +565,11 @@ public:
         ROS_INFO("Max Keyframe %d. Generate CGraph %d path %s\n", solver_params.max_frame_number, solver_params.enable_cgraph_generation, solver_params.cgraph_path.c_str());
 
     }
+
+    ~SwarmLocalizationNode() {
+        //Stop the solver thread before the solver it uses
+        delete solver_worker;
+    }
 };
 
 
@@ -51,8 +51,6 @@ using namespace Swarm;
 #define RAND_INIT_XY 5
 #define RAND_INIT_Z 1
 
-#define INIT_TRIAL 3
-
 #define BEGIN_MIN_LOOP_DT 1000.0
 
 //For testing loop closure for single drone, use 1
@@ -70,6 +68,7 @@ float DETECTION_SPHERE_STD;
 float DETECTION_INV_DEP_STD;
 float DETECTION_DEP_STD;
 Eigen::Vector3d CG;
+bool ANALYTIC_JACOBIAN = true;
 
 SwarmLocalizationSolver::SwarmLocalizationSolver(const swarm_localization_solver_params & _params) :
             params(_params), max_frame_number(_params.max_frame_number), min_frame_number(_params.min_frame_number),
@@ -94,8 +93,10 @@ SwarmLocalizationSolver::SwarmLocalizationSolver(const swarm_localization_solver
             params.det_dpos_thres = 1e8;
             params.loop_outlier_distance_threshold = 1e8;
         }
+        residuals.robust_loss = !_params.debug_no_rejection;
 
         outlier_rejection = new SwarmLocalOutlierRejection(_params.self_id, params.outlier_rejection_params, ego_motion_trajs);
+        predict_state = std::make_shared<PredictState>();
 
         ROS_INFO("[SWARM_LOCAL] Init solver with self_id %d", _params.self_id);
     }
@@ -174,6 +175,14 @@ void SwarmLocalizationSolver::delete_frame_i(int i) {
     sf_sld_win.erase(sf_sld_win.begin() + i);
 }
 
+void SwarmLocalizationSolver::reset_init() {
+    finish_init = false;
+    if (priors.size() > 0) {
+        ROS_INFO("[SWARM_LOCAL] Init reset, clear %ld priors", priors.size());
+        priors.clear();
+    }
+}
+
 bool SwarmLocalizationSolver::is_frame_useful(unsigned int i) const {
     for (unsigned int id : sf_sld_win.at(i).node_id_list) {
         if (node_kf_count.at(id) < min_frame_number) {
@@ -190,17 +199,124 @@ void SwarmLocalizationSolver::process_frame_clear() {
     if (params.enable_random_keyframe_deletetion) {
         while (sf_sld_win.size() > max_frame_number) {
             _index = rand()%(max_frame_number-1);
+            if (params.enable_marginalization && finish_init) {
+                marginalize_frame(_index);
+            }
             delete_frame_i(_index);
             ROS_INFO("[SWARM_LOCAL] Clear random frame %d from sld win, now size %ld", _index, sf_sld_win.size());
         }
     } else {
         while (sf_sld_win.size() > max_frame_number) {
+            if (params.enable_marginalization && finish_init) {
+                marginalize_frame(_index);
+            }
             delete_frame_i(_index);
             ROS_INFO("[SWARM_LOCAL] Clear first frame from sld win, now size %ld", sf_sld_win.size());
         }
     }
 }
 
+//Marginalize the poses of the frame into a prior on the poses left. The distances of the frame are carried
+//by the ego-motion to the nearest frame of each drone, the one before or after it for the first frame.
+void SwarmLocalizationSolver::marginalize_frame(int i) {
+    const SwarmFrame & sf = sf_sld_win[i];
+    TsType ts = sf.ts;
+    Problem problem;
+    std::vector<double*> drop_poses;
+    std::map<int, double*> frame_poses;
+    for (auto & it : sf.id2nodeframe) {
+        int _id = it.first;
+        if (est_poses_idts.find(_id) == est_poses_idts.end() || est_poses_idts.at(_id).find(ts) == est_poses_idts.at(_id).end() ||
+            !enable_to_init_by_drone.at(_id)) {
+            continue;
+        }
+        auto & poses = est_poses_idts.at(_id);
+        double * pose = poses.at(ts);
+        frame_poses[_id] = pose;
+
+        int j_near = -1;
+        bool shared = false;
+        for (int j = 0; j < sf_sld_win.size(); j ++) {
+            if (j == i || poses.find(sf_sld_win[j].ts) == poses.end()) {
+                continue;
+            }
+            if (poses.at(sf_sld_win[j].ts) == pose) {
+                //Not moving or static, the pose stays in the window
+                shared = true;
+                break;
+            }
+            if (j < i || j_near < 0) {
+                j_near = j;
+            }
+        }
+        if (shared) {
+            continue;
+        }
+
+        drop_poses.push_back(pose);
+        if (j_near >= 0 && ego_motion_trajs.find(_id) != ego_motion_trajs.end()) {
+            TsType ts_near = sf_sld_win[j_near].ts;
+            double * pose_near = poses.at(ts_near);
+            if (j_near < i) {
+                auto odom = ego_motion_trajs.at(_id).get_relative_pose_by_ts(ts_near, ts, true);
+                problem.AddResidualBlock(RelativePoseFactor4d::CreateCov6d(odom.first, odom.second), nullptr, pose_near, pose);
+            } else {
+                auto odom = ego_motion_trajs.at(_id).get_relative_pose_by_ts(ts, ts_near, true);
+                problem.AddResidualBlock(RelativePoseFactor4d::CreateCov6d(odom.first, odom.second), nullptr, pose, pose_near);
+            }
+        }
+    }
+
+    int informative = 0;
+    for (auto & it : sf.id2nodeframe) {
+        const NodeFrame & _nf = it.second;
+        int _ida = it.first;
+        if (frame_poses.find(_ida) == frame_poses.end() || !(enable_distance && _nf.frame_available && _nf.dists_available)) {
+            continue;
+        }
+        for (auto it_dis : _nf.dis_map) {
+            int _idb = it_dis.first;
+            if (_idb < _ida && frame_poses.find(_idb) != frame_poses.end() && 
+                sf.node_id_list.find(_idb) != sf.node_id_list.end() && _nf.distance_available(_idb)) {
+                ceres::LossFunction *loss_function = nullptr;
+                if (!params.debug_no_rejection) {
+                    loss_function = new ceres::HuberLoss(1.0);
+                }
+                auto cost = DistanceMeasurementFactor::Create(it_dis.second, 1/sqrt(params.distance_measurement_cov));
+                problem.AddResidualBlock(cost, loss_function, frame_poses[_ida], frame_poses[_idb]);
+                informative ++;
+            }
+        }
+    }
+
+    //Priors on the dropped poses are merged into the new one
+    for (auto it = priors.begin(); it != priors.end(); ) {
+        bool touched = false;
+        for (auto pose : drop_poses) {
+            touched = touched || it->second->has_pose(pose);
+        }
+        if (touched) {
+            problem.AddResidualBlock(new MarginalizationFactor(it->second), nullptr, it->second->kept_poses);
+            informative ++;
+            it = priors.erase(it);
+        } else {
+            it ++;
+        }
+    }
+
+    if (informative == 0 || drop_poses.empty()) {
+        return;
+    }
+
+    TicToc tic;
+    auto info = std::make_shared<MarginalizationInfo>();
+    if (info->marginalize(problem, drop_poses)) {
+        priors[prior_count ++] = info;
+        ROS_INFO("[SWARM_LOCAL] Marginalize frame %d to prior on %ld poses rank %ld in %.1fms, %ld priors", TSShort(ts),
+            info->kept_poses.size(), info->linearized_residuals.size(), tic.toc(), priors.size());
+    }
+}
+
 void SwarmLocalizationSolver::random_init_pose(EstimatePoses &swarm_est_poses, std::set<int> ids_to_init) {
     for (auto it : swarm_est_poses) {
         for (auto it2 : it.second) {
@@ -219,9 +335,11 @@ void SwarmLocalizationSolver::init_pose_by_loops(EstimatePoses &swarm_est_poses,
     for (auto _id: ids_to_init) {
         ROS_INFO("Try to init %d with loops", _id);
         auto loop_sets =  outlier_rejection->all_loops_set_by_pair[_id];
+        outlier_rejection->lcm_mutex.lock();
         if (outlier_rejection->good_loops_set.find(_id) != outlier_rejection->good_loops_set.end()) {
             loop_sets = outlier_rejection->good_loops_set.at(_id);
         }
+        outlier_rejection->lcm_mutex.unlock();
         for (auto it : loop_sets) {
             auto id2 = it.first;
             if (it.second.size() == 0 || estimated_nodes.find(id2) == estimated_nodes.end()) {
@@ -589,6 +707,10 @@ void SwarmLocalizationSolver::add_new_loop_connection(const swarm_msgs::LoopEdge
 
 
 void SwarmLocalizationSolver::replace_last_kf(const SwarmFrame &sf) {
+    //Priors may hold the poses of the replaced frame, carry them and its distances to the previous frame
+    if (params.enable_marginalization && finish_init) {
+        marginalize_frame(sf_sld_win.size()-1);
+    }
     delete_frame_i(sf_sld_win.size()-1);
     sf_sld_win.push_back(sf);
     all_sf[sf.ts] = sf;
@@ -607,6 +729,9 @@ void SwarmLocalizationSolver::replace_last_kf(const SwarmFrame &sf) {
 
 
 void SwarmLocalizationSolver::add_new_swarm_frame(const SwarmFrame &sf) {
+    if (t_first_frame.isZero()) {
+        t_first_frame = ros::WallTime::now();
+    }
     process_frame_clear();
 
     auto _ids = sf.node_id_list;
@@ -640,7 +765,9 @@ void SwarmLocalizationSolver::add_new_swarm_frame(const SwarmFrame &sf) {
         enable_to_init_by_drone[self_id] = true;
 
         if (all_nodes.size() > num) {
-            finish_init = false;
+            reset_init();
+            //Stop the prediction until the new drone is initialized
+            publish_predict_state();
         }
 
         add_as_keyframe(sf);
@@ -670,64 +797,45 @@ void SwarmLocalizationSolver::add_new_swarm_frame(const SwarmFrame &sf) {
 }
 
 
-bool SwarmLocalizationSolver::PredictNode(const NodeFrame & nf, Pose & _pose, Eigen::Matrix4d & cov) const {
-    std::pair<Pose, Eigen::Matrix4d> ret; 
+bool SwarmLocalizationSolver::PredictNode(const PredictState & state, const NodeFrame & nf, Pose & _pose, Eigen::Matrix4d & cov) const {
     int _id = nf.drone_id;
-    if (last_saved_est_kf_ts.size() > 0 && finish_init && 
-            enable_to_init_by_drone.find(_id) != enable_to_init_by_drone.end() &&
-            enable_to_init_by_drone.at(_id)) {
-        for (auto it = last_saved_est_kf_ts.rbegin(); it != last_saved_est_kf_ts.rend(); ++it ) { 
-            TsType _ts = *it;
-            if(est_poses_tsid_saved.at(_ts).find(_id)!=est_poses_tsid_saved.at(_ts).end() ) {
-
-                //Use last solve relative res, e.g init with last
-                int _id = nf.drone_id;
-                Pose est_last_4d = Pose(est_poses_tsid_saved.at(_ts).at(_id), true);
-                Pose last_vo_4d = all_sf.at(_ts).id2nodeframe.at(_id).pose();
-                last_vo_4d.set_yaw_only();
-                Pose now_vo_6d = nf.pose();
-
-                // _pose = Predict_By_VO(now_vo_6d, last_vo_6d, est_last_4d, true);
-                _pose = est_last_4d * Pose::DeltaPose(last_vo_4d, now_vo_6d, false);
-                cov = Eigen::Matrix4d::Zero();
-                return true;
-            }
-        }
+    if (state.finish_init && state.enable_to_init.find(_id) != state.enable_to_init.end() &&
+            state.est_and_vo.find(_id) != state.est_and_vo.end()) {
+        //Use last solve relative res, e.g init with last
+        Pose est_last_4d = state.est_and_vo.at(_id).first;
+        Pose last_vo_4d = state.est_and_vo.at(_id).second;
+        Pose now_vo_6d = nf.pose();
+
+        // _pose = Predict_By_VO(now_vo_6d, last_vo_6d, est_last_4d, true);
+        _pose = est_last_4d * Pose::DeltaPose(last_vo_4d, now_vo_6d, false);
+        cov = Eigen::Matrix4d::Zero();
+        return true;
     }
     return false;
 }
 
 
-bool SwarmLocalizationSolver::NodeCooridnateOffset(int _id, Pose & _pose, Eigen::Matrix4d & cov) const {
-    bool find_node = false;
-    if (last_saved_est_kf_ts.size() > 0 && finish_init) {
-        for (auto it = last_saved_est_kf_ts.rbegin(); it != last_saved_est_kf_ts.rend(); ++it ) { 
-            TsType _ts = *it;
-            if(est_poses_tsid_saved.at(_ts).find(_id)!=est_poses_tsid_saved.at(_ts).end() ) {
-                find_node = true;
-                Pose PBA = Pose(est_poses_tsid_saved.at(_ts).at(_id), true);
-
-                Pose PBB = all_sf.at(_ts).id2nodeframe.at(_id).pose();
-                
-                PBA.set_yaw_only();
-                PBB.set_yaw_only();
-                
-                _pose = Pose(PBA.to_isometry() * PBB.to_isometry().inverse());
-                
+bool SwarmLocalizationSolver::NodeCooridnateOffset(const PredictState & state, int _id, Pose & _pose, Eigen::Matrix4d & cov) const {
+    if (state.finish_init && state.est_and_vo.find(_id) != state.est_and_vo.end()) {
+        Pose PBA = state.est_and_vo.at(_id).first;
+        Pose PBB = state.est_and_vo.at(_id).second;
+        
+        PBA.set_yaw_only();
+        
+        _pose = Pose(PBA.to_isometry() * PBB.to_isometry().inverse());
+        
 #ifdef COMPUTE_COV
-                if (_id != self_id){
-                    auto cov = est_cov_tsid.at(last_saved_est_kf_ts).at(_id);
-                    cov.block<3,3>(0,0) = PBA.to_isometry().rotation()*cov.block<3,3>(0,0);
-                    ret.second = cov;
-                } else {
-                    ret.second = Eigen::Matrix4d::Zero();
-                }
+        if (_id != self_id){
+            auto cov = est_cov_tsid.at(last_saved_est_kf_ts).at(_id);
+            cov.block<3,3>(0,0) = PBA.to_isometry().rotation()*cov.block<3,3>(0,0);
+            ret.second = cov;
+        } else {
+            ret.second = Eigen::Matrix4d::Zero();
+        }
 #else
-                cov = Eigen::Matrix4d::Zero();
+        cov = Eigen::Matrix4d::Zero();
 #endif
-                return true;
-            }
-        }
+        return true;
     }
     return false;
 }
@@ -735,7 +843,8 @@ bool SwarmLocalizationSolver::NodeCooridnateOffset(int _id, Pose & _pose, Eigen:
 
 SwarmFrameState SwarmLocalizationSolver::PredictSwarm(const SwarmFrame &sf) const {
     SwarmFrameState sfs;
-    if(!finish_init) {
+    auto state = get_predict_state();
+    if(!state->finish_init) {
         ROS_WARN("[SWARM_LOCAL] Predict swarm poses failed: SwarmLocalizationSolver not inited\n");
         return sfs;
     }
@@ -746,14 +855,14 @@ SwarmFrameState SwarmLocalizationSolver::PredictSwarm(const SwarmFrame &sf) cons
         NodeFrame & nf = it.second;
         Pose pose, pose1;
         Eigen::Matrix4d cov, cov1;
-        auto ret = this->PredictNode(nf, pose, cov);
+        auto ret = this->PredictNode(*state, nf, pose, cov);
         if (ret) {
             sfs.node_poses[_id] = pose;
             sfs.node_covs[_id] = cov;
         }
         //Give node velocity predict here
         sfs.node_vels[_id] = Eigen::Vector3d(0, 0, 0);
-        ret = this->NodeCooridnateOffset(nf.drone_id, pose1, cov1);
+        ret = this->NodeCooridnateOffset(*state, nf.drone_id, pose1, cov1);
         if (ret) {
             sfs.base_coor_poses[_id] = pose1;
             sfs.base_coor_covs[_id] = cov1;
@@ -764,6 +873,91 @@ SwarmFrameState SwarmLocalizationSolver::PredictSwarm(const SwarmFrame &sf) cons
     return sfs;
 }
 
+//Called by the solver thread only, the prediction swaps to the new state at once
+void SwarmLocalizationSolver::publish_predict_state() {
+    auto state = std::make_shared<PredictState>();
+    state->finish_init = finish_init;
+    for (auto it : enable_to_init_by_drone) {
+        if (it.second) {
+            state->enable_to_init.insert(it.first);
+        }
+    }
+
+    if (finish_init) {
+        //Newest saved keyframe of each drone
+        for (auto it = last_saved_est_kf_ts.rbegin(); it != last_saved_est_kf_ts.rend() && 
+                state->est_and_vo.size() < all_nodes.size(); ++it ) { 
+            TsType _ts = *it;
+            for (auto it2 : est_poses_tsid_saved.at(_ts)) {
+                int _id = it2.first;
+                if (state->est_and_vo.find(_id) == state->est_and_vo.end()) {
+                    Pose est = Pose(it2.second, true);
+                    Pose vo = all_sf.at(_ts).id2nodeframe.at(_id).pose();
+                    vo.set_yaw_only();
+                    state->est_and_vo[_id] = std::make_pair(est, vo);
+                }
+            }
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(predict_lock);
+        predict_state = state;
+    }
+
+    if (params.debug_check_prediction && finish_init && sf_sld_win.size() > 0 && !check_predict_state(sf_sld_win.back())) {
+        ROS_ERROR("[SWARM_LOCAL] Prediction of the published state differs from the saved estimates at TS %d",
+            TSShort(sf_sld_win.back().ts));
+    }
+}
+
+bool SwarmLocalizationSolver::predict_by_saved_est(const NodeFrame & nf, Pose & _pose, Pose & base_coor) const {
+    int _id = nf.drone_id;
+    for (auto it = last_saved_est_kf_ts.rbegin(); it != last_saved_est_kf_ts.rend(); ++it ) { 
+        TsType _ts = *it;
+        if (est_poses_tsid_saved.at(_ts).find(_id) != est_poses_tsid_saved.at(_ts).end()) {
+            Pose est_last_4d = Pose(est_poses_tsid_saved.at(_ts).at(_id), true);
+            Pose last_vo_4d = all_sf.at(_ts).id2nodeframe.at(_id).pose();
+            last_vo_4d.set_yaw_only();
+            _pose = est_last_4d * Pose::DeltaPose(last_vo_4d, nf.pose(), false);
+
+            Pose PBA = est_last_4d;
+            PBA.set_yaw_only();
+            base_coor = Pose(PBA.to_isometry() * last_vo_4d.to_isometry().inverse());
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SwarmLocalizationSolver::check_predict_state(const SwarmFrame & sf) const {
+    auto sfs = PredictSwarm(sf);
+    bool ok = true;
+    for (auto & it : sf.id2nodeframe) {
+        int _id = it.first;
+        Pose pose, base_coor;
+        bool saved = finish_init && predict_by_saved_est(it.second, pose, base_coor);
+        bool by_node = saved && enable_to_init_by_drone.find(_id) != enable_to_init_by_drone.end() && enable_to_init_by_drone.at(_id);
+        bool has_pose = sfs.node_poses.find(_id) != sfs.node_poses.end();
+        bool has_base = sfs.base_coor_poses.find(_id) != sfs.base_coor_poses.end();
+        if (has_pose != by_node || has_base != saved) {
+            ROS_WARN("[SWARM_LOCAL] Drone %d predicted %d/%d by the state, %d/%d by the saved estimates", _id,
+                has_pose, has_base, by_node, saved);
+            ok = false;
+            continue;
+        }
+        if (by_node) {
+            Pose dpose = Pose::DeltaPose(pose, sfs.node_poses.at(_id), false);
+            ok = ok && dpose.pos().norm() < 1e-6 && dpose.att().angularDistance(Eigen::Quaterniond::Identity()) < 1e-6;
+        }
+        if (saved) {
+            Pose dpose = Pose::DeltaPose(base_coor, sfs.base_coor_poses.at(_id), false);
+            ok = ok && dpose.pos().norm() < 1e-6 && dpose.att().angularDistance(Eigen::Quaterniond::Identity()) < 1e-6;
+        }
+    }
+    return ok;
+}
+
 
 std::pair<bool, Swarm::Pose> SwarmLocalizationSolver::get_estimated_pose(int _id, TsType ts) const {
     if (est_poses_idts.find(_id) == est_poses_idts.end()) {
@@ -778,69 +972,142 @@ std::pair<bool, Swarm::Pose> SwarmLocalizationSolver::get_estimated_pose(int _id
 }
 
 
+//Copy of the poses for an init trial, with the poses shared by frames kept shared
+void copy_est_poses(const EstimatePoses & src, EstimatePoses & est_poses_tsid, EstimatePosesIDTS & est_poses_idts) {
+    std::map<double*, double*> copied;
+    for (auto it : src) {
+        auto ts = it.first;
+        for (auto it2 : it.second) {
+            auto _id = it2.first;
+            if (copied.find(it2.second) == copied.end()) {
+                copied[it2.second] = new double[4];
+                memcpy(copied[it2.second], it2.second, 4*sizeof(double));
+            }
+            est_poses_tsid[ts][_id] = copied[it2.second];
+            est_poses_idts[_id][ts] = copied[it2.second];
+        }
+    }
+}
+
+void delete_est_poses(EstimatePoses & est_poses_tsid) {
+    std::set<double*> poses;
+    for (auto it : est_poses_tsid) {
+        for (auto it2 : it.second) {
+            poses.insert(it2.second);
+        }
+    }
+    for (auto p : poses) {
+        delete [] p;
+    }
+    est_poses_tsid.clear();
+}
+
+struct InitTrial {
+    EstimatePoses est_poses_tsid;
+    EstimatePosesIDTS est_poses_idts;
+    Problem * problem = nullptr;
+    int num_res_blks = 0;
+    double cost = -1;
+    double solve_time = 0;
+};
+
 bool SwarmLocalizationSolver::solve_with_multiple_init(int max_number, std::set<int> new_init_ids) {
 
     double cost = acpt_cost;
     bool cost_updated = false;
+    TicToc tic_init;
     
     if (!system_is_initied_by_motion) {
         max_number = 1;
     }
 
     ROS_INFO("[SWARM_LOCAL] Try to use %d random init to solve expect cost %f", max_number, cost);
-    //Need to rewrite here to enable multiple trial of input!!!
-    EstimatePoses _est_poses_best;// = est_poses_tsid;
-    EstimatePoses & _est_poses = est_poses_tsid;
-    EstimatePosesIDTS & _est_poses_idts = est_poses_idts;
-    
+
+    //Each trial has its own poses and problem, set up here one by one as the setup uses the solver.
+    //The persistent problem is rebuilt on the chosen poses by the next solve.
+    std::vector<InitTrial> trials(max_number);
     for (int i = 0; i < max_number; i++) {
         printf("[SWARM_LOCAL] %d time of init trial IDs: ", i);
         for (auto id: new_init_ids){
             printf("%d ", id);
         }
         printf("\n");
+        auto & trial = trials[i];
+        copy_est_poses(est_poses_tsid, trial.est_poses_tsid, trial.est_poses_idts);
         if (system_is_initied_by_motion) {
-            random_init_pose(_est_poses, new_init_ids);
+            random_init_pose(trial.est_poses_tsid, new_init_ids);
         } else {
-            init_pose_by_loops(_est_poses, new_init_ids);
+            init_pose_by_loops(trial.est_poses_tsid, new_init_ids);
+        }
+        trial.problem = &reset_problem();
+        persistent_problem = nullptr;
+        trial.num_res_blks = setup_problem(trial.est_poses_tsid, trial.est_poses_idts, *trial.problem);
+    }
+    residuals.clear();
+    double t_setup = tic_init.toc();
+
+    //The trials are solved on the workers, the first one below init_cancel_cost stops the others
+    std::atomic<bool> cancel(false);
+    std::atomic<int> next_trial(0);
+    //The workers share the Ceres threads
+    int worker_num = std::max(1, std::min(params.init_thread_num, max_number));
+    int trial_threads = std::max(1, (int) thread_num / worker_num);
+    auto solve_trials = [&]() {
+        int i;
+        while (!cancel && (i = next_trial ++) < max_number) {
+            TicToc tic;
+            Solver::Summary summary;
+            trials[i].cost = solve_problem(*trials[i].problem, trials[i].num_res_blks, summary, &cancel, trial_threads);
+            trials[i].solve_time = tic.toc();
+            if (trials[i].cost >= 0 && trials[i].cost < params.init_cancel_cost) {
+                cancel = true;
+            }
         }
+    };
 
-        double c = solve_once(_est_poses,  _est_poses_idts,  true);
+    std::vector<std::thread> workers;
+    for (int worker_id = 1; worker_id < worker_num; worker_id ++) {
+        workers.emplace_back(solve_trials);
+    }
+    solve_trials();
+    for (auto & worker : workers) {
+        worker.join();
+    }
 
-        if (c < cost) {
-            ROS_INFO("[SWARM_LOCAL] Got better cost %f", c);
-            cost_updated = true;
-            cost_now = cost = c;
-            // return true;
-            for (auto it : est_poses_tsid) {
-                auto ts = it.first;
-                if (_est_poses_best.find(ts) != _est_poses_best.end()) {
-                    for (auto it2: _est_poses_best[ts]) {
-                        delete [] (_est_poses_best[ts][it2.first]);
-                    }
-                }
-                _est_poses_best[ts] = std::map<int, double*>();
-                for (auto it2: it.second) {
-                    auto _id = it2.first;
-                    double * _p = new double[4];
-                    _est_poses_best[ts][_id] = _p;
-                    memcpy(_p, _est_poses[ts][_id], 4*sizeof(double));
-                }
+    int best = -1;
+    int cancelled = 0;
+    for (int i = 0; i < max_number; i++) {
+        if (trials[i].cost < 0) {
+            cancelled ++;
+        } else {
+            ROS_INFO("[SWARM_LOCAL] Init trial %d cost %f in %.1fms", i, trials[i].cost, trials[i].solve_time);
+            if (trials[i].cost < cost) {
+                best = i;
+                cost = trials[i].cost;
             }
         }
     }
 
-    if (cost_updated) {
+    if (best >= 0) {
+        ROS_INFO("[SWARM_LOCAL] Got better cost %f", cost);
+        cost_updated = true;
+        cost_now = cost;
         for (auto it : est_poses_tsid) {
             auto ts = it.first;
             for (auto it2: it.second) {
                 auto _id = it2.first;
-                memcpy(_est_poses[ts][_id], _est_poses_best[ts][_id], 4*sizeof(double));
-                delete [] (_est_poses_best[ts][_id]);
+                memcpy(it2.second, trials[best].est_poses_tsid[ts][_id], 4*sizeof(double));
             }
         }
     }
 
+    for (auto & trial : trials) {
+        delete trial.problem;
+        delete_est_poses(trial.est_poses_tsid);
+    }
+
+    ROS_INFO("[SWARM_LOCAL] Init %d trials on %d threads of %d Ceres threads in %.1fms, setup %.1fms, %d cancelled, success %d",
+        max_number, worker_num, trial_threads, tic_init.toc(), t_setup, cancelled, cost_updated);
     return cost_updated;
 }
 
@@ -922,17 +1189,21 @@ double SwarmLocalizationSolver::solve() {
             is_init_solve = true;
             //generate_cgraph();
             ROS_INFO("[SWARM_LOCAL] Not init before, try to init");
-            finish_init = solve_with_multiple_init(INIT_TRIAL, ids_to_init);
+            finish_init = solve_with_multiple_init(params.init_trial_num, ids_to_init);
             if (finish_init) {
                 if (enable_cgraph_generation) {
                     generate_cgraph();
                 }
                 last_drone_num = drone_num;
                 ROS_INFO("Finish init\n");
+                if (first_init) {
+                    ROS_INFO("[SWARM_LOCAL] First estimate %.2fs after the first frame", (ros::WallTime::now() - t_first_frame).toSec());
+                }
                 first_init = false;
             }
         } else {
             // ROS_WARN("[SWARM_LOCAL] BONDING BOX too small; Pending more movement");
+            publish_predict_state();
             return -1;
         }
        
@@ -945,7 +1216,7 @@ double SwarmLocalizationSolver::solve() {
     }
 
     if (cost_now > acpt_cost) {
-        finish_init = false;
+        reset_init();
     }
 
     if (finish_init) {
@@ -955,6 +1226,7 @@ double SwarmLocalizationSolver::solve() {
         count_solve_time += 1;
         ROS_INFO("[SWARM_LOCAL] Solve avg %3.1fms cur %3.1fms obs %.1fms", sum_solve_time/count_solve_time, tt.toc(), t_obs);
     }
+    publish_predict_state();
     printf("\n\n");
     return cost_now;
 }
@@ -1061,8 +1333,12 @@ unsigned int SwarmLocalizationSolver::sliding_window_size() const {
 }
     
     
-void SwarmLocalizationSolver::setup_problem_with_loops_and_detections(const EstimatePosesIDTS & est_poses_idts, Problem &problem) const {
-    for (auto loc : good_2drone_measurements) {
+void SwarmLocalizationSolver::setup_problem_with_loops_and_detections(const EstimatePosesIDTS & est_poses_idts, Problem &problem) {
+    //Loops and detections are selected again by the outlier rejection each solve, so they are always rebuilt
+    residuals.remove_from_kind(problem, RES_LOOP);
+
+    for (unsigned int i = 0; i < good_2drone_measurements.size(); i ++) {
+        auto loc = good_2drone_measurements[i];
         if (yaw_observability.find(loc->id_a) == yaw_observability.end() || yaw_observability.find(loc->id_b) == yaw_observability.end()  || !yaw_observability.at(loc->id_a) || !yaw_observability.at(loc->id_b)) {
             continue;
         }
@@ -1074,24 +1350,18 @@ void SwarmLocalizationSolver::setup_problem_with_loops_and_detections(const Esti
         if (loc->measurement_type == Swarm::GeneralMeasurement2Drones::Loop ||
             loc->measurement_type == Swarm::GeneralMeasurement2Drones::Detection4d ||
             loc->measurement_type == Swarm::GeneralMeasurement2Drones::Detection6d) {
-            CostFunction * cost = RelativePoseFactor4d::Create(loc);;
-            ceres::LossFunction *loss_function = nullptr;
-            if (!params.debug_no_rejection) {
-                loss_function = new ceres::HuberLoss(1.0);
-            }
-            problem.AddResidualBlock(cost, loss_function, posea, poseb);
+            residuals.add_residual(problem, ResidualKey(RES_LOOP, i, loc->ts_a, loc->ts_b, posea, poseb), [loc]() {
+                return RelativePoseFactor4d::Create(loc);
+            }, true);
 
             #ifdef DEBUG_OUTPUT_ALL_RES
                 ROS_INFO("LoopResidual %d@%d->%d@%d %p->%p pose %s", loc->id_a, TSShort(loc->ts_a), loc->id_b, TSShort(loc->ts_b), posea, poseb, 
                     static_cast<const Swarm::LoopEdge*>(loc)->relative_pose.tostr().c_str());
             #endif
         } else {
-            CostFunction * cost = DroneDetection4dFactor::Create(loc);;
-            ceres::LossFunction *loss_function = nullptr;
-            if (!params.debug_no_rejection) {
-                loss_function = new ceres::HuberLoss(1.0);
-            }
-            problem.AddResidualBlock(cost, loss_function, posea, poseb);
+            residuals.add_residual(problem, ResidualKey(RES_LOOP, i, loc->ts_a, loc->ts_b, posea, poseb), [loc]() {
+                return DroneDetection4dFactor::Create(loc);
+            }, true);
             #ifdef DEBUG_OUTPUT_ALL_RES
                 ROS_INFO("DetResidual: %d@%d->%d@%d %p->%p", loc->id_a, TSShort(loc->ts_a), loc->id_b, TSShort(loc->ts_b), posea, poseb);
             #endif
@@ -1099,7 +1369,31 @@ void SwarmLocalizationSolver::setup_problem_with_loops_and_detections(const Esti
     }
 }
     
+void SwarmLocalizationSolver::setup_problem_with_priors(Problem &problem) {
+    std::set<double*> window_poses;
+    for (auto & sf : sf_sld_win) {
+        for (auto & it : est_poses_idts) {
+            auto it_ts = it.second.find(sf.ts);
+            if (it_ts != it.second.end()) {
+                window_poses.insert(it_ts->second);
+            }
+        }
+    }
+    int stale = remove_stale_priors(priors, window_poses);
+    if (stale > 0) {
+        ROS_WARN("[SWARM_LOCAL] Removed %d priors on poses out of the sliding window", stale);
+    }
+
+    for (auto & it : priors) {
+        auto info = it.second;
+        residuals.add_residual(problem, ResidualKey(RES_PRIOR, it.first, 0, 0, nullptr, nullptr), [info]() {
+            return new MarginalizationFactor(info);
+        }, false, info->kept_poses);
+    }
+}
+
 void SwarmLocalizationSolver::setup_problem_with_sferror(const EstimatePoses & swarm_est_poses, 
+    const EstimatePosesIDTS & est_poses_idts,
     Problem& problem, 
     const SwarmFrame& sf, 
     TSIDArray& param_indexs, 
@@ -1132,16 +1426,13 @@ void SwarmLocalizationSolver::setup_problem_with_sferror(const EstimatePoses & s
                     // ROS_INFO("TS %d ID %d<->%d idb not found", TSShort(_nf.ts), _ida, _idb);
                     continue;
                 }
-                double * poseb = est_poses_idts.at(_ida).at(ts);
                 if ( _idb < _ida && sf.node_id_list.find(_idb) != sf.node_id_list.end() && _nf.distance_available(_idb)) {
                     //Now we setup factor from ida to idb
-                    ceres::LossFunction *loss_function = nullptr;
-                    if (!params.debug_no_rejection) {
-                        loss_function = new ceres::HuberLoss(1.0);
-                    }
-                    auto cost = DistanceMeasurementFactor::Create(distance_measurement, 1/sqrt(params.distance_measurement_cov));
                     double * poseb = est_poses_idts.at(_idb).at(ts);
-                    problem.AddResidualBlock(cost, loss_function, posea, poseb);
+                    double sqrt_inf = 1/sqrt(params.distance_measurement_cov);
+                    residuals.add_residual(problem, ResidualKey(RES_DISTANCE, 0, ts, ts, posea, poseb), [distance_measurement, sqrt_inf]() {
+                        return DistanceMeasurementFactor::Create(distance_measurement, sqrt_inf);
+                    }, true);
                     #ifdef DEBUG_OUTPUT_ALL_RES
                         ROS_INFO("DistanceMeasurementFactor@TS%d %p->%p distance %f", TSShort(_nf.ts), posea, poseb, distance_measurement);
                     #endif
@@ -1153,7 +1444,7 @@ void SwarmLocalizationSolver::setup_problem_with_sferror(const EstimatePoses & s
     }
 }
 
-void SwarmLocalizationSolver::setup_problem_with_ego_motion(const EstimatePosesIDTS & est_poses_idts, Problem& problem, int drone_id) const {
+void SwarmLocalizationSolver::setup_problem_with_ego_motion(const EstimatePosesIDTS & est_poses_idts, Problem& problem, int drone_id) {
     auto nfs = est_poses_idts.at(drone_id);
 
     std::vector<double*> poses_all_ego;
@@ -1168,23 +1459,25 @@ void SwarmLocalizationSolver::setup_problem_with_ego_motion(const EstimatePosesI
                 poses_all_ego.push_back(nfs[ts]);
             } else {
                 if (ts_last != ts) {
-                    auto odom = ego_motion_trajs.at(drone_id).get_relative_pose_by_ts(ts_last, ts, true);
                     double * pose_ptr_1 = nfs[ts_last];
                     double * pose_ptr_2 = nfs[ts];
                     poses_all_ego.push_back(nfs[ts]);
 
                     if (pose_ptr_1 != pose_ptr_2 &&
                             !(drone_id == self_id && params.debug_no_relocalization)) {
-                        auto cf = RelativePoseFactor4d::CreateCov6d(odom.first, odom.second);
-                        problem.AddResidualBlock(cf, nullptr, pose_ptr_1, pose_ptr_2);
+                        auto & traj = ego_motion_trajs.at(drone_id);
+                        residuals.add_residual(problem, ResidualKey(RES_EGO_MOTION, 0, ts_last, ts, pose_ptr_1, pose_ptr_2), [&traj, ts_last, ts]() {
+                            auto odom = traj.get_relative_pose_by_ts(ts_last, ts, true);
+                            return RelativePoseFactor4d::CreateCov6d(odom.first, odom.second);
+                        }, false);
                         if (pose_ptr_1 != last_ptr && last_ptr != nullptr) {
                             ROS_ERROR("EgoMoition chain breaked! exit!");
-                            ROS_INFO("EgoMoition@drone%d %d->%d %p->%p pose %s", drone_id, TSShort(ts_last), TSShort(ts), pose_ptr_1, pose_ptr_2, odom.first.tostr().c_str());
+                            ROS_INFO("EgoMoition@drone%d %d->%d %p->%p", drone_id, TSShort(ts_last), TSShort(ts), pose_ptr_1, pose_ptr_2);
                             exit(-1);
                         }
                         last_ptr = pose_ptr_2;
                         #ifdef DEBUG_OUTPUT_ALL_RES
-                            ROS_INFO("EgoMoition@drone%d %d->%d %p->%p pose %s", drone_id, TSShort(ts_last), TSShort(ts), pose_ptr_1, pose_ptr_2, odom.first.tostr().c_str());
+                            ROS_INFO("EgoMoition@drone%d %d->%d %p->%p", drone_id, TSShort(ts_last), TSShort(ts), pose_ptr_1, pose_ptr_2);
                         #endif
                     }
                 }
@@ -1194,14 +1487,10 @@ void SwarmLocalizationSolver::setup_problem_with_ego_motion(const EstimatePosesI
     }
 
     if (drone_id == self_id) {
-        if (problem.HasParameterBlock(poses_all_ego[0])) {
-            problem.SetParameterBlockConstant(poses_all_ego[0]);
-        }
+        residuals.set_constant(poses_all_ego[0]);
         if (params.debug_no_relocalization) {
             for (int i = 1; i < poses_all_ego.size(); i ++) {
-                if (problem.HasParameterBlock(poses_all_ego[i])) {
-                    problem.SetParameterBlockConstant(poses_all_ego[i]);
-                }
+                residuals.set_constant(poses_all_ego[i]);
             }
         }
     }
@@ -1213,6 +1502,18 @@ void SwarmLocalizationSolver::setup_problem_with_ego_motion(const EstimatePosesI
 
 }
 
+Problem & SwarmLocalizationSolver::reset_problem() {
+    if (persistent_problem != nullptr) {
+        delete persistent_problem;
+    }
+    Problem::Options options;
+    //Residuals are removed in every solve
+    options.enable_fast_removal = true;
+    persistent_problem = new Problem(options);
+    residuals.clear();
+    return *persistent_problem;
+}
+
 bool SwarmLocalizationSolver::NFnotMoving(const NodeFrame & _nf1, const NodeFrame & _nf2) const {
     Eigen::Vector3d _diff = _nf1.position() - _nf2.position();
     //TODO: make it set to if last dont's have some detection and this frame has, than keyframe
@@ -1390,7 +1691,7 @@ std::set<int> SwarmLocalizationSolver::estimate_observability() {
         for (int _id : all_nodes) {
             //Can't deal with machines power on later than movement
             if (!pos_observability[_id]) {
-                finish_init = false;
+                reset_init();
                 system_is_initied_by_motion = true;
                 ids_to_init.insert(_id);
             }
@@ -1665,33 +1966,55 @@ std::vector<GeneralMeasurement2Drones*> SwarmLocalizationSolver::find_available_
     return ret;
 }
 
-double SwarmLocalizationSolver::solve_once(EstimatePoses & swarm_est_poses, EstimatePosesIDTS & est_poses_idts, bool report) {
-
-    ros::Time t1 = ros::Time::now();
-    Problem problem;
+int SwarmLocalizationSolver::setup_problem(EstimatePoses & swarm_est_poses, EstimatePosesIDTS & est_poses_idts, Problem & problem) {
+    TicToc tic_setup;
 
 //        if (solve_count % 10 == 0)
     has_new_keyframe = false;
+    residuals.begin_setup();
     std::vector<std::pair<TsType, int>> param_indexs;
     cutting_edges();
     for (unsigned int i = 0; i < sf_sld_win.size(); i++ ) {
-        this->setup_problem_with_sferror(swarm_est_poses, problem, sf_sld_win[i], param_indexs, i==sf_sld_win.size()-1);
+        this->setup_problem_with_sferror(swarm_est_poses, est_poses_idts, problem, sf_sld_win[i], param_indexs, i==sf_sld_win.size()-1);
     }
 
-    int distance_res_blks = problem.NumResidualBlocks();
-
+    if (finish_init) {
+        this->setup_problem_with_priors(problem);
+    }
     this->setup_problem_with_loops_and_detections(est_poses_idts, problem);
-    int num_res_blks = problem.NumResidualBlocks();
     for (int _id: all_nodes) {
         if (enable_to_init_by_drone.at(_id)) {
             this->setup_problem_with_ego_motion(est_poses_idts, problem, _id);       
         }
     }   
-    int ego_motion_blks = problem.NumResidualBlocks() - num_res_blks;
+    int removed_blks = residuals.remove_unused(problem);
+    int distance_res_blks = residuals.count(RES_DISTANCE);
+    int num_res_blks = distance_res_blks + residuals.count(RES_LOOP);
+    int ego_motion_blks = residuals.count(RES_EGO_MOTION);
+    int prior_blks = residuals.count(RES_PRIOR);
+    double t_setup = tic_setup.toc();
+    sum_setup_time += t_setup;
+    count_setup_time += 1;
 
     ROS_INFO("[SWARM_LOCAL] TICK: %d sliding_window_size: %d Residual blocks %d distance %d ego-motion %d loops %d all_dets %ld det_not_in_kf %d", 
         solve_count, sliding_window_size(), num_res_blks, distance_res_blks, ego_motion_blks, good_loop_num, all_detections_6d.size(), good_dets);
+    ROS_INFO("[SWARM_LOCAL] Setup problem %.2fms avg %.2fms, created %d removed %d blocks, priors %d", t_setup, sum_setup_time/count_setup_time,
+        residuals.created(), removed_blks, prior_blks);
+    return num_res_blks;
+}
 
+//Stops the solve of an init trial when another trial got an accepted cost
+class InitTrialCancelCallback : public ceres::IterationCallback {
+    const std::atomic<bool> & cancel;
+public:
+    InitTrialCancelCallback(const std::atomic<bool> & _cancel): cancel(_cancel) {}
+
+    virtual ceres::CallbackReturnType operator()(const ceres::IterationSummary& summary) {
+        return cancel ? ceres::SOLVER_ABORT : ceres::SOLVER_CONTINUE;
+    }
+};
+
+double SwarmLocalizationSolver::solve_problem(Problem & problem, int num_res_blks, Solver::Summary & summary, const std::atomic<bool> * cancel, int num_threads) const {
     ceres::Solver::Options options;
 
     options.max_num_iterations = 1000;
@@ -1703,11 +2026,13 @@ double SwarmLocalizationSolver::solve_once(EstimatePoses & swarm_est_poses, Esti
         options.max_num_iterations = 1000;
     }
     
-    options.num_threads = thread_num;
-    Solver::Summary summary;
+    options.num_threads = num_threads > 0 ? num_threads : thread_num;
 
-    
-    ros::Time t2 = ros::Time::now();
+    std::unique_ptr<InitTrialCancelCallback> callback;
+    if (cancel != nullptr) {
+        callback.reset(new InitTrialCancelCallback(*cancel));
+        options.callbacks.push_back(callback.get());
+    }
 
     ceres::Solve(options, &problem, &summary);
 
@@ -1718,11 +2043,26 @@ double SwarmLocalizationSolver::solve_once(EstimatePoses & swarm_est_poses, Esti
         exit(-1);
     }
 
+    if (summary.termination_type == ceres::TerminationType::USER_FAILURE) {
+        //Cancelled
+        return -1;
+    }
+
     double equv_cost = summary.final_cost;
 
     if (num_res_blks > 1) {
         equv_cost = sqrt(equv_cost) / problem.NumResiduals() / sliding_window_size();
     }
+    return equv_cost;
+}
+
+double SwarmLocalizationSolver::solve_once(EstimatePoses & swarm_est_poses, EstimatePosesIDTS & est_poses_idts, bool report) {
+    //The poses are the parameter blocks, so the problem kept from the last solve starts from its solution
+    Problem & problem = (params.incremental_solve && persistent_problem != nullptr) ? *persistent_problem : reset_problem();
+    int num_res_blks = setup_problem(swarm_est_poses, est_poses_idts, problem);
+
+    Solver::Summary summary;
+    double equv_cost = solve_problem(problem, num_res_blks, summary);
 
     if (!report) {
         return equv_cost;
@@ -0,0 +1,126 @@
+#include "swarm_localization/swarm_marginalization.hpp"
+#include "swarm_localization/swarm_outlier_rejection.hpp"
+#include "swarm_localization/swarm_localization_factors.hpp"
+#include <set>
+
+//Eigen values below are taken as unobservable directions
+#define MARGIN_EPS 1e-8
+
+bool MarginalizationInfo::marginalize(ceres::Problem & problem, const std::vector<double*> & drop_poses) {
+    std::vector<double*> blocks;
+    problem.GetParameterBlocks(&blocks);
+    std::set<double*> drop_set(drop_poses.begin(), drop_poses.end());
+    kept_poses.clear();
+    linearized_poses.clear();
+    for (auto pose : blocks) {
+        if (drop_set.find(pose) == drop_set.end()) {
+            kept_poses.push_back(pose);
+            linearized_poses.push_back(Eigen::Vector4d(pose[0], pose[1], pose[2], pose[3]));
+        }
+    }
+    if (kept_poses.empty() || drop_poses.empty()) {
+        return false;
+    }
+
+    //Poses to drop first in the jacobian
+    ceres::Problem::EvaluateOptions options;
+    options.parameter_blocks = drop_poses;
+    options.parameter_blocks.insert(options.parameter_blocks.end(), kept_poses.begin(), kept_poses.end());
+    double cost = 0;
+    std::vector<double> residuals;
+    ceres::CRSMatrix jacobian;
+    problem.Evaluate(options, &cost, &residuals, nullptr, &jacobian);
+
+    Eigen::MatrixXd J = Eigen::MatrixXd::Zero(jacobian.num_rows, jacobian.num_cols);
+    for (int row = 0; row < jacobian.num_rows; row ++) {
+        for (int k = jacobian.rows[row]; k < jacobian.rows[row + 1]; k ++) {
+            J(row, jacobian.cols[k]) = jacobian.values[k];
+        }
+    }
+    Eigen::Map<Eigen::VectorXd> r(residuals.data(), residuals.size());
+    Eigen::MatrixXd H = J.transpose()*J;
+    Eigen::VectorXd b = J.transpose()*r;
+
+    int m = 4*drop_poses.size();
+    int n = 4*kept_poses.size();
+    Eigen::MatrixXd Hmm = 0.5*(H.topLeftCorner(m, m) + H.topLeftCorner(m, m).transpose());
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> saes(Hmm);
+    Eigen::VectorXd inv_values = (saes.eigenvalues().array() > MARGIN_EPS).select(saes.eigenvalues().array().inverse(), 0);
+    Eigen::MatrixXd Hmm_inv = saes.eigenvectors()*inv_values.asDiagonal()*saes.eigenvectors().transpose();
+
+    Eigen::MatrixXd Hnm = H.bottomLeftCorner(n, m);
+    Eigen::MatrixXd S = H.bottomRightCorner(n, n) - Hnm*Hmm_inv*H.topRightCorner(m, n);
+    Eigen::VectorXd bs = b.tail(n) - Hnm*Hmm_inv*b.head(m);
+
+    //S = Jp^T Jp and bs = Jp^T rp for the prior residual rp + Jp dx
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> saes2(0.5*(S + S.transpose()));
+    std::vector<int> observable;
+    for (int i = 0; i < n; i ++) {
+        if (saes2.eigenvalues()(i) > MARGIN_EPS) {
+            observable.push_back(i);
+        }
+    }
+    if (observable.empty()) {
+        return false;
+    }
+    linearized_jacobians.resize(observable.size(), n);
+    linearized_residuals.resize(observable.size());
+    for (unsigned int i = 0; i < observable.size(); i ++) {
+        double s = sqrt(saes2.eigenvalues()(observable[i]));
+        Eigen::VectorXd v = saes2.eigenvectors().col(observable[i]);
+        linearized_jacobians.row(i) = s*v.transpose();
+        linearized_residuals(i) = v.dot(bs)/s;
+    }
+    return true;
+}
+
+bool MarginalizationInfo::has_pose(const double * pose) const {
+    return std::find(kept_poses.begin(), kept_poses.end(), pose) != kept_poses.end();
+}
+
+int remove_stale_priors(std::map<int, std::shared_ptr<MarginalizationInfo>> & priors, const std::set<double*> & window_poses) {
+    int removed = 0;
+    for (auto it = priors.begin(); it != priors.end(); ) {
+        bool stale = false;
+        for (auto pose : it->second->kept_poses) {
+            stale = stale || window_poses.find(pose) == window_poses.end();
+        }
+        if (stale) {
+            it = priors.erase(it);
+            removed ++;
+        } else {
+            it ++;
+        }
+    }
+    return removed;
+}
+
+MarginalizationFactor::MarginalizationFactor(std::shared_ptr<MarginalizationInfo> _info):
+    info(_info) {
+    for (unsigned int i = 0; i < info->kept_poses.size(); i ++) {
+        mutable_parameter_block_sizes()->push_back(4);
+    }
+    set_num_residuals(info->linearized_residuals.size());
+}
+
+bool MarginalizationFactor::Evaluate(double const* const* parameters, double* residuals, double** jacobians) const {
+    int n = info->kept_poses.size();
+    Eigen::VectorXd dx(4*n);
+    for (int i = 0; i < n; i ++) {
+        for (int k = 0; k < 3; k ++) {
+            dx(4*i + k) = parameters[i][k] - info->linearized_poses[i](k);
+        }
+        dx(4*i + 3) = NormalizeAngle(parameters[i][3] - info->linearized_poses[i](3));
+    }
+    Eigen::Map<Eigen::VectorXd> r(residuals, num_residuals());
+    r = info->linearized_jacobians*dx + info->linearized_residuals;
+    if (jacobians) {
+        for (int i = 0; i < n; i ++) {
+            if (jacobians[i]) {
+                Eigen::Map<Eigen::Matrix<double, Eigen::Dynamic, 4, Eigen::RowMajor>> J(jacobians[i], num_residuals(), 4);
+                J = info->linearized_jacobians.middleCols(4*i, 4);
+            }
+        }
+    }
+    return true;
+}
@@ -72,6 +72,7 @@ std::vector<int64_t> SwarmLocalOutlierRejection::good_loops() {
 
 void SwarmLocalOutlierRejection::broadcast_good_loops(ros::Time stamp, int id_a, int id_b) {
     LoopInliers_t msg;
+    lcm_mutex.lock();
     if (good_loops_set.find(id_a) != good_loops_set.end()) {
         if (good_loops_set.find(id_b) != good_loops_set.end()) {
             for (auto _id : good_loops_set[id_a][id_b]) {
@@ -79,6 +80,7 @@ void SwarmLocalOutlierRejection::broadcast_good_loops(ros::Time stamp, int id_a,
             }
         }
     }
+    lcm_mutex.unlock();
     msg.drone_id_a = id_a;
     msg.drone_id_b = id_b;
     msg.sender_id = self_id;
@@ -289,10 +291,13 @@ void SwarmLocalOutlierRejection::OutlierRejectionLoopEdgesPCM(const std::vector<
     ROS_INFO("[SWARM_LOCAL](OutlierRejection) %d<->%d compute_pcm_errors %.1fms maxCliqueHeu takes %.1fms inter_loop %ld good %ld", 
         id_a, id_b, compute_pcm_erros, tic.toc(), _all_loops.size(), max_clique_data.size());
 
+    //Read by good_loops from the prediction thread
+    lcm_mutex.lock();
     good_loops_set[id_a][id_b].clear();
     good_loops_set[id_b][id_a].clear();
     for (auto i : max_clique_data) {
         good_loops_set[id_a][id_b].insert(_all_loops[i].id);
         good_loops_set[id_b][id_a].insert(_all_loops[i].id);
     }
+    lcm_mutex.unlock();
 }
\ No newline at end of file
@@ -0,0 +1,155 @@
+#include "swarm_localization/swarm_outlier_rejection.hpp"
+#include "swarm_localization/swarm_localization_factors.hpp"
+#include <swarm_msgs/swarm_types.hpp>
+#include <functional>
+#include <random>
+#include <chrono>
+#include <stdio.h>
+
+float DETECTION_SPHERE_STD = 0.1;
+float DETECTION_INV_DEP_STD = 0.5;
+float DETECTION_DEP_STD = 0.5;
+Eigen::Vector3d CG;
+bool ANALYTIC_JACOBIAN = false;
+
+#define JACOBIAN_TOL 1e-8
+#define TEST_SAMPLES 1000
+#define BENCH_EVALUATIONS 200000
+
+std::default_random_engine eng{0};
+std::uniform_real_distribution<double> uniform(-1, 1);
+
+int failed = 0;
+
+Eigen::Vector4d random_pose(double range) {
+    //Yaw over the whole circle to cross the normalization of the angles
+    return Eigen::Vector4d(uniform(eng)*range, uniform(eng)*range, uniform(eng)*range, uniform(eng)*M_PI*1.2);
+}
+
+//Max difference of residuals and jacobians of the two cost functions, relative to their scale
+double compare(ceres::CostFunction * a, ceres::CostFunction * b, const Eigen::Vector4d & pose_a, const Eigen::Vector4d & pose_b) {
+    int n = a->num_residuals();
+    std::vector<double> res_a(n), res_b(n), ja0(n*4), ja1(n*4), jb0(n*4), jb1(n*4);
+    const double * params[2] = {pose_a.data(), pose_b.data()};
+    double * jac_a[2] = {ja0.data(), ja1.data()};
+    double * jac_b[2] = {jb0.data(), jb1.data()};
+    a->Evaluate(params, res_a.data(), jac_a);
+    b->Evaluate(params, res_b.data(), jac_b);
+    double err = 0;
+    for (int i = 0; i < n; i ++) {
+        err = std::max(err, fabs(res_a[i] - res_b[i])/(1 + fabs(res_a[i])));
+    }
+    for (int i = 0; i < n*4; i ++) {
+        err = std::max(err, fabs(ja0[i] - jb0[i])/(1 + fabs(ja0[i])));
+        err = std::max(err, fabs(ja1[i] - jb1[i])/(1 + fabs(ja1[i])));
+    }
+    return err;
+}
+
+//ns per residual of Evaluate with jacobians
+double benchmark(ceres::CostFunction * cost, const Eigen::Vector4d & pose_a, const Eigen::Vector4d & pose_b) {
+    int n = cost->num_residuals();
+    std::vector<double> res(n), j0(n*4), j1(n*4);
+    const double * params[2] = {pose_a.data(), pose_b.data()};
+    double * jacs[2] = {j0.data(), j1.data()};
+    double sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_EVALUATIONS; i ++) {
+        cost->Evaluate(params, res.data(), jacs);
+        sum += res[0] + j0[i % (n*4)];
+    }
+    double dt = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    //Keep the loop from being optimized out
+    if (sum == 12345.6789) {
+        printf(" ");
+    }
+    return dt/BENCH_EVALUATIONS/n;
+}
+
+//Check the analytic version made by create against autodiff on random poses and compare their speed
+void check_factor(const char * name, std::function<ceres::CostFunction*()> create, double range) {
+    double err = 0;
+    double t_auto = 0, t_analytic = 0;
+    for (int i = 0; i < TEST_SAMPLES; i ++) {
+        //Same random measurement for both
+        ANALYTIC_JACOBIAN = false;
+        eng.seed(i);
+        auto autodiff = create();
+        ANALYTIC_JACOBIAN = true;
+        eng.seed(i);
+        auto analytic = create();
+        auto pose_a = random_pose(range);
+        auto pose_b = random_pose(range);
+        err = std::max(err, compare(autodiff, analytic, pose_a, pose_b));
+        if (i == 0) {
+            t_auto = benchmark(autodiff, pose_a, pose_b);
+            t_analytic = benchmark(analytic, pose_a, pose_b);
+        }
+        delete autodiff;
+        delete analytic;
+    }
+    bool ok = err < JACOBIAN_TOL;
+    failed += !ok;
+    printf("%-32s max err %.2e autodiff %6.1fns analytic %6.1fns per residual, %.1fx %s\n", name, err,
+        t_auto, t_analytic, t_auto/t_analytic, ok ? "OK" : "FAILED");
+}
+
+Swarm::DroneDetection random_detection(bool enable_depth, bool enable_dpose) {
+    Swarm::DroneDetection det;
+    det.enable_depth = enable_depth;
+    det.enable_dpose = enable_dpose;
+    det.p = Eigen::Vector3d(uniform(eng), uniform(eng), uniform(eng)).normalized();
+    det.inv_dep = 0.2 + 0.5*(1 + uniform(eng));
+    det.dpose_self_a = Swarm::Pose(Eigen::Vector3d(uniform(eng), uniform(eng), uniform(eng))*0.3, uniform(eng)*0.3);
+    det.dpose_self_b = Swarm::Pose(Eigen::Vector3d(uniform(eng), uniform(eng), uniform(eng))*0.3, uniform(eng)*0.3);
+    det.extrinsic = Swarm::Pose(Eigen::Vector3d(0.1, 0, 0.05), 0);
+    //Tangent base of the direction
+    Eigen::Vector3d tmp = fabs(det.p.z()) < 0.9 ? Eigen::Vector3d::UnitZ() : Eigen::Vector3d::UnitX();
+    Eigen::Vector3d b1 = det.p.cross(tmp).normalized();
+    Eigen::Vector3d b2 = det.p.cross(b1);
+    det.detect_tan_base.row(0) = b1.transpose();
+    det.detect_tan_base.row(1) = b2.transpose();
+    return det;
+}
+
+//Usage: swarm_localization_factor_test
+//Check the analytic jacobians of the distance, relative pose and detection factors against autodiff
+//and compare their evaluation time per residual.
+int main(int argc, char* argv[]) {
+    check_factor("DistanceMeasurementFactor", []() {
+        return DistanceMeasurementFactor::Create(1 + uniform(eng), 1/sqrt(0.1));
+    }, 5);
+
+    check_factor("RelativePoseFactor4d", []() {
+        auto rel = random_pose(2);
+        Eigen::Matrix4d sqrt_inf = Eigen::Matrix4d::Identity()*10;
+        for (int k = 0; k < 16; k ++) {
+            sqrt_inf(k / 4, k % 4) += uniform(eng);
+        }
+        return RelativePoseFactor4d::Create(Swarm::Pose(Eigen::Vector3d(rel.head<3>()), rel(3)), sqrt_inf);
+    }, 5);
+
+    check_factor("RelativePoseFactor4d CreateCov6d", []() {
+        auto rel = random_pose(2);
+        Eigen::Matrix6d cov = Eigen::Matrix6d::Identity()*0.01;
+        return RelativePoseFactor4d::CreateCov6d(Swarm::Pose(Eigen::Vector3d(rel.head<3>()), rel(3)), cov);
+    }, 5);
+
+    check_factor("DroneDetection4dFactor", []() {
+        return DroneDetection4dFactor::Create(random_detection(false, false));
+    }, 5);
+
+    check_factor("DroneDetection4dFactor depth", []() {
+        return DroneDetection4dFactor::Create(random_detection(true, false));
+    }, 5);
+
+    check_factor("DroneDetection4dFactor dpose", []() {
+        return DroneDetection4dFactor::Create(random_detection(false, true));
+    }, 5);
+
+    check_factor("DroneDetection4dFactor depth dpose", []() {
+        return DroneDetection4dFactor::Create(random_detection(true, true));
+    }, 5);
+
+    return failed > 0 ? -1 : 0;
+}
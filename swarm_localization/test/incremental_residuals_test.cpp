@@ -0,0 +1,130 @@
+#include "swarm_localization/swarm_incremental_residuals.hpp"
+#include <stdio.h>
+#include <chrono>
+
+#define INC_DRONES 3
+#define INC_WINDOW 120
+#define INC_SLIDES 50
+#define INC_LOOPS 2
+#define INC_PAIRS (INC_DRONES*(INC_DRONES - 1)/2)
+//Residuals of one new frame and the loops rebuilt every solve
+#define INC_DELTA (INC_PAIRS + INC_DRONES + INC_LOOPS)
+#define INC_FULL (INC_WINDOW*INC_PAIRS + (INC_WINDOW - 1)*INC_DRONES + INC_LOOPS)
+
+int failed = 0;
+
+void check(bool ok, const char * what) {
+    if (!ok) {
+        printf("FAILED: %s\n", what);
+        failed ++;
+    }
+}
+
+class PoseDiff : public ceres::SizedCostFunction<4, 4, 4> {
+public:
+    virtual bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const {
+        for (int k = 0; k < 4; k ++) {
+            residuals[k] = parameters[1][k] - parameters[0][k];
+        }
+        return true;
+    }
+};
+
+//Poses of each frame, pose[frame][drone]
+std::map<int, std::vector<double*>> poses;
+
+ceres::CostFunction * create_cost() {
+    return new PoseDiff;
+}
+
+//Declare the residuals of the window [start, start + INC_WINDOW) as solve_once does:
+//distances in each frame, ego-motion between frames, loops to the newest frame and the anchor of drone 0 constant
+int setup(IncrementalResiduals & residuals, ceres::Problem & problem, int start) {
+    residuals.begin_setup();
+    int end = start + INC_WINDOW;
+    for (int f = start; f < end; f ++) {
+        if (poses.find(f) == poses.end()) {
+            for (int d = 0; d < INC_DRONES; d ++) {
+                poses[f].push_back(new double[4]{(double) f, (double) d, 0, 0});
+            }
+        }
+        for (int a = 0; a < INC_DRONES; a ++) {
+            for (int b = a + 1; b < INC_DRONES; b ++) {
+                residuals.add_residual(problem, ResidualKey(RES_DISTANCE, 0, f, f, poses[f][a], poses[f][b]), create_cost, true);
+            }
+        }
+    }
+    residuals.remove_from_kind(problem, RES_LOOP);
+    for (int i = 0; i < INC_LOOPS; i ++) {
+        int f = start + i*INC_WINDOW/INC_LOOPS;
+        residuals.add_residual(problem, ResidualKey(RES_LOOP, i, end - 1, f, poses[end - 1][0], poses[f][1 + i % (INC_DRONES - 1)]), create_cost, true);
+    }
+    for (int d = 0; d < INC_DRONES; d ++) {
+        for (int f = start + 1; f < end; f ++) {
+            residuals.add_residual(problem, ResidualKey(RES_EGO_MOTION, 0, f - 1, f, poses[f - 1][d], poses[f][d]), create_cost, false);
+        }
+    }
+    residuals.set_constant(poses[start][0]);
+    return residuals.remove_unused(problem);
+}
+
+//Usage: swarm_localization_incremental_test
+//Slide a window of INC_WINDOW frames over INC_SLIDES solves on one problem. Fails unless every solve
+//creates only the residuals of the new frame and the loops, removes the ones of the frame left the window
+//with its poses, and leaves the same residuals as a rebuilt problem.
+int main(int argc, char* argv[]) {
+    ceres::Problem::Options options;
+    options.enable_fast_removal = true;
+    ceres::Problem problem(options);
+    IncrementalResiduals residuals;
+
+    setup(residuals, problem, 0);
+    check(residuals.created() == INC_FULL && problem.NumResidualBlocks() == INC_FULL, "first setup creates the window");
+
+    double sum_inc = 0, sum_rebuild = 0;
+    bool created_ok = true, removed_ok = true, window_ok = true, constant_ok = true;
+    for (int start = 1; start <= INC_SLIDES; start ++) {
+        auto t0 = std::chrono::high_resolution_clock::now();
+        int removed = setup(residuals, problem, start);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        sum_inc += std::chrono::duration<double, std::milli>(t1 - t0).count();
+
+        created_ok = created_ok && residuals.created() == INC_DELTA;
+        removed_ok = removed_ok && removed == INC_PAIRS + INC_DRONES;
+        window_ok = window_ok && problem.NumResidualBlocks() == INC_FULL && residuals.count(RES_DISTANCE) == INC_WINDOW*INC_PAIRS &&
+            problem.NumParameterBlocks() == INC_WINDOW*INC_DRONES && !problem.HasParameterBlock(poses[start - 1][0]);
+        constant_ok = constant_ok && problem.IsParameterBlockConstant(poses[start][0]) && !problem.IsParameterBlockConstant(poses[start + 1][0]);
+
+        //The same window on a new problem
+        ceres::Problem rebuilt(options);
+        IncrementalResiduals rebuilt_residuals;
+        auto t2 = std::chrono::high_resolution_clock::now();
+        setup(rebuilt_residuals, rebuilt, start);
+        sum_rebuild += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t2).count();
+        window_ok = window_ok && rebuilt.NumResidualBlocks() == problem.NumResidualBlocks();
+
+        for (auto pose : poses[start - 1]) {
+            delete [] pose;
+        }
+        poses.erase(start - 1);
+    }
+    printf("Window %d frames of %d drones, %d residuals: %d created per slide, setup %.3fms rebuild %.3fms\n",
+        INC_WINDOW, INC_DRONES, INC_FULL, INC_DELTA, sum_inc/INC_SLIDES, sum_rebuild/INC_SLIDES);
+    check(created_ok, "each slide creates only the new frame and the loops");
+    check(removed_ok, "each slide removes the frame left the window");
+    check(window_ok, "problem holds the window as a rebuilt one");
+    check(constant_ok, "anchor pose follows the window");
+
+    //Nothing declared, all residuals and poses go
+    residuals.begin_setup();
+    residuals.remove_unused(problem);
+    check(problem.NumResidualBlocks() == 0 && problem.NumParameterBlocks() == 0, "all removed");
+
+    for (auto & it : poses) {
+        for (auto pose : it.second) {
+            delete [] pose;
+        }
+    }
+    printf("%s\n", failed == 0 ? "OK" : "FAILED");
+    return failed == 0 ? 0 : -1;
+}
@@ -0,0 +1,224 @@
+#include "swarm_localization/swarm_outlier_rejection.hpp"
+#include "swarm_localization/swarm_localization_factors.hpp"
+#include "swarm_localization/swarm_marginalization.hpp"
+#include <random>
+#include <stdio.h>
+
+float DETECTION_SPHERE_STD = 0.1;
+float DETECTION_INV_DEP_STD = 0.5;
+float DETECTION_DEP_STD = 0.5;
+Eigen::Vector3d CG;
+bool ANALYTIC_JACOBIAN = false;
+
+#define MARGIN_POSES 6
+#define MARGIN_TOL 1e-6
+
+std::default_random_engine eng{0};
+std::uniform_real_distribution<double> uniform(-1, 1);
+
+int failed = 0;
+
+void check(bool ok, const char * what, double err) {
+    printf("%-48s err %.2e %s\n", what, err, ok ? "OK" : "FAILED");
+    failed += !ok;
+}
+
+//Fixes the gauge of the problem on the first pose
+class PosePrior : public ceres::SizedCostFunction<4, 4> {
+    Eigen::Vector4d pose;
+    double sqrt_inf;
+public:
+    PosePrior(const Eigen::Vector4d & _pose, double _sqrt_inf): pose(_pose), sqrt_inf(_sqrt_inf) {}
+
+    virtual bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const {
+        for (int k = 0; k < 4; k ++) {
+            residuals[k] = (parameters[0][k] - pose(k))*sqrt_inf;
+        }
+        if (jacobians && jacobians[0]) {
+            Eigen::Map<Eigen::Matrix<double, 4, 4, Eigen::RowMajor>> J(jacobians[0]);
+            J = Eigen::Matrix4d::Identity()*sqrt_inf;
+        }
+        return true;
+    }
+};
+
+struct Residual {
+    ceres::CostFunction * cost;
+    std::vector<int> poses;
+};
+
+//Dense J and r of all residuals over all poses, assembled here independently of ceres::Problem::Evaluate
+void linearize(const std::vector<Residual> & residuals, std::vector<Eigen::Vector4d> & poses, Eigen::MatrixXd & J, Eigen::VectorXd & r) {
+    int rows = 0;
+    for (auto & res : residuals) {
+        rows += res.cost->num_residuals();
+    }
+    J = Eigen::MatrixXd::Zero(rows, 4*poses.size());
+    r = Eigen::VectorXd::Zero(rows);
+    int row = 0;
+    for (auto & res : residuals) {
+        int n = res.cost->num_residuals();
+        std::vector<const double*> params;
+        std::vector<std::vector<double>> jacs(res.poses.size(), std::vector<double>(n*4));
+        std::vector<double*> jac_ptrs;
+        for (unsigned int i = 0; i < res.poses.size(); i ++) {
+            params.push_back(poses[res.poses[i]].data());
+            jac_ptrs.push_back(jacs[i].data());
+        }
+        res.cost->Evaluate(params.data(), r.data() + row, jac_ptrs.data());
+        for (unsigned int i = 0; i < res.poses.size(); i ++) {
+            for (int k = 0; k < n*4; k ++) {
+                J(row + k / 4, 4*res.poses[i] + k % 4) += jacs[i][k];
+            }
+        }
+        row += n;
+    }
+}
+
+//Usage: swarm_localization_marginalization_test
+//Marginalize the two oldest poses out of a small 4 DoF pose graph of relative pose and distance factors,
+//and compare the Schur complement prior of MarginalizationInfo with the exact marginal from the dense covariance:
+//its information matrix, its Gauss-Newton step on the kept poses and the MarginalizationFactor around the linearization point.
+//Then check that a prior on a pose dropped from the window without marginalization is removed.
+int main(int argc, char* argv[]) {
+    std::vector<Eigen::Vector4d> poses;
+    for (int i = 0; i < MARGIN_POSES; i ++) {
+        //Yaw over the whole circle to cross the normalization of the angles
+        poses.push_back(Eigen::Vector4d(i + uniform(eng)*0.3, uniform(eng), uniform(eng)*0.3, uniform(eng)*M_PI));
+    }
+
+    std::vector<Residual> residuals;
+    residuals.push_back(Residual{new PosePrior(poses[0], 10), {0}});
+    auto add_relative = [&](int a, int b) {
+        //Noisy measurements, so the residuals and the gradient are not zero
+        Swarm::Pose rel(Eigen::Vector3d(1 + uniform(eng)*0.2, uniform(eng)*0.2, uniform(eng)*0.1), uniform(eng)*3);
+        Eigen::Matrix4d sqrt_inf = Eigen::Matrix4d::Identity()*5;
+        for (int k = 0; k < 16; k ++) {
+            sqrt_inf(k / 4, k % 4) += uniform(eng)*0.5;
+        }
+        residuals.push_back(Residual{RelativePoseFactor4d::Create(rel, sqrt_inf), {a, b}});
+    };
+    auto add_distance = [&](int a, int b) {
+        double dis = (poses[a].head<3>() - poses[b].head<3>()).norm() + uniform(eng)*0.1;
+        residuals.push_back(Residual{DistanceMeasurementFactor::Create(dis, 10), {a, b}});
+    };
+    for (int i = 0; i + 1 < MARGIN_POSES; i ++) {
+        add_relative(i, i + 1);
+    }
+    add_relative(0, 2);
+    add_relative(1, 3);
+    add_distance(0, 4);
+    add_distance(1, 5);
+    add_distance(2, 5);
+
+    ceres::Problem::Options problem_options;
+    problem_options.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+    ceres::Problem problem(problem_options);
+    for (auto & res : residuals) {
+        if (res.poses.size() == 1) {
+            problem.AddResidualBlock(res.cost, nullptr, poses[res.poses[0]].data());
+        } else {
+            problem.AddResidualBlock(res.cost, nullptr, poses[res.poses[0]].data(), poses[res.poses[1]].data());
+        }
+    }
+
+    //Drop the two oldest poses, as the sliding window
+    int m = 2;
+    int n = MARGIN_POSES - m;
+    auto info = std::make_shared<MarginalizationInfo>();
+    std::vector<double*> drop_poses{poses[0].data(), poses[1].data()};
+    bool ok = info->marginalize(problem, drop_poses);
+    check(ok && info->kept_poses.size() == (size_t) n, "marginalize", 0);
+    if (!ok) {
+        return -1;
+    }
+    //Kept poses as indices of poses, in the order of the prior
+    std::vector<int> kept;
+    for (auto pose : info->kept_poses) {
+        for (int i = 0; i < MARGIN_POSES; i ++) {
+            if (poses[i].data() == pose) {
+                kept.push_back(i);
+            }
+        }
+    }
+
+    //Exact marginal: information of the kept poses is the inverse of their block of the full covariance
+    Eigen::MatrixXd J;
+    Eigen::VectorXd r;
+    linearize(residuals, poses, J, r);
+    Eigen::MatrixXd H = J.transpose()*J;
+    Eigen::VectorXd b = J.transpose()*r;
+    Eigen::MatrixXd cov = H.inverse();
+    Eigen::MatrixXd cov_kept(4*n, 4*n);
+    Eigen::VectorXd step_full = -cov*b;
+    Eigen::VectorXd step_kept_exact(4*n);
+    for (int i = 0; i < n; i ++) {
+        for (int j = 0; j < n; j ++) {
+            cov_kept.block<4, 4>(4*i, 4*j) = cov.block<4, 4>(4*kept[i], 4*kept[j]);
+        }
+        step_kept_exact.segment<4>(4*i) = step_full.segment<4>(4*kept[i]);
+    }
+    Eigen::MatrixXd inf_exact = cov_kept.inverse();
+
+    const Eigen::MatrixXd & Jp = info->linearized_jacobians;
+    const Eigen::VectorXd & rp = info->linearized_residuals;
+    Eigen::MatrixXd inf_prior = Jp.transpose()*Jp;
+    double err = (inf_prior - inf_exact).norm()/inf_exact.norm();
+    check(err < MARGIN_TOL, "information of the prior", err);
+
+    //The prior alone gives the kept part of the Gauss-Newton step of the full problem
+    Eigen::VectorXd step_prior = -inf_prior.ldlt().solve(Jp.transpose()*rp);
+    err = (step_prior - step_kept_exact).norm()/(1 + step_kept_exact.norm());
+    check(err < MARGIN_TOL, "Gauss-Newton step of the prior", err);
+
+    //The factor around the linearization point: gradient of the exact marginal, and yaw wrapped by 2pi
+    MarginalizationFactor factor(info);
+    Eigen::VectorXd dx(4*n);
+    for (int k = 0; k < 4*n; k ++) {
+        dx(k) = uniform(eng)*0.01;
+    }
+    std::vector<Eigen::Vector4d> perturbed(n), wrapped(n);
+    std::vector<const double*> params(n), params_wrapped(n);
+    std::vector<std::vector<double>> jacs(n, std::vector<double>(rp.size()*4));
+    std::vector<double*> jac_ptrs(n);
+    for (int i = 0; i < n; i ++) {
+        perturbed[i] = poses[kept[i]] + dx.segment<4>(4*i);
+        wrapped[i] = perturbed[i] + Eigen::Vector4d(0, 0, 0, 2*M_PI);
+        params[i] = perturbed[i].data();
+        params_wrapped[i] = wrapped[i].data();
+        jac_ptrs[i] = jacs[i].data();
+    }
+    Eigen::VectorXd res(rp.size()), res_wrapped(rp.size());
+    factor.Evaluate(params.data(), res.data(), jac_ptrs.data());
+    factor.Evaluate(params_wrapped.data(), res_wrapped.data(), nullptr);
+    Eigen::MatrixXd Jf(rp.size(), 4*n);
+    for (int i = 0; i < n; i ++) {
+        for (int k = 0; k < rp.size()*4; k ++) {
+            Jf(k / 4, 4*i + k % 4) = jacs[i][k];
+        }
+    }
+    Eigen::VectorXd grad = Jf.transpose()*res;
+    Eigen::VectorXd grad_exact = inf_exact*(dx - step_kept_exact);
+    err = (grad - grad_exact).norm()/(1 + grad_exact.norm());
+    check(err < MARGIN_TOL, "gradient of the factor", err);
+    err = (res - res_wrapped).norm();
+    check(err < MARGIN_TOL, "factor with yaw wrapped", err);
+
+    //Init reset while the prior is active: the frames leaving the window are not marginalized,
+    //a prior on their poses must be removed and the priors on the window kept
+    std::map<int, std::shared_ptr<MarginalizationInfo>> priors;
+    priors[0] = info;
+    priors[1] = std::make_shared<MarginalizationInfo>();
+    priors[1]->kept_poses.push_back(info->kept_poses.back());
+    std::set<double*> window(info->kept_poses.begin(), info->kept_poses.end());
+    check(remove_stale_priors(priors, window) == 0 && priors.size() == 2, "priors on the window kept", 0);
+    window.erase(info->kept_poses.front());
+    check(remove_stale_priors(priors, window) == 1 && priors.size() == 1 && priors.find(1) != priors.end(),
+        "prior on a pose out of the window removed", 0);
+
+    for (auto & res : residuals) {
+        delete res.cost;
+    }
+    printf("%s\n", failed == 0 ? "OK" : "FAILED");
+    return failed == 0 ? 0 : -1;
+}
@@ -0,0 +1,110 @@
+#include "swarm_localization/swarm_solver_worker.hpp"
+#include <swarm_msgs/swarm_types.hpp>
+#include <memory>
+#include <atomic>
+#include <vector>
+#include <stdio.h>
+
+#define FEED_RATE 100.0
+#define FEED_FRAMES 400
+#define SOLVE_FREQ 10.0
+//A slow solve, as Ceres with the full sliding window
+#define SOLVE_MS 150
+#define PREDICT_RATE 100.0
+
+//Stands for the solved poses read by the prediction, the pair must always be from the same solve
+struct FakeState {
+    int solve_id = 0;
+    int frames = 0;
+    double check = 0;
+};
+
+//Usage: swarm_localization_worker_test
+//Feed synthetic frames at FEED_RATE to the solver worker with a solve of SOLVE_MS while predicting at PREDICT_RATE,
+//check that all frames and measurements are taken in order and that prediction always reads a whole solved state.
+//The wait times of intake and prediction are printed only, they depend on the machine.
+int main(int argc, char* argv[]) {
+    //Used by the solver thread only
+    std::vector<int> frames_in;
+    std::vector<int> measurements_in;
+    bool in_order = true;
+
+    std::mutex state_lock;
+    std::shared_ptr<const FakeState> state = std::make_shared<FakeState>();
+    auto get_state = [&]() {
+        std::lock_guard<std::mutex> lk(state_lock);
+        return state;
+    };
+
+    int solve_count = 0;
+    SolverWorker worker(1/SOLVE_FREQ, [&](double t_frame) {
+        auto s = std::make_shared<FakeState>();
+        s->solve_id = ++ solve_count;
+        s->frames = frames_in.size();
+        std::this_thread::sleep_for(std::chrono::milliseconds(SOLVE_MS));
+        s->check = s->solve_id * 1000 + s->frames;
+        std::lock_guard<std::mutex> lk(state_lock);
+        state = s;
+    });
+
+    std::atomic<bool> feeding(true);
+    double predict_max = 0, predict_sum = 0;
+    int predict_num = 0, inconsistent = 0, last_solve_seen = 0;
+    std::thread predictor([&] {
+        while (feeding) {
+            TicToc tic;
+            auto s = get_state();
+            double dt = tic.toc();
+            predict_max = std::max(predict_max, dt);
+            predict_sum += dt;
+            predict_num ++;
+            inconsistent += s->check != s->solve_id * 1000 + s->frames;
+            last_solve_seen = std::max(last_solve_seen, s->solve_id);
+            std::this_thread::sleep_for(std::chrono::microseconds((int)(1e6/PREDICT_RATE)));
+        }
+    });
+
+    double push_max = 0, push_sum = 0;
+    TicToc tic_feed;
+    for (int i = 0; i < FEED_FRAMES; i ++) {
+        double stamp = 1000 + i/FEED_RATE;
+        TicToc tic;
+        worker.push_frame([&, i] {
+            in_order = in_order && (int) frames_in.size() == i;
+            frames_in.push_back(i);
+        }, stamp);
+        if (i % 10 == 0) {
+            worker.push_measurement([&, i] {
+                measurements_in.push_back(i);
+            });
+        }
+        double dt = tic.toc();
+        push_max = std::max(push_max, dt);
+        push_sum += dt;
+        std::this_thread::sleep_for(std::chrono::microseconds((int)(1e6/FEED_RATE)));
+    }
+    double t_feed = tic_feed.toc();
+
+    //Let the last solve finish
+    while (worker.size() > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(2*SOLVE_MS));
+    feeding = false;
+    predictor.join();
+    worker.stop();
+
+    auto stats = worker.stats();
+    printf("Fed %d frames in %.0fms, push avg %.3fms max %.3fms (inline solve would block %dms)\n",
+        FEED_FRAMES, t_feed, push_sum/FEED_FRAMES, push_max, SOLVE_MS);
+    printf("Predict %d times avg %.3fms max %.3fms, saw solve %d, inconsistent %d\n",
+        predict_num, predict_sum/std::max(predict_num, 1), predict_max, last_solve_seen, inconsistent);
+    printf("Worker consumed %ld/%ld jobs, queue max %d, %ld solves avg %.1fms\n", stats.consumed, stats.pushed,
+        stats.queue_max, stats.solves, stats.solve_sum/std::max(stats.solves, 1L));
+
+    bool ok = (int) frames_in.size() == FEED_FRAMES && measurements_in.size() == FEED_FRAMES/10 && in_order &&
+        inconsistent == 0 &&
+        stats.solves > 1 && last_solve_seen == stats.solves;
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <swarm_msgs/ImageDescriptorHeader_t.hpp>
+#include <stdint.h>
+#include <vector>
+
+//Wire formats of descriptors shared between drones. The receiver decodes them back to float, so matching
+//and the faiss index are unchanged.
+enum DescFormat {
+    DESC_FLOAT32 = 0,
+    //float32 scale, then int8 of each dimension, v = q*scale
+    DESC_INT8 = 1,
+    //float32 scale, then the sign of each dimension as bits, v = +-scale
+    DESC_BINARY = 2,
+    //float32 scale, then int4 of each dimension in [-7, 7], two per byte low nibble first, v = q*scale
+    DESC_INT4 = 3
+};
+
+//Image header with the quantized NetVLAD descriptor, sent on QUANTIZED_HEADER_CHANNEL instead of VIOKF_HEADER:
+//  uint32 magic, uint8 version, uint8 format, uint16 dim, quantized descriptor,
+//  the LCM encoded ImageDescriptorHeader_t with an empty image_desc
+#define QUANTIZED_HEADER_CHANNEL "VIOKF_HEADER_Q"
+#define QUANTIZED_HEADER_MAGIC 0x52444851
+#define QUANTIZED_HEADER_VERSION 1
+
+//Format of the landmarks when desc_wire_format is not set, with the int8 NetVLAD descriptor a keyframe is
+//about 4.5 times smaller than one float32 LandmarkDescriptor_t per landmark
+#define DESC_WIRE_FORMAT_DEFAULT DESC_INT4
+
+bool desc_format_valid(int format);
+
+//Bytes of a descriptor of dim in format
+int quantized_desc_size(int dim, int format);
+
+void quantize_desc(const float * v, int dim, int format, uint8_t * out);
+
+void dequantize_desc(const uint8_t * in, int dim, int format, float * v);
+
+std::vector<uint8_t> encode_quantized_header(const swarm_msgs::ImageDescriptorHeader_t & header, int format);
+
+//False if data is not a valid quantized header
+bool decode_quantized_header(const void * data, int size, swarm_msgs::ImageDescriptorHeader_t & header);
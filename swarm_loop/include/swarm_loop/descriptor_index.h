@@ -0,0 +1,56 @@
+#pragma once
+
+#include <faiss/IndexFlat.h>
+#include <faiss/MetaIndexes.h>
+#include <set>
+#include <string>
+#include <vector>
+
+//Inner product index of NetVLAD descriptors with stable ids, exact or approximate.
+//factory is a faiss index_factory string, "Flat" for exact search, or e.g. "PCA256,HNSW32" or "PCA512,IVF256,PQ64"
+//for approximate search. Approximate indexes need training, so descriptors go to an exact flat index until
+//train_size of them are collected, then the index is trained on them and takes over; later descriptors are inserted online.
+//search_params are faiss ParameterSpace settings trading recall for latency, e.g. "nprobe=16" or "efSearch=64".
+//Indexes that can't remove descriptors (HNSW) keep the removed ids as stale, skip them at search and are rebuilt
+//from their live descriptors once more than rebuild_stale of the descriptors are stale.
+class DescriptorIndex {
+    int dim;
+    std::string factory;
+    std::string search_params;
+    int train_size;
+    double rebuild_stale;
+
+    faiss::IndexFlatIP flat;
+    faiss::IndexIDMap flat_map;
+    faiss::IndexIDMap * ann = nullptr;
+    std::set<faiss::Index::idx_t> stale;
+
+    void train_ann();
+
+    //New ann of the live descriptors, keeps the training
+    void rebuild_ann();
+
+public:
+    DescriptorIndex(int _dim, std::string _factory = "Flat", std::string _search_params = "", int _train_size = 2000,
+        double _rebuild_stale = 0.1);
+    ~DescriptorIndex();
+
+    void add(faiss::Index::idx_t id, const float * desc);
+
+    void remove(const std::vector<faiss::Index::idx_t> & ids);
+
+    void search(const float * desc, int k, float * distances, faiss::Index::idx_t * labels) const;
+
+    bool is_approximate() const {
+        return ann != nullptr;
+    }
+
+    //Live descriptors, stale ones not counted
+    int64_t ntotal() const {
+        return ann != nullptr ? ann->ntotal - (int64_t) stale.size() : flat_map.ntotal;
+    }
+
+    int64_t stale_num() const {
+        return stale.size();
+    }
+};
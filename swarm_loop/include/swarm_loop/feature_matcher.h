@@ -0,0 +1,22 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+//Brute force matcher of the PCA reduced SuperPoint descriptors, works on the flat descriptor arrays of the LCM messages.
+#define MATCH_DESC_SIZE 64
+
+namespace Swarm {
+
+//Mutual nearest neighbours by L2 distance between num_a descriptors desc_a and num_b descriptors desc_b, row major,
+//as cv::BFMatcher(cv::NORM_L2, true). With ratio < 1, a match is also dropped unless its distance is below
+//ratio times the distance to the second nearest neighbour in desc_b. matches are ordered by queryIdx (index in desc_a).
+void matchDescriptors(const float * desc_a, int num_a, const float * desc_b, int num_b,
+    std::vector<cv::DMatch> & matches, float ratio = 1.0f);
+
+inline void matchDescriptors(const std::vector<float> & desc_a, const std::vector<float> & desc_b,
+    std::vector<cv::DMatch> & matches, float ratio = 1.0f) {
+    matchDescriptors(desc_a.data(), desc_a.size()/MATCH_DESC_SIZE, desc_b.data(), desc_b.size()/MATCH_DESC_SIZE, matches, ratio);
+}
+
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <stdint.h>
+
+//Fused network input preprocessing: bilinear resize, uint8 to float, scaling and HWC to CHW in one pass.
+namespace Swarm {
+
+//src is a channels (1 or 3, BGR) uint8 image of src_width x src_height with src_step bytes per row.
+//Resize with the same sampling as cv::INTER_LINEAR to width x height, multiply by scale and write
+//planar channels to dst (RGB plane order for 3 channel input). dst must hold width*height*channels floats.
+void preprocessImage(const uint8_t * src, int src_width, int src_height, size_t src_step, int channels,
+    int width, int height, float scale, float * dst);
+
+//src must be CV_8UC1 or CV_8UC3
+inline void preprocessImage(const cv::Mat & src, int width, int height, float scale, float * dst) {
+    assert(src.depth() == CV_8U && (src.channels() == 1 || src.channels() == 3) && "Only support 8 bit 1 or 3 channel images");
+    preprocessImage(src.data, src.cols, src.rows, src.step, src.channels(), width, height, scale, dst);
+}
+
+}
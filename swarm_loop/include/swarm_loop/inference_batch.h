@@ -0,0 +1,47 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+//CPU side of batched network inference. Kept free of TensorRT so it can be driven by a mock engine.
+namespace Swarm {
+
+//Call run_batch(start, batch) for consecutive chunks of at most max_batch of the num inputs
+template<typename F>
+void splitBatches(int num, int max_batch, F run_batch) {
+    if (max_batch < 1) {
+        max_batch = 1;
+    }
+    for (int start = 0; start < num; start += max_batch) {
+        run_batch(start, std::min(max_batch, num - start));
+    }
+}
+
+//Pack inputs[start, start+batch) of CV_32F images into a contiguous planar (NCHW, RGB) buffer,
+//each image takes input_size floats
+inline void packImageBatch(const std::vector<cv::Mat> & inputs, int start, int batch, uint64_t input_size, float * dst) {
+    for (int i = 0; i < batch; i ++) {
+        const cv::Mat & input = inputs[start + i];
+        float * img_dst = dst + i * input_size;
+        int plane = input.rows*input.cols;
+        assert(input.depth() == CV_32F && input.total()*input.channels() == input_size && "Input image must match network input");
+        if (input.channels() == 1) {
+            if (input.isContinuous()) {
+                memcpy(img_dst, input.data, plane*sizeof(float));
+            } else {
+                for (int r = 0; r < input.rows; r ++) {
+                    memcpy(img_dst + r*input.cols, input.ptr<float>(r), input.cols*sizeof(float));
+                }
+            }
+        } else {
+            cv::Mat bgr[3] = {
+                cv::Mat(input.rows, input.cols, CV_32F, img_dst + plane*2),
+                cv::Mat(input.rows, input.cols, CV_32F, img_dst + plane),
+                cv::Mat(input.rows, input.cols, CV_32F, img_dst)
+            };
+            cv::split(input, bgr);
+        }
+    }
+}
+
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+
+//Asynchronous inference scheduling. Kept free of CUDA so it can be driven by a fake executor on CPU.
+namespace Swarm {
+
+//Backend of InferencePipeline. A slot is one set of input/output host buffers with its own stream,
+//slots run independently so filling one slot overlaps with the compute of the others.
+class InferenceExecutor {
+public:
+    virtual int slotNum() const = 0;
+    virtual float * slotInput(int slot) = 0;
+    virtual std::vector<float*> slotOutputs(int slot) = 0;
+    //Launch copy in, execute and copy out on the slot, must not block
+    virtual void enqueueSlot(int slot, int batch) = 0;
+    //Block until the work launched on the slot is finished
+    virtual void synchronizeSlot(int slot) = 0;
+    virtual ~InferenceExecutor() {}
+};
+
+//Ping-pong slots over an executor. submit preprocesses into a free slot on the caller thread and enqueues it,
+//a completion thread waits for the slot, runs the postprocess and fulfills the returned future.
+class InferencePipeline {
+    InferenceExecutor * executor;
+    std::vector<bool> slot_busy;
+    int next_slot = 0;
+    std::queue<std::pair<int, std::function<void()>>> inflight;
+    std::mutex pipeline_lock;
+    std::condition_variable pipeline_cv;
+    bool running = true;
+    std::thread completion_thread;
+
+    void completion_loop() {
+        while (true) {
+            std::pair<int, std::function<void()>> job;
+            {
+                std::unique_lock<std::mutex> lock(pipeline_lock);
+                pipeline_cv.wait(lock, [&] { return !inflight.empty() || !running; });
+                if (inflight.empty()) {
+                    return;
+                }
+                job = inflight.front();
+                inflight.pop();
+            }
+
+            executor->synchronizeSlot(job.first);
+            job.second();
+
+            {
+                std::lock_guard<std::mutex> lock(pipeline_lock);
+                slot_busy[job.first] = false;
+            }
+            pipeline_cv.notify_all();
+        }
+    }
+
+public:
+    InferencePipeline(InferenceExecutor * _executor):
+        executor(_executor), slot_busy(_executor->slotNum(), false) {
+        completion_thread = std::thread(&InferencePipeline::completion_loop, this);
+    }
+
+    ~InferencePipeline() {
+        {
+            std::lock_guard<std::mutex> lock(pipeline_lock);
+            running = false;
+        }
+        pipeline_cv.notify_all();
+        completion_thread.join();
+    }
+
+    //preprocess(slot_input) runs on the caller thread, postprocess(slot_outputs) runs on the completion thread
+    template<typename T>
+    std::future<T> submit(std::function<void(float*)> preprocess, std::function<T(const std::vector<float*> &)> postprocess, int batch = 1) {
+        int slot;
+        {
+            std::unique_lock<std::mutex> lock(pipeline_lock);
+            slot = next_slot;
+            next_slot = (next_slot + 1) % slot_busy.size();
+            pipeline_cv.wait(lock, [&] { return !slot_busy[slot]; });
+            slot_busy[slot] = true;
+        }
+
+        preprocess(executor->slotInput(slot));
+        executor->enqueueSlot(slot, batch);
+
+        auto promise = std::make_shared<std::promise<T>>();
+        auto outputs = executor->slotOutputs(slot);
+        {
+            std::lock_guard<std::mutex> lock(pipeline_lock);
+            inflight.emplace(slot, [promise, postprocess, outputs] () {
+                try {
+                    promise->set_value(postprocess(outputs));
+                } catch (...) {
+                    promise->set_exception(std::current_exception());
+                }
+            });
+        }
+        pipeline_cv.notify_all();
+        return promise->get_future();
+    }
+};
+
+}
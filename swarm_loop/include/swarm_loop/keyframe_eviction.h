@@ -0,0 +1,81 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <map>
+#include <set>
+#include <vector>
+#include <stdint.h>
+#include <tuple>
+
+//Bookkeeping of the keyframes held by LoopDetector so the database stays within a memory budget.
+//Free of ROS and faiss so the policy can be driven by a synthetic stream.
+
+enum KeyframeEvictionPolicy {
+    //Evict the keyframe which is the longest time not added or matched
+    EVICT_LRU = 0,
+    //Evict the least recently used keyframe which has another keyframe of the same drone in its voxel, LRU if there is none
+    EVICT_SPATIAL = 1
+};
+
+class KeyframeEvictor {
+    struct Entry {
+        int drone_id;
+        Eigen::Vector3i voxel;
+        size_t bytes;
+        uint64_t last_used;
+    };
+
+    struct VoxelKey {
+        int drone_id;
+        int x, y, z;
+        bool operator<(const VoxelKey & k) const {
+            return std::tie(drone_id, x, y, z) < std::tie(k.drone_id, k.x, k.y, k.z);
+        }
+    };
+
+    std::map<int64_t, Entry> entries;
+    //(last_used, msg_id), oldest first
+    std::set<std::pair<uint64_t, int64_t>> lru;
+    std::map<VoxelKey, int> voxel_count;
+    size_t total_bytes = 0;
+    uint64_t clock = 0;
+
+    VoxelKey voxel_key(const Entry & e) const {
+        return VoxelKey{e.drone_id, e.voxel.x(), e.voxel.y(), e.voxel.z()};
+    }
+
+    bool over_budget() const;
+
+public:
+    //0 for unlimited
+    size_t max_bytes = 0;
+    int max_frames = 0;
+    KeyframeEvictionPolicy policy = EVICT_LRU;
+    double spatial_radius = 1.0;
+
+    KeyframeEvictor() {}
+    KeyframeEvictor(size_t _max_bytes, int _max_frames, KeyframeEvictionPolicy _policy, double _spatial_radius):
+        max_bytes(_max_bytes), max_frames(_max_frames), policy(_policy), spatial_radius(_spatial_radius) {}
+
+    void add(int64_t msg_id, int drone_id, const Eigen::Vector3d & pos, size_t bytes);
+
+    //Mark the keyframe as used, e.g. it was matched in a loop
+    void touch(int64_t msg_id);
+
+    void remove(int64_t msg_id);
+
+    //Keyframes to drop to get back within the budget, they are already removed from the evictor
+    std::vector<int64_t> evict();
+
+    bool contains(int64_t msg_id) const {
+        return entries.find(msg_id) != entries.end();
+    }
+
+    size_t bytes() const {
+        return total_bytes;
+    }
+
+    size_t size() const {
+        return entries.size();
+    }
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+//Keypoint selection on the SuperPoint heatmap. Kept free of torch so it can be benchmarked alone.
+namespace Swarm {
+
+#define SP_NMS_CELL 8
+
+//Keep the pixels above threshold which are the maximum of their (2*radius+1)^2 window, ties go to the first in row-major order.
+//The heatmap is walked per SP_NMS_CELL x SP_NMS_CELL cell and cells whose maximum is below threshold are skipped.
+//At most max_num keypoints are returned, sorted by confidence. With bucket_num > 0 the image is split into
+//bucket_num x bucket_num buckets, each bucket gets an equal share of max_num and unused share goes to the best remaining ones.
+//Scratch memory is kept per thread, so there is no allocation after the first frame.
+void gridNMS(const float * prob, int width, int height, float threshold, int radius, int max_num,
+    std::vector<cv::Point2f> & keypoints, int bucket_num = 0);
+
+//The original full-image NMS, code is modified from https://github.com/KinglittleQ/SuperPoint_SLAM
+//Kept as reference for loop_nms_test.
+void NMS2(std::vector<cv::Point2f> det, cv::Mat conf, std::vector<cv::Point2f>& pts,
+            int border, int dist_thresh, int img_width, int img_height, int max_num);
+}
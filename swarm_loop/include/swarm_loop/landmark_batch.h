@@ -0,0 +1,42 @@
+#pragma once
+
+#include <swarm_msgs/ImageDescriptor_t.hpp>
+#include "swarm_loop/descriptor_codec.h"
+#include <stdint.h>
+#include <vector>
+
+//Packed landmarks of an image descriptor sent on LANDMARK_BATCH_CHANNEL, instead of one LandmarkDescriptor_t per landmark.
+//A chunk is a fixed header followed by landmark_num packed landmarks, little endian:
+//  uint32 magic, uint8 version, uint8 desc_format, uint16 desc_len, int32 drone_id, int64 header_id,
+//  uint16 seq, uint16 chunk_num, uint16 landmark_num
+//  landmark: int8 flag, float32 2d_norm[2], float32 2d[2], float32 3d[3], descriptor in desc_format (DescFormat)
+#define LANDMARK_BATCH_CHANNEL "VIOKF_LM_BATCH"
+#define LANDMARK_BATCH_MAGIC 0x544d4c42
+#define LANDMARK_BATCH_VERSION 1
+#define LANDMARK_BATCH_HEADER_SIZE 26
+//LCM sends a message in a single datagram up to 1435 bytes including its own header and the channel name
+#define LANDMARK_BATCH_DEFAULT_BYTES 1400
+
+struct LandmarkBatchInfo {
+    int drone_id = -1;
+    int64_t header_id = 0;
+    int seq = 0;
+    int chunk_num = 0;
+    int landmark_num = 0;
+    int desc_len = 0;
+    int desc_format = DESC_FLOAT32;
+};
+
+//Bytes of a packed landmark with a descriptor of desc_len
+int landmark_batch_entry_size(int desc_len, int desc_format = DESC_FLOAT32);
+
+//Split the landmarks of img_des with a flag (all of them with send_all) into chunks of at most max_bytes,
+//numbered by seq from 0. The chunks are keyed by img_des.msg_id as the header.
+std::vector<std::vector<uint8_t>> encode_landmark_batches(const swarm_msgs::ImageDescriptor_t & img_des, bool send_all,
+    int max_bytes = LANDMARK_BATCH_DEFAULT_BYTES, int desc_format = DESC_FLOAT32);
+
+//Read the header of a chunk, false if it is not a valid chunk
+bool parse_landmark_batch(const void * data, int size, LandmarkBatchInfo & info);
+
+//Append the landmarks of a valid chunk to the landmark fields and feature_descriptor of img_des, decoded to float
+void append_landmark_batch(const void * data, int size, swarm_msgs::ImageDescriptor_t & img_des);
@@ -7,6 +7,8 @@
 #include <camodocal/camera_models/Camera.h>
 #include <camodocal/camera_models/PinholeCamera.h>
 #include <functional>
+#include <mutex>
+#include <thread>
 #include <vins/VIOKeyframe.h>
 #include <swarm_msgs/ImageDescriptor_t.hpp>
 #include <swarm_msgs/FisheyeFrameDescriptor_t.hpp>
@@ -15,9 +17,14 @@
 #include <vins/FlattenImages.h>
 #include "superpoint_tensorrt.h"
 #include "mobilenetvlad_tensorrt.h"
+#include "superpoint_onnx.h"
+#include "mobilenetvlad_onnx.h"
 #include <message_filters/subscriber.h>
 #include <message_filters/time_synchronizer.h>
 #include <swarm_loop/utils.h>
+#include <swarm_loop/pipeline_stage.h>
+#include <memory>
+#include <future>
 
 //#include <swarm_loop/HFNetSrv.h>
 
@@ -32,6 +39,10 @@ struct StereoFrame{
     std::vector<cv::Mat> left_images, right_images, depth_images;
     geometry_msgs::Pose pose_drone;
     std::vector<geometry_msgs::Pose> left_extrisincs, right_extrisincs;
+    //Fills the images from the received messages, see load_images
+    std::function<void(StereoFrame &)> image_loader;
+    //Keep alive the messages the images share their data with
+    std::vector<cv_bridge::CvImageConstPtr> image_handles;
 
     StereoFrame():stamp(0) {
 
@@ -59,21 +70,38 @@ struct StereoFrame{
         keyframe_id = generate_keyframe_id(_stamp, self_id);
     }
 
-    StereoFrame(vins::FlattenImages vins_flatten, int self_id):
-        stamp(vins_flatten.header.stamp) {
-        for (int i = 1; i < vins_flatten.up_cams.size(); i++) {
-            left_extrisincs.push_back(vins_flatten.extrinsic_up_cams[i]);
-            right_extrisincs.push_back(vins_flatten.extrinsic_down_cams[i]);
-            
-            auto _l = getImageFromMsg(vins_flatten.up_cams[i]);
-            auto _r = getImageFromMsg(vins_flatten.down_cams[i]);
-
-            left_images.push_back(_l->image);
-            right_images.push_back(_r->image);
+    //The images stay in the message until load_images
+    StereoFrame(const vins::FlattenImagesConstPtr & vins_flatten, int self_id):
+        stamp(vins_flatten->header.stamp) {
+        for (int i = 1; i < vins_flatten->up_cams.size(); i++) {
+            left_extrisincs.push_back(vins_flatten->extrinsic_up_cams[i]);
+            right_extrisincs.push_back(vins_flatten->extrinsic_down_cams[i]);
         }
+        left_images.resize(left_extrisincs.size());
+        right_images.resize(right_extrisincs.size());
+        image_loader = [vins_flatten] (StereoFrame & frame) {
+            for (int i = 1; i < vins_flatten->up_cams.size(); i++) {
+                frame.share_image(frame.left_images[i-1], vins_flatten->up_cams[i], vins_flatten);
+                frame.share_image(frame.right_images[i-1], vins_flatten->down_cams[i], vins_flatten);
+            }
+        };
 
         keyframe_id = generate_keyframe_id(stamp, self_id);
     }
+
+    void share_image(cv::Mat & image, const sensor_msgs::Image & msg, const boost::shared_ptr<void const> & tracked_object) {
+        auto ptr = getImageShareFromMsg(msg, tracked_object);
+        image_handles.push_back(ptr);
+        image = ptr->image;
+    }
+
+    //Convert the images once the frame is chosen as keyframe, most frames are dropped before
+    void load_images() {
+        if (image_loader) {
+            image_loader(*this);
+            image_loader = nullptr;
+        }
+    }
 };
 
 class LoopCam {
@@ -85,12 +113,25 @@ class LoopCam {
     ros::ServiceClient superpoint_client;
     CameraConfig camera_configuration;
     std::fstream fsp;
+    std::mutex fsp_lock;
+    //Each extraction worker owns one copy of the networks, directions of a frame are split among workers
+    int extraction_threads = 1;
 #ifdef USE_TENSORRT
-    Swarm::SuperPointTensorRT superpoint_net;
-    Swarm::MobileNetVLADTensorRT netvlad_net;
+    std::vector<std::unique_ptr<Swarm::SuperPointTensorRT>> superpoint_nets;
+    std::vector<std::unique_ptr<Swarm::MobileNetVLADTensorRT>> netvlad_nets;
+#elif defined(USE_ONNX)
+    std::vector<std::unique_ptr<Swarm::SuperPointONNX>> superpoint_nets;
+    std::vector<std::unique_ptr<Swarm::MobileNetVLADONNX>> netvlad_nets;
 #endif
+    //Long lived threads of the workers 1.., worker 0 is the caller. Declared after the nets so they stop first
+    std::vector<std::unique_ptr<PipelineStage<std::function<void()>>>> extraction_workers;
 
     bool send_img;
+
+    ImageDescriptor_t prepare_img_desc(ros::Time stamp, cv::Mat & img);
+#if defined(USE_TENSORRT) || defined(USE_ONNX)
+    void fill_img_desc_deepnet(ImageDescriptor_t & img_des, cv::Mat img, const std::vector<cv::Point2f> & features, int worker_id);
+#endif
 public:
 
     bool show = false;
@@ -101,18 +142,21 @@ public:
         std::string _pca_comp,
         std::string _pca_mean,
         double thres, int max_kp_num, const std::string & netvlad_model, int width, int height, 
-        int self_id, bool _send_img, ros::NodeHandle & nh);
+        int self_id, bool _send_img, ros::NodeHandle & nh, int _extraction_threads = 1);
     
-    ImageDescriptor_t extractor_img_desc_deepnet(ros::Time stamp, cv::Mat img, bool superpoint_mode=false);
+    ImageDescriptor_t extractor_img_desc_deepnet(ros::Time stamp, cv::Mat img, bool superpoint_mode=false, int worker_id=0);
     
-    ImageDescriptor_t generate_stereo_image_descriptor(const StereoFrame & msg, cv::Mat & img, const int & vcam_id, cv::Mat &_show);
-    ImageDescriptor_t generate_gray_depth_image_descriptor(const StereoFrame & msg, cv::Mat & img, const int & vcam_id, cv::Mat &_show);
+    void extractor_stereo_desc_deepnet(ros::Time stamp, cv::Mat img_up, cv::Mat img_down, 
+        ImageDescriptor_t & ides_up, ImageDescriptor_t & ides_down, int worker_id=0);
+
+    ImageDescriptor_t generate_stereo_image_descriptor(const StereoFrame & msg, cv::Mat & img, const int & vcam_id, cv::Mat &_show, int worker_id=0);
+    ImageDescriptor_t generate_gray_depth_image_descriptor(const StereoFrame & msg, cv::Mat & img, const int & vcam_id, cv::Mat &_show, int worker_id=0);
     
     FisheyeFrameDescriptor_t on_flattened_images(const StereoFrame & msg, std::vector<cv::Mat> & imgs);
 
     void encode_image(const cv::Mat & _img, ImageDescriptor_t & _img_desc);
     
-    void match_HFNet_local_features(std::vector<cv::Point2f> & pts_up, std::vector<cv::Point2f> & pts_down, std::vector<float> _desc_up, std::vector<float> _desc_down, 
+    void match_HFNet_local_features(std::vector<cv::Point2f> & pts_up, std::vector<cv::Point2f> & pts_down, const std::vector<float> & _desc_up, const std::vector<float> & _desc_down, 
         std::vector<int> & ids_up, std::vector<int> & ids_down);
 
     CameraPtr cam;
@@ -61,6 +61,9 @@ extern int ACCEPT_MIN_3D_PTS;
 
 #define RPERR_THRES 10*DEG2RAD
 
+//Loop ids are self_id*MAX_LOOP_ID + loop count
+#define MAX_LOOP_ID 100000000
+
 extern double DEPTH_NEAR_THRES;
 extern double DEPTH_FAR_THRES;
 
@@ -80,6 +83,7 @@ extern double loop_cov_pos;
 extern double loop_cov_ang;
 
 extern double DETECTOR_MATCH_THRES;
+extern double DETECTOR_MATCH_RATIO;
 
 extern double odometry_consistency_threshold;
 
@@ -107,6 +111,23 @@ extern int height;
 extern int inter_drone_init_frames;
 
 extern bool is_4dof;
+
+extern int ONNX_NUM_THREADS;
+extern int SUPERPOINT_NMS_BUCKETS;
+extern double KEYFRAME_DB_MAX_MB;
+extern int KEYFRAME_DB_MAX_FRAMES;
+extern int KEYFRAME_DB_EVICTION;
+extern double KEYFRAME_DB_SPATIAL_RADIUS;
+extern std::string LOOP_INDEX_FACTORY;
+extern std::string LOOP_INDEX_SEARCH_PARAMS;
+extern int LOOP_INDEX_TRAIN_SIZE;
+extern double LOOP_INDEX_REBUILD_STALE;
+extern int LOOP_CANDIDATE_NUM;
+extern int LOOP_VERIFY_THREADS;
+extern int PNP_SOLVER;
+extern double PNP_PROSAC_THRES;
+extern int LANDMARK_BATCH_BYTES;
+extern int DESC_WIRE_FORMAT;
     
 enum CameraConfig{
     STEREO_PINHOLE = 0,
@@ -8,11 +8,14 @@
 #include "swarm_loop/loop_defines.h"
 #include <swarm_loop/loop_cam.h>
 #include <functional>
+#include <atomic>
+#include <thread>
 #include <swarm_msgs/Pose.h>
 #include <swarm_msgs/FisheyeFrameDescriptor_t.hpp>
 #include <swarm_msgs/swarm_types.hpp>
+#include "swarm_loop/keyframe_eviction.h"
+#include "swarm_loop/descriptor_index.h"
 #ifdef USE_DEEPNET
-#include <faiss/IndexFlat.h>
 #else
 #include <DBoW3/DBoW3.h>
 #endif
@@ -21,27 +24,48 @@ using namespace swarm_msgs;
 
 #define REMOTE_MAGIN_NUMBER 1000000
 
+struct LoopCandidate {
+    int64_t msg_id;
+    int direction_new;
+    int direction_old;
+    double distance;
+};
+
 class LoopDetector {
 
 protected:
-    faiss::IndexFlatIP local_index;
-
-    faiss::IndexFlatIP remote_index;
+    //Image ids are never reused, so keyframes can be removed from the indexes
+    DescriptorIndex local_index;
+    DescriptorIndex remote_index;
+    int64_t local_index_next_id = 0;
+    int64_t remote_index_next_id = 0;
 
     std::map<int, int64_t> imgid2fisheye;
     std::map<int, int> imgid2dir;
+    std::map<int64_t, std::vector<int>> fisheye2imgids;
     std::map<int, std::map<int, int>> inter_drone_loop_count;
 
     std::map<int64_t, FisheyeFrameDescriptor_t> fisheyeframe_database;
 
     std::map<int64_t, std::vector<cv::Mat>> msgid2cvimgs;
+
+    KeyframeEvictor evictor;
     
     double t0 = -1;
     int loop_count = 0;
     
     bool compute_loop(const FisheyeFrameDescriptor_t & new_fisheye_desc, const FisheyeFrameDescriptor_t & old_fisheye_desc,
         int main_dir_new, int main_dir_old,
-        std::vector<cv::Mat> img_new, std::vector<cv::Mat> img_old, LoopEdge & ret, bool init_mode=false);
+        std::vector<cv::Mat> img_new, std::vector<cv::Mat> img_old, LoopEdge & ret, bool init_mode=false,
+        const std::atomic<bool> * cancelled = nullptr);
+
+    //Number the verified loop and count it for init mode
+    void commit_loop(LoopEdge & ret);
+
+    //Verify the candidates, best ranked first, with LOOP_VERIFY_THREADS workers, stops once one passes.
+    //Return the index of the verified candidate and its loop in ret, -1 if none passes
+    int verify_loop_candidates(const FisheyeFrameDescriptor_t & flatten_desc, const std::vector<cv::Mat> & imgs,
+        const std::vector<LoopCandidate> & candidates, bool init_mode, LoopEdge & ret);
 
     bool compute_correspond_features(const ImageDescriptor_t & new_img_desc, const ImageDescriptor_t & old_img_desc, 
         std::vector<cv::Point2f> &new_norm_2d,
@@ -49,7 +73,9 @@ protected:
         std::vector<int> &new_idx,
         std::vector<cv::Point2f> &old_norm_2d,
         std::vector<cv::Point3f> &old_3d,
-        std::vector<int> &old_idx
+        std::vector<int> &old_idx,
+        //Descriptor distance of each correspondence
+        std::vector<float> &scores
     );
 
     bool compute_correspond_features(const FisheyeFrameDescriptor_t & new_img_desc, const FisheyeFrameDescriptor_t & old_img_desc, 
@@ -61,6 +87,7 @@ protected:
         std::vector<cv::Point2f> &old_norm_2d,
         std::vector<cv::Point3f> &old_3d,
         std::vector<std::vector<int>> &old_idx,
+        std::vector<float> &scores,
         std::vector<int> &dirs_new,
         std::vector<int> &dirs_old,
         std::map<int, std::pair<int, int>> &index2dirindex_new,
@@ -73,6 +100,8 @@ protected:
 
         const std::vector<cv::Point2f> old_norm_2d,
         const std::vector<cv::Point3f> old_3d,
+        //Descriptor distance of the correspondences, ranks them for PROSAC
+        const std::vector<float> & scores,
 
         Swarm::Pose old_extrinsic,
         Swarm::Pose drone_pose_now,
@@ -86,9 +115,17 @@ protected:
 
     int add_to_database(const FisheyeFrameDescriptor_t & new_fisheye_desc);
     int add_to_database(const ImageDescriptor_t & new_img_desc);
-    FisheyeFrameDescriptor_t & query_fisheyeframe_from_database(const FisheyeFrameDescriptor_t & new_img_desc, bool init_mode, bool nonkeyframe, int & direction_new, int & direction_old);
-    int query_from_database(const ImageDescriptor_t & new_img_desc, bool init_mode, bool nonkeyframe, double & distance);
-    int query_from_database(const ImageDescriptor_t & new_img_desc, faiss::IndexFlatIP & index, bool remote_db, double thres, int max_index, double & distance);
+    //Up to max_num keyframes matching the new frame, best first. With max_num 1 only the main direction is queried
+    std::vector<LoopCandidate> query_loop_candidates(const FisheyeFrameDescriptor_t & new_img_desc, bool init_mode, bool nonkeyframe, int max_num);
+    //Append the (image id, distance) passing the threshold, best first
+    void query_from_database(const ImageDescriptor_t & new_img_desc, bool init_mode, bool nonkeyframe, std::vector<std::pair<int, double>> & results);
+    void query_from_database(const ImageDescriptor_t & new_img_desc, const DescriptorIndex & index, bool remote_db, double thres, int max_index, std::vector<std::pair<int, double>> & results);
+
+    //Add the keyframe with its images to the database and evict to the budget
+    void add_keyframe(const FisheyeFrameDescriptor_t & flatten_desc, const std::vector<cv::Mat> & imgs);
+
+    //Drop the keyframes chosen by evictor from the maps and the faiss indexes
+    void evict_from_database();
 
 
     std::set<int> all_nodes;
@@ -7,9 +7,10 @@
 #include <lcm/lcm-cpp.hpp>
 #include <swarm_msgs/ImageDescriptor_t.hpp>
 #include "swarm_loop/loop_defines.h"
+#include "swarm_loop/packet_reassembler.h"
+#include "swarm_loop/msg_dedup.h"
 #include <swarm_msgs/swarm_lcm_converter.hpp>
 #include <functional>
-#include <set>
 #include <swarm_msgs/ImageDescriptorHeader_t.hpp>
 #include <swarm_msgs/LandmarkDescriptor_t.hpp>
 #include <swarm_msgs/FisheyeFrameDescriptor_t.hpp>
@@ -20,38 +21,66 @@ using namespace swarm_msgs;
 class LoopNet {
     lcm::LCM lcm;
 
-    std::set<int64_t> sent_message;
+    MsgSequence msg_seq;
+    SlidingWindowDedup sent_message;
+    //Loop ids are self_id*MAX_LOOP_ID + loop count, see LoopDetector::commit_loop
+    SlidingWindowDedup sent_loops;
+    //Messages are sent from the broadcast and detection threads while LCM receives on its own
+    std::mutex sent_lock;
+
+    void mark_sent(int64_t _id) {
+        std::lock_guard<std::mutex> lk(sent_lock);
+        sent_message.mark(_id);
+    }
+
+    bool is_sent(int64_t _id) {
+        std::lock_guard<std::mutex> lk(sent_lock);
+        return sent_message.contains(_id);
+    }
+
+    void mark_loop_sent(int64_t _id) {
+        std::lock_guard<std::mutex> lk(sent_lock);
+        sent_loops.mark(_id / MAX_LOOP_ID, _id % MAX_LOOP_ID);
+    }
+
+    bool is_loop_sent(int64_t _id) {
+        std::lock_guard<std::mutex> lk(sent_lock);
+        return sent_loops.contains(_id / MAX_LOOP_ID, _id % MAX_LOOP_ID);
+    }
 
     double recv_period;
 
     std::mutex recv_lock;
+    PacketReassembler reassembler;
+
+    void on_image_reassembled(const ImageDescriptor_t & image, int announced);
+
+    //Frames finished under recv_lock, delivered to frame_desc_callback after it is released,
+    //so a callback waiting for a full queue doesn't stall the reassembly
+    std::vector<FisheyeFrameDescriptor_t> finished_frames;
+    //Keeps the frames delivered one at a time and in order
+    std::mutex deliver_lock;
+
+    void deliver_frames();
 
     bool send_img;
     bool send_whole_img_desc;
 
 public:
     LoopNet(std::string _lcm_uri, bool _send_img, bool _send_whole_img_desc, double _recv_period = 0.5):
-        lcm(_lcm_uri), send_img(_send_img), send_whole_img_desc(_send_whole_img_desc), recv_period(_recv_period) {
+        lcm(_lcm_uri), send_img(_send_img), send_whole_img_desc(_send_whole_img_desc), recv_period(_recv_period),
+        reassembler(_recv_period, MIN_DIRECTION_LOOP) {
         this->setup_network(_lcm_uri);
         msg_recv_rate_callback = [&](const int, float) {};
     }
 
-    std::map<int64_t, ImageDescriptor_t> received_images;
-    std::map<int64_t, double> msg_recv_last_time;
-
-    std::map<int64_t, double> msg_header_recv_time;
-    std::map<int64_t, double> frame_header_recv_time;
-    
-    std::set<int64_t> active_receving_msg;
-    std::set<int64_t> active_receving_frames;
-    std::set<int64_t> blacklist;
-    std::map<int64_t, FisheyeFrameDescriptor_t> received_frames;
+    //Images finished by the reassembler, late packets of them are dropped
+    SlidingWindowDedup blacklist;
 
     std::function<void(const FisheyeFrameDescriptor_t &)> frame_desc_callback;
     std::function<void(const LoopEdge_t &)> loopconn_callback;
     std::function<void(const int, float)> msg_recv_rate_callback;
 
-    void image_desc_callback(const ImageDescriptor_t & image);
     void setup_network(std::string _lcm_uri);
     void broadcast_img_desc(ImageDescriptor_t & img_des);
     void broadcast_fisheye_desc(FisheyeFrameDescriptor_t & fisheye_desc);
@@ -74,15 +103,21 @@ public:
                 const std::string& chan, 
                 const LandmarkDescriptor_t* msg);
 
+    void on_landmark_batch_recevied(const lcm::ReceiveBuffer* rbuf,
+                const std::string& chan);
+
+    void on_quantized_header_recevied(const lcm::ReceiveBuffer* rbuf,
+                const std::string& chan);
+
     int lcm_handle() {
         return lcm.handle();
     }
 
-    void update_recv_img_desc_ts(int64_t id, bool is_header=false);
-
+    //Finish the images and frames timed out, called by a timer
     void scan_recv_packets();
 
+    //Called under recv_lock, the reassembler adds finished images to blacklist from the timer
     bool msg_blocked(int64_t _id) {
-        return blacklist.find(_id) != blacklist.end() || sent_message.find(_id) != sent_message.end();
+        return blacklist.contains(_id) || is_sent(_id);
     }
 };
@@ -0,0 +1,28 @@
+#pragma once
+
+#ifdef USE_ONNX
+#include "swarm_loop/onnx_generic.h"
+namespace Swarm {
+class MobileNetVLADONNX: public ONNXInferenceGeneric {
+public:
+    bool enable_perf;
+    const int descriptor_size = 4096;
+    MobileNetVLADONNX(std::string engine_path, int _width, int _height, int _num_threads = 4, bool _enable_perf = false) : 
+        ONNXInferenceGeneric("image:0", _width, _height, _num_threads), enable_perf(_enable_perf) {
+        ONNXTensorInfo outputTensorDesc;
+        outputTensorDesc.blobName = "descriptor:0";
+        outputTensorDesc.volume = descriptor_size;
+        outputTensorDesc.shape = {1, descriptor_size};
+        //Exported from tensorflow, input is NHWC
+        m_InputShape = {1, height, width, 1};
+        m_InputSize = height*width;
+        m_OutputTensors.push_back(outputTensorDesc);
+        std::cout << "Trying to init ONNX model of MobileNetVLADONNX" << std::endl;
+
+        init(engine_path);
+    }
+
+    std::vector<float> inference(const cv::Mat & input);
+};
+}
+#endif
@@ -7,7 +7,8 @@ class MobileNetVLADTensorRT: public TensorRTInferenceGeneric {
 public:
     bool enable_perf;
     const int descriptor_size = 4096;
-    MobileNetVLADTensorRT(std::string engine_path, int _width, int _height, bool _enable_perf = false) : TensorRTInferenceGeneric("image:0", _width, _height), enable_perf(_enable_perf) {
+    MobileNetVLADTensorRT(std::string engine_path, int _width, int _height, bool _enable_perf = false, int _batch_size = 1) : 
+        TensorRTInferenceGeneric("image:0", _width, _height, _batch_size), enable_perf(_enable_perf) {
         TensorInfo outputTensorDesc;
         outputTensorDesc.blobName = "descriptor:0";
         outputTensorDesc.volume = descriptor_size;
@@ -19,6 +20,10 @@ public:
     }
 
     std::vector<float> inference(const cv::Mat & input);
+
+    std::vector<std::vector<float>> inference(const std::vector<cv::Mat> & inputs);
+
+    std::future<std::vector<float>> inferenceAsync(const cv::Mat & input);
 };
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+#include <chrono>
+#include <atomic>
+
+//Message ids shared between drones: the sender drone id in the high bits and a sequence number of MSG_ID_SEQ_BITS.
+//The sequence starts from the clock in microseconds, so it keeps increasing over restarts of a drone.
+#define MSG_ID_SEQ_BITS 40
+#define MSG_ID_SEQ_MASK ((1LL << MSG_ID_SEQ_BITS) - 1)
+#define DEDUP_DEFAULT_WINDOW 4096
+
+inline int64_t make_msg_id(int drone_id, int64_t seq) {
+    return ((int64_t) drone_id << MSG_ID_SEQ_BITS) | (seq & MSG_ID_SEQ_MASK);
+}
+
+inline int msg_id_drone(int64_t id) {
+    return id >> MSG_ID_SEQ_BITS;
+}
+
+inline int64_t msg_id_seq(int64_t id) {
+    return id & MSG_ID_SEQ_MASK;
+}
+
+class MsgSequence {
+    std::atomic<int64_t> seq;
+public:
+    MsgSequence() {
+        auto now = std::chrono::system_clock::now().time_since_epoch();
+        seq = std::chrono::duration_cast<std::chrono::microseconds>(now).count() & MSG_ID_SEQ_MASK;
+    }
+
+    int64_t next_id(int drone_id) {
+        return make_msg_id(drone_id, seq ++);
+    }
+};
+
+//Sequence numbers seen from each sender, kept for the newest window_size numbers of the sender in a ring bitmap.
+//Numbers older than the window count as seen, so late duplicates are dropped.
+//Sequence numbers wrap at seq_bits, compared by serial number arithmetic (RFC 1982).
+//O(1) per operation and window_size/8 bytes per sender.
+class SlidingWindowDedup {
+    struct Window {
+        int64_t head = -1;
+        std::vector<uint64_t> bits;
+    };
+    int window_size;
+    int seq_bits;
+    std::unordered_map<int, Window> windows;
+
+    //seq - head in (-2^(seq_bits-1), 2^(seq_bits-1)]
+    int64_t serial_diff(int64_t seq, int64_t head) const {
+        int shift = 64 - seq_bits;
+        return (int64_t) ((uint64_t) (seq - head) << shift) >> shift;
+    }
+
+    int64_t slot(int64_t seq) const {
+        return seq & (window_size - 1);
+    }
+
+    bool test(const Window & w, int64_t seq) const {
+        return (w.bits[slot(seq) / 64] >> (slot(seq) % 64)) & 1;
+    }
+
+    void set(Window & w, int64_t seq, bool v) {
+        uint64_t mask = 1ULL << (slot(seq) % 64);
+        if (v) {
+            w.bits[slot(seq) / 64] |= mask;
+        } else {
+            w.bits[slot(seq) / 64] &= ~mask;
+        }
+    }
+
+public:
+    //window_size is rounded up to a power of 2 of at least 64
+    SlidingWindowDedup(int _window_size = DEDUP_DEFAULT_WINDOW, int _seq_bits = MSG_ID_SEQ_BITS):
+        window_size(64), seq_bits(_seq_bits) {
+        while (window_size < _window_size) {
+            window_size *= 2;
+        }
+    }
+
+    bool contains(int sender, int64_t seq) const {
+        auto it = windows.find(sender);
+        if (it == windows.end() || it->second.head < 0) {
+            return false;
+        }
+        int64_t d = serial_diff(seq, it->second.head);
+        if (d > 0) {
+            return false;
+        }
+        if (d <= -window_size) {
+            return true;
+        }
+        return test(it->second, seq);
+    }
+
+    //Return false if seq was already seen
+    bool mark(int sender, int64_t seq) {
+        Window & w = windows[sender];
+        if (w.head < 0) {
+            w.bits.assign(window_size / 64, 0);
+            w.head = seq;
+            set(w, seq, true);
+            return true;
+        }
+        int64_t d = serial_diff(seq, w.head);
+        if (d > 0) {
+            //Slide the window, the slots of the numbers skipped over are cleared
+            if (d >= window_size) {
+                std::fill(w.bits.begin(), w.bits.end(), 0);
+            } else {
+                for (int64_t i = 1; i <= d; i ++) {
+                    set(w, w.head + i, false);
+                }
+            }
+            w.head = seq;
+            set(w, seq, true);
+            return true;
+        }
+        if (d <= -window_size || test(w, seq)) {
+            return false;
+        }
+        set(w, seq, true);
+        return true;
+    }
+
+    bool contains(int64_t msg_id) const {
+        return contains(msg_id_drone(msg_id), msg_id_seq(msg_id));
+    }
+
+    bool mark(int64_t msg_id) {
+        return mark(msg_id_drone(msg_id), msg_id_seq(msg_id));
+    }
+
+    int senders() const {
+        return windows.size();
+    }
+
+    int bytes_per_sender() const {
+        return window_size / 8;
+    }
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#ifdef USE_ONNX
+
+#include <onnxruntime_cxx_api.h>
+#include <opencv2/opencv.hpp>
+#include "swarm_loop/image_preprocess.h"
+
+namespace Swarm {
+struct ONNXTensorInfo
+{
+    std::string blobName;
+    float* hostBuffer{nullptr};
+    uint64_t volume{0};
+    std::vector<int64_t> shape;
+};
+
+//CPU counterpart of TensorRTInferenceGeneric, runs the exported ONNX weights with onnxruntime.
+//Input and output tensors are allocated once in init and bound to the session on every run.
+class ONNXInferenceGeneric {
+protected:
+    Ort::Env m_Env;
+    Ort::Session * m_Session = nullptr;
+    Ort::MemoryInfo m_MemoryInfo;
+    Ort::Value m_InputTensor{nullptr};
+    std::vector<Ort::Value> m_OutputValues;
+    std::vector<ONNXTensorInfo> m_OutputTensors;
+    std::vector<int64_t> m_InputShape;
+    float * m_InputBuffer = nullptr;
+    uint64_t m_InputSize;
+    //uint8 inputs are multiplied by m_InputScale
+    float m_InputScale = 1.0;
+    const std::string m_InputBlobName;
+    int m_NumThreads = 4;
+    int width = 400;
+    int height = 208;
+public:
+    ONNXInferenceGeneric(std::string input_blob_name, int _width, int _height, int _num_threads = 4);
+
+    virtual ~ONNXInferenceGeneric();
+
+    //3 channel images are converted to gray for a 1 channel network,
+    //CV_8U images are resized and scaled into the input tensor in one pass by preprocessImage,
+    //CV_32F images are taken as already scaled, other depths are converted by OpenCV
+    virtual void doInference(const cv::Mat & input);
+
+    void allocateBuffers();
+
+    void init(const std::string & onnx_path);
+};
+
+}
+#endif
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <swarm_msgs/ImageDescriptor_t.hpp>
+#include <swarm_msgs/ImageDescriptorHeader_t.hpp>
+#include <swarm_msgs/LandmarkDescriptor_t.hpp>
+#include <swarm_msgs/FisheyeFrameDescriptor_t.hpp>
+#include "swarm_loop/landmark_batch.h"
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+//Deadlines of ids in a min-heap. Cancelled or rescheduled entries stay in the heap and are skipped when popped,
+//so schedule, cancel and expire are O(log n) amortized.
+class DeadlineQueue {
+    typedef std::pair<double, int64_t> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+    std::unordered_map<int64_t, double> deadlines;
+public:
+    void schedule(int64_t id, double deadline) {
+        deadlines[id] = deadline;
+        heap.emplace(deadline, id);
+    }
+
+    void cancel(int64_t id) {
+        deadlines.erase(id);
+    }
+
+    bool contains(int64_t id) const {
+        return deadlines.find(id) != deadlines.end();
+    }
+
+    //Remove and return the ids due at tnow, earliest first
+    std::vector<int64_t> expire(double tnow) {
+        std::vector<int64_t> ids;
+        while (!heap.empty() && heap.top().first <= tnow) {
+            auto entry = heap.top();
+            heap.pop();
+            auto it = deadlines.find(entry.second);
+            if (it != deadlines.end() && it->second == entry.first) {
+                deadlines.erase(it);
+                ids.push_back(entry.second);
+            }
+        }
+        return ids;
+    }
+
+    int size() const {
+        return deadlines.size();
+    }
+};
+
+//Reassembles images from their header and landmark packets, and frames from images, whatever the order of arrival.
+//An image completes once all the landmarks announced by its header arrived, or recv_period after its first packet.
+//A frame completes with min_directions images, or 2 recv_period after the header of its image.
+//Completion is checked for the image a packet belongs to, timeouts by the deadline queues.
+//Not thread safe, LoopNet calls it under recv_lock.
+class PacketReassembler {
+    double recv_period;
+    int min_directions;
+
+    std::unordered_map<int64_t, swarm_msgs::ImageDescriptor_t> images;
+    //Header arrival time of the images whose header is received
+    std::unordered_map<int64_t, double> header_time;
+    std::unordered_map<int64_t, std::vector<bool>> batch_chunks;
+    std::unordered_map<int64_t, swarm_msgs::FisheyeFrameDescriptor_t> frames;
+    DeadlineQueue image_deadlines, frame_deadlines;
+
+    swarm_msgs::ImageDescriptor_t & image_of(int64_t id, double tnow);
+    void check_image(int64_t id, double tnow);
+    void finish_image(int64_t id, double tnow);
+    void add_to_frame(const swarm_msgs::ImageDescriptor_t & image, double t_header);
+    void finish_frame(int64_t frame_hash);
+
+public:
+    PacketReassembler(double _recv_period = 0.5, int _min_directions = 1):
+        recv_period(_recv_period), min_directions(_min_directions) {
+        image_callback = [](const swarm_msgs::ImageDescriptor_t &, int) {};
+        frame_callback = [](const swarm_msgs::FisheyeFrameDescriptor_t &) {};
+    }
+
+    //A finished image with the landmark number announced by its header, landmark_num is the received number
+    std::function<void(const swarm_msgs::ImageDescriptor_t &, int)> image_callback;
+    std::function<void(const swarm_msgs::FisheyeFrameDescriptor_t &)> frame_callback;
+
+    void on_header(const swarm_msgs::ImageDescriptorHeader_t & header, double tnow);
+    void on_landmark(const swarm_msgs::LandmarkDescriptor_t & lm, double tnow);
+    //A chunk accepted by parse_landmark_batch
+    void on_landmark_batch(const void * data, int size, const LandmarkBatchInfo & info, double tnow);
+    //A whole image as sent on SWARM_LOOP_IMG_DES
+    void on_image(const swarm_msgs::ImageDescriptor_t & image, double tnow);
+    //Finish the images and frames whose deadline is passed
+    void expire(double tnow);
+
+    int active_images() const {
+        return images.size();
+    }
+
+    int active_frames() const {
+        return frames.size();
+    }
+};
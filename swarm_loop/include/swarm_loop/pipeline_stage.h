@@ -0,0 +1,150 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <stdio.h>
+
+//What push does when the queue of a stage is full
+enum StageDropPolicy {
+    //Wait for room, the producer is slowed down to the rate of the stage
+    STAGE_BLOCK = 0,
+    //Drop the oldest queued item, so the stage works on the freshest data
+    STAGE_DROP_OLDEST = 1,
+    //Drop the pushed item
+    STAGE_DROP_NEWEST = 2
+};
+
+struct StageStats {
+    long pushed = 0;
+    long processed = 0;
+    long dropped = 0;
+    //Milliseconds an item waited in the queue and was processed
+    double wait_sum = 0;
+    double wait_max = 0;
+    double process_sum = 0;
+    double process_max = 0;
+};
+
+//A bounded queue with its own worker thread, which calls process on every item in order.
+template<typename T>
+class PipelineStage {
+    typedef std::chrono::steady_clock Clock;
+
+    std::string name;
+    int capacity;
+    StageDropPolicy policy;
+    std::function<void(T &)> process;
+
+    std::deque<std::pair<T, Clock::time_point>> queue;
+    mutable std::mutex lock;
+    std::condition_variable not_empty, not_full;
+    bool stopped = false;
+    StageStats _stats;
+    std::thread worker;
+
+    static double ms_between(Clock::time_point a, Clock::time_point b) {
+        return std::chrono::duration<double, std::milli>(b - a).count();
+    }
+
+    void run() {
+        while (true) {
+            std::unique_lock<std::mutex> lk(lock);
+            not_empty.wait(lk, [&] { return stopped || !queue.empty(); });
+            if (stopped) {
+                return;
+            }
+            T item = std::move(queue.front().first);
+            auto t_push = queue.front().second;
+            queue.pop_front();
+            not_full.notify_one();
+            lk.unlock();
+
+            auto t_start = Clock::now();
+            process(item);
+            auto t_end = Clock::now();
+
+            lk.lock();
+            double wait = ms_between(t_push, t_start), dt = ms_between(t_start, t_end);
+            _stats.processed ++;
+            _stats.wait_sum += wait;
+            _stats.wait_max = std::max(_stats.wait_max, wait);
+            _stats.process_sum += dt;
+            _stats.process_max = std::max(_stats.process_max, dt);
+        }
+    }
+
+public:
+    PipelineStage(std::string _name, int _capacity, StageDropPolicy _policy, std::function<void(T &)> _process):
+        name(_name), capacity(std::max(_capacity, 1)), policy(_policy), process(_process) {
+        worker = std::thread([&] { run(); });
+    }
+
+    ~PipelineStage() {
+        stop();
+    }
+
+    //Queued items are discarded
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lk(lock);
+            stopped = true;
+        }
+        not_empty.notify_all();
+        not_full.notify_all();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    //False if the item or an older one was dropped
+    bool push(T item) {
+        std::unique_lock<std::mutex> lk(lock);
+        _stats.pushed ++;
+        bool dropped = false;
+        if ((int) queue.size() >= capacity) {
+            if (policy == STAGE_BLOCK) {
+                not_full.wait(lk, [&] { return stopped || (int) queue.size() < capacity; });
+            } else if (policy == STAGE_DROP_OLDEST) {
+                queue.pop_front();
+                dropped = true;
+            } else {
+                _stats.dropped ++;
+                return false;
+            }
+        }
+        if (stopped) {
+            return false;
+        }
+        _stats.dropped += dropped;
+        queue.emplace_back(std::move(item), Clock::now());
+        lk.unlock();
+        not_empty.notify_one();
+        return !dropped;
+    }
+
+    int size() const {
+        std::lock_guard<std::mutex> lk(lock);
+        return queue.size();
+    }
+
+    StageStats stats() const {
+        std::lock_guard<std::mutex> lk(lock);
+        return _stats;
+    }
+
+    //One line summary of the stage, for logging
+    std::string report() const {
+        auto s = stats();
+        int n = std::max(s.processed, 1L);
+        char buf[256];
+        snprintf(buf, sizeof(buf), "%s: queue %d/%d processed %ld dropped %ld wait avg %.1fms max %.1fms process avg %.1fms max %.1fms",
+            name.c_str(), size(), capacity, s.processed, s.dropped, s.wait_sum/n, s.wait_max, s.process_sum/n, s.process_max);
+        return std::string(buf);
+    }
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <functional>
+#include <vector>
+
+//PnP RANSAC for loop verification: PROSAC sampling of the correspondences ranked by match score, adaptive
+//termination from the inlier ratio of the best model and local optimization of every new best model.
+
+enum PnPSolverType {
+    //cv::solvePnPRansac with fixed iterations
+    PNP_SOLVER_RANSAC = 0,
+    PNP_SOLVER_PROSAC = 1
+};
+
+struct PnPProsacParams {
+    int max_iterations = 100;
+    //Reprojection error on the normalized plane
+    double reproj_thres = 0.02;
+    double confidence = 0.99;
+    //Refits with all inliers after a new best model
+    int lo_iterations = 3;
+    //Random seed, fixed so the result of a pair of frames is repeatable
+    uint64_t seed = 0;
+};
+
+struct PnPProsacStats {
+    int iterations = 0;
+    int lo_runs = 0;
+    //Hypotheses refused by the check
+    int rejected = 0;
+};
+
+//Check of a hypothesis before it is scored, e.g. the roll and pitch against the gravity direction from VIO,
+//so that only the 4 DoF observable by loop are searched. Return false to reject it.
+typedef std::function<bool(const cv::Mat & rvec, const cv::Mat & tvec)> PnPHypothesisCheck;
+
+//Pose (rvec, tvec) of the camera of pts_2d by points pts_3d and the normalized 2d points, K is identity.
+//scores: match distance of each correspondence, lower is better; empty for uniform (plain RANSAC) sampling.
+//inliers: indices of inlier correspondences of the final model. Return false if no model is found.
+bool solvePnPProsac(const std::vector<cv::Point3f> & pts_3d, const std::vector<cv::Point2f> & pts_2d,
+    const std::vector<float> & scores, cv::Mat & rvec, cv::Mat & tvec, std::vector<int> & inliers,
+    const PnPProsacParams & params = PnPProsacParams(), const PnPHypothesisCheck & check = nullptr,
+    PnPProsacStats * stats = nullptr);
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <cmath>
+
+//Items ordered by stamp in a ring of fixed capacity. The oldest item is dropped when the ring is full
+//or when it is more than retention seconds older than the newest one.
+//Lookups don't remove items, so a frame can be matched again by a later or out of order query.
+//Pushing in stamp order is O(1), nearest stamp lookup O(log n). Not thread safe.
+template<typename T>
+class StampedBuffer {
+    typedef std::pair<double, T> Entry;
+    std::vector<Entry> items;
+    int head = 0;
+    int count = 0;
+    double retention;
+
+    Entry & at(int i) {
+        return items[(head + i) % items.size()];
+    }
+
+    const Entry & at(int i) const {
+        return items[(head + i) % items.size()];
+    }
+
+    void pop_front() {
+        //Release the item now, not when the slot is reused
+        at(0) = Entry();
+        head = (head + 1) % items.size();
+        count --;
+    }
+
+public:
+    StampedBuffer(int capacity = 100, double _retention = 2.0):
+        items(capacity > 0 ? capacity : 1), retention(_retention) {
+    }
+
+    void push(double stamp, const T & item) {
+        push(stamp, T(item));
+    }
+
+    void push(double stamp, T && item) {
+        if (count == (int) items.size()) {
+            pop_front();
+        }
+        //Items arriving late are moved to their place
+        int i = count;
+        count ++;
+        while (i > 0 && at(i - 1).first > stamp) {
+            at(i) = std::move(at(i - 1));
+            i --;
+        }
+        at(i) = Entry(stamp, std::move(item));
+
+        double newest = at(count - 1).first;
+        while (count > 0 && at(0).first < newest - retention) {
+            pop_front();
+        }
+    }
+
+    //Copy the item with the stamp nearest to stamp into item if it is closer than tolerance
+    bool find_nearest(double stamp, double tolerance, T & item) const {
+        //First item not older than stamp
+        int lo = 0, hi = count;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (at(mid).first < stamp) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        int best = -1;
+        double best_dt = tolerance;
+        for (int i = lo - 1; i <= lo; i ++) {
+            if (i >= 0 && i < count && fabs(at(i).first - stamp) < best_dt) {
+                best = i;
+                best_dt = fabs(at(i).first - stamp);
+            }
+        }
+        if (best < 0) {
+            return false;
+        }
+        item = at(best).second;
+        return true;
+    }
+
+    int size() const {
+        return count;
+    }
+
+    double oldest_stamp() const {
+        return count > 0 ? at(0).first : 0;
+    }
+
+    double newest_stamp() const {
+        return count > 0 ? at(count - 1).first : 0;
+    }
+};
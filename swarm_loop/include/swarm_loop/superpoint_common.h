@@ -0,0 +1,20 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <Eigen/Dense>
+
+#define SP_DESC_RAW_LEN 256
+
+//Post processing shared by all SuperPoint backends (TensorRT, ONNX)
+namespace Swarm {
+Eigen::MatrixXf load_csv_mat_eigen(std::string csv);
+Eigen::VectorXf load_csv_vec_eigen(std::string csv);
+
+//Grid NMS on the heatmap, bucket_num > 0 spreads the keypoints over bucket_num x bucket_num buckets
+void getKeyPoints(const cv::Mat & prob, float threshold, std::vector<cv::Point2f> &keypoints, int width, int height, int max_num, int bucket_num = 0);
+
+//Bilinear sample the [SP_DESC_RAW_LEN, height/8, width/8] descriptor map at the keypoints, normalize and project with PCA.
+//Numerically the same as the former torch::grid_sampler implementation.
+void computeDescriptors(const float * desc_map, const std::vector<cv::Point2f> &keypoints,
+    std::vector<float> & local_descriptors, int width, int height, const Eigen::MatrixXf & pca_comp_T, const Eigen::RowVectorXf & pca_mean);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#ifdef USE_ONNX
+#include "swarm_loop/onnx_generic.h"
+#include "swarm_loop/superpoint_common.h"
+namespace Swarm {
+class SuperPointONNX: public ONNXInferenceGeneric {
+    Eigen::MatrixXf pca_comp_T;
+    Eigen::RowVectorXf pca_mean;
+
+public:
+    double thres = 0.015;
+    bool enable_perf;
+    int max_num = 200;
+    //Spread keypoints over nms_bucket_num x nms_bucket_num buckets, 0 to disable
+    int nms_bucket_num = 0;
+    SuperPointONNX(std::string engine_path,
+        std::string _pca_comp,
+        std::string _pca_mean,
+        int _width, int _height, float _thres = 0.015, int _max_num = 200, int _num_threads = 4, bool _enable_perf = false);
+
+    void inference(const cv::Mat & input, std::vector<cv::Point2f> & keypoints, std::vector<float> & local_descriptors);
+
+    //Same interface as SuperPointTensorRT, images are run one by one on CPU
+    void inference(const std::vector<cv::Mat> & inputs, std::vector<std::vector<cv::Point2f>> & keypoints, std::vector<std::vector<float>> & local_descriptors);
+};
+}
+#endif
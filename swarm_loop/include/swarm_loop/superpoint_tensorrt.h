@@ -2,13 +2,13 @@
 
 #ifdef USE_TENSORRT
 #include "swarm_loop/tensorrt_generic.h"
-#include <torch/csrc/autograd/variable.h>
-#include <ATen/ATen.h>
-#include <torch/csrc/api/include/torch/types.h>
-#include <Eigen/Dense>
-
-#define SP_DESC_RAW_LEN 256
+#include "swarm_loop/superpoint_common.h"
 namespace Swarm {
+struct SuperPointResult {
+    std::vector<cv::Point2f> keypoints;
+    std::vector<float> local_descriptors;
+};
+
 class SuperPointTensorRT: public TensorRTInferenceGeneric {
     Eigen::MatrixXf pca_comp_T;
     Eigen::RowVectorXf pca_mean;
@@ -17,15 +17,25 @@ public:
     double thres = 0.015;
     bool enable_perf;
     int max_num = 200;
+    //Spread keypoints over nms_bucket_num x nms_bucket_num buckets, 0 to disable
+    int nms_bucket_num = 0;
     SuperPointTensorRT(std::string engine_path, 
         std::string _pca_comp,
         std::string _pca_mean,
-        int _width, int _height, float _thres = 0.015, int _max_num = 200, bool _enable_perf = false);
+        int _width, int _height, float _thres = 0.015, int _max_num = 200, bool _enable_perf = false, int _batch_size = 1);
 
     void getKeyPoints(const cv::Mat & prob, float threshold, std::vector<cv::Point2f> &keypoints);
-    void computeDescriptors(const torch::Tensor & mProb, const torch::Tensor & desc, const std::vector<cv::Point2f> &keypoints, std::vector<float> & local_descriptors);
+    void computeDescriptors(const float * desc, const std::vector<cv::Point2f> &keypoints, std::vector<float> & local_descriptors);
+
+    void postProcess(float * prob, float * desc, std::vector<cv::Point2f> & keypoints, std::vector<float> & local_descriptors);
 
     void inference(const cv::Mat & input, std::vector<cv::Point2f> & keypoints, std::vector<float> & local_descriptors);
+
+    //Batched inference, e.g. up and down images of a stereo pair
+    void inference(const std::vector<cv::Mat> & inputs, std::vector<std::vector<cv::Point2f>> & keypoints, std::vector<std::vector<float>> & local_descriptors);
+
+    //Returns once the input is in a pipeline slot, keypoints and descriptors are extracted off the caller thread
+    std::future<SuperPointResult> inferenceAsync(const cv::Mat & input);
 };
 }
 #endif
\ No newline at end of file
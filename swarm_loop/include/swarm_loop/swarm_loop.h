@@ -4,11 +4,14 @@
 #include "swarm_loop/loop_net.h"
 #include "swarm_loop/loop_cam.h"
 #include "swarm_loop/loop_detector.h"
+#include "swarm_loop/pipeline_stage.h"
+#include "swarm_loop/stamped_buffer.h"
 #include <chrono> 
 #include <Eigen/Eigen>
 #include <thread>
 #include <nav_msgs/Odometry.h>
 #include <mutex>
+#include <atomic>
 #include <swarm_msgs/FisheyeFrameDescriptor.h>
 #include <opencv2/core/eigen.hpp>
 #include <sensor_msgs/CompressedImage.h>
@@ -16,6 +19,18 @@
 using namespace std::chrono; 
 
 namespace swarm_localization_pkg {
+
+struct KeyframeJob {
+    StereoFrame frame;
+    bool nonkeyframe;
+};
+
+struct DetectionJob {
+    FisheyeFrameDescriptor_t frame_desc;
+    std::vector<cv::Mat> imgs;
+    bool is_local;
+};
+
 class SwarmLoop {
 protected:
     LoopDetector * loop_detector = nullptr;
@@ -25,7 +40,7 @@ protected:
     bool debug_image = false;
     double min_movement_keyframe = 0.3;
     int self_id = 0;
-    bool received_image = false;
+    std::atomic<bool> received_image;
     ros::Time last_kftime;
     Eigen::Vector3d last_keyframe_position = Eigen::Vector3d(10000, 10000, 10000);
 
@@ -35,12 +50,13 @@ protected:
 
     void on_loop_connection (LoopEdge & loop_con, bool is_local = false);
 
-    std::queue<StereoFrame> raw_stereo_images;
+    //Raw frames waiting for their odometry, by stamp
+    StampedBuffer<StereoFrame> raw_stereo_images;
     std::mutex raw_stereo_image_lock;
 
     StereoFrame find_images_raw(const nav_msgs::Odometry & odometry);
 
-    void flatten_raw_callback(const vins::FlattenImages & viokf);
+    void flatten_raw_callback(const vins::FlattenImagesConstPtr & viokf);
 
     void stereo_images_callback(const sensor_msgs::ImageConstPtr left, const sensor_msgs::ImageConstPtr right);
     void comp_stereo_images_callback(const sensor_msgs::CompressedImageConstPtr left, const sensor_msgs::CompressedImageConstPtr right);
@@ -55,6 +71,15 @@ protected:
     void VIOnonKF_callback(const StereoFrame & viokf);
     void VIOKF_callback(const StereoFrame & viokf, bool nonkeyframe = false);
 
+    //Keyframes go through extraction, then broadcast and detection, each stage on its own thread
+    //so a slow stage doesn't stall the ROS callbacks
+    PipelineStage<KeyframeJob> * extraction_stage = nullptr;
+    PipelineStage<FisheyeFrameDescriptor_t> * broadcast_stage = nullptr;
+    PipelineStage<DetectionJob> * detection_stage = nullptr;
+
+    void process_keyframe(KeyframeJob & job);
+    void process_detection(DetectionJob & job);
+
     void pub_node_frame(const FisheyeFrameDescriptor_t & viokf);
 
     void on_remote_frame_ros(const swarm_msgs::FisheyeFrameDescriptor & remote_img_desc);
@@ -91,12 +116,26 @@ protected:
     double recv_msg_duration = 0.5;
     double superpoint_thres = 0.012;
     int superpoint_max_num = 200;
+    int extraction_threads = 1;
+    int extraction_queue_size = 2;
+    int broadcast_queue_size = 10;
+    int detection_queue_size = 10;
+    int extraction_queue_policy = STAGE_DROP_OLDEST;
+    int broadcast_queue_policy = STAGE_BLOCK;
+    int detection_queue_policy = STAGE_BLOCK;
+    double raw_image_tolerance = 1e-3;
+    double raw_image_retention = 2.0;
+    int raw_image_buffer_size = 100;
 
     ros::Timer timer;
+    ros::Timer pipeline_report_timer;
 
     geometry_msgs::Pose left_extrinsic, right_extrinsic;
 public:
     SwarmLoop ();
+
+    //Stops the keyframe stages, upstream first
+    virtual ~SwarmLoop ();
     
 protected:
     virtual void Init(ros::NodeHandle & nh);
@@ -6,6 +6,10 @@
 #include "NvInfer.h"
 #include <opencv2/opencv.hpp>
 #include <trt_utils.h>
+#include <functional>
+#include "swarm_loop/inference_batch.h"
+#include "swarm_loop/inference_pipeline.h"
+#include "swarm_loop/image_preprocess.h"
 
 namespace Swarm {
 struct TensorInfo
@@ -16,28 +20,88 @@ struct TensorInfo
     int bindingIndex{-1};
 };
 
+//Resources of one slot of the asynchronous pipeline, each slot has its own context and stream
+struct InferenceSlot
+{
+    nvinfer1::IExecutionContext* context{nullptr};
+    cudaStream_t stream;
+    std::vector<void*> deviceBuffers;
+    float* inputHostBuffer{nullptr};
+    std::vector<float*> outputHostBuffers;
+};
 
-class TensorRTInferenceGeneric {
+class TensorRTInferenceGeneric: public InferenceExecutor {
 protected:
     Logger m_Logger;
     nvinfer1::ICudaEngine* m_Engine = nullptr;
     int m_InputBindingIndex;
     uint64_t m_InputSize;
-    nvinfer1::IExecutionContext* m_Context;
+    nvinfer1::IExecutionContext* m_Context = nullptr;
     std::vector<void*> m_DeviceBuffers;
     cudaStream_t m_CudaStream;
     std::vector<TensorInfo> m_OutputTensors;
     int m_BatchSize = 1;
+    //uint8 inputs are multiplied by m_InputScale
+    float m_InputScale = 1.0;
+    //Pinned host input of m_BatchSize images for batched inference
+    float * m_InputHostBuffer = nullptr;
+    std::vector<InferenceSlot> m_Slots;
+    InferencePipeline * m_Pipeline = nullptr;
     const std::string m_InputBlobName;
     int width = 400;
     int height = 208;
 public:
-    TensorRTInferenceGeneric(std::string input_blob_name, int _width, int _height);
+    TensorRTInferenceGeneric(std::string input_blob_name, int _width, int _height, int _batch_size = 1);
+
+    //Stops the pipeline, which finishes the inflight slots first, then frees the slots and the engine
+    virtual ~TensorRTInferenceGeneric();
 
     virtual void doInference(const unsigned char* input, const uint32_t batchSize);
 
+    //3 channel images are converted to gray for a 1 channel network,
+    //CV_8U images are resized, scaled and split into planes in one pass by preprocessImage,
+    //CV_32F images are taken as already scaled, other depths are converted by OpenCV
+    void packInput(const cv::Mat & input, float * dst);
+
     virtual void doInference(const cv::Mat & input);
 
+    //Run all inputs in batches of at most m_BatchSize with one enqueue per batch.
+    //on_batch(start, batch) is called once the outputs of inputs[start, start+batch) are in the output host buffers.
+    virtual void doInference(const std::vector<cv::Mat> & inputs, std::function<void(int, int)> on_batch);
+
+    int batchSize() const {
+        return m_BatchSize;
+    }
+
+    //Allocate slot_num ping-pong slots for doInferenceAsync, call after init
+    void initAsync(int slot_num = 2);
+
+    //Pack input into a free slot on the caller thread and return immediately,
+    //postprocess gets the slot output host buffers once the GPU is done.
+    template<typename T>
+    std::future<T> doInferenceAsync(const cv::Mat & input, std::function<T(const std::vector<float*> &)> postprocess) {
+        assert(m_Pipeline != nullptr && "initAsync must be called before doInferenceAsync");
+        return m_Pipeline->submit<T>([&](float * slot_input) {
+            packInput(input, slot_input);
+        }, postprocess);
+    }
+
+    int slotNum() const override {
+        return m_Slots.size();
+    }
+
+    float * slotInput(int slot) override {
+        return m_Slots[slot].inputHostBuffer;
+    }
+
+    std::vector<float*> slotOutputs(int slot) override {
+        return m_Slots[slot].outputHostBuffers;
+    }
+
+    void enqueueSlot(int slot, int batch) override;
+
+    void synchronizeSlot(int slot) override;
+
     bool verifyEngine();
 
     void allocateBuffers();
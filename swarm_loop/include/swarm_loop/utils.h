@@ -8,6 +8,8 @@
 cv_bridge::CvImageConstPtr getImageFromMsg(const sensor_msgs::Image &img_msg);
 cv_bridge::CvImageConstPtr getImageFromMsg(const sensor_msgs::ImageConstPtr &img_msg);
 cv::Mat getImageFromMsg(const sensor_msgs::CompressedImageConstPtr &img_msg, int flag);
+//As getImageFromMsg, without copy for 8UC1, mono8, 16UC1 and bgr8 images. tracked_object owns img_msg
+cv_bridge::CvImageConstPtr getImageShareFromMsg(const sensor_msgs::Image &img_msg, const boost::shared_ptr<void const> & tracked_object);
 inline int generate_keyframe_id(ros::Time stamp, int self_id) {
     static int keyframe_count = 0;
     int t_ms = 0;//stamp.toSec()*1000;
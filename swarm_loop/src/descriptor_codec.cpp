@@ -0,0 +1,139 @@
+#include "swarm_loop/descriptor_codec.h"
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+using namespace swarm_msgs;
+
+#define QUANTIZED_HEADER_PREFIX_SIZE 8
+
+bool desc_format_valid(int format) {
+    return format == DESC_FLOAT32 || format == DESC_INT8 || format == DESC_BINARY || format == DESC_INT4;
+}
+
+int quantized_desc_size(int dim, int format) {
+    switch (format) {
+        case DESC_INT8:
+            return sizeof(float) + dim;
+        case DESC_BINARY:
+            return sizeof(float) + (dim + 7) / 8;
+        case DESC_INT4:
+            return sizeof(float) + (dim + 1) / 2;
+        default:
+            return dim * sizeof(float);
+    }
+}
+
+void quantize_desc(const float * v, int dim, int format, uint8_t * out) {
+    if (format == DESC_INT8 || format == DESC_INT4) {
+        float max_abs = 0;
+        for (int i = 0; i < dim; i ++) {
+            max_abs = std::max(max_abs, fabsf(v[i]));
+        }
+        int q_max = format == DESC_INT8 ? 127 : 7;
+        float scale = max_abs > 0 ? max_abs / q_max : 1;
+        memcpy(out, &scale, sizeof(float));
+        if (format == DESC_INT8) {
+            int8_t * q = (int8_t *) (out + sizeof(float));
+            for (int i = 0; i < dim; i ++) {
+                q[i] = (int8_t) lrintf(v[i] / scale);
+            }
+        } else {
+            uint8_t * q = out + sizeof(float);
+            memset(q, 0, (dim + 1) / 2);
+            for (int i = 0; i < dim; i ++) {
+                int _q = std::max(-q_max, std::min(q_max, (int) lrintf(v[i] / scale)));
+                q[i / 2] |= (_q & 0xf) << (4 * (i % 2));
+            }
+        }
+    } else if (format == DESC_BINARY) {
+        //RMS magnitude keeps the L2 norm of the vector
+        float sum_sq = 0;
+        for (int i = 0; i < dim; i ++) {
+            sum_sq += v[i]*v[i];
+        }
+        float scale = sqrtf(sum_sq / dim);
+        memcpy(out, &scale, sizeof(float));
+        uint8_t * bits = out + sizeof(float);
+        memset(bits, 0, (dim + 7) / 8);
+        for (int i = 0; i < dim; i ++) {
+            if (v[i] >= 0) {
+                bits[i / 8] |= 1 << (i % 8);
+            }
+        }
+    } else {
+        memcpy(out, v, dim * sizeof(float));
+    }
+}
+
+void dequantize_desc(const uint8_t * in, int dim, int format, float * v) {
+    if (format == DESC_INT8) {
+        float scale;
+        memcpy(&scale, in, sizeof(float));
+        const int8_t * q = (const int8_t *) (in + sizeof(float));
+        for (int i = 0; i < dim; i ++) {
+            v[i] = q[i] * scale;
+        }
+    } else if (format == DESC_INT4) {
+        float scale;
+        memcpy(&scale, in, sizeof(float));
+        const uint8_t * q = in + sizeof(float);
+        for (int i = 0; i < dim; i ++) {
+            int _q = (q[i / 2] >> (4 * (i % 2))) & 0xf;
+            //Sign extend the nibble
+            v[i] = (_q >= 8 ? _q - 16 : _q) * scale;
+        }
+    } else if (format == DESC_BINARY) {
+        float scale;
+        memcpy(&scale, in, sizeof(float));
+        const uint8_t * bits = in + sizeof(float);
+        for (int i = 0; i < dim; i ++) {
+            v[i] = (bits[i / 8] >> (i % 8)) & 1 ? scale : -scale;
+        }
+    } else {
+        memcpy(v, in, dim * sizeof(float));
+    }
+}
+
+std::vector<uint8_t> encode_quantized_header(const ImageDescriptorHeader_t & header, int format) {
+    ImageDescriptorHeader_t _header = header;
+    _header.image_desc.clear();
+    _header.image_desc_size = 0;
+
+    int dim = header.image_desc.size();
+    int desc_size = quantized_desc_size(dim, format);
+    std::vector<uint8_t> buf(QUANTIZED_HEADER_PREFIX_SIZE + desc_size + _header.getEncodedSize());
+    uint32_t magic = QUANTIZED_HEADER_MAGIC;
+    uint16_t _dim = dim;
+    memcpy(buf.data(), &magic, sizeof(magic));
+    buf[4] = QUANTIZED_HEADER_VERSION;
+    buf[5] = format;
+    memcpy(buf.data() + 6, &_dim, sizeof(_dim));
+    quantize_desc(header.image_desc.data(), dim, format, buf.data() + QUANTIZED_HEADER_PREFIX_SIZE);
+    _header.encode(buf.data(), QUANTIZED_HEADER_PREFIX_SIZE + desc_size, _header.getEncodedSize());
+    return buf;
+}
+
+bool decode_quantized_header(const void * data, int size, ImageDescriptorHeader_t & header) {
+    const uint8_t * p = (const uint8_t *) data;
+    if (size < QUANTIZED_HEADER_PREFIX_SIZE) {
+        return false;
+    }
+    uint32_t magic;
+    uint16_t dim;
+    memcpy(&magic, p, sizeof(magic));
+    memcpy(&dim, p + 6, sizeof(dim));
+    int format = p[5];
+    if (magic != QUANTIZED_HEADER_MAGIC || p[4] != QUANTIZED_HEADER_VERSION || !desc_format_valid(format)) {
+        return false;
+    }
+    int desc_size = quantized_desc_size(dim, format);
+    if (size < QUANTIZED_HEADER_PREFIX_SIZE + desc_size ||
+        header.decode(p, QUANTIZED_HEADER_PREFIX_SIZE + desc_size, size - QUANTIZED_HEADER_PREFIX_SIZE - desc_size) < 0) {
+        return false;
+    }
+    header.image_desc.resize(dim);
+    header.image_desc_size = dim;
+    dequantize_desc(p + QUANTIZED_HEADER_PREFIX_SIZE, dim, format, header.image_desc.data());
+    return true;
+}
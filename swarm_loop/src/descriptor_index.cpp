@@ -0,0 +1,139 @@
+#include "swarm_loop/descriptor_index.h"
+#include <faiss/AutoTune.h>
+#include <faiss/clone_index.h>
+#include <faiss/index_factory.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/FaissException.h>
+#include <algorithm>
+#include <stdio.h>
+
+DescriptorIndex::DescriptorIndex(int _dim, std::string _factory, std::string _search_params, int _train_size, double _rebuild_stale):
+    dim(_dim), factory(_factory), search_params(_search_params), train_size(_train_size), rebuild_stale(_rebuild_stale),
+    flat(_dim), flat_map(&flat) {
+}
+
+DescriptorIndex::~DescriptorIndex() {
+    //ann owns the factory index
+    delete ann;
+}
+
+void DescriptorIndex::train_ann() {
+    int n = flat_map.ntotal;
+    std::vector<float> xs(n*dim);
+    for (int i = 0; i < n; i ++) {
+        flat.reconstruct(i, xs.data() + i*dim);
+    }
+
+    faiss::Index * base = nullptr;
+    try {
+        base = faiss::index_factory(dim, factory.c_str(), faiss::METRIC_INNER_PRODUCT);
+        base->train(n, xs.data());
+        if (search_params.size() > 0) {
+            faiss::ParameterSpace().set_index_parameters(base, search_params.c_str());
+        }
+    } catch (const faiss::FaissException & e) {
+        //e.g. fewer descriptors than IVF lists, stay exact and try again with more
+        printf("[SWARM_LOOP] Train descriptor index %s with %d descriptors failed: %s\n", factory.c_str(), n, e.what());
+        delete base;
+        train_size *= 2;
+        return;
+    }
+
+    ann = new faiss::IndexIDMap(base);
+    ann->own_fields = true;
+    ann->add_with_ids(n, xs.data(), flat_map.id_map.data());
+    flat_map.reset();
+    printf("[SWARM_LOOP] Descriptor index %s trained with %d descriptors\n", factory.c_str(), n);
+}
+
+void DescriptorIndex::rebuild_ann() {
+    int64_t n = ann->ntotal;
+    std::vector<float> xs;
+    std::vector<faiss::Index::idx_t> ids;
+    xs.reserve((n - stale.size())*dim);
+    ids.reserve(n - stale.size());
+    std::vector<float> x(dim);
+    for (int64_t i = 0; i < n; i ++) {
+        if (stale.find(ann->id_map[i]) != stale.end()) {
+            continue;
+        }
+        //Exact for the stored vectors, PCA is reversed and applied again on add
+        ann->index->reconstruct(i, x.data());
+        xs.insert(xs.end(), x.begin(), x.end());
+        ids.push_back(ann->id_map[i]);
+    }
+
+    faiss::Index * base = faiss::clone_index(ann->index);
+    base->reset();
+    auto _ann = new faiss::IndexIDMap(base);
+    _ann->own_fields = true;
+    _ann->add_with_ids(ids.size(), xs.data(), ids.data());
+    printf("[SWARM_LOOP] Descriptor index %s rebuilt with %ld live of %ld descriptors\n", factory.c_str(), ids.size(), n);
+    delete ann;
+    ann = _ann;
+    stale.clear();
+}
+
+void DescriptorIndex::add(faiss::Index::idx_t id, const float * desc) {
+    if (ann != nullptr) {
+        ann->add_with_ids(1, desc, &id);
+        return;
+    }
+    flat_map.add_with_ids(1, desc, &id);
+    if (factory != "Flat" && flat_map.ntotal >= train_size) {
+        train_ann();
+    }
+}
+
+void DescriptorIndex::remove(const std::vector<faiss::Index::idx_t> & ids) {
+    faiss::IDSelectorArray sel(ids.size(), ids.data());
+    if (ann == nullptr) {
+        flat_map.remove_ids(sel);
+        return;
+    }
+    try {
+        ann->remove_ids(sel);
+    } catch (const faiss::FaissException & e) {
+        //HNSW graphs can't remove nodes
+        stale.insert(ids.begin(), ids.end());
+        if (stale.size() > rebuild_stale*ann->ntotal) {
+            rebuild_ann();
+        }
+    }
+}
+
+void DescriptorIndex::search(const float * desc, int k, float * distances, faiss::Index::idx_t * labels) const {
+    if (ann == nullptr) {
+        flat_map.search(1, desc, k, distances, labels);
+        return;
+    }
+    if (stale.empty()) {
+        ann->search(1, desc, k, distances, labels);
+        return;
+    }
+
+    //Fetch more for the stale results to be skipped, again with twice as many while they fill it
+    int j = 0;
+    for (int64_t fetch = 2*k; ; fetch *= 2) {
+        fetch = std::min(fetch, ann->ntotal);
+        std::vector<float> _distances(fetch);
+        std::vector<faiss::Index::idx_t> _labels(fetch);
+        ann->search(1, desc, fetch, _distances.data(), _labels.data());
+        j = 0;
+        for (int64_t i = 0; i < fetch && j < k; i ++) {
+            if (_labels[i] < 0 || stale.find(_labels[i]) != stale.end()) {
+                continue;
+            }
+            distances[j] = _distances[i];
+            labels[j] = _labels[i];
+            j ++;
+        }
+        if (j == k || fetch == ann->ntotal) {
+            break;
+        }
+    }
+    for (; j < k; j ++) {
+        distances[j] = 0;
+        labels[j] = -1;
+    }
+}
@@ -0,0 +1,213 @@
+#include "swarm_loop/feature_matcher.h"
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+//desc_b is packed in blocks of MATCH_LANES descriptors, dimension major, so one kernel step
+//gives the dot products of a descriptor of desc_a with a whole block without horizontal sums
+#define MATCH_LANES 8
+#define MATCH_ROWS 4
+//Blocks of desc_b kept hot in L1 while all of desc_a passes over them, 16 blocks are 32KB
+#define MATCH_TILE_BLOCKS 16
+
+namespace Swarm {
+
+typedef void (*DotKernel)(const float * const a[MATCH_ROWS], const float * pb, float out[MATCH_ROWS][MATCH_LANES]);
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2,fma")))
+static void dotKernelAVX2(const float * const a[MATCH_ROWS], const float * pb, float out[MATCH_ROWS][MATCH_LANES]) {
+    //Even and odd dimensions in separate accumulators, 8 independent FMA chains hide the FMA latency
+    __m256 e0 = _mm256_setzero_ps(), e1 = e0, e2 = e0, e3 = e0;
+    __m256 o0 = e0, o1 = e0, o2 = e0, o3 = e0;
+    for (int k = 0; k < MATCH_DESC_SIZE; k += 2) {
+        __m256 b = _mm256_loadu_ps(pb + k*MATCH_LANES);
+        e0 = _mm256_fmadd_ps(_mm256_set1_ps(a[0][k]), b, e0);
+        e1 = _mm256_fmadd_ps(_mm256_set1_ps(a[1][k]), b, e1);
+        e2 = _mm256_fmadd_ps(_mm256_set1_ps(a[2][k]), b, e2);
+        e3 = _mm256_fmadd_ps(_mm256_set1_ps(a[3][k]), b, e3);
+        b = _mm256_loadu_ps(pb + (k + 1)*MATCH_LANES);
+        o0 = _mm256_fmadd_ps(_mm256_set1_ps(a[0][k + 1]), b, o0);
+        o1 = _mm256_fmadd_ps(_mm256_set1_ps(a[1][k + 1]), b, o1);
+        o2 = _mm256_fmadd_ps(_mm256_set1_ps(a[2][k + 1]), b, o2);
+        o3 = _mm256_fmadd_ps(_mm256_set1_ps(a[3][k + 1]), b, o3);
+    }
+    _mm256_storeu_ps(out[0], _mm256_add_ps(e0, o0));
+    _mm256_storeu_ps(out[1], _mm256_add_ps(e1, o1));
+    _mm256_storeu_ps(out[2], _mm256_add_ps(e2, o2));
+    _mm256_storeu_ps(out[3], _mm256_add_ps(e3, o3));
+}
+
+static void dotKernelSSE(const float * const a[MATCH_ROWS], const float * pb, float out[MATCH_ROWS][MATCH_LANES]) {
+    __m128 acc[MATCH_ROWS][2];
+    for (int r = 0; r < MATCH_ROWS; r ++) {
+        acc[r][0] = acc[r][1] = _mm_setzero_ps();
+    }
+    for (int k = 0; k < MATCH_DESC_SIZE; k ++) {
+        __m128 b0 = _mm_loadu_ps(pb + k*MATCH_LANES);
+        __m128 b1 = _mm_loadu_ps(pb + k*MATCH_LANES + 4);
+        for (int r = 0; r < MATCH_ROWS; r ++) {
+            __m128 s = _mm_set1_ps(a[r][k]);
+            acc[r][0] = _mm_add_ps(acc[r][0], _mm_mul_ps(s, b0));
+            acc[r][1] = _mm_add_ps(acc[r][1], _mm_mul_ps(s, b1));
+        }
+    }
+    for (int r = 0; r < MATCH_ROWS; r ++) {
+        _mm_storeu_ps(out[r], acc[r][0]);
+        _mm_storeu_ps(out[r] + 4, acc[r][1]);
+    }
+}
+#elif defined(__ARM_NEON)
+static void dotKernelNEON(const float * const a[MATCH_ROWS], const float * pb, float out[MATCH_ROWS][MATCH_LANES]) {
+    float32x4_t acc[MATCH_ROWS][2];
+    for (int r = 0; r < MATCH_ROWS; r ++) {
+        acc[r][0] = acc[r][1] = vdupq_n_f32(0);
+    }
+    for (int k = 0; k < MATCH_DESC_SIZE; k ++) {
+        float32x4_t b0 = vld1q_f32(pb + k*MATCH_LANES);
+        float32x4_t b1 = vld1q_f32(pb + k*MATCH_LANES + 4);
+        for (int r = 0; r < MATCH_ROWS; r ++) {
+            acc[r][0] = vmlaq_n_f32(acc[r][0], b0, a[r][k]);
+            acc[r][1] = vmlaq_n_f32(acc[r][1], b1, a[r][k]);
+        }
+    }
+    for (int r = 0; r < MATCH_ROWS; r ++) {
+        vst1q_f32(out[r], acc[r][0]);
+        vst1q_f32(out[r] + 4, acc[r][1]);
+    }
+}
+#else
+static void dotKernelScalar(const float * const a[MATCH_ROWS], const float * pb, float out[MATCH_ROWS][MATCH_LANES]) {
+    for (int r = 0; r < MATCH_ROWS; r ++) {
+        for (int l = 0; l < MATCH_LANES; l ++) {
+            out[r][l] = 0;
+        }
+        for (int k = 0; k < MATCH_DESC_SIZE; k ++) {
+            for (int l = 0; l < MATCH_LANES; l ++) {
+                out[r][l] += a[r][k]*pb[k*MATCH_LANES + l];
+            }
+        }
+    }
+}
+#endif
+
+static DotKernel selectDotKernel() {
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return dotKernelAVX2;
+    }
+    return dotKernelSSE;
+#elif defined(__ARM_NEON)
+    return dotKernelNEON;
+#else
+    return dotKernelScalar;
+#endif
+}
+
+static inline float squaredNorm(const float * v) {
+    float s = 0;
+    for (int k = 0; k < MATCH_DESC_SIZE; k ++) {
+        s += v[k]*v[k];
+    }
+    return s;
+}
+
+void matchDescriptors(const float * desc_a, int num_a, const float * desc_b, int num_b,
+        std::vector<cv::DMatch> & matches, float ratio) {
+    static const DotKernel dotKernel = selectDotKernel();
+    thread_local std::vector<float> packed;
+    thread_local std::vector<float> norm_a, norm_b;
+    thread_local std::vector<float> row_best, row_second, col_best;
+    thread_local std::vector<int> row_best_idx, col_best_idx;
+
+    matches.clear();
+    if (num_a == 0 || num_b == 0) {
+        return;
+    }
+
+    int blocks = (num_b + MATCH_LANES - 1) / MATCH_LANES;
+    packed.assign(blocks*MATCH_LANES*MATCH_DESC_SIZE, 0);
+    norm_b.resize(blocks*MATCH_LANES);
+    for (int j = 0; j < blocks*MATCH_LANES; j ++) {
+        float * pb = packed.data() + (j / MATCH_LANES)*MATCH_LANES*MATCH_DESC_SIZE + j % MATCH_LANES;
+        if (j < num_b) {
+            const float * b = desc_b + j*MATCH_DESC_SIZE;
+            for (int k = 0; k < MATCH_DESC_SIZE; k ++) {
+                pb[k*MATCH_LANES] = b[k];
+            }
+            norm_b[j] = squaredNorm(b);
+        }
+    }
+    norm_a.resize(num_a);
+    for (int i = 0; i < num_a; i ++) {
+        norm_a[i] = squaredNorm(desc_a + i*MATCH_DESC_SIZE);
+    }
+
+    row_best.assign(num_a, INFINITY);
+    row_second.assign(num_a, INFINITY);
+    row_best_idx.assign(num_a, -1);
+    col_best.assign(blocks*MATCH_LANES, INFINITY);
+    col_best_idx.assign(blocks*MATCH_LANES, -1);
+
+    float dots[MATCH_ROWS][MATCH_LANES];
+    for (int tile = 0; tile < blocks; tile += MATCH_TILE_BLOCKS) {
+        int tile_end = std::min(blocks, tile + MATCH_TILE_BLOCKS);
+        for (int i0 = 0; i0 < num_a; i0 += MATCH_ROWS) {
+            //The rows past num_a repeat the last one and are ignored
+            const float * a[MATCH_ROWS];
+            int rows = std::min(MATCH_ROWS, num_a - i0);
+            for (int r = 0; r < MATCH_ROWS; r ++) {
+                a[r] = desc_a + std::min(i0 + r, num_a - 1)*MATCH_DESC_SIZE;
+            }
+            for (int blk = tile; blk < tile_end; blk ++) {
+                dotKernel(a, packed.data() + blk*MATCH_LANES*MATCH_DESC_SIZE, dots);
+                int lanes = std::min(MATCH_LANES, num_b - blk*MATCH_LANES);
+                const float * nb = norm_b.data() + blk*MATCH_LANES;
+                float * cb = col_best.data() + blk*MATCH_LANES;
+                int * cb_idx = col_best_idx.data() + blk*MATCH_LANES;
+                for (int r = 0; r < rows; r ++) {
+                    int i = i0 + r;
+                    float d[MATCH_LANES];
+                    for (int l = 0; l < MATCH_LANES; l ++) {
+                        d[l] = norm_a[i] + nb[l] - 2*dots[r][l];
+                    }
+                    for (int l = 0; l < lanes; l ++) {
+                        if (d[l] < cb[l]) {
+                            cb[l] = d[l];
+                            cb_idx[l] = i;
+                        }
+                        //Most candidates are farther than the second best so far
+                        if (d[l] < row_second[i]) {
+                            if (d[l] < row_best[i]) {
+                                row_second[i] = row_best[i];
+                                row_best[i] = d[l];
+                                row_best_idx[i] = blk*MATCH_LANES + l;
+                            } else {
+                                row_second[i] = d[l];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    float ratio2 = ratio*ratio;
+    for (int i = 0; i < num_a; i ++) {
+        int j = row_best_idx[i];
+        if (j < 0 || col_best_idx[j] != i) {
+            continue;
+        }
+        if (ratio < 1 && !(row_best[i] < ratio2*row_second[i])) {
+            continue;
+        }
+        matches.push_back(cv::DMatch(i, j, sqrt(std::max(row_best[i], 0.0f))));
+    }
+}
+
+}
@@ -0,0 +1,168 @@
+#include "swarm_loop/image_preprocess.h"
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#if defined(__SSE4_1__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace Swarm {
+
+#if defined(__ARM_NEON)
+static inline void storeU8x8(uint8x8_t v, float * dst, float32x4_t s) {
+    uint16x8_t v16 = vmovl_u8(v);
+    vst1q_f32(dst, vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(v16))), s));
+    vst1q_f32(dst + 4, vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(v16))), s));
+}
+#endif
+
+//dst[i] = src[i]*scale
+static void convertRowU8(const uint8_t * src, float * dst, int n, float scale) {
+    int i = 0;
+#if defined(__AVX2__)
+    __m256 s = _mm256_set1_ps(scale);
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), s));
+    }
+#elif defined(__SSE4_1__)
+    __m128 s = _mm_set1_ps(scale);
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadl_epi64((const __m128i*)(src + i));
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(v)), s));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(v, 4))), s));
+    }
+#elif defined(__ARM_NEON)
+    float32x4_t s = vdupq_n_f32(scale);
+    for (; i + 8 <= n; i += 8) {
+        storeU8x8(vld1_u8(src + i), dst + i, s);
+    }
+#endif
+    for (; i < n; i ++) {
+        dst[i] = src[i]*scale;
+    }
+}
+
+//Split n BGR pixels into r, g and b planes, multiplied by scale
+static void convertRowBGR(const uint8_t * src, float * r, float * g, float * b, int n, float scale) {
+    int i = 0;
+#if defined(__SSE4_1__)
+    const __m128i mask_b = _mm_setr_epi8(0, -1, -1, -1, 3, -1, -1, -1, 6, -1, -1, -1, 9, -1, -1, -1);
+    const __m128i mask_g = _mm_setr_epi8(1, -1, -1, -1, 4, -1, -1, -1, 7, -1, -1, -1, 10, -1, -1, -1);
+    const __m128i mask_r = _mm_setr_epi8(2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1);
+    __m128 s = _mm_set1_ps(scale);
+    //A 16 byte load takes 4 pixels and 4 bytes more, keep it inside the row
+    for (; i + 6 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i*3));
+        _mm_storeu_ps(b + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_shuffle_epi8(v, mask_b)), s));
+        _mm_storeu_ps(g + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_shuffle_epi8(v, mask_g)), s));
+        _mm_storeu_ps(r + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_shuffle_epi8(v, mask_r)), s));
+    }
+#elif defined(__ARM_NEON)
+    float32x4_t s = vdupq_n_f32(scale);
+    for (; i + 8 <= n; i += 8) {
+        uint8x8x3_t v = vld3_u8(src + i*3);
+        storeU8x8(v.val[0], b + i, s);
+        storeU8x8(v.val[1], g + i, s);
+        storeU8x8(v.val[2], r + i, s);
+    }
+#endif
+    for (; i < n; i ++) {
+        b[i] = src[i*3]*scale;
+        g[i] = src[i*3 + 1]*scale;
+        r[i] = src[i*3 + 2]*scale;
+    }
+}
+
+//Convert one source row into channel planes of src_width floats each, RGB order
+static void convertRow(const uint8_t * src, float * dst, int src_width, int channels, float scale) {
+    if (channels == 1) {
+        convertRowU8(src, dst, src_width, scale);
+    } else {
+        convertRowBGR(src, dst, dst + src_width, dst + src_width*2, src_width, scale);
+    }
+}
+
+//Same sample position as cv::resize INTER_LINEAR
+static inline void linearSample(int dst_x, double ratio, int src_size, int & x0, float & w) {
+    double sx = (dst_x + 0.5)*ratio - 0.5;
+    x0 = floor(sx);
+    w = sx - x0;
+    if (x0 < 0) {
+        x0 = 0;
+        w = 0;
+    }
+    if (x0 >= src_size - 1) {
+        x0 = src_size - 1;
+        w = 0;
+    }
+}
+
+void preprocessImage(const uint8_t * src, int src_width, int src_height, size_t src_step, int channels,
+        int width, int height, float scale, float * dst) {
+    int plane = width*height;
+    if (src_width == width && src_height == height) {
+        for (int y = 0; y < height; y ++) {
+            const uint8_t * row = src + y*src_step;
+            if (channels == 1) {
+                convertRowU8(row, dst + y*width, width, scale);
+            } else {
+                convertRowBGR(row, dst + y*width, dst + plane + y*width, dst + plane*2 + y*width, width, scale);
+            }
+        }
+        return;
+    }
+
+    //Per thread scratch rows, reused between calls
+    thread_local std::vector<int> xofs;
+    thread_local std::vector<float> xweight;
+    thread_local std::vector<float> row0, row1;
+
+    double ratio_x = (double) src_width / width;
+    double ratio_y = (double) src_height / height;
+    xofs.resize(width);
+    xweight.resize(width);
+    for (int x = 0; x < width; x ++) {
+        linearSample(x, ratio_x, src_width, xofs[x], xweight[x]);
+    }
+    row0.resize(src_width*channels);
+    row1.resize(src_width*channels);
+
+    int cached_y0 = -1, cached_y1 = -1;
+    for (int y = 0; y < height; y ++) {
+        int y0;
+        float wy;
+        linearSample(y, ratio_y, src_height, y0, wy);
+        int y1 = std::min(y0 + 1, src_height - 1);
+        if (y0 == cached_y1) {
+            std::swap(row0, row1);
+            std::swap(cached_y0, cached_y1);
+        }
+        if (y0 != cached_y0) {
+            convertRow(src + y0*src_step, row0.data(), src_width, channels, scale);
+            cached_y0 = y0;
+        }
+        if (y1 != cached_y1) {
+            convertRow(src + y1*src_step, row1.data(), src_width, channels, scale);
+            cached_y1 = y1;
+        }
+
+        for (int c = 0; c < channels; c ++) {
+            const float * r0 = row0.data() + c*src_width;
+            const float * r1 = row1.data() + c*src_width;
+            float * out = dst + c*plane + y*width;
+            for (int x = 0; x < width; x ++) {
+                int x0 = xofs[x];
+                int x1 = std::min(x0 + 1, src_width - 1);
+                float wx = xweight[x];
+                float top = r0[x0] + (r0[x1] - r0[x0])*wx;
+                float bottom = r1[x0] + (r1[x1] - r1[x0])*wx;
+                out[x] = top + (bottom - top)*wy;
+            }
+        }
+    }
+}
+
+}
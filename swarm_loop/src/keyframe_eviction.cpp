@@ -0,0 +1,64 @@
+#include "swarm_loop/keyframe_eviction.h"
+#include <math.h>
+
+void KeyframeEvictor::add(int64_t msg_id, int drone_id, const Eigen::Vector3d & pos, size_t bytes) {
+    if (contains(msg_id)) {
+        remove(msg_id);
+    }
+    Entry e;
+    e.drone_id = drone_id;
+    e.voxel = Eigen::Vector3i(floor(pos.x()/spatial_radius), floor(pos.y()/spatial_radius), floor(pos.z()/spatial_radius));
+    e.bytes = bytes;
+    e.last_used = clock ++;
+    entries[msg_id] = e;
+    lru.insert(std::make_pair(e.last_used, msg_id));
+    voxel_count[voxel_key(e)] ++;
+    total_bytes += bytes;
+}
+
+void KeyframeEvictor::touch(int64_t msg_id) {
+    auto it = entries.find(msg_id);
+    if (it == entries.end()) {
+        return;
+    }
+    lru.erase(std::make_pair(it->second.last_used, msg_id));
+    it->second.last_used = clock ++;
+    lru.insert(std::make_pair(it->second.last_used, msg_id));
+}
+
+void KeyframeEvictor::remove(int64_t msg_id) {
+    auto it = entries.find(msg_id);
+    if (it == entries.end()) {
+        return;
+    }
+    auto & e = it->second;
+    lru.erase(std::make_pair(e.last_used, msg_id));
+    auto key = voxel_key(e);
+    if (-- voxel_count[key] <= 0) {
+        voxel_count.erase(key);
+    }
+    total_bytes -= e.bytes;
+    entries.erase(it);
+}
+
+bool KeyframeEvictor::over_budget() const {
+    return (max_bytes > 0 && total_bytes > max_bytes) || (max_frames > 0 && (int) entries.size() > max_frames);
+}
+
+std::vector<int64_t> KeyframeEvictor::evict() {
+    std::vector<int64_t> victims;
+    while (over_budget() && entries.size() > 1) {
+        int64_t victim = lru.begin()->second;
+        if (policy == EVICT_SPATIAL) {
+            for (auto & item : lru) {
+                if (voxel_count[voxel_key(entries[item.second])] > 1) {
+                    victim = item.second;
+                    break;
+                }
+            }
+        }
+        remove(victim);
+        victims.push_back(victim);
+    }
+    return victims;
+}
@@ -0,0 +1,204 @@
+#include "swarm_loop/keypoint_nms.h"
+#include <algorithm>
+
+namespace Swarm {
+
+struct NMSCandidate {
+    float conf;
+    int index; //y*width + x
+};
+
+static bool candidate_comp(const NMSCandidate & a, const NMSCandidate & b) {
+    return a.conf > b.conf || (a.conf == b.conf && a.index < b.index);
+}
+
+//Whether prob at (x, y) is the maximum of its window, ties go to the first in row-major order
+static inline bool is_window_max(const float * prob, int width, int height, int x, int y, int radius) {
+    float p = prob[y*width + x];
+    int y_end = std::min(height - 1, y + radius);
+    int x_begin = std::max(0, x - radius);
+    int x_end = std::min(width - 1, x + radius);
+    for (int yy = std::max(0, y - radius); yy <= y_end; yy ++) {
+        const float * row = prob + yy*width;
+        for (int xx = x_begin; xx <= x_end; xx ++) {
+            if (row[xx] > p || (row[xx] == p && (yy < y || (yy == y && xx < x)))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+//Sorted best candidates with at most quota in each bucket, then the best of the rest up to max_num
+static void select_bucketed(std::vector<NMSCandidate> & kept, int width, int height, int bucket_num, int max_num) {
+    thread_local std::vector<int> bucket_count;
+    thread_local std::vector<NMSCandidate> selected, rest;
+    int quota = std::max(1, max_num / (bucket_num*bucket_num));
+    bucket_count.assign(bucket_num*bucket_num, 0);
+    selected.clear();
+    rest.clear();
+
+    std::sort(kept.begin(), kept.end(), candidate_comp);
+    for (auto & c : kept) {
+        int bx = (c.index % width) * bucket_num / width;
+        int by = (c.index / width) * bucket_num / height;
+        int & count = bucket_count[by*bucket_num + bx];
+        if (count < quota && (int) selected.size() < max_num) {
+            count ++;
+            selected.push_back(c);
+        } else {
+            rest.push_back(c);
+        }
+    }
+
+    for (unsigned int i = 0; i < rest.size() && (int) selected.size() < max_num; i ++) {
+        selected.push_back(rest[i]);
+    }
+    std::sort(selected.begin(), selected.end(), candidate_comp);
+    kept.swap(selected);
+}
+
+void gridNMS(const float * prob, int width, int height, float threshold, int radius, int max_num,
+        std::vector<cv::Point2f> & keypoints, int bucket_num) {
+    thread_local std::vector<float> cell_max;
+    thread_local std::vector<NMSCandidate> kept;
+    keypoints.clear();
+    kept.clear();
+    if (max_num <= 0) {
+        return;
+    }
+
+    int cells_x = (width + SP_NMS_CELL - 1) / SP_NMS_CELL;
+    int cells_y = (height + SP_NMS_CELL - 1) / SP_NMS_CELL;
+    cell_max.resize(cells_x*cells_y);
+
+    //Maximum of each cell, one row-major pass over the heatmap
+    for (int y = 0; y < height; y ++) {
+        const float * row = prob + y*width;
+        float * cmax = cell_max.data() + (y / SP_NMS_CELL)*cells_x;
+        if (y % SP_NMS_CELL == 0) {
+            std::fill(cmax, cmax + cells_x, threshold);
+        }
+        for (int cx = 0; cx < cells_x; cx ++) {
+            int x_end = std::min(width, (cx + 1)*SP_NMS_CELL);
+            float m = cmax[cx];
+            for (int x = cx*SP_NMS_CELL; x < x_end; x ++) {
+                m = std::max(m, row[x]);
+            }
+            cmax[cx] = m;
+        }
+    }
+
+    for (int cy = 0; cy < cells_y; cy ++) {
+        for (int cx = 0; cx < cells_x; cx ++) {
+            if (cell_max[cy*cells_x + cx] <= threshold) {
+                continue;
+            }
+            int y_end = std::min(height, (cy + 1)*SP_NMS_CELL);
+            int x_end = std::min(width, (cx + 1)*SP_NMS_CELL);
+            for (int y = cy*SP_NMS_CELL; y < y_end; y ++) {
+                const float * row = prob + y*width;
+                for (int x = cx*SP_NMS_CELL; x < x_end; x ++) {
+                    if (row[x] > threshold && is_window_max(prob, width, height, x, y, radius)) {
+                        kept.push_back({row[x], y*width + x});
+                    }
+                }
+            }
+        }
+    }
+
+    if (bucket_num > 0 && (int) kept.size() > max_num) {
+        select_bucketed(kept, width, height, bucket_num, max_num);
+    } else if ((int) kept.size() > max_num) {
+        std::partial_sort(kept.begin(), kept.begin() + max_num, kept.end(), candidate_comp);
+        kept.resize(max_num);
+    } else {
+        std::sort(kept.begin(), kept.end(), candidate_comp);
+    }
+
+    for (auto & c : kept) {
+        keypoints.push_back(cv::Point2f(c.index % width, c.index / width));
+    }
+}
+
+static bool pt_conf_comp(std::pair<cv::Point2f, double> i1, std::pair<cv::Point2f, double> i2)
+{
+    return (i1.second > i2.second);
+}
+
+void NMS2(std::vector<cv::Point2f> det, cv::Mat conf, std::vector<cv::Point2f>& pts,
+            int border, int dist_thresh, int img_width, int img_height, int max_num)
+{
+
+    std::vector<cv::Point2f> pts_raw = det;
+
+    std::vector<std::pair<cv::Point2f, double>> pts_conf_vec;
+
+    cv::Mat grid = cv::Mat(cv::Size(img_width, img_height), CV_8UC1);
+    cv::Mat inds = cv::Mat(cv::Size(img_width, img_height), CV_16UC1);
+
+    cv::Mat confidence = cv::Mat(cv::Size(img_width, img_height), CV_32FC1);
+
+    grid.setTo(0);
+    inds.setTo(0);
+    confidence.setTo(0);
+
+    for (unsigned int i = 0; i < pts_raw.size(); i++)
+    {
+        int uu = (int) pts_raw[i].x;
+        int vv = (int) pts_raw[i].y;
+
+        grid.at<char>(vv, uu) = 1;
+        inds.at<unsigned short>(vv, uu) = i;
+
+        confidence.at<float>(vv, uu) = conf.at<float>(i, 0);
+    }
+
+    for (int i = 0; i < pts_raw.size(); i++)
+    {
+        int uu = (int) pts_raw[i].x;
+        int vv = (int) pts_raw[i].y;
+
+        if (grid.at<char>(vv, uu) != 1)
+            continue;
+
+        for(int k = -dist_thresh; k < (dist_thresh+1); k++)
+            for(int j = -dist_thresh; j < (dist_thresh+1); j++)
+            {
+                if(j==0 && k==0) continue;
+
+                if ( confidence.at<float>(vv + k, uu + j) < confidence.at<float>(vv, uu) ) {
+                    grid.at<char>(vv + k, uu + j) = 0;
+                }
+            }
+        grid.at<char>(vv, uu) = 2;
+    }
+
+    size_t valid_cnt = 0;
+
+    for (int v = 0; v < (img_height); v++){
+        for (int u = 0; u < (img_width); u++)
+        {
+            if (u>= (img_width - border) || u < border || v >= (img_height - border) || v < border)
+            continue;
+
+            if (grid.at<char>(v,u) == 2)
+            {
+                int select_ind = (int) inds.at<unsigned short>(v, u);
+                float _conf = confidence.at<float> (v, u);
+                cv::Point2f p = pts_raw[select_ind];
+                pts_conf_vec.push_back(std::make_pair(p, _conf));
+                valid_cnt++;
+            }
+        }
+    }
+
+    std::sort(pts_conf_vec.begin(), pts_conf_vec.end(), pt_conf_comp);
+    for (unsigned int i = 0; i < max_num && i < pts_conf_vec.size(); i ++) {
+        pts.push_back(pts_conf_vec[i].first);
+        // printf("conf:%f\n", pts_conf_vec[i].second);
+    }
+
+}
+
+}
@@ -0,0 +1,139 @@
+#include "swarm_loop/landmark_batch.h"
+#include "swarm_loop/loop_defines.h"
+#include <string.h>
+#include <algorithm>
+
+using namespace swarm_msgs;
+
+class BatchWriter {
+    uint8_t * p;
+public:
+    BatchWriter(uint8_t * _p): p(_p) {}
+    template<typename T>
+    void put(T v) {
+        memcpy(p, &v, sizeof(T));
+        p += sizeof(T);
+    }
+    void put_desc(const float * v, int dim, int format) {
+        quantize_desc(v, dim, format, p);
+        p += quantized_desc_size(dim, format);
+    }
+};
+
+class BatchReader {
+    const uint8_t * p;
+public:
+    BatchReader(const void * _p): p((const uint8_t *) _p) {}
+    template<typename T>
+    T get() {
+        T v;
+        memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return v;
+    }
+    void get_desc(float * v, int dim, int format) {
+        dequantize_desc(p, dim, format, v);
+        p += quantized_desc_size(dim, format);
+    }
+};
+
+int landmark_batch_entry_size(int desc_len, int desc_format) {
+    return sizeof(int8_t) + 7*sizeof(float) + quantized_desc_size(desc_len, desc_format);
+}
+
+std::vector<std::vector<uint8_t>> encode_landmark_batches(const ImageDescriptor_t & img_des, bool send_all, int max_bytes, int desc_format) {
+    std::vector<int> ids;
+    for (int i = 0; i < img_des.landmark_num; i ++) {
+        if (img_des.landmarks_flag[i] > 0 || send_all) {
+            ids.push_back(i);
+        }
+    }
+
+    std::vector<std::vector<uint8_t>> chunks;
+    if (ids.empty()) {
+        return chunks;
+    }
+    int entry_size = landmark_batch_entry_size(FEATURE_DESC_SIZE, desc_format);
+    int per_chunk = std::max(1, (max_bytes - LANDMARK_BATCH_HEADER_SIZE) / entry_size);
+    int chunk_num = (ids.size() + per_chunk - 1) / per_chunk;
+    chunks.resize(chunk_num);
+
+    for (int seq = 0; seq < chunk_num; seq ++) {
+        int begin = seq * per_chunk;
+        int num = std::min(per_chunk, (int) ids.size() - begin);
+        auto & chunk = chunks[seq];
+        chunk.resize(LANDMARK_BATCH_HEADER_SIZE + num * entry_size);
+        BatchWriter w(chunk.data());
+        w.put<uint32_t>(LANDMARK_BATCH_MAGIC);
+        w.put<uint8_t>(LANDMARK_BATCH_VERSION);
+        w.put<uint8_t>(desc_format);
+        w.put<uint16_t>(FEATURE_DESC_SIZE);
+        w.put<int32_t>(img_des.drone_id);
+        w.put<int64_t>(img_des.msg_id);
+        w.put<uint16_t>(seq);
+        w.put<uint16_t>(chunk_num);
+        w.put<uint16_t>(num);
+        for (int k = begin; k < begin + num; k ++) {
+            int i = ids[k];
+            w.put<int8_t>(img_des.landmarks_flag[i]);
+            w.put<float>(img_des.landmarks_2d_norm[i].x);
+            w.put<float>(img_des.landmarks_2d_norm[i].y);
+            w.put<float>(img_des.landmarks_2d[i].x);
+            w.put<float>(img_des.landmarks_2d[i].y);
+            w.put<float>(img_des.landmarks_3d[i].x);
+            w.put<float>(img_des.landmarks_3d[i].y);
+            w.put<float>(img_des.landmarks_3d[i].z);
+            w.put_desc(img_des.feature_descriptor.data() + i*FEATURE_DESC_SIZE, FEATURE_DESC_SIZE, desc_format);
+        }
+    }
+    return chunks;
+}
+
+bool parse_landmark_batch(const void * data, int size, LandmarkBatchInfo & info) {
+    if (size < LANDMARK_BATCH_HEADER_SIZE) {
+        return false;
+    }
+    BatchReader r(data);
+    if (r.get<uint32_t>() != LANDMARK_BATCH_MAGIC || r.get<uint8_t>() != LANDMARK_BATCH_VERSION) {
+        return false;
+    }
+    info.desc_format = r.get<uint8_t>();
+    info.desc_len = r.get<uint16_t>();
+    info.drone_id = r.get<int32_t>();
+    info.header_id = r.get<int64_t>();
+    info.seq = r.get<uint16_t>();
+    info.chunk_num = r.get<uint16_t>();
+    info.landmark_num = r.get<uint16_t>();
+    //Descriptors of another length can not be matched against ours
+    return desc_format_valid(info.desc_format) && info.desc_len == FEATURE_DESC_SIZE && info.seq < info.chunk_num &&
+        size == LANDMARK_BATCH_HEADER_SIZE + info.landmark_num * landmark_batch_entry_size(info.desc_len, info.desc_format);
+}
+
+void append_landmark_batch(const void * data, int size, ImageDescriptor_t & img_des) {
+    LandmarkBatchInfo info;
+    if (!parse_landmark_batch(data, size, info)) {
+        return;
+    }
+    BatchReader r((const uint8_t *) data + LANDMARK_BATCH_HEADER_SIZE);
+    size_t desc_begin = img_des.feature_descriptor.size();
+    img_des.feature_descriptor.resize(desc_begin + info.landmark_num*info.desc_len);
+    float * desc = img_des.feature_descriptor.data() + desc_begin;
+    for (int k = 0; k < info.landmark_num; k ++) {
+        Point2d_t pt2d_norm, pt2d;
+        Point3d_t pt3d;
+        int8_t flag = r.get<int8_t>();
+        pt2d_norm.x = r.get<float>();
+        pt2d_norm.y = r.get<float>();
+        pt2d.x = r.get<float>();
+        pt2d.y = r.get<float>();
+        pt3d.x = r.get<float>();
+        pt3d.y = r.get<float>();
+        pt3d.z = r.get<float>();
+        r.get_desc(desc + k*info.desc_len, info.desc_len, info.desc_format);
+        img_des.landmarks_flag.push_back(flag);
+        img_des.landmarks_2d_norm.push_back(pt2d_norm);
+        img_des.landmarks_2d.push_back(pt2d);
+        img_des.landmarks_3d.push_back(pt3d);
+    }
+    img_des.feature_descriptor_size = img_des.feature_descriptor.size();
+}
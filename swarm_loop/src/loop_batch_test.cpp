@@ -0,0 +1,103 @@
+#include "swarm_loop/inference_batch.h"
+#include <stdio.h>
+using namespace Swarm;
+
+int failed = 0;
+
+void check(bool ok, const char * what) {
+    if (!ok) {
+        printf("FAILED: %s\n", what);
+        failed ++;
+    }
+}
+
+//Every input must be in exactly one batch, in order, no batch larger than max_batch
+void check_split(int num, int max_batch) {
+    std::vector<std::pair<int, int>> batches;
+    splitBatches(num, max_batch, [&](int start, int batch) {
+        batches.emplace_back(start, batch);
+    });
+    int _max_batch = std::max(max_batch, 1);
+    int next = 0;
+    bool ok = true;
+    for (auto & b : batches) {
+        ok = ok && b.first == next && b.second >= 1 && b.second <= _max_batch;
+        next += b.second;
+    }
+    int expect_num = (num + _max_batch - 1)/_max_batch;
+    ok = ok && next == num && (int) batches.size() == expect_num;
+    //Only the last batch may be partial
+    for (size_t i = 0; i + 1 < batches.size(); i ++) {
+        ok = ok && batches[i].second == _max_batch;
+    }
+    char what[100];
+    snprintf(what, sizeof(what), "splitBatches num %d max_batch %d", num, max_batch);
+    check(ok, what);
+}
+
+//Planar RGB layout the networks take, pixel by pixel
+void check_pack(int channels, int num, int start, int batch, bool roi) {
+    int width = 7, height = 5;
+    uint64_t input_size = width*height*channels;
+    std::vector<cv::Mat> inputs;
+    for (int i = 0; i < num; i ++) {
+        cv::Mat big(height + 4, width + 6, CV_32FC(channels));
+        cv::randu(big, cv::Scalar::all(-1), cv::Scalar::all(1));
+        //An ROI is not continuous
+        cv::Mat input = big(cv::Rect(3, 2, width, height));
+        inputs.push_back(roi ? input : input.clone());
+    }
+    //Guard floats after the batch must not be written
+    std::vector<float> dst(input_size*batch + 16, 12345.0f);
+    packImageBatch(inputs, start, batch, input_size, dst.data());
+
+    bool ok = true;
+    int plane = width*height;
+    for (int i = 0; i < batch; i ++) {
+        const cv::Mat & input = inputs[start + i];
+        const float * img = dst.data() + i*input_size;
+        for (int r = 0; r < height; r ++) {
+            for (int c = 0; c < width; c ++) {
+                if (channels == 1) {
+                    ok = ok && img[r*width + c] == input.at<float>(r, c);
+                } else {
+                    auto bgr = input.at<cv::Vec3f>(r, c);
+                    ok = ok && img[r*width + c] == bgr[2] && img[plane + r*width + c] == bgr[1] && img[plane*2 + r*width + c] == bgr[0];
+                }
+            }
+        }
+    }
+    for (size_t i = input_size*batch; i < dst.size(); i ++) {
+        ok = ok && dst[i] == 12345.0f;
+    }
+    char what[100];
+    snprintf(what, sizeof(what), "packImageBatch %d channels inputs [%d, %d) of %d %s", channels, start, start + batch, num, roi ? "roi" : "continuous");
+    check(ok, what);
+}
+
+//Usage: loop_batch_test
+//Check the CPU side of batched inference without TensorRT: the split of the inputs into batches
+//and the packing of 1 and 3 channel images into the planar batch buffer.
+int main(int argc, char* argv[]) {
+    int nums[] = {0, 1, 2, 3, 5, 7, 8, 13};
+    int max_batches[] = {0, 1, 2, 3, 4, 8, 16};
+    for (int num : nums) {
+        for (int max_batch : max_batches) {
+            check_split(num, max_batch);
+        }
+    }
+
+    for (int channels : {1, 3}) {
+        for (bool roi : {false, true}) {
+            //Full batch, odd batch in the middle, partial last batch of a split by 3
+            check_pack(channels, 4, 0, 4, roi);
+            check_pack(channels, 7, 1, 3, roi);
+            splitBatches(7, 3, [&](int start, int batch) {
+                check_pack(channels, 7, start, batch, roi);
+            });
+        }
+    }
+
+    printf("%s\n", failed == 0 ? "OK" : "FAILED");
+    return failed == 0 ? 0 : -1;
+}
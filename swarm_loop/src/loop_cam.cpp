@@ -1,4 +1,5 @@
 #include <swarm_loop/loop_cam.h>
+#include <swarm_loop/feature_matcher.h>
 #include <camodocal/camera_models/CameraFactory.h>
 #include <cv_bridge/cv_bridge.h>
 #include <opencv2/opencv.hpp>
@@ -11,28 +12,43 @@ using namespace std::chrono;
 
 double TRIANGLE_THRES;
 
-#define USE_TENSORRT
-
 LoopCam::LoopCam(CameraConfig _camera_configuration, 
     const std::string &camera_config_path, 
     const std::string &superpoint_model, 
     std::string _pca_comp,
     std::string _pca_mean,
     double thres, int max_kp_num,
-    const std::string & netvlad_model, int width, int height, int _self_id, bool _send_img, ros::NodeHandle &nh) : 
+    const std::string & netvlad_model, int width, int height, int _self_id, bool _send_img, ros::NodeHandle &nh, int _extraction_threads) : 
     camera_configuration(_camera_configuration),
     self_id(_self_id),
-#ifdef USE_TENSORRT
-    superpoint_net(superpoint_model, _pca_comp, _pca_mean, width, height, thres, max_kp_num), 
-    netvlad_net(netvlad_model, width, height), 
-#endif
+    extraction_threads(std::max(_extraction_threads, 1)),
     send_img(_send_img)
 {
+    for (int i = 0; i < extraction_threads; i ++) {
+#ifdef USE_TENSORRT
+        superpoint_nets.emplace_back(new Swarm::SuperPointTensorRT(superpoint_model, _pca_comp, _pca_mean, width, height, thres, max_kp_num, false, 2));
+        netvlad_nets.emplace_back(new Swarm::MobileNetVLADTensorRT(netvlad_model, width, height));
+        superpoint_nets.back()->initAsync();
+        netvlad_nets.back()->initAsync();
+#elif defined(USE_ONNX)
+        superpoint_nets.emplace_back(new Swarm::SuperPointONNX(superpoint_model, _pca_comp, _pca_mean, width, height, thres, max_kp_num, ONNX_NUM_THREADS));
+        netvlad_nets.emplace_back(new Swarm::MobileNetVLADONNX(netvlad_model, width, height, ONNX_NUM_THREADS));
+#endif
+#if defined(USE_TENSORRT) || defined(USE_ONNX)
+        superpoint_nets.back()->nms_bucket_num = SUPERPOINT_NMS_BUCKETS;
+#endif
+    }
+    for (int i = 1; i < extraction_threads; i ++) {
+        extraction_workers.emplace_back(new PipelineStage<std::function<void()>>("extraction", 1, STAGE_BLOCK,
+            [] (std::function<void()> & job) { job(); }));
+    }
+    ROS_INFO("[SWARM_LOOP] LoopCam with %d extraction workers", extraction_threads);
+
     camodocal::CameraFactory cam_factory;
     ROS_INFO("Read camera from %s", camera_config_path.c_str());
     cam = cam_factory.generateCameraFromYamlFile(camera_config_path);
 
-#ifndef USE_TENSORRT
+#if !defined(USE_TENSORRT) && !defined(USE_ONNX)
     hfnet_client = nh.serviceClient<HFNetSrv>("/swarm_loop/hfnet");
     superpoint_client = nh.serviceClient<HFNetSrv>("/swarm_loop/superpoint");
 #endif
@@ -138,16 +154,11 @@ cv::Mat drawMatches(std::vector<cv::Point2f> pts1, std::vector<cv::Point2f> pts2
     return _show;
 }
 
-void LoopCam::match_HFNet_local_features(std::vector<cv::Point2f> & pts_up, std::vector<cv::Point2f> & pts_down, std::vector<float> _desc_up, std::vector<float> _desc_down, 
+void LoopCam::match_HFNet_local_features(std::vector<cv::Point2f> & pts_up, std::vector<cv::Point2f> & pts_down, const std::vector<float> & _desc_up, const std::vector<float> & _desc_down, 
         std::vector<int> & ids_up, std::vector<int> & ids_down) {
     printf("match_HFNet_local_features %ld %ld: ", pts_up.size(), pts_down.size());
-    cv::Mat desc_up( _desc_up.size()/FEATURE_DESC_SIZE, FEATURE_DESC_SIZE, CV_32F, _desc_up.data());
-    cv::Mat desc_down( _desc_down.size()/FEATURE_DESC_SIZE, FEATURE_DESC_SIZE, CV_32F, _desc_down.data());
-
-    cv::BFMatcher bfmatcher(cv::NORM_L2, true);
-
     std::vector<cv::DMatch> _matches;
-    bfmatcher.match(desc_up, desc_down, _matches);
+    Swarm::matchDescriptors(_desc_up, _desc_down, _matches);
 
     std::vector<cv::Point2f> _pts_up, _pts_down;
     std::vector<int> ids;
@@ -181,20 +192,41 @@ FisheyeFrameDescriptor_t LoopCam::on_flattened_images(const StereoFrame & msg, s
     
     imgs.resize(msg.left_images.size());
 
-    cv::Mat _show, tmp;
+    cv::Mat _show;
     TicToc tt;
     static int t_count = 0;
     static double tt_sum = 0;
 
-    for (unsigned int i = 0; i < msg.left_images.size(); i ++) {
-        if (camera_configuration == CameraConfig::PINHOLE_DEPTH) {
-            frame_desc.images.push_back(generate_gray_depth_image_descriptor(msg, imgs[i], i, tmp));
-            frame_desc.images[i].direction = i;
-        } else {
-            frame_desc.images.push_back(generate_stereo_image_descriptor(msg, imgs[i], i, tmp));
+    int dir_num = msg.left_images.size();
+    std::vector<cv::Mat> shows(dir_num);
+    frame_desc.images.resize(dir_num);
+
+    auto process_dirs = [&] (int worker_id) {
+        for (int i = worker_id; i < dir_num; i += extraction_threads) {
+            if (camera_configuration == CameraConfig::PINHOLE_DEPTH) {
+                frame_desc.images[i] = generate_gray_depth_image_descriptor(msg, imgs[i], i, shows[i], worker_id);
+            } else {
+                frame_desc.images[i] = generate_stereo_image_descriptor(msg, imgs[i], i, shows[i], worker_id);
+            }
             frame_desc.images[i].direction = i;
         }
+    };
+
+    std::vector<std::future<void>> done;
+    for (int worker_id = 1; worker_id < extraction_threads && worker_id < dir_num; worker_id ++) {
+        auto promise = std::make_shared<std::promise<void>>();
+        done.emplace_back(promise->get_future());
+        extraction_workers[worker_id - 1]->push([&process_dirs, promise, worker_id] () {
+            process_dirs(worker_id);
+            promise->set_value();
+        });
+    }
+    process_dirs(0);
+    for (auto & d : done) {
+        d.wait();
+    }
 
+    for (auto & tmp : shows) {
         if (_show.cols == 0) {
             _show = tmp;
         } else {
@@ -228,7 +260,7 @@ FisheyeFrameDescriptor_t LoopCam::on_flattened_images(const StereoFrame & msg, s
     return frame_desc;
 }
 
-ImageDescriptor_t LoopCam::generate_gray_depth_image_descriptor(const StereoFrame & msg, cv::Mat & img, const int & vcam_id, cv::Mat & _show)
+ImageDescriptor_t LoopCam::generate_gray_depth_image_descriptor(const StereoFrame & msg, cv::Mat & img, const int & vcam_id, cv::Mat & _show, int worker_id)
 {
     if (vcam_id > msg.left_images.size()) {
         ROS_WARN("Flatten images too few");
@@ -238,7 +270,7 @@ ImageDescriptor_t LoopCam::generate_gray_depth_image_descriptor(const StereoFram
         return ides;
     }
     
-    ImageDescriptor_t ides = extractor_img_desc_deepnet(msg.stamp, msg.left_images[vcam_id], LOWER_CAM_AS_MAIN);
+    ImageDescriptor_t ides = extractor_img_desc_deepnet(msg.stamp, msg.left_images[vcam_id], LOWER_CAM_AS_MAIN, worker_id);
 
     if (ides.image_desc_size == 0)
     {
@@ -338,7 +370,7 @@ ImageDescriptor_t LoopCam::generate_gray_depth_image_descriptor(const StereoFram
     return ides;
 }
 
-ImageDescriptor_t LoopCam::generate_stereo_image_descriptor(const StereoFrame & msg, cv::Mat & img, const int & vcam_id, cv::Mat & _show)
+ImageDescriptor_t LoopCam::generate_stereo_image_descriptor(const StereoFrame & msg, cv::Mat & img, const int & vcam_id, cv::Mat & _show, int worker_id)
 {
     if (vcam_id > msg.left_images.size()) {
         ROS_WARN("Flatten images too few");
@@ -347,8 +379,8 @@ ImageDescriptor_t LoopCam::generate_stereo_image_descriptor(const StereoFrame &
         return ides;
     }
     
-    ImageDescriptor_t ides = extractor_img_desc_deepnet(msg.stamp, msg.left_images[vcam_id], LOWER_CAM_AS_MAIN);
-    ImageDescriptor_t ides_down = extractor_img_desc_deepnet(msg.stamp, msg.right_images[vcam_id], !LOWER_CAM_AS_MAIN);
+    ImageDescriptor_t ides, ides_down;
+    extractor_stereo_desc_deepnet(msg.stamp, msg.left_images[vcam_id], msg.right_images[vcam_id], ides, ides_down, worker_id);
 
     if (ides.image_desc_size == 0 && ides_down.image_desc_size == 0)
     {
@@ -522,10 +554,7 @@ ImageDescriptor_t LoopCam::generate_stereo_image_descriptor(const StereoFrame &
 
 }
 
-ImageDescriptor_t LoopCam::extractor_img_desc_deepnet(ros::Time stamp, cv::Mat img, bool superpoint_mode)
-{
-    auto start = high_resolution_clock::now();
-
+ImageDescriptor_t LoopCam::prepare_img_desc(ros::Time stamp, cv::Mat & img) {
     ImageDescriptor_t img_des;
     img_des.timestamp = toLCMTime(stamp);
     img_des.image_desc_size = 0;
@@ -534,12 +563,50 @@ ImageDescriptor_t LoopCam::extractor_img_desc_deepnet(ros::Time stamp, cv::Mat i
     img_des.landmark_num = 0;
 
     if (camera_configuration == CameraConfig::STEREO_FISHEYE) {
-    cv::Mat roi = img(cv::Rect(0, img.rows*3/4, img.cols, img.rows/4));
-    roi.setTo(cv::Scalar(0, 0, 0));
+        //img may share the data of the ROS message, mask a copy
+        img = img.clone();
+        cv::Mat roi = img(cv::Rect(0, img.rows*3/4, img.cols, img.rows/4));
+        roi.setTo(cv::Scalar(0, 0, 0));
     }
+    return img_des;
+}
+
+void LoopCam::extractor_stereo_desc_deepnet(ros::Time stamp, cv::Mat img_up, cv::Mat img_down, 
+        ImageDescriptor_t & ides_up, ImageDescriptor_t & ides_down, int worker_id) {
+#if defined(USE_TENSORRT) || defined(USE_ONNX)
+    ides_up = prepare_img_desc(stamp, img_up);
+    ides_down = prepare_img_desc(stamp, img_down);
+    cv::Mat & img_main = LOWER_CAM_AS_MAIN ? img_down : img_up;
 #ifdef USE_TENSORRT
-    std::vector<cv::Point2f> features;
-    superpoint_net.inference(img, features, img_des.feature_descriptor);
+    //NetVLAD of the main image runs on its own stream while SuperPoint is running
+    auto netvlad_future = netvlad_nets[worker_id]->inferenceAsync(img_main);
+#endif
+
+    //Up and down images go through SuperPoint in one batch
+    std::vector<std::vector<cv::Point2f>> features;
+    std::vector<std::vector<float>> local_descriptors;
+    superpoint_nets[worker_id]->inference(std::vector<cv::Mat>{img_up, img_down}, features, local_descriptors);
+    ides_up.feature_descriptor = local_descriptors[0];
+    ides_down.feature_descriptor = local_descriptors[1];
+
+    fill_img_desc_deepnet(ides_up, img_up, features[0], worker_id);
+    fill_img_desc_deepnet(ides_down, img_down, features[1], worker_id);
+
+    ImageDescriptor_t & ides_main = LOWER_CAM_AS_MAIN ? ides_down : ides_up;
+#ifdef USE_TENSORRT
+    ides_main.image_desc = netvlad_future.get();
+#else
+    ides_main.image_desc = netvlad_nets[worker_id]->inference(img_main);
+#endif
+    ides_main.image_desc_size = ides_main.image_desc.size();
+#else
+    ides_up = extractor_img_desc_deepnet(stamp, img_up, LOWER_CAM_AS_MAIN, worker_id);
+    ides_down = extractor_img_desc_deepnet(stamp, img_down, !LOWER_CAM_AS_MAIN, worker_id);
+#endif
+}
+
+#if defined(USE_TENSORRT) || defined(USE_ONNX)
+void LoopCam::fill_img_desc_deepnet(ImageDescriptor_t & img_des, cv::Mat img, const std::vector<cv::Point2f> & features, int worker_id) {
     img_des.image_desc_size = 0;
     img_des.image_desc.clear();
     CVPoints2LCM(features, img_des.landmarks_2d);
@@ -550,11 +617,6 @@ ImageDescriptor_t LoopCam::extractor_img_desc_deepnet(ros::Time stamp, cv::Mat i
     img_des.landmarks_2d_norm.clear();
     img_des.image_size = 0;
 
-    if (!superpoint_mode) {
-        img_des.image_desc = netvlad_net.inference(img);
-        img_des.image_desc_size = img_des.image_desc.size();
-    }
-
     for (unsigned int i = 0; i < img_des.landmarks_2d.size(); i++)
     {
         auto pt_up = img_des.landmarks_2d[i];
@@ -575,13 +637,45 @@ ImageDescriptor_t LoopCam::extractor_img_desc_deepnet(ros::Time stamp, cv::Mat i
         img_des.landmarks_flag.push_back(0);
 
         if (OUTPUT_RAW_SUPERPOINT_DESC) {
+            std::lock_guard<std::mutex> guard(fsp_lock);
             for (int j = 0; j < FEATURE_DESC_SIZE; j ++) {
                 fsp << img_des.feature_descriptor[i*FEATURE_DESC_SIZE + j] << " ";
             }
             fsp << std::endl;
         }
     } 
+}
+#endif
+
+ImageDescriptor_t LoopCam::extractor_img_desc_deepnet(ros::Time stamp, cv::Mat img, bool superpoint_mode, int worker_id)
+{
+    auto start = high_resolution_clock::now();
 
+    ImageDescriptor_t img_des = prepare_img_desc(stamp, img);
+#if defined(USE_TENSORRT) || defined(USE_ONNX)
+#ifdef USE_TENSORRT
+    //SuperPoint and NetVLAD run on their own streams, the SuperPoint NMS and descriptors run on its completion thread
+    auto superpoint_future = superpoint_nets[worker_id]->inferenceAsync(img);
+    std::future<std::vector<float>> netvlad_future;
+    if (!superpoint_mode) {
+        netvlad_future = netvlad_nets[worker_id]->inferenceAsync(img);
+    }
+    auto superpoint_result = superpoint_future.get();
+    std::vector<cv::Point2f> & features = superpoint_result.keypoints;
+    img_des.feature_descriptor = std::move(superpoint_result.local_descriptors);
+#else
+    std::vector<cv::Point2f> features;
+    superpoint_nets[worker_id]->inference(img, features, img_des.feature_descriptor);
+#endif
+    fill_img_desc_deepnet(img_des, img, features, worker_id);
+    if (!superpoint_mode) {
+#ifdef USE_TENSORRT
+        img_des.image_desc = netvlad_future.get();
+#else
+        img_des.image_desc = netvlad_nets[worker_id]->inference(img);
+#endif
+        img_des.image_desc_size = img_des.image_desc.size();
+    }
     return img_des;
 #else
     HFNetSrv hfnet_srv;
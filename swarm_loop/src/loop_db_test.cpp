@@ -0,0 +1,142 @@
+#include "swarm_loop/loop_detector.h"
+#include <swarm_msgs/swarm_lcm_converter.hpp>
+#include <geometry_msgs/Pose.h>
+#include <random>
+#include <stdio.h>
+#include <unistd.h>
+
+#define DB_DIRS 4
+//200 landmarks per keyframe
+#define DB_LANDMARKS 50
+
+double rss_mb() {
+    long pages = 0, resident = 0;
+    FILE * f = fopen("/proc/self/statm", "r");
+    if (f) {
+        fscanf(f, "%ld %ld", &pages, &resident);
+        fclose(f);
+    }
+    return resident * sysconf(_SC_PAGESIZE) / 1024.0 / 1024.0;
+}
+
+//Opens the keyframe database of LoopDetector to the test
+class DatabaseProbe : public LoopDetector {
+public:
+    DatabaseProbe(int _self_id): LoopDetector(_self_id) {
+    }
+
+    void add(const FisheyeFrameDescriptor_t & flatten_desc) {
+        add_keyframe(flatten_desc, std::vector<cv::Mat>(flatten_desc.images.size()));
+    }
+
+    size_t frames() const {
+        return evictor.size();
+    }
+
+    double mb() const {
+        return evictor.bytes()/1024.0/1024.0;
+    }
+
+    //The maps, the index and the evictor hold the same keyframes. With full, every image maps to a kept keyframe
+    //and a search of desc returns kept images only
+    bool consistent(bool full, const float * desc) {
+        size_t frames = evictor.size();
+        bool ok = database_size() == (int) imgid2fisheye.size() && imgid2dir.size() == imgid2fisheye.size() &&
+            fisheyeframe_database.size() == frames && fisheye2imgids.size() == frames && msgid2cvimgs.size() == frames;
+        if (!ok || !full) {
+            return ok;
+        }
+        for (auto & it : imgid2fisheye) {
+            ok = ok && fisheyeframe_database.find(it.second) != fisheyeframe_database.end();
+        }
+        float distances[SEARCH_NEAREST_NUM];
+        faiss::Index::idx_t labels[SEARCH_NEAREST_NUM];
+        local_index.search(desc, SEARCH_NEAREST_NUM, distances, labels);
+        for (int i = 0; i < SEARCH_NEAREST_NUM; i ++) {
+            ok = ok && (labels[i] < 0 || imgid2fisheye.find(labels[i]) != imgid2fisheye.end());
+        }
+        return ok;
+    }
+};
+
+//Usage: loop_db_test [frames] [budget_mb] [policy] [index_factory]
+//Feed a synthetic keyframe stream of one drone flying a random walk into the bounded LoopDetector database,
+//check after every keyframe that eviction keeps its maps, index and evictor consistent and print its size and the process RSS.
+int main(int argc, char* argv[]) {
+    int frames = argc > 1 ? atoi(argv[1]) : 100000;
+    double budget_mb = argc > 2 ? atof(argv[2]) : 200;
+    int policy = argc > 3 ? atoi(argv[3]) : EVICT_LRU;
+    std::string factory = argc > 4 ? argv[4] : "Flat";
+
+    KEYFRAME_DB_MAX_MB = budget_mb;
+    KEYFRAME_DB_MAX_FRAMES = 0;
+    KEYFRAME_DB_EVICTION = policy;
+    KEYFRAME_DB_SPATIAL_RADIUS = 1.0;
+    LOOP_INDEX_FACTORY = factory;
+    LOOP_INDEX_SEARCH_PARAMS = "";
+    LOOP_INDEX_TRAIN_SIZE = 2000;
+    LOOP_INDEX_REBUILD_STALE = 0.1;
+    pos_covariance_per_meter = 4e-3;
+    yaw_covariance_per_meter = 4e-5;
+    //An eviction is logged at every keyframe
+    if (ros::console::set_logger_level(ROSCONSOLE_DEFAULT_NAME, ros::console::levels::Warn)) {
+        ros::console::notifyLoggerLevelsChanged();
+    }
+
+    DatabaseProbe detector(0);
+    std::mt19937 rng(0);
+    std::normal_distribution<float> normal(0, 1);
+    geometry_msgs::Pose pose;
+    pose.orientation.w = 1;
+    double max_rss = 0, rss_half = 0;
+    int report_interval = std::max(frames/10, 1);
+
+    for (int64_t msg_id = 0; msg_id < frames; msg_id ++) {
+        pose.position.x += normal(rng)*0.3;
+        pose.position.y += normal(rng)*0.3;
+        pose.position.z += normal(rng)*0.03;
+
+        FisheyeFrameDescriptor_t desc;
+        desc.msg_id = msg_id;
+        desc.drone_id = 0;
+        desc.image_num = DB_DIRS;
+        desc.landmark_num = DB_DIRS*DB_LANDMARKS;
+        desc.pose_drone = fromROSPose(pose);
+        for (int i = 0; i < DB_DIRS; i ++) {
+            ImageDescriptor_t img;
+            img.msg_id = msg_id*DB_DIRS + i;
+            img.drone_id = 0;
+            img.landmark_num = DB_LANDMARKS;
+            img.image_desc.resize(DEEP_DESC_SIZE);
+            for (auto & v : img.image_desc) {
+                v = normal(rng);
+            }
+            img.image_desc_size = img.image_desc.size();
+            img.feature_descriptor.resize(DB_LANDMARKS*FEATURE_DESC_SIZE, 0.5);
+            img.feature_descriptor_size = img.feature_descriptor.size();
+            desc.images.push_back(img);
+        }
+        detector.add(desc);
+
+        bool full = msg_id % report_interval == 0 || msg_id == frames - 1;
+        if (!detector.consistent(full, desc.images[0].image_desc.data())) {
+            printf("Frame %ld: database inconsistent, %ld keyframes %d indexed images\n",
+                msg_id, detector.frames(), detector.database_size());
+            return -1;
+        }
+
+        double rss = rss_mb();
+        max_rss = std::max(max_rss, rss);
+        if (msg_id == frames/2) {
+            rss_half = max_rss;
+        }
+        if (msg_id % report_interval == 0) {
+            printf("Frame %ld: %ld keyframes %d indexed images %.1fMB budget %.1fMB RSS %.1fMB\n", msg_id,
+                detector.frames(), detector.database_size(), detector.mb(), budget_mb, rss);
+        }
+    }
+
+    //Flat profile: no growth of the peak RSS over the second half of the stream
+    printf("Peak RSS %.1fMB at half, %.1fMB at end\n", rss_half, max_rss);
+    return max_rss < rss_half*1.1 ? 0 : -1;
+}
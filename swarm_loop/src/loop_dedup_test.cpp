@@ -0,0 +1,161 @@
+#include "swarm_loop/msg_dedup.h"
+#include <swarm_msgs/swarm_types.hpp>
+#include <random>
+#include <algorithm>
+#include <set>
+#include <stdio.h>
+
+#define TEST_WINDOW 1024
+#define TEST_MESSAGES 1000000
+
+int failed = 0;
+
+void check(bool ok, const char * name) {
+    printf("%-52s %s\n", name, ok ? "OK" : "FAILED");
+    failed += !ok;
+}
+
+//Marks seqs from one sender and compares with a std::set limited to the newest window, seqs older than it count as seen
+bool agrees_with_set(SlidingWindowDedup & dedup, int sender, const std::vector<int64_t> & seqs, int window) {
+    std::set<int64_t> seen;
+    int64_t head = -1;
+    for (auto seq : seqs) {
+        bool expect_new = seen.find(seq) == seen.end() && (head < 0 || seq > head - window);
+        if (dedup.contains(sender, seq) == expect_new || dedup.mark(sender, seq) != expect_new) {
+            return false;
+        }
+        seen.insert(seq);
+        head = std::max(head, seq);
+    }
+    return true;
+}
+
+void test_order() {
+    std::mt19937 rng(0);
+    SlidingWindowDedup dedup(TEST_WINDOW);
+    std::vector<int64_t> seqs;
+    for (int64_t i = 0; i < 100000; i ++) {
+        seqs.push_back(i);
+    }
+    check(agrees_with_set(dedup, 1, seqs, TEST_WINDOW), "in order");
+
+    //Each seq moved by up to half a window and repeated sometimes
+    SlidingWindowDedup dedup2(TEST_WINDOW);
+    std::vector<int64_t> reordered;
+    std::uniform_int_distribution<int> jitter(0, TEST_WINDOW/2);
+    std::vector<std::pair<int64_t, int64_t>> keys;
+    for (int64_t i = 0; i < 100000; i ++) {
+        keys.emplace_back(i + jitter(rng), i);
+        if (i % 7 == 0) {
+            keys.emplace_back(i + jitter(rng), i);
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    for (auto & k : keys) {
+        reordered.push_back(k.second);
+    }
+    check(agrees_with_set(dedup2, 1, reordered, TEST_WINDOW), "reordered within the window, duplicated");
+
+    SlidingWindowDedup dedup3(TEST_WINDOW);
+    dedup3.mark(1, 100);
+    dedup3.mark(1, 100 + 10*TEST_WINDOW);
+    check(dedup3.contains(1, 100) && dedup3.contains(1, 101) && !dedup3.contains(1, 100 + 10*TEST_WINDOW - 1) &&
+        dedup3.mark(1, 100 + 10*TEST_WINDOW - 1) && !dedup3.mark(1, 100 + 10*TEST_WINDOW),
+        "jump over more than a window");
+
+    //Seqs are never negative, a fresh window must not treat 0 as a duplicate
+    SlidingWindowDedup dedup4(TEST_WINDOW);
+    check(!dedup4.contains(0, 0) && dedup4.mark(0, 0) && !dedup4.mark(0, 0), "seq 0 of drone 0");
+}
+
+void test_wraparound() {
+    //Small sequence space, wraps many times
+    int bits = 12;
+    SlidingWindowDedup dedup(64, bits);
+    bool ok = true;
+    for (int64_t i = 0; i < 100000; i ++) {
+        int64_t seq = i & ((1 << bits) - 1);
+        ok = ok && !dedup.contains(1, seq) && dedup.mark(1, seq) && !dedup.mark(1, seq);
+        if (i >= 10) {
+            //Late duplicate of a recent seq across the wrap
+            ok = ok && dedup.contains(1, (i - 10) & ((1 << bits) - 1));
+        }
+    }
+    check(ok, "wraparound of 12 bit seqs");
+
+    //Message ids across the end of the 40 bit sequence
+    SlidingWindowDedup dedup2;
+    int64_t start = MSG_ID_SEQ_MASK - 100;
+    ok = true;
+    std::vector<int64_t> ids;
+    for (int64_t i = 0; i < 200; i ++) {
+        ids.push_back(make_msg_id(5, start + i));
+    }
+    std::swap(ids[90], ids[110]);
+    for (auto id : ids) {
+        ok = ok && msg_id_drone(id) == 5 && dedup2.mark(id) && dedup2.contains(id);
+    }
+    for (auto id : ids) {
+        ok = ok && !dedup2.mark(id);
+    }
+    ok = ok && !dedup2.contains(make_msg_id(5, 100)) && dedup2.contains(make_msg_id(5, start - 5000));
+    check(ok, "message ids across 2^40");
+
+    MsgSequence seq;
+    int64_t a = seq.next_id(3), b = seq.next_id(3);
+    check(msg_id_drone(a) == 3 && msg_id_seq(b) == msg_id_seq(a) + 1, "MsgSequence");
+}
+
+void test_senders() {
+    SlidingWindowDedup dedup(TEST_WINDOW);
+    bool ok = true;
+    for (int64_t i = 0; i < 10000; i ++) {
+        for (int drone = 0; drone < 10; drone ++) {
+            //Drones with very different sequence starts
+            ok = ok && dedup.mark(make_msg_id(drone, drone*1000000000LL + i));
+        }
+    }
+    for (int drone = 0; drone < 10; drone ++) {
+        ok = ok && dedup.contains(make_msg_id(drone, drone*1000000000LL + 9999)) &&
+            !dedup.contains(make_msg_id(drone, drone*1000000000LL + 10000));
+    }
+    ok = ok && dedup.senders() == 10;
+    check(ok, "10 independent senders");
+    printf("Memory: %d bytes per sender for any number of messages\n", dedup.bytes_per_sender());
+}
+
+void benchmark() {
+    std::vector<int64_t> ids;
+    for (int64_t i = 0; i < TEST_MESSAGES; i ++) {
+        ids.push_back(make_msg_id(i % 5, i));
+    }
+    SlidingWindowDedup dedup;
+    TicToc tic;
+    int dup = 0;
+    for (auto id : ids) {
+        dup += dedup.contains(id);
+        dedup.mark(id);
+    }
+    double dt_window = tic.toc();
+
+    std::set<int64_t> set;
+    TicToc tic_set;
+    for (auto id : ids) {
+        dup += set.find(id) != set.end();
+        set.insert(id);
+    }
+    double dt_set = tic_set.toc();
+    printf("%d messages: sliding window %.1fns/msg %d bytes, std::set %.1fns/msg %ld bytes at least\n", TEST_MESSAGES,
+        dt_window*1e6/TEST_MESSAGES, dedup.senders()*dedup.bytes_per_sender(),
+        dt_set*1e6/TEST_MESSAGES, set.size()*(sizeof(int64_t) + 3*sizeof(void*)));
+}
+
+//Usage: loop_dedup_test
+//Check SlidingWindowDedup against std::set on in order, reordered, duplicated and wrapping sequences and compare their speed.
+int main(int argc, char* argv[]) {
+    test_order();
+    test_wraparound();
+    test_senders();
+    benchmark();
+    return failed > 0 ? -1 : 0;
+}
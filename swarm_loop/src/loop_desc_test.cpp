@@ -0,0 +1,95 @@
+#include "swarm_loop/superpoint_common.h"
+#include "swarm_msgs/swarm_types.hpp"
+#include <torch/csrc/autograd/variable.h>
+#include <ATen/ATen.h>
+#include <ATen/Parallel.h>
+#include <torch/csrc/api/include/torch/types.h>
+using namespace Swarm;
+
+#define DESC_WIDTH 400
+#define DESC_HEIGHT 208
+#define DESC_ITERS 1000
+//Relative to the largest output, sums are accumulated in a different order
+#define DESC_TOLERANCE 1e-5
+
+//The former computeDescriptors with torch::grid_sampler, as reference
+void computeDescriptorsTorch(float * desc_map, const std::vector<cv::Point2f> &keypoints, std::vector<float> & local_descriptors,
+        int width, int height, const Eigen::MatrixXf & pca_comp_T, const Eigen::RowVectorXf & pca_mean) {
+    auto mDesc = at::from_blob(desc_map, {1, SP_DESC_RAW_LEN, height/8, width/8}, torch::TensorOptions().dtype(torch::kFloat32));
+    cv::Mat kpt_mat(keypoints.size(), 2, CV_32F);  // [n_keypoints, 2]  (y, x)
+    for (size_t i = 0; i < keypoints.size(); i++) {
+        kpt_mat.at<float>(i, 0) = (float)keypoints[i].y;
+        kpt_mat.at<float>(i, 1) = (float)keypoints[i].x;
+    }
+
+    auto fkpts = torch::from_blob(kpt_mat.data, {(long) keypoints.size(), 2}, torch::kFloat);
+
+    auto grid = torch::zeros({1, 1, fkpts.size(0), 2});  // [1, 1, n_keypoints, 2]
+    grid[0][0].slice(1, 0, 1) = 2.0 * fkpts.slice(1, 1, 2) / width - 1;  // x
+    grid[0][0].slice(1, 1, 2) = 2.0 * fkpts.slice(1, 0, 1) / height - 1;  // y
+
+    auto desc = torch::grid_sampler(mDesc, grid, 0, 0, 0);
+    desc = desc.squeeze(0).squeeze(1);
+
+    auto dn = torch::norm(desc, 2, 1);
+    desc = desc.div(torch::unsqueeze(dn, 1));
+
+    desc = desc.transpose(0, 1).contiguous();
+    Eigen::Map<Eigen::Matrix<float,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor>> _desc(desc.data<float>(), desc.size(0), desc.size(1));
+    Eigen::Matrix<float,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> _desc_new = (_desc.rowwise() - pca_mean) *pca_comp_T;
+    local_descriptors = std::vector<float>(_desc_new.data(), _desc_new.data()+_desc_new.cols()*_desc_new.rows());
+}
+
+//Usage: loop_desc_test [pca_comp.csv pca_mean.csv]
+//Compare the native descriptor sampling with torch::grid_sampler and benchmark both, random PCA if no csv given.
+int main(int argc, char* argv[]) {
+    at::set_num_threads(1);
+    Eigen::MatrixXf pca_comp_T;
+    Eigen::RowVectorXf pca_mean;
+    if (argc > 2) {
+        pca_comp_T = load_csv_mat_eigen(argv[1]).transpose();
+        pca_mean = load_csv_vec_eigen(argv[2]).transpose();
+    } else {
+        pca_comp_T = Eigen::MatrixXf::Random(SP_DESC_RAW_LEN, 64);
+        pca_mean = Eigen::RowVectorXf::Random(SP_DESC_RAW_LEN);
+    }
+
+    cv::RNG rng(0);
+    cv::Mat desc_map(1, SP_DESC_RAW_LEN*DESC_HEIGHT/8*DESC_WIDTH/8, CV_32F);
+    rng.fill(desc_map, cv::RNG::NORMAL, 0, 1);
+
+    //Random keypoints, including the image border where the bilinear taps fall out of the map
+    std::vector<cv::Point2f> keypoints;
+    for (int i = 0; i < 200; i ++) {
+        keypoints.push_back(cv::Point2f(rng.uniform(0, DESC_WIDTH), rng.uniform(0, DESC_HEIGHT)));
+    }
+    keypoints.push_back(cv::Point2f(0, 0));
+    keypoints.push_back(cv::Point2f(DESC_WIDTH - 1, DESC_HEIGHT - 1));
+
+    std::vector<float> ref, out;
+    TicToc tic;
+    for (int i = 0; i < DESC_ITERS; i ++) {
+        computeDescriptorsTorch((float*) desc_map.data, keypoints, ref, DESC_WIDTH, DESC_HEIGHT, pca_comp_T, pca_mean);
+    }
+    double dt_torch = tic.toc()/DESC_ITERS;
+
+    TicToc tic2;
+    for (int i = 0; i < DESC_ITERS; i ++) {
+        computeDescriptors((float*) desc_map.data, keypoints, out, DESC_WIDTH, DESC_HEIGHT, pca_comp_T, pca_mean);
+    }
+    double dt_native = tic2.toc()/DESC_ITERS;
+
+    if (ref.size() != out.size()) {
+        printf("Descriptor size mismatch torch %ld native %ld\n", ref.size(), out.size());
+        return -1;
+    }
+    double max_err = 0, max_val = 1e-10;
+    for (size_t i = 0; i < ref.size(); i ++) {
+        max_err = std::max(max_err, (double) fabs(ref[i] - out[i]));
+        max_val = std::max(max_val, (double) fabs(ref[i]));
+    }
+    max_err = max_err / max_val;
+    printf("%ld keypoints: torch %.3fms native %.3fms speedup %.1fx max relative err %e %s\n", keypoints.size(),
+        dt_torch, dt_native, dt_torch/dt_native, max_err, max_err <= DESC_TOLERANCE ? "OK" : "FAILED");
+    return max_err <= DESC_TOLERANCE ? 0 : -1;
+}
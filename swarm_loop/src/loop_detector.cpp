@@ -1,12 +1,15 @@
 #include <swarm_loop/loop_detector.h>
+#include <swarm_loop/feature_matcher.h>
+#include <swarm_loop/pnp_prosac.h>
 #include <swarm_msgs/swarm_lcm_converter.hpp>
 #include <opencv2/opencv.hpp>
 #include <chrono> 
 
+static_assert(FEATURE_DESC_SIZE == MATCH_DESC_SIZE, "Landmark descriptors must have the size of the matcher");
+
 using namespace std::chrono; 
 
 #define USE_FUNDMENTAL
-#define MAX_LOOP_ID 100000000
 
 void LoopDetector::on_image_recv(const FisheyeFrameDescriptor_t & flatten_desc, std::vector<cv::Mat> imgs) {
     TicToc tt;
@@ -87,8 +90,7 @@ void LoopDetector::on_image_recv(const FisheyeFrameDescriptor_t & flatten_desc,
         }
 
         if (!flatten_desc.prevent_adding_db || new_node) {
-            add_to_database(flatten_desc);
-            msgid2cvimgs[flatten_desc.msg_id] = imgs;
+            add_keyframe(flatten_desc, imgs);
         } else {
             ROS_DEBUG("[SWARM_LOOP] This image is prevent to adding to DB");
         }
@@ -99,26 +101,15 @@ void LoopDetector::on_image_recv(const FisheyeFrameDescriptor_t & flatten_desc,
 
             ROS_INFO("[SWARM_LOOP] Querying image from database size %d init_mode %d nonkeyframe %d", database_size(), init_mode, flatten_desc.prevent_adding_db);
             
-            int direction = 1;
-            int direction_old = -1;
-            FisheyeFrameDescriptor_t & _old_fisheye_img = query_fisheyeframe_from_database(flatten_desc, init_mode, flatten_desc.prevent_adding_db, direction, direction_old);
-            auto stop = high_resolution_clock::now(); 
+            auto candidates = query_loop_candidates(flatten_desc, init_mode, flatten_desc.prevent_adding_db, LOOP_CANDIDATE_NUM);
 
-            if (direction_old >= 0 ) {
+            if (candidates.size() > 0) {
                 swarm_msgs::LoopEdge ret;
-
-                if (_old_fisheye_img.drone_id == self_id) {
-                    success = compute_loop(flatten_desc, _old_fisheye_img, direction, direction_old, imgs, msgid2cvimgs[_old_fisheye_img.msg_id], ret, init_mode);
-                } else {
-                    //We grab remote drone from database
-                    if (flatten_desc.drone_id == self_id) {
-                        success = compute_loop(_old_fisheye_img, flatten_desc, direction_old, direction, msgid2cvimgs[_old_fisheye_img.msg_id],  imgs, ret, init_mode);
-                    } else {
-                        ROS_WARN("[SWARM_LOOP] Will not compute loop, drone id is %d(self %d)", flatten_desc.drone_id, self_id);
-                    }
-                }
-
-                if (success) {
+                int best = verify_loop_candidates(flatten_desc, imgs, candidates, init_mode, ret);
+                if (best >= 0) {
+                    success = true;
+                    commit_loop(ret);
+                    evictor.touch(candidates[best].msg_id);
                     on_loop_connection(ret);
                 }
             } else {
@@ -154,6 +145,7 @@ int LoopDetector::add_to_database(const FisheyeFrameDescriptor_t & new_fisheye_d
             int index = add_to_database(img_desc);
             imgid2fisheye[index] = new_fisheye_desc.msg_id;
             imgid2dir[index] = i;
+            fisheye2imgids[new_fisheye_desc.msg_id].push_back(index);
             // ROS_INFO("[SWARM_LOOP] Add keyframe from %d(dir %d) to local keyframe database index: %d", img_desc.drone_id, i, index);
         }
     }
@@ -163,46 +155,107 @@ int LoopDetector::add_to_database(const FisheyeFrameDescriptor_t & new_fisheye_d
 
 int LoopDetector::add_to_database(const ImageDescriptor_t & new_img_desc) {
     if (new_img_desc.drone_id == self_id) {
-        local_index.add(1, new_img_desc.image_desc.data());
-        return local_index.ntotal - 1;
+        faiss::Index::idx_t id = local_index_next_id ++;
+        local_index.add(id, new_img_desc.image_desc.data());
+        return id;
     } else {
-        remote_index.add(1, new_img_desc.image_desc.data());
-        return remote_index.ntotal - 1 + REMOTE_MAGIN_NUMBER;
+        faiss::Index::idx_t id = remote_index_next_id ++;
+        remote_index.add(id, new_img_desc.image_desc.data());
+        return id + REMOTE_MAGIN_NUMBER;
     }
     return -1;
 }
 
+size_t keyframe_bytes(const FisheyeFrameDescriptor_t & fisheye_desc, const std::vector<cv::Mat> & imgs) {
+    size_t bytes = sizeof(FisheyeFrameDescriptor_t);
+    for (auto & img : fisheye_desc.images) {
+        bytes += sizeof(ImageDescriptor_t) + img.image.size();
+        bytes += img.image_desc.size()*sizeof(float);
+        bytes += img.feature_descriptor.size()*sizeof(float);
+        bytes += img.landmarks_2d.size()*sizeof(Point2d_t);
+        bytes += img.landmarks_2d_norm.size()*sizeof(Point2d_t);
+        bytes += img.landmarks_3d.size()*sizeof(Point3d_t);
+        bytes += img.landmarks_flag.size()*sizeof(img.landmarks_flag[0]);
+        if (img.landmark_num > 0) {
+            //Copy in the faiss index
+            bytes += img.image_desc.size()*sizeof(float);
+        }
+    }
+    for (auto & img : imgs) {
+        bytes += img.total()*img.elemSize();
+    }
+    return bytes;
+}
+
+void LoopDetector::add_keyframe(const FisheyeFrameDescriptor_t & flatten_desc, const std::vector<cv::Mat> & imgs) {
+    add_to_database(flatten_desc);
+    msgid2cvimgs[flatten_desc.msg_id] = imgs;
+    evictor.add(flatten_desc.msg_id, flatten_desc.drone_id, Swarm::Pose(flatten_desc.pose_drone).pos(), keyframe_bytes(flatten_desc, imgs));
+    evict_from_database();
+}
+
+void LoopDetector::evict_from_database() {
+    auto victims = evictor.evict();
+    if (victims.size() == 0) {
+        return;
+    }
+
+    std::vector<faiss::Index::idx_t> local_ids, remote_ids;
+    for (auto msg_id : victims) {
+        for (auto index : fisheye2imgids[msg_id]) {
+            if (index >= REMOTE_MAGIN_NUMBER) {
+                remote_ids.push_back(index - REMOTE_MAGIN_NUMBER);
+            } else {
+                local_ids.push_back(index);
+            }
+            imgid2fisheye.erase(index);
+            imgid2dir.erase(index);
+        }
+        fisheye2imgids.erase(msg_id);
+        fisheyeframe_database.erase(msg_id);
+        msgid2cvimgs.erase(msg_id);
+    }
+
+    if (local_ids.size() > 0) {
+        local_index.remove(local_ids);
+    }
+    if (remote_ids.size() > 0) {
+        remote_index.remove(remote_ids);
+    }
+
+    ROS_INFO("[SWARM_LOOP] Evicted %ld keyframes, database keeps %ld keyframes %.1fMB", victims.size(),
+        evictor.size(), evictor.bytes()/1024.0/1024.0);
+}
+
 
-int LoopDetector::query_from_database(const ImageDescriptor_t & img_desc, bool init_mode, bool nonkeyframe, double & distance) {
+void LoopDetector::query_from_database(const ImageDescriptor_t & img_desc, bool init_mode, bool nonkeyframe, std::vector<std::pair<int, double>> & results) {
     double thres = INNER_PRODUCT_THRES;
     if (init_mode) {
         thres = INIT_MODE_PRODUCT_THRES;
     }
 
     if (img_desc.drone_id == self_id) {
-        //Then this is self drone
-        int _id = query_from_database(img_desc, remote_index, true, thres, 1, distance);
+        //Then this is self drone. Keyframes are matched with own history, non keyframes only with remote drones
         if(!nonkeyframe){
-            int _id = query_from_database(img_desc, local_index, false, thres, MATCH_INDEX_DIST, distance);
-            return _id;
-        } else if (_id != -1) {
-            return _id;
-        } 
+            query_from_database(img_desc, local_index, false, thres, MATCH_INDEX_DIST, results);
+        } else {
+            query_from_database(img_desc, remote_index, true, thres, 1, results);
+        }
     } else {
-        int _id = query_from_database(img_desc, local_index, false, thres, 1, distance);
+        query_from_database(img_desc, local_index, false, thres, 1, results);
         // ROS_INFO("Is remote image, query only from remote db: %d", _id);
-        return _id;
     }
-    return -1;
 }
 
-int LoopDetector::query_from_database(const ImageDescriptor_t & img_desc, faiss::IndexFlatIP & index, bool remote_db, double thres, int max_index, double & distance) {
+void LoopDetector::query_from_database(const ImageDescriptor_t & img_desc, const DescriptorIndex & index, bool remote_db, double thres, int max_index, std::vector<std::pair<int, double>> & results) {
     float distances[1000] = {0};
     faiss::Index::idx_t labels[1000];
 
     int index_offset = 0;
+    int64_t index_next_id = local_index_next_id;
     if (remote_db) {
         index_offset = REMOTE_MAGIN_NUMBER;
+        index_next_id = remote_index_next_id;
     }
     
     for (int i = 0; i < 1000; i++) {
@@ -210,9 +263,7 @@ int LoopDetector::query_from_database(const ImageDescriptor_t & img_desc, faiss:
     }
 
     int search_num = SEARCH_NEAREST_NUM + max_index;
-    index.search(1, img_desc.image_desc.data(), search_num, distances, labels);
-    int return_msg_id = -1, return_drone_id = -1;
-    int k = -1;
+    index.search(img_desc.image_desc.data(), search_num, distances, labels);
     for (int i = 0; i < search_num; i++) {
         if (labels[i] < 0) {
             continue;
@@ -223,72 +274,127 @@ int LoopDetector::query_from_database(const ImageDescriptor_t & img_desc, faiss:
             continue;
         }
 
-        // int return_msg_id = imgid2fisheye.at(labels[i] + index_offset);
-        return_msg_id = labels[i] + index_offset;
-        return_drone_id = fisheyeframe_database[imgid2fisheye[return_msg_id]].drone_id;
-
-        //ROS_INFO("Return Label %d/%d/%d from %d, distance %f/%f", labels[i] + index_offset, index.ntotal, index.ntotal - max_index , return_drone_id, distances[i], thres);
+        //ROS_INFO("Return Label %d/%d/%d, distance %f/%f", labels[i] + index_offset, index.ntotal(), index.ntotal() - max_index, distances[i], thres);
         
-        if (labels[i] <= index.ntotal - max_index && distances[i] > thres) {
+        if (labels[i] <= index_next_id - max_index && distances[i] > thres) {
             //Is same id, max index make sense
-            k = i;
-            thres = distance = distances[i];
-            return return_msg_id;
+            results.push_back(std::make_pair(labels[i] + index_offset, distances[i]));
         }
     }
-
-    // ROS_INFO("Database return %ld on drone %d, radius %f msg_id %d", labels[k] + index_offset, return_drone_id, distances[k], return_msg_id);
-    return return_msg_id;
 }
 
-
-FisheyeFrameDescriptor_t & LoopDetector::query_fisheyeframe_from_database(const FisheyeFrameDescriptor_t & new_img_desc, bool init_mode, bool nonkeyframe, int & direction_new, int & direction_old) {
-    double best_distance = -1;
-    int best_image_id = -1;
-    //Strict use direction 1 now
-    direction_new = 0;
-    if (loop_cam->get_camera_configuration() == CameraConfig::STEREO_FISHEYE) {
-        direction_new = 1;
+std::vector<LoopCandidate> LoopDetector::query_loop_candidates(const FisheyeFrameDescriptor_t & new_img_desc, bool init_mode, bool nonkeyframe, int max_num) {
+    std::vector<int> directions;
+    if (max_num > 1) {
+        for (size_t i = 0; i < new_img_desc.images.size(); i ++) {
+            directions.push_back(i);
+        }
+    } else if (loop_cam->get_camera_configuration() == CameraConfig::STEREO_FISHEYE) {
+        //Strict use direction 1 with a single candidate
+        directions.push_back(1);
     } else if (
         loop_cam->get_camera_configuration() == CameraConfig::STEREO_PINHOLE ||
         loop_cam->get_camera_configuration() == CameraConfig::PINHOLE_DEPTH
     ) {
-        direction_new = 0;
+        directions.push_back(0);
     } else {
-        ROS_ERROR("[SWARM_LOOP] Camera configuration %d not support yet in query_fisheyeframe_from_database", loop_cam->get_camera_configuration());
+        ROS_ERROR("[SWARM_LOOP] Camera configuration %d not support yet in query_loop_candidates", loop_cam->get_camera_configuration());
         exit(-1);
     }
 
-    if (new_img_desc.images[direction_new].landmark_num > 0) {
-        double distance = -1;
-        int id = query_from_database(new_img_desc.images.at(direction_new), init_mode, nonkeyframe, distance);
-        if (id != -1 && distance > best_distance) {
-            best_image_id = id;
+    //Best direction pair of each keyframe
+    std::map<int64_t, LoopCandidate> best;
+    for (auto direction_new : directions) {
+        if (new_img_desc.images[direction_new].landmark_num == 0) {
+            continue;
+        }
+        std::vector<std::pair<int, double>> results;
+        query_from_database(new_img_desc.images.at(direction_new), init_mode, nonkeyframe, results);
+        for (auto & res : results) {
+            int64_t msg_id = imgid2fisheye[res.first];
+            auto it = best.find(msg_id);
+            if (it == best.end() || it->second.distance < res.second) {
+                best[msg_id] = LoopCandidate{msg_id, direction_new, imgid2dir[res.first], res.second};
+            }
         }
+    }
 
-        // ROS_INFO("query_from_database(new_img_desc.images.at(direction_new) return %d best_image_id %d distance %f/%f", 
-            // id, best_image_id, distance, best_distance);
+    std::vector<LoopCandidate> candidates;
+    for (auto & it : best) {
+        candidates.push_back(it.second);
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const LoopCandidate & a, const LoopCandidate & b) {
+        return a.distance > b.distance;
+    });
+    if ((int) candidates.size() > max_num) {
+        candidates.resize(max_num);
+    }
 
+    for (auto & c : candidates) {
+        ROS_INFO("[SWARM_LOOP] Database return fisheye frame %ld from drone %d with direction %d->%d dist %f", 
+            c.msg_id, fisheyeframe_database[c.msg_id].drone_id, c.direction_new, c.direction_old, c.distance);
+    }
+    return candidates;
+}
 
-        if (best_image_id != -1) {
-            int msg_id = imgid2fisheye[best_image_id];
-            direction_old = imgid2dir[best_image_id];
-            FisheyeFrameDescriptor_t & ret = fisheyeframe_database[msg_id];
-            ROS_INFO("[SWARM_LOOP] Database return image %d fisheye frame from drone %d with direction %d dist %f", 
-                best_image_id, ret.drone_id, direction_old, distance);
-            return ret;
+int LoopDetector::verify_loop_candidates(const FisheyeFrameDescriptor_t & flatten_desc, const std::vector<cv::Mat> & imgs,
+        const std::vector<LoopCandidate> & candidates, bool init_mode, LoopEdge & ret) {
+    int num = candidates.size();
+    std::vector<LoopEdge> rets(num);
+    std::vector<int> success(num, 0);
+    //Look up before the workers start, they must not insert into the maps
+    std::vector<const FisheyeFrameDescriptor_t *> old_descs;
+    std::vector<const std::vector<cv::Mat> *> old_imgs;
+    for (auto & c : candidates) {
+        old_descs.push_back(&fisheyeframe_database[c.msg_id]);
+        old_imgs.push_back(&msgid2cvimgs[c.msg_id]);
+    }
+
+    //Set once a candidate is verified, the workers then skip the rest
+    std::atomic<bool> found(false);
+    auto verify = [&] (int worker_id, int worker_num) {
+        for (int i = worker_id; i < num && !found; i += worker_num) {
+            auto & c = candidates[i];
+            auto & old_desc = *old_descs[i];
+            if (old_desc.drone_id == self_id) {
+                success[i] = compute_loop(flatten_desc, old_desc, c.direction_new, c.direction_old, imgs, *old_imgs[i], rets[i], init_mode, &found);
+            } else if (flatten_desc.drone_id == self_id) {
+                //We grab remote drone from database
+                success[i] = compute_loop(old_desc, flatten_desc, c.direction_old, c.direction_new, *old_imgs[i], imgs, rets[i], init_mode, &found);
+            } else {
+                ROS_WARN("[SWARM_LOOP] Will not compute loop, drone id is %d(self %d)", flatten_desc.drone_id, self_id);
+            }
+            if (success[i]) {
+                found = true;
+            }
         }
+    };
+
+    //The visualization of compute_loop is not thread safe
+    int worker_num = enable_visualize ? 1 : std::max(1, std::min(LOOP_VERIFY_THREADS, num));
+    std::vector<std::thread> workers;
+    for (int worker_id = 1; worker_id < worker_num; worker_id ++) {
+        workers.emplace_back(verify, worker_id, worker_num);
+    }
+    verify(0, worker_num);
+    for (auto & worker : workers) {
+        worker.join();
     }
 
-    direction_old = -1;
-    FisheyeFrameDescriptor_t ret;
-    ret.msg_id = -1;
-    return ret;
+    //Several may pass before the others notice, take the best ranked
+    for (int i = 0; i < num; i ++) {
+        if (success[i]) {
+            ROS_INFO("[SWARM_LOOP] Loop verified on candidate %d/%d", i + 1, num);
+            ret = rets[i];
+            return i;
+        }
+    }
+    return -1;
 }
 
 
 int LoopDetector::database_size() const {
-    return local_index.ntotal + remote_index.ntotal;
+    return local_index.ntotal() + remote_index.ntotal();
 }
 
 
@@ -357,6 +463,7 @@ int LoopDetector::compute_relative_pose(
         const std::vector<cv::Point3f> matched_3d_now,
         const std::vector<cv::Point2f> matched_2d_norm_old,
         const std::vector<cv::Point3f> matched_3d_old,
+        const std::vector<float> & scores,
         Swarm::Pose old_extrinsic,
         Swarm::Pose drone_pose_now,
         Swarm::Pose drone_pose_old,
@@ -387,16 +494,33 @@ int LoopDetector::compute_relative_pose(
         iteratives = 1000;
     }
 
-    bool success = solvePnPRansac(matched_3d_now, matched_2d_norm_old, K, D, rvec, t, false,   
-        iteratives,  3, 0.99,  inliers);
+    bool success = false;
+    if (PNP_SOLVER == PNP_SOLVER_PROSAC) {
+        PnPProsacParams params;
+        params.max_iterations = iteratives;
+        params.reproj_thres = PNP_PROSAC_THRES;
+        //Roll and pitch are observable by VIO on both drones, reject hypotheses far from them before scoring
+        auto check = [&](const cv::Mat & _rvec, const cv::Mat & _t) {
+            auto p_drone = PnPRestoCamPose(_rvec, _t)*(old_extrinsic.to_isometry().inverse());
+            return RPerror(p_drone, drone_pose_old, drone_pose_now) < RPERR_THRES;
+        };
+        std::vector<int> _inliers;
+        PnPProsacStats stats;
+        success = solvePnPProsac(matched_3d_now, matched_2d_norm_old, scores, rvec, t, _inliers, params, check, &stats);
+        inliers = cv::Mat(_inliers, true);
+        ROS_INFO("[SWARM_LOOP] PROSAC PnP %d iterations %d LO runs %d rejected by RP", stats.iterations, stats.lo_runs, stats.rejected);
+    } else {
+        success = solvePnPRansac(matched_3d_now, matched_2d_norm_old, K, D, rvec, t, false,   
+            iteratives,  3, 0.99,  inliers);
+    }
 
-    auto p_cam_old_in_new = PnPRestoCamPose(rvec, t);
-    auto p_drone_old_in_new = p_cam_old_in_new*(old_extrinsic.to_isometry().inverse());
-    
     if (!success) {
         return 0;
     }
 
+    auto p_cam_old_in_new = PnPRestoCamPose(rvec, t);
+    auto p_drone_old_in_new = p_cam_old_in_new*(old_extrinsic.to_isometry().inverse());
+
     DP_old_to_new =  Swarm::Pose::DeltaPose(p_drone_old_in_new, drone_pose_now, is_4dof);
     
     auto RPerr = RPerror(p_drone_old_in_new, drone_pose_old, drone_pose_now);
@@ -438,6 +562,7 @@ bool LoopDetector::compute_correspond_features(const FisheyeFrameDescriptor_t &
     std::vector<cv::Point2f> &old_norm_2d,
     std::vector<cv::Point3f> &old_3d,
     std::vector<std::vector<int>> &old_idx,
+    std::vector<float> &scores,
     std::vector<int> &dirs_new,
     std::vector<int> &dirs_old,
     std::map<int, std::pair<int, int>> &index2dirindex_new,
@@ -483,6 +608,7 @@ bool LoopDetector::compute_correspond_features(const FisheyeFrameDescriptor_t &
         std::vector<cv::Point2f> _old_norm_2d;
         std::vector<cv::Point3f> _old_3d;
         std::vector<int> _old_idx;
+        std::vector<float> _scores;
 
         if (dir_new < new_frame_desc.images.size() && dir_old < old_frame_desc.images.size()) {
             compute_correspond_features(
@@ -493,7 +619,8 @@ bool LoopDetector::compute_correspond_features(const FisheyeFrameDescriptor_t &
                 _new_idx,
                 _old_norm_2d,
                 _old_3d,
-                _old_idx
+                _old_idx,
+                _scores
             );
             ROS_INFO("[SWARM_LOOP] compute_correspond_features on direction %d:%d gives %d common features", dir_old, dir_new, _new_3d.size());
         } else {
@@ -506,6 +633,7 @@ bool LoopDetector::compute_correspond_features(const FisheyeFrameDescriptor_t &
 
         new_3d.insert(new_3d.end(), _new_3d.begin(), _new_3d.end());
         old_3d.insert(old_3d.end(), _old_3d.begin(), _old_3d.end());
+        scores.insert(scores.end(), _scores.begin(), _scores.end());
         new_idx.push_back(_new_idx);
         old_idx.push_back(_old_idx);
 
@@ -542,7 +670,8 @@ bool LoopDetector::compute_correspond_features(const ImageDescriptor_t & new_img
         std::vector<int> &new_idx,
         std::vector<cv::Point2f> &old_norm_2d,
         std::vector<cv::Point3f> &old_3d,
-        std::vector<int> &old_idx) {
+        std::vector<int> &old_idx,
+        std::vector<float> &scores) {
     // ROS_INFO("[SWARM_LOOP](LoopDetector::compute_correspond_features) %d %d ", new_img_desc.landmarks_2d.size(), new_img_desc.feature_descriptor.size());
     assert(new_img_desc.landmarks_2d.size() * FEATURE_DESC_SIZE == new_img_desc.feature_descriptor.size() && "Desciptor size of new img desc must equal to to landmarks*256!!!");
     assert(old_img_desc.landmarks_2d.size() * FEATURE_DESC_SIZE == old_img_desc.feature_descriptor.size() && "Desciptor size of old img desc must equal to to landmarks*256!!!");
@@ -555,16 +684,9 @@ bool LoopDetector::compute_correspond_features(const ImageDescriptor_t & new_img
     auto _now_2d = toCV(new_img_desc.landmarks_2d);
     auto _now_3d = toCV(new_img_desc.landmarks_3d);
 
-    cv::Mat desc_now( _now_norm_2d.size(), FEATURE_DESC_SIZE, CV_32F);
-    memcpy(desc_now.data, new_img_desc.feature_descriptor.data(), new_img_desc.feature_descriptor.size()*sizeof(float));
-
-    cv::Mat desc_old( old_img_desc.landmarks_2d.size(), FEATURE_DESC_SIZE, CV_32F);
-    memcpy(desc_old.data, old_img_desc.feature_descriptor.data(), old_img_desc.feature_descriptor.size()*sizeof(float));
-    
-    cv::BFMatcher bfmatcher(cv::NORM_L2, true);
     std::vector<cv::DMatch> _matches;
     std::vector<unsigned char> mask;
-    bfmatcher.match(desc_now, desc_old, _matches);
+    Swarm::matchDescriptors(new_img_desc.feature_descriptor, old_img_desc.feature_descriptor, _matches, DETECTOR_MATCH_RATIO);
 
 #ifdef USE_FUNDMENTAL
     std::vector<cv::Point2f> old_2d, new_2d;
@@ -583,6 +705,7 @@ bool LoopDetector::compute_correspond_features(const ImageDescriptor_t & new_img
 
             old_3d.push_back(_old_3d[old_id]);
             old_norm_2d.push_back(_old_norm_2d[old_id]);
+            scores.push_back(match.distance);
         }
     }
 
@@ -596,6 +719,7 @@ bool LoopDetector::compute_correspond_features(const ImageDescriptor_t & new_img
 
         reduceVector(old_3d, mask);
         reduceVector(old_norm_2d, mask);
+        reduceVector(scores, mask);
     } else {
         return false;
     }
@@ -615,6 +739,7 @@ bool LoopDetector::compute_correspond_features(const ImageDescriptor_t & new_img
 
             old_3d.push_back(_old_3d[old_id]);
             old_norm_2d.push_back(_old_norm_2d[old_id]);
+            scores.push_back(match.distance);
         } else {
             // printf("Give up distance too high %f\n", match.distance);
         }
@@ -627,7 +752,7 @@ bool LoopDetector::compute_correspond_features(const ImageDescriptor_t & new_img
 bool LoopDetector::compute_loop(const FisheyeFrameDescriptor_t & new_frame_desc, const FisheyeFrameDescriptor_t & old_frame_desc,
     int main_dir_new, int main_dir_old,
     std::vector<cv::Mat> imgs_new, std::vector<cv::Mat> imgs_old,
-    LoopEdge & ret, bool init_mode) {
+    LoopEdge & ret, bool init_mode, const std::atomic<bool> * cancelled) {
 
     if (new_frame_desc.landmark_num < MIN_LOOP_NUM) {
         return false;
@@ -653,6 +778,7 @@ bool LoopDetector::compute_loop(const FisheyeFrameDescriptor_t & new_frame_desc,
     std::vector<cv::Point2f> old_norm_2d;
     std::vector<cv::Point3f> old_3d;
     std::vector<std::vector<int>> old_idx;
+    std::vector<float> scores;
     std::vector<int> dirs_new;
     std::vector<int> dirs_old;
     Swarm::Pose DP_old_to_new;
@@ -664,14 +790,19 @@ bool LoopDetector::compute_loop(const FisheyeFrameDescriptor_t & new_frame_desc,
     success = compute_correspond_features(new_frame_desc, old_frame_desc, 
         main_dir_new, main_dir_old,
         new_norm_2d, new_3d, new_idx,
-        old_norm_2d, old_3d, old_idx, dirs_new, dirs_old, 
+        old_norm_2d, old_3d, old_idx, scores, dirs_new, dirs_old, 
         index2dirindex_new, index2dirindex_old);
     
+    if (cancelled != nullptr && *cancelled) {
+        //Another candidate is already verified, skip the PnP RANSAC
+        return false;
+    }
+
     if(success) {
         if (new_norm_2d.size() > MIN_LOOP_NUM || (init_mode && new_norm_2d.size() > INIT_MODE_MIN_LOOP_NUM)) {
             success = compute_relative_pose(
                     new_norm_2d, new_3d, 
-                    old_norm_2d, old_3d,
+                    old_norm_2d, old_3d, scores,
                     Swarm::Pose(old_frame_desc.images[main_dir_old].camera_extrinsic),
                     Swarm::Pose(new_frame_desc.pose_drone),
                     Swarm::Pose(old_frame_desc.pose_drone),
@@ -808,26 +939,9 @@ bool LoopDetector::compute_loop(const FisheyeFrameDescriptor_t & new_frame_desc,
         ret.ang_cov.z = loop_cov_ang;
 
         ret.pnp_inlier_num = inlier_num;
-        ret.id = self_id*MAX_LOOP_ID + loop_count;
 
         if (check_loop_odometry_consistency(ret)) {
-            loop_count ++;
-            ROS_INFO("[SWARM_LOOP] Loop %ld Detected %d->%d dt %3.3fs DPos %4.3f %4.3f %4.3f Dyaw %3.2fdeg inliers %d. Will publish\n",
-                ret.id,
-                ret.drone_id_a, ret.drone_id_b,
-                (ret.ts_b - ret.ts_a).toSec(),
-                DP_old_to_new.pos().x(), DP_old_to_new.pos().y(), DP_old_to_new.pos().z(),
-                DP_old_to_new.yaw()*57.3,
-                ret.pnp_inlier_num
-            );
-
-            int new_d_id = new_frame_desc.drone_id;
-            int old_d_id = old_frame_desc.drone_id;
-            inter_drone_loop_count[new_d_id][old_d_id] = inter_drone_loop_count[new_d_id][old_d_id] +1;
-            inter_drone_loop_count[old_d_id][new_d_id] = inter_drone_loop_count[old_d_id][new_d_id] +1;
-            
             return true;
-
         } else {
             ROS_INFO("[SWARM_LOOP] Loop not consistency with odometry, give up.");
         }
@@ -835,10 +949,32 @@ bool LoopDetector::compute_loop(const FisheyeFrameDescriptor_t & new_frame_desc,
     return false;
 }
 
+void LoopDetector::commit_loop(LoopEdge & ret) {
+    ret.id = self_id*MAX_LOOP_ID + loop_count;
+    loop_count ++;
+    Swarm::Pose DP_old_to_new(ret.relative_pose);
+    ROS_INFO("[SWARM_LOOP] Loop %ld Detected %d->%d dt %3.3fs DPos %4.3f %4.3f %4.3f Dyaw %3.2fdeg inliers %d. Will publish\n",
+        ret.id,
+        ret.drone_id_a, ret.drone_id_b,
+        (ret.ts_b - ret.ts_a).toSec(),
+        DP_old_to_new.pos().x(), DP_old_to_new.pos().y(), DP_old_to_new.pos().z(),
+        DP_old_to_new.yaw()*57.3,
+        ret.pnp_inlier_num
+    );
+
+    int new_d_id = ret.drone_id_b;
+    int old_d_id = ret.drone_id_a;
+    inter_drone_loop_count[new_d_id][old_d_id] = inter_drone_loop_count[new_d_id][old_d_id] +1;
+    inter_drone_loop_count[old_d_id][new_d_id] = inter_drone_loop_count[old_d_id][new_d_id] +1;
+}
+
 void LoopDetector::on_loop_connection(LoopEdge & loop_conn) {
     on_loop_cb(loop_conn);
 }
 
-LoopDetector::LoopDetector(int _self_id): self_id(_self_id), local_index(DEEP_DESC_SIZE), remote_index(DEEP_DESC_SIZE), 
+LoopDetector::LoopDetector(int _self_id): self_id(_self_id), 
+    local_index(DEEP_DESC_SIZE, LOOP_INDEX_FACTORY, LOOP_INDEX_SEARCH_PARAMS, LOOP_INDEX_TRAIN_SIZE, LOOP_INDEX_REBUILD_STALE),
+    remote_index(DEEP_DESC_SIZE, LOOP_INDEX_FACTORY, LOOP_INDEX_SEARCH_PARAMS, LOOP_INDEX_TRAIN_SIZE, LOOP_INDEX_REBUILD_STALE),
+    evictor(KEYFRAME_DB_MAX_MB*1024*1024, KEYFRAME_DB_MAX_FRAMES, (KeyframeEvictionPolicy) KEYFRAME_DB_EVICTION, KEYFRAME_DB_SPATIAL_RADIUS),
     ego_motion_traj(_self_id, true, pos_covariance_per_meter, yaw_covariance_per_meter) {
 }
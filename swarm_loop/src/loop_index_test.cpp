@@ -0,0 +1,137 @@
+#include "swarm_loop/descriptor_index.h"
+#include "swarm_msgs/swarm_types.hpp"
+#include <Eigen/Dense>
+#include <random>
+#include <set>
+#include <stdio.h>
+
+#define INDEX_DESC_SIZE 4096
+//NetVLAD descriptors of a trajectory lie close to a low dimensional manifold
+#define INDEX_LATENT_SIZE 64
+#define INDEX_CHUNK 1000
+#define INDEX_QUERIES 200
+#define INDEX_TOPK 5
+
+//Keyframes along a random walk in the latent space, lifted to normalized descriptors
+class SyntheticPlaces {
+    std::mt19937 rng;
+    std::normal_distribution<float> normal;
+    Eigen::MatrixXf basis;
+    Eigen::VectorXf place;
+public:
+    std::vector<Eigen::VectorXf> latents;
+
+    SyntheticPlaces(): rng(0), normal(0, 1) {
+        basis = Eigen::MatrixXf::NullaryExpr(INDEX_DESC_SIZE, INDEX_LATENT_SIZE, [&]() { return normal(rng); });
+        place = Eigen::VectorXf::Zero(INDEX_LATENT_SIZE);
+    }
+
+    Eigen::VectorXf noise(int size, float sigma) {
+        return Eigen::VectorXf::NullaryExpr(size, [&]() { return normal(rng)*sigma; });
+    }
+
+    //One descriptor per column
+    Eigen::MatrixXf lift(const Eigen::MatrixXf & z) {
+        Eigen::MatrixXf x = basis*z + Eigen::MatrixXf::NullaryExpr(INDEX_DESC_SIZE, z.cols(), [&]() { return normal(rng)*0.3f; });
+        x.colwise().normalize();
+        return x;
+    }
+
+    Eigen::MatrixXf next(int num) {
+        Eigen::MatrixXf z(INDEX_LATENT_SIZE, num);
+        for (int i = 0; i < num; i ++) {
+            place += noise(INDEX_LATENT_SIZE, 0.3);
+            latents.push_back(place);
+            z.col(i) = place;
+        }
+        return lift(z);
+    }
+
+    //Revisits of random database keyframes
+    Eigen::MatrixXf queries(int num) {
+        Eigen::MatrixXf z(INDEX_LATENT_SIZE, num);
+        std::uniform_int_distribution<int> pick(0, latents.size() - 1);
+        for (int i = 0; i < num; i ++) {
+            z.col(i) = latents[pick(rng)] + noise(INDEX_LATENT_SIZE, 0.2);
+        }
+        return lift(z);
+    }
+};
+
+//Usage: loop_index_test [factory] [search_params] [train_size] [max_frames]
+//Insert a synthetic keyframe stream online into an exact and an approximate DescriptorIndex,
+//print recall@5 of the approximate index against the exact one and query latency of both at 1k/10k/100k frames,
+//then evict the older half and check that evicted keyframes are neither returned nor counted.
+//e.g. loop_index_test PCA256,HNSW32 efSearch=64 or loop_index_test PCA512,IVF256,PQ64 nprobe=16
+int main(int argc, char* argv[]) {
+    std::string factory = argc > 1 ? argv[1] : "PCA256,HNSW32";
+    std::string search_params = argc > 2 ? argv[2] : "";
+    int train_size = argc > 3 ? atoi(argv[3]) : 1000;
+    int max_frames = argc > 4 ? atoi(argv[4]) : 100000;
+
+    DescriptorIndex exact(INDEX_DESC_SIZE);
+    DescriptorIndex ann(INDEX_DESC_SIZE, factory, search_params, train_size);
+    SyntheticPlaces places;
+    std::vector<faiss::Index::idx_t> labels_exact(INDEX_TOPK), labels_ann(INDEX_TOPK);
+    std::vector<float> dis(INDEX_TOPK);
+
+    printf("%s %s\n", factory.c_str(), search_params.c_str());
+    int64_t next_id = 0;
+    double dt_insert = 0;
+    for (int checkpoint = 1000; checkpoint <= max_frames; checkpoint *= 10) {
+        while (next_id < checkpoint) {
+            Eigen::MatrixXf descs = places.next(INDEX_CHUNK);
+            for (int i = 0; i < descs.cols(); i ++) {
+                exact.add(next_id, descs.col(i).data());
+                TicToc tic;
+                ann.add(next_id, descs.col(i).data());
+                dt_insert += tic.toc();
+                next_id ++;
+            }
+        }
+
+        Eigen::MatrixXf queries = places.queries(INDEX_QUERIES);
+        double dt_exact = 0, dt_ann = 0;
+        int hits = 0;
+        for (int i = 0; i < INDEX_QUERIES; i ++) {
+            TicToc tic;
+            exact.search(queries.col(i).data(), INDEX_TOPK, dis.data(), labels_exact.data());
+            dt_exact += tic.toc();
+            TicToc tic2;
+            ann.search(queries.col(i).data(), INDEX_TOPK, dis.data(), labels_ann.data());
+            dt_ann += tic2.toc();
+            std::set<faiss::Index::idx_t> truth(labels_exact.begin(), labels_exact.end());
+            for (auto l : labels_ann) {
+                hits += truth.count(l);
+            }
+        }
+        printf("%7ld frames%s: recall@%d %.3f query exact %.3fms approximate %.3fms insert %.3fms\n", next_id,
+            ann.is_approximate() ? "" : " (not trained)", INDEX_TOPK, hits/(double)(INDEX_QUERIES*INDEX_TOPK),
+            dt_exact/INDEX_QUERIES, dt_ann/INDEX_QUERIES, dt_insert/next_id);
+    }
+
+    //Evict the older half as LoopDetector does, in chunks, evicted ids must never be returned
+    //and the size must count the live descriptors only, whether or not the index can remove them
+    int64_t evicted = next_id/2;
+    for (int64_t start = 0; start < evicted; start += INDEX_CHUNK) {
+        std::vector<faiss::Index::idx_t> ids;
+        for (int64_t id = start; id < std::min(start + INDEX_CHUNK, evicted); id ++) {
+            ids.push_back(id);
+        }
+        exact.remove(ids);
+        ann.remove(ids);
+    }
+    Eigen::MatrixXf queries = places.queries(INDEX_QUERIES);
+    int returned_evicted = 0;
+    for (int i = 0; i < INDEX_QUERIES; i ++) {
+        ann.search(queries.col(i).data(), INDEX_TOPK, dis.data(), labels_ann.data());
+        for (auto l : labels_ann) {
+            returned_evicted += l >= 0 && l < evicted;
+        }
+    }
+    bool ok = returned_evicted == 0 && exact.ntotal() == next_id - evicted && ann.ntotal() == next_id - evicted;
+    printf("Evicted %ld: exact keeps %ld approximate keeps %ld (%ld stale), evicted returned %d\n", evicted,
+        exact.ntotal(), ann.ntotal(), ann.stale_num(), returned_evicted);
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,116 @@
+#include "swarm_loop/loop_cam.h"
+#include "swarm_loop/utils.h"
+#include <sensor_msgs/image_encodings.h>
+#include <ctime>
+#include <cstring>
+#include <stdio.h>
+
+#define INTAKE_RATE 30
+#define INTAKE_SECONDS 10
+//Keyframes per second taken by VIOKF_callback, max_freq
+#define INTAKE_KEYFRAME_RATE 1
+#define INTAKE_WIDTH 400
+#define INTAKE_HEIGHT 208
+//Flattened fisheye has the unused cam 0 and 4 directions
+#define INTAKE_CAMS 5
+
+sensor_msgs::Image synthetic_image(int seed) {
+    sensor_msgs::Image img;
+    img.width = INTAKE_WIDTH;
+    img.height = INTAKE_HEIGHT;
+    img.encoding = sensor_msgs::image_encodings::MONO8;
+    img.step = INTAKE_WIDTH;
+    img.data.resize(INTAKE_WIDTH*INTAKE_HEIGHT);
+    for (size_t i = 0; i < img.data.size(); i ++) {
+        img.data[i] = (i*7 + seed) & 0xff;
+    }
+    return img;
+}
+
+vins::FlattenImagesConstPtr synthetic_flatten(int seq) {
+    vins::FlattenImagesPtr msg(new vins::FlattenImages);
+    msg->header.stamp = ros::Time(1000 + (double) seq / INTAKE_RATE);
+    for (int i = 0; i < INTAKE_CAMS; i ++) {
+        msg->up_cams.push_back(synthetic_image(seq + i));
+        msg->down_cams.push_back(synthetic_image(seq + i + 100));
+        msg->extrinsic_up_cams.push_back(geometry_msgs::Pose());
+        msg->extrinsic_down_cams.push_back(geometry_msgs::Pose());
+    }
+    return msg;
+}
+
+//flatten_raw_callback before: the message taken by value and every image copied by toCvCopy
+StereoFrame copy_intake(vins::FlattenImages vins_flatten, int self_id) {
+    StereoFrame frame;
+    frame.stamp = vins_flatten.header.stamp;
+    for (int i = 1; i < vins_flatten.up_cams.size(); i++) {
+        frame.left_extrisincs.push_back(vins_flatten.extrinsic_up_cams[i]);
+        frame.right_extrisincs.push_back(vins_flatten.extrinsic_down_cams[i]);
+        frame.left_images.push_back(getImageFromMsg(vins_flatten.up_cams[i])->image);
+        frame.right_images.push_back(getImageFromMsg(vins_flatten.down_cams[i])->image);
+    }
+    return frame;
+}
+
+double cpu_ms(std::clock_t start) {
+    return (std::clock() - start)*1000.0/CLOCKS_PER_SEC;
+}
+
+//Usage: loop_intake_test
+//CPU time of the flattened image callback at 30Hz, copying every frame as before against sharing the messages
+//and converting only the keyframes.
+int main(int argc, char* argv[]) {
+    int frame_num = INTAKE_RATE*INTAKE_SECONDS;
+    std::vector<vins::FlattenImagesConstPtr> msgs;
+    for (int i = 0; i < frame_num; i ++) {
+        msgs.push_back(synthetic_flatten(i));
+    }
+
+    std::vector<StereoFrame> frames;
+    auto start = std::clock();
+    for (int i = 0; i < frame_num; i ++) {
+        frames.push_back(copy_intake(*msgs[i], 1));
+        if (frames.size() > INTAKE_RATE) {
+            frames.erase(frames.begin());
+        }
+    }
+    double dt_copy = cpu_ms(start);
+    frames.clear();
+
+    int keyframes = 0;
+    bool ok = true;
+    start = std::clock();
+    for (int i = 0; i < frame_num; i ++) {
+        frames.emplace_back(msgs[i], 1);
+        if (i % (INTAKE_RATE/INTAKE_KEYFRAME_RATE) == 0) {
+            auto & frame = frames.back();
+            frame.load_images();
+            keyframes ++;
+            for (int j = 1; j < INTAKE_CAMS; j ++) {
+                //Zero copy: the images point into the message
+                ok = ok && frame.left_images[j-1].data == msgs[i]->up_cams[j].data.data() &&
+                    frame.right_images[j-1].data == msgs[i]->down_cams[j].data.data();
+            }
+        }
+        if (frames.size() > INTAKE_RATE) {
+            frames.erase(frames.begin());
+        }
+    }
+    double dt_share = cpu_ms(start);
+
+    //Images must outlive the messages once shared
+    auto frame = StereoFrame(synthetic_flatten(0), 1);
+    frame.load_images();
+    auto expected = synthetic_image(1);
+    ok = ok && frame.left_images.size() == INTAKE_CAMS - 1 &&
+        memcmp(frame.left_images[0].data, expected.data.data(), expected.data.size()) == 0;
+
+    double bytes = 2.0*(INTAKE_CAMS - 1)*INTAKE_WIDTH*INTAKE_HEIGHT;
+    printf("%d frames at %dHz, %d keyframes, %.0fKB of images per frame\n", frame_num, INTAKE_RATE, keyframes, bytes/1024);
+    printf("copy:  %.3fms CPU per callback, %.1f%% of a core, %.1fMB/s copied\n", dt_copy/frame_num,
+        dt_copy/frame_num*INTAKE_RATE/10, 2*bytes*INTAKE_RATE/1e6);
+    printf("share: %.3fms CPU per callback, %.1f%% of a core, 0MB/s copied\n", dt_share/frame_num,
+        dt_share/frame_num*INTAKE_RATE/10);
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : -1;
+}
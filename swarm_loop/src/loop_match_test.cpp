@@ -0,0 +1,67 @@
+#include "swarm_loop/feature_matcher.h"
+#include "swarm_msgs/swarm_types.hpp"
+using namespace Swarm;
+
+#define MATCH_ITERS 200
+
+//Descriptors of num landmarks and of a second view of them, a quarter of them replaced by unrelated landmarks
+void synthetic_views(cv::RNG & rng, int num, std::vector<float> & desc_a, std::vector<float> & desc_b) {
+    cv::Mat a(num, MATCH_DESC_SIZE, CV_32F), b(num, MATCH_DESC_SIZE, CV_32F), noise(num, MATCH_DESC_SIZE, CV_32F);
+    rng.fill(a, cv::RNG::NORMAL, 0, 1);
+    rng.fill(noise, cv::RNG::NORMAL, 0, 0.3);
+    b = a + noise;
+    rng.fill(b.rowRange(0, num/4), cv::RNG::NORMAL, 0, 1);
+    for (int i = 0; i < num; i ++) {
+        cv::normalize(a.row(i), a.row(i));
+        cv::normalize(b.row(i), b.row(i));
+    }
+    desc_a = std::vector<float>((float*) a.data, (float*) a.data + a.total());
+    desc_b = std::vector<float>((float*) b.data, (float*) b.data + b.total());
+}
+
+//Usage: loop_match_test
+//Compare matchDescriptors with cv::BFMatcher(NORM_L2, crossCheck) on synthetic landmark descriptors and benchmark both.
+int main(int argc, char* argv[]) {
+    cv::RNG rng(0);
+    int failed = 0;
+    for (int num : {200, 500, 1000}) {
+        std::vector<float> desc_a, desc_b;
+        synthetic_views(rng, num, desc_a, desc_b);
+
+        std::vector<cv::DMatch> ref, out;
+        TicToc tic;
+        for (int i = 0; i < MATCH_ITERS; i ++) {
+            //As the former matching, copy into cv::Mat and match
+            cv::Mat mat_a(num, MATCH_DESC_SIZE, CV_32F), mat_b(num, MATCH_DESC_SIZE, CV_32F);
+            memcpy(mat_a.data, desc_a.data(), desc_a.size()*sizeof(float));
+            memcpy(mat_b.data, desc_b.data(), desc_b.size()*sizeof(float));
+            cv::BFMatcher bfmatcher(cv::NORM_L2, true);
+            bfmatcher.match(mat_a, mat_b, ref);
+        }
+        double dt_bf = tic.toc()/MATCH_ITERS;
+
+        TicToc tic2;
+        for (int i = 0; i < MATCH_ITERS; i ++) {
+            matchDescriptors(desc_a, desc_b, out);
+        }
+        double dt_simd = tic2.toc()/MATCH_ITERS;
+
+        int same = 0;
+        std::map<int, int> ref_map;
+        for (auto & m : ref) {
+            ref_map[m.queryIdx] = m.trainIdx;
+        }
+        for (auto & m : out) {
+            same += ref_map.count(m.queryIdx) && ref_map[m.queryIdx] == m.trainIdx;
+        }
+        bool ok = same == (int) ref.size() && out.size() == ref.size();
+        failed += !ok;
+
+        std::vector<cv::DMatch> ratio_out;
+        matchDescriptors(desc_a, desc_b, ratio_out, 0.8);
+        printf("%4d landmarks: BFMatcher %.3fms %.0f matches/s, SIMD %.3fms %.0f matches/s speedup %.1fx, %ld/%ld matches agree %s, %ld after ratio test 0.8\n",
+            num, dt_bf, ref.size()/dt_bf*1000, dt_simd, out.size()/dt_simd*1000, dt_bf/dt_simd, same, ref.size(), ok ? "OK" : "FAILED",
+            ratio_out.size());
+    }
+    return failed > 0 ? -1 : 0;
+}
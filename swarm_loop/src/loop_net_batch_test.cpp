@@ -0,0 +1,131 @@
+#include "swarm_loop/landmark_batch.h"
+#include "swarm_loop/loop_defines.h"
+#include "swarm_msgs/swarm_types.hpp"
+#include <swarm_msgs/LandmarkDescriptor_t.hpp>
+#include <lcm/lcm-cpp.hpp>
+#include <thread>
+#include <atomic>
+#include <unistd.h>
+
+using namespace swarm_msgs;
+
+#define TEST_LCM_URI "udpm://239.255.76.67:7667?ttl=0"
+#define TEST_SINGLE_CHANNEL "LM_TEST_SINGLE"
+#define TEST_BATCH_CHANNEL "LM_TEST_BATCH"
+
+class LandmarkCounter {
+public:
+    std::atomic<long> landmarks{0}, packets{0}, bytes{0};
+    void on_single(const lcm::ReceiveBuffer* rbuf, const std::string& chan, const LandmarkDescriptor_t* msg) {
+        landmarks ++;
+        packets ++;
+        bytes += rbuf->data_size;
+    }
+    void on_batch(const lcm::ReceiveBuffer* rbuf, const std::string& chan) {
+        LandmarkBatchInfo info;
+        if (parse_landmark_batch(rbuf->data, rbuf->data_size, info)) {
+            ImageDescriptor_t img;
+            append_landmark_batch(rbuf->data, rbuf->data_size, img);
+            landmarks += img.landmarks_2d.size();
+        }
+        packets ++;
+        bytes += rbuf->data_size;
+    }
+    void reset() {
+        landmarks = 0;
+        packets = 0;
+        bytes = 0;
+    }
+};
+
+ImageDescriptor_t synthetic_image(int landmark_num) {
+    ImageDescriptor_t img;
+    img.drone_id = 1;
+    img.landmark_num = landmark_num;
+    img.feature_descriptor.resize(landmark_num*FEATURE_DESC_SIZE);
+    img.feature_descriptor_size = img.feature_descriptor.size();
+    img.landmarks_2d_norm.resize(landmark_num);
+    img.landmarks_2d.resize(landmark_num);
+    img.landmarks_3d.resize(landmark_num);
+    img.landmarks_flag.resize(landmark_num);
+    std::fill(img.landmarks_flag.begin(), img.landmarks_flag.end(), 1);
+    for (size_t i = 0; i < img.feature_descriptor.size(); i ++) {
+        img.feature_descriptor[i] = (i % 17) * 0.01f;
+    }
+    return img;
+}
+
+//Usage: loop_net_batch_test [frames] [landmarks] [frame_interval_ms]
+//Send keyframe landmarks over loopback LCM as one LandmarkDescriptor_t per landmark (as before) and as
+//packed batches, report packets, bytes, sender time and the landmarks delivered.
+int main(int argc, char* argv[]) {
+    int frames = argc > 1 ? atoi(argv[1]) : 100;
+    int landmark_num = argc > 2 ? atoi(argv[2]) : 200;
+    int interval_ms = argc > 3 ? atoi(argv[3]) : 0;
+
+    lcm::LCM sender(TEST_LCM_URI), receiver(TEST_LCM_URI);
+    if (!sender.good() || !receiver.good()) {
+        printf("LCM %s failed\n", TEST_LCM_URI);
+        return -1;
+    }
+    LandmarkCounter counter;
+    receiver.subscribe(TEST_SINGLE_CHANNEL, &LandmarkCounter::on_single, &counter);
+    receiver.subscribe(TEST_BATCH_CHANNEL, &LandmarkCounter::on_batch, &counter);
+    std::atomic<bool> running(true);
+    std::thread th([&] {
+        while (running) {
+            receiver.handleTimeout(50);
+        }
+    });
+
+    auto img = synthetic_image(landmark_num);
+    long total = (long) frames * landmark_num;
+    for (int mode = 0; mode < 2; mode ++) {
+        counter.reset();
+        long packets_sent = 0, bytes_sent = 0;
+        double send_time = 0;
+        for (int f = 0; f < frames; f ++) {
+            img.msg_id = f;
+            TicToc tic;
+            if (mode == 0) {
+                for (int i = 0; i < landmark_num; i ++) {
+                    LandmarkDescriptor_t lm;
+                    lm.landmark_id = i;
+                    lm.landmark_2d_norm = img.landmarks_2d_norm[i];
+                    lm.landmark_2d = img.landmarks_2d[i];
+                    lm.landmark_3d = img.landmarks_3d[i];
+                    lm.landmark_flag = img.landmarks_flag[i];
+                    lm.drone_id = img.drone_id;
+                    lm.desc_len = FEATURE_DESC_SIZE;
+                    lm.feature_descriptor = std::vector<float>(img.feature_descriptor.data() + i*FEATURE_DESC_SIZE,
+                        img.feature_descriptor.data() + (i + 1)*FEATURE_DESC_SIZE);
+                    lm.msg_id = i;
+                    lm.header_id = img.msg_id;
+                    sender.publish(TEST_SINGLE_CHANNEL, &lm);
+                    packets_sent ++;
+                    bytes_sent += lm.getEncodedSize();
+                }
+            } else {
+                auto chunks = encode_landmark_batches(img, false);
+                for (auto & chunk : chunks) {
+                    sender.publish(TEST_BATCH_CHANNEL, chunk.data(), chunk.size());
+                    bytes_sent += chunk.size();
+                }
+                packets_sent += chunks.size();
+            }
+            send_time += tic.toc();
+            if (interval_ms > 0) {
+                usleep(interval_ms*1000);
+            }
+        }
+        //Let the receiver drain
+        usleep(500000);
+        printf("%-10s %ld packets %.1fkB sent in %.1fms (%.1fus/packet), received %ld packets %.1f%% landmarks %ld/%ld\n",
+            mode == 0 ? "single" : "batch", packets_sent, bytes_sent/1000.0, send_time, send_time*1000/packets_sent,
+            counter.packets.load(), counter.landmarks*100.0/total, counter.landmarks.load(), total);
+    }
+
+    running = false;
+    th.join();
+    return 0;
+}
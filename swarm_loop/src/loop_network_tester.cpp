@@ -1,4 +1,5 @@
 #include "swarm_loop/loop_net.h"
+#include "swarm_loop/landmark_batch.h"
 #include "swarm_msgs/swarm_lcm_converter.hpp"
 #include "swarmcomm_msgs/drone_network_status.h"
 #include <thread>
@@ -13,6 +14,8 @@ public:
     SwarmNetworkTester(ros::NodeHandle & nh):
         loopnet("udpm://224.0.0.251:7667?ttl=255", false, false) {
         nh.param<int>("self_id", self_id, -1);
+        nh.param<int>("landmark_batch_bytes", LANDMARK_BATCH_BYTES, LANDMARK_BATCH_DEFAULT_BYTES);
+        nh.param<int>("desc_wire_format", DESC_WIRE_FORMAT, DESC_WIRE_FORMAT_DEFAULT);
         loopnet.msg_recv_rate_callback = [&](int drone_id, float rate) {
             this->receive_rate_callback(drone_id, rate);
         };
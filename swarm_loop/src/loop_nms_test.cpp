@@ -0,0 +1,158 @@
+#include "swarm_loop/keypoint_nms.h"
+#include "swarm_msgs/swarm_types.hpp"
+using namespace Swarm;
+
+#define NMS_WIDTH 400
+#define NMS_HEIGHT 208
+#define NMS_THRES 0.015
+#define NMS_RADIUS 4
+#define NMS_MAX_NUM 200
+#define NMS_ITERS 1000
+#define NMS_BUCKETS 4
+
+int failed = 0;
+
+void check(bool ok, const char * what) {
+    if (!ok) {
+        printf("FAILED: %s\n", what);
+        failed ++;
+    }
+}
+
+//The previous getKeyPoints: threshold, findNonZero and NMS2
+void nms2_keypoints(const cv::Mat & prob, std::vector<cv::Point2f> & keypoints) {
+    keypoints.clear();
+    auto mask = (prob > NMS_THRES);
+    std::vector<cv::Point> kps;
+    cv::findNonZero(mask, kps);
+    std::vector<cv::Point2f> keypoints_no_nms;
+    cv::Mat conf(kps.size(), 1, CV_32F);
+    for (size_t i = 0; i < kps.size(); i++) {
+        keypoints_no_nms.push_back(cv::Point2f(kps[i].x, kps[i].y));
+        conf.at<float>(i, 0) = prob.at<float>(kps[i].y, kps[i].x);
+    }
+    NMS2(keypoints_no_nms, conf, keypoints, 0, NMS_RADIUS, NMS_WIDTH, NMS_HEIGHT, NMS_MAX_NUM);
+}
+
+//Isolated gaussian peaks at least 3*NMS_RADIUS apart and away from the border, over noise below threshold.
+//On such heatmaps NMS2 and gridNMS must select the same points.
+cv::Mat synthetic_peaks(cv::RNG & rng, int peak_num) {
+    cv::Mat prob(NMS_HEIGHT, NMS_WIDTH, CV_32F);
+    rng.fill(prob, cv::RNG::UNIFORM, 0, NMS_THRES*0.5);
+    std::vector<cv::Point> peaks;
+    for (int tries = 0; tries < peak_num*20 && (int) peaks.size() < peak_num; tries ++) {
+        cv::Point pt(rng.uniform(2*NMS_RADIUS, NMS_WIDTH - 2*NMS_RADIUS), rng.uniform(2*NMS_RADIUS, NMS_HEIGHT - 2*NMS_RADIUS));
+        bool far = true;
+        for (auto & p : peaks) {
+            far = far && (abs(p.x - pt.x) > 3*NMS_RADIUS || abs(p.y - pt.y) > 3*NMS_RADIUS);
+        }
+        if (!far) {
+            continue;
+        }
+        peaks.push_back(pt);
+        float height = rng.uniform(0.05f, 1.0f);
+        for (int dy = -NMS_RADIUS; dy <= NMS_RADIUS; dy ++) {
+            for (int dx = -NMS_RADIUS; dx <= NMS_RADIUS; dx ++) {
+                float v = height*exp(-(dx*dx + dy*dy)/2.0);
+                float & p = prob.at<float>(pt.y + dy, pt.x + dx);
+                p = std::max(p, v);
+            }
+        }
+    }
+    return prob;
+}
+
+std::vector<int> bucket_count(const std::vector<cv::Point2f> & kps) {
+    std::vector<int> count(NMS_BUCKETS*NMS_BUCKETS, 0);
+    for (auto & pt : kps) {
+        count[int(pt.y)*NMS_BUCKETS/NMS_HEIGHT*NMS_BUCKETS + int(pt.x)*NMS_BUCKETS/NMS_WIDTH] ++;
+    }
+    return count;
+}
+
+//Every bucket keeps its share of max_num, or all its window maxima if it has fewer,
+//and the share left unused by sparse buckets goes to the others
+void check_buckets(const cv::Mat & prob, const char * what) {
+    std::vector<cv::Point2f> all, kps;
+    gridNMS((float*) prob.data, NMS_WIDTH, NMS_HEIGHT, NMS_THRES, NMS_RADIUS, NMS_WIDTH*NMS_HEIGHT, all);
+    gridNMS((float*) prob.data, NMS_WIDTH, NMS_HEIGHT, NMS_THRES, NMS_RADIUS, NMS_MAX_NUM, kps, NMS_BUCKETS);
+    auto count_all = bucket_count(all);
+    auto count = bucket_count(kps);
+    int quota = NMS_MAX_NUM/(NMS_BUCKETS*NMS_BUCKETS);
+    bool ok = (int) kps.size() == std::min((int) all.size(), NMS_MAX_NUM);
+    for (unsigned int i = 0; i < count.size(); i ++) {
+        ok = ok && count[i] >= std::min(quota, count_all[i]) && count[i] <= count_all[i];
+    }
+    printf("%s: %ld of %ld window maxima, per bucket min %d max %d\n", what, kps.size(), all.size(),
+        *std::min_element(count.begin(), count.end()), *std::max_element(count.begin(), count.end()));
+    check(ok, what);
+}
+
+//Usage: loop_nms_test
+//Check gridNMS against NMS2 on synthetic heatmaps, the window maximum rule on neighbouring peaks,
+//the bucket shares, and benchmark both
+int main(int argc, char* argv[]) {
+    cv::RNG rng(0);
+    std::vector<cv::Point2f> kps_ref, kps_grid;
+
+    int mismatch = 0;
+    for (int i = 0; i < 100; i ++) {
+        cv::Mat prob = synthetic_peaks(rng, rng.uniform(10, 400));
+        nms2_keypoints(prob, kps_ref);
+        gridNMS((float*) prob.data, NMS_WIDTH, NMS_HEIGHT, NMS_THRES, NMS_RADIUS, NMS_MAX_NUM, kps_grid);
+        if (kps_ref != kps_grid) {
+            mismatch ++;
+            printf("Heatmap %d: NMS2 %ld keypoints gridNMS %ld keypoints\n", i, kps_ref.size(), kps_grid.size());
+        }
+    }
+    check(mismatch == 0, "gridNMS equivalent to NMS2 on isolated peaks");
+
+    //Neighbouring single pixel peaks. B is in the window of A and C in the window of B:
+    //gridNMS keeps only A, as C is not the maximum of its window, while NMS2 keeps C once B is suppressed.
+    //D and E tie, the first in row-major order is kept. F and G are radius + 1 apart and both kept.
+    cv::Mat peaks = cv::Mat::zeros(NMS_HEIGHT, NMS_WIDTH, CV_32F);
+    peaks.at<float>(100, 100) = 0.8; //A
+    peaks.at<float>(100, 100 + NMS_RADIUS) = 0.6; //B
+    peaks.at<float>(100, 100 + 2*NMS_RADIUS) = 0.4; //C
+    peaks.at<float>(50, 200) = 0.5; //D
+    peaks.at<float>(50 + NMS_RADIUS/2, 200 + NMS_RADIUS/2) = 0.5; //E
+    peaks.at<float>(150, 300) = 0.3; //F
+    peaks.at<float>(150, 300 + NMS_RADIUS + 1) = 0.2; //G
+    gridNMS((float*) peaks.data, NMS_WIDTH, NMS_HEIGHT, NMS_THRES, NMS_RADIUS, NMS_MAX_NUM, kps_grid);
+    check(kps_grid == std::vector<cv::Point2f>{cv::Point2f(100, 100), cv::Point2f(200, 50), cv::Point2f(300, 150),
+        cv::Point2f(300 + NMS_RADIUS + 1, 150)}, "gridNMS keeps window maxima of neighbouring peaks");
+    nms2_keypoints(peaks, kps_ref);
+    check(std::find(kps_ref.begin(), kps_ref.end(), cv::Point2f(100 + 2*NMS_RADIUS, 100)) != kps_ref.end(),
+        "NMS2 keeps the peak next to a suppressed one");
+
+    //Dense heatmap, many pixels above threshold as on textured images
+    cv::Mat prob = synthetic_peaks(rng, 400);
+    cv::Mat noise(NMS_HEIGHT, NMS_WIDTH, CV_32F);
+    rng.fill(noise, cv::RNG::UNIFORM, 0, NMS_THRES*3);
+    prob = cv::max(prob, noise);
+
+    TicToc tic;
+    for (int i = 0; i < NMS_ITERS; i ++) {
+        nms2_keypoints(prob, kps_ref);
+    }
+    double dt_nms2 = tic.toc()/NMS_ITERS;
+
+    TicToc tic2;
+    for (int i = 0; i < NMS_ITERS; i ++) {
+        gridNMS((float*) prob.data, NMS_WIDTH, NMS_HEIGHT, NMS_THRES, NMS_RADIUS, NMS_MAX_NUM, kps_grid);
+    }
+    double dt_grid = tic2.toc()/NMS_ITERS;
+    printf("Dense heatmap: NMS2 %.3fms %ld kps, gridNMS %.3fms %ld kps, speedup %.1fx\n",
+        dt_nms2, kps_ref.size(), dt_grid, kps_grid.size(), dt_nms2/dt_grid);
+
+    //Bucketed selection on the dense heatmap, then with the left half empty so its share goes to the right half
+    auto count = bucket_count(kps_grid);
+    printf("Unbucketed: %ld kps, per bucket min %d max %d\n", kps_grid.size(),
+        *std::min_element(count.begin(), count.end()), *std::max_element(count.begin(), count.end()));
+    check_buckets(prob, "Bucketed dense heatmap");
+    prob.colRange(0, NMS_WIDTH/2).setTo(0);
+    check_buckets(prob, "Bucketed half empty heatmap");
+
+    printf("%s\n", failed == 0 ? "OK" : "FAILED");
+    return failed == 0 ? 0 : -1;
+}
@@ -0,0 +1,129 @@
+#include "swarm_loop/superpoint_onnx.h"
+#include "swarm_loop/loop_defines.h"
+#include "swarm_loop/mobilenetvlad_onnx.h"
+#include "swarm_loop/utils.h"
+#include "swarm_msgs/swarm_types.hpp"
+#include <opencv2/dnn.hpp>
+#include <fstream>
+#include <sstream>
+using namespace Swarm;
+
+#define NETVLAD_TARGET_MS 100.0
+#define NETVLAD_REF_TOLERANCE 1e-3
+#define NETVLAD_REF_MIN_COSINE 0.999
+
+int failed = 0;
+
+void check(bool ok, const char * what) {
+    if (!ok) {
+        printf("FAILED: %s\n", what);
+        failed ++;
+    }
+}
+
+//One line of comma separated descriptor values
+std::vector<float> load_reference_csv(const char * path) {
+    std::vector<float> ref;
+    std::ifstream infile(path);
+    std::string line, cell;
+    std::getline(infile, line);
+    std::stringstream line_stream(line);
+    while (std::getline(line_stream, cell, ',')) {
+        ref.push_back(std::stof(cell));
+    }
+    return ref;
+}
+
+//Same weights run by the OpenCV dnn ONNX importer with plain OpenCV preprocessing,
+//independent of onnxruntime and of preprocessImage
+std::vector<float> reference_netvlad(const char * onnx_path, const cv::Mat & img_gray) {
+    cv::dnn::Net net = cv::dnn::readNetFromONNX(onnx_path);
+    cv::Mat input;
+    img_gray.convertTo(input, CV_32F);
+    //Exported from tensorflow, input is NHWC
+    int shape[] = {1, img_gray.rows, img_gray.cols, 1};
+    net.setInput(cv::Mat(4, shape, CV_32F, input.data));
+    cv::Mat out = net.forward();
+    return std::vector<float>((float*) out.data, (float*) out.data + out.total());
+}
+
+//Usage: loop_onnx_test superpoint.onnx mobilenetvlad.onnx image.png [threads] [netvlad_reference.csv]
+//Without a reference csv (one line of comma separated values dumped from the TensorRT/tensorflow model on the same image)
+//the reference is computed from the same model by OpenCV dnn.
+//Fails if the ONNX NetVLAD differs from the reference or takes more than NETVLAD_TARGET_MS per image.
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        printf("Usage: loop_onnx_test superpoint.onnx mobilenetvlad.onnx image.png [threads] [netvlad_reference.csv]\n");
+        return -1;
+    }
+
+    std::cout << "Load Model from " << argv[1] << std::endl;
+    std::cout << "Load Model from " << argv[2] << std::endl;
+
+    int threads = 4;
+    if (argc > 4) {
+        threads = atoi(argv[4]);
+    }
+
+    SuperPointONNX sp_onnx(argv[1], "", "", 400, 208, 0.012, 200, threads);
+    MobileNetVLADONNX netvlad_onnx(argv[2], 400, 208, threads);
+
+    std::cout << "Load 2 Model success" << std::endl << " Loading image " << argv[3] << std::endl;
+
+    cv::Mat img = cv::imread(argv[3]);
+    if (img.empty()) {
+        printf("Can't open image %s\n", argv[3]);
+        return -1;
+    }
+    cv::resize(img, img, cv::Size(400, 208));
+    std::vector<float> local_desc;
+    std::vector<cv::Point2f> kps;
+
+    cv::Mat img_gray;
+    cv::cvtColor(img, img_gray, cv::COLOR_BGR2GRAY);
+    TicToc tic;
+    for (unsigned int i = 0; i < 100; i ++) {
+        sp_onnx.inference(img_gray, kps, local_desc);
+    }
+    double dt = tic.toc();
+
+    std::vector<float> global_desc;
+    TicToc tic2;
+    for (unsigned int i = 0; i < 100; i ++) {
+        global_desc = netvlad_onnx.inference(img_gray);
+    }
+    double dt2 = tic2.toc();
+
+    printf("Superpoint CPU %d threads: %.1fms per image, %ld features\n", threads, dt/100, kps.size());
+    printf("NetVLAD CPU %d threads: %.1fms per image (target %.0fms)\n", threads, dt2/100, NETVLAD_TARGET_MS);
+    check(dt2/100 < NETVLAD_TARGET_MS, "NetVLAD per image under NETVLAD_TARGET_MS");
+
+    std::vector<float> ref;
+    if (argc > 5) {
+        ref = load_reference_csv(argv[5]);
+        printf("NetVLAD reference from %s\n", argv[5]);
+    } else {
+        ref = reference_netvlad(argv[2], img_gray);
+        printf("NetVLAD reference from OpenCV dnn\n");
+    }
+
+    if (ref.empty() || ref.size() != global_desc.size()) {
+        printf("Reference size %ld mismatch descriptor size %ld\n", ref.size(), global_desc.size());
+        return -1;
+    }
+
+    double max_err = 0, dot = 0, norm_ref = 0, norm_desc = 0;
+    for (size_t i = 0; i < ref.size(); i ++) {
+        max_err = std::max(max_err, (double) fabs(ref[i] - global_desc[i]));
+        dot += ref[i]*global_desc[i];
+        norm_ref += ref[i]*ref[i];
+        norm_desc += global_desc[i]*global_desc[i];
+    }
+    double cos_sim = dot/sqrt(norm_ref*norm_desc);
+    printf("NetVLAD vs reference: max abs err %e cosine %f\n", max_err, cos_sim);
+    check(max_err <= NETVLAD_REF_TOLERANCE, "NetVLAD max abs err to reference");
+    check(cos_sim >= NETVLAD_REF_MIN_COSINE, "NetVLAD cosine to reference");
+
+    printf("%s\n", failed == 0 ? "OK" : "FAILED");
+    return failed == 0 ? 0 : -1;
+}
@@ -22,6 +22,7 @@ double DEPTH_FAR_THRES;
 
 int MIN_DIRECTION_LOOP;
 double DETECTOR_MATCH_THRES;
+double DETECTOR_MATCH_RATIO;
 double loop_cov_pos;
 double loop_cov_ang;
 double odometry_consistency_threshold;
@@ -32,5 +33,21 @@ int width;
 int height;
 int inter_drone_init_frames;
 bool is_4dof;
+int ONNX_NUM_THREADS;
+int SUPERPOINT_NMS_BUCKETS;
+double KEYFRAME_DB_MAX_MB;
+int KEYFRAME_DB_MAX_FRAMES;
+int KEYFRAME_DB_EVICTION;
+double KEYFRAME_DB_SPATIAL_RADIUS;
+std::string LOOP_INDEX_FACTORY;
+std::string LOOP_INDEX_SEARCH_PARAMS;
+int LOOP_INDEX_TRAIN_SIZE;
+double LOOP_INDEX_REBUILD_STALE;
+int LOOP_CANDIDATE_NUM;
+int LOOP_VERIFY_THREADS;
+int PNP_SOLVER;
+double PNP_PROSAC_THRES;
+int LANDMARK_BATCH_BYTES;
+int DESC_WIRE_FORMAT;
 
 double ACCEPT_NONKEYFRAME_WAITSEC;
\ No newline at end of file
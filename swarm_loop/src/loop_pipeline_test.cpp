@@ -0,0 +1,126 @@
+#include "swarm_loop/inference_pipeline.h"
+#include "swarm_msgs/swarm_types.hpp"
+#include <chrono>
+#include <stdio.h>
+using namespace Swarm;
+
+#define PIPELINE_SLOTS 2
+#define PIPELINE_JOBS 40
+#define COMPUTE_MS 4
+#define PREPROCESS_MS 4
+
+//CPU stand in of the GPU: a slot computes for COMPUTE_MS after enqueue. Like an async copy on a stream,
+//the input is read only when the slot is synchronized, so a slot reused too early gives a wrong output.
+class FakeExecutor : public InferenceExecutor {
+    typedef std::chrono::steady_clock Clock;
+    std::vector<std::vector<float>> inputs, outputs;
+    std::vector<Clock::time_point> done_at;
+    std::vector<bool> enqueued;
+    std::mutex lock;
+public:
+    int inflight = 0;
+    int max_inflight = 0;
+    int errors = 0;
+
+    FakeExecutor(int slots):
+        inputs(slots, std::vector<float>(1)), outputs(slots, std::vector<float>(1)), done_at(slots), enqueued(slots, false) {
+    }
+
+    int slotNum() const override {
+        return inputs.size();
+    }
+
+    float * slotInput(int slot) override {
+        std::lock_guard<std::mutex> lk(lock);
+        errors += enqueued[slot];
+        return inputs[slot].data();
+    }
+
+    std::vector<float*> slotOutputs(int slot) override {
+        return std::vector<float*>{outputs[slot].data()};
+    }
+
+    void enqueueSlot(int slot, int batch) override {
+        std::lock_guard<std::mutex> lk(lock);
+        errors += enqueued[slot];
+        enqueued[slot] = true;
+        done_at[slot] = Clock::now() + std::chrono::milliseconds(COMPUTE_MS);
+        inflight ++;
+        max_inflight = std::max(max_inflight, inflight);
+    }
+
+    void synchronizeSlot(int slot) override {
+        Clock::time_point t;
+        {
+            std::lock_guard<std::mutex> lk(lock);
+            errors += !enqueued[slot];
+            t = done_at[slot];
+        }
+        std::this_thread::sleep_until(t);
+        std::lock_guard<std::mutex> lk(lock);
+        outputs[slot][0] = inputs[slot][0]*2;
+        enqueued[slot] = false;
+        inflight --;
+    }
+};
+
+//Usage: loop_pipeline_test
+//Drive InferencePipeline with a fake executor and check the outputs and their order, that no more than
+//the slot number of jobs are in flight, that preprocessing overlaps compute and that shutdown fulfills every future.
+int main(int argc, char* argv[]) {
+    bool ok = true;
+
+    FakeExecutor executor(PIPELINE_SLOTS);
+    std::vector<std::future<float>> futures;
+    std::vector<int> post_order;
+    {
+        InferencePipeline pipeline(&executor);
+        TicToc tic;
+        for (int i = 0; i < PIPELINE_JOBS; i ++) {
+            futures.push_back(pipeline.submit<float>([i](float * input) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(PREPROCESS_MS));
+                input[0] = i;
+            }, [i, &post_order](const std::vector<float*> & outputs) {
+                post_order.push_back(i);
+                return outputs[0][0];
+            }));
+        }
+        double dt_submit = tic.toc();
+        for (int i = 0; i < PIPELINE_JOBS; i ++) {
+            ok = ok && futures[i].get() == i*2;
+        }
+        double dt = tic.toc();
+        double serial = PIPELINE_JOBS*(PREPROCESS_MS + COMPUTE_MS);
+        printf("%d jobs in %.1fms (submit %.1fms), serial would take %.0fms, max in flight %d of %d slots\n",
+            PIPELINE_JOBS, dt, dt_submit, serial, executor.max_inflight, PIPELINE_SLOTS);
+        //Preprocessing of a slot overlaps the compute of the other
+        ok = ok && dt < serial*0.8;
+
+        //A failing postprocess reaches the caller
+        auto failing = pipeline.submit<float>([](float * input) { input[0] = 0; },
+            [](const std::vector<float*> & outputs) -> float { throw std::runtime_error("postprocess"); });
+        try {
+            failing.get();
+            ok = false;
+        } catch (std::runtime_error & e) {
+        }
+
+        //Shutdown with jobs in flight
+        futures.clear();
+        for (int i = 0; i < PIPELINE_SLOTS; i ++) {
+            futures.push_back(pipeline.submit<float>([i](float * input) { input[0] = i; },
+                [](const std::vector<float*> & outputs) { return outputs[0][0]; }));
+        }
+    }
+    for (int i = 0; i < PIPELINE_SLOTS; i ++) {
+        bool ready = futures[i].wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        ok = ok && ready && futures[i].get() == i*2;
+    }
+
+    for (int i = 0; i < PIPELINE_JOBS; i ++) {
+        ok = ok && post_order[i] == i;
+    }
+    ok = ok && executor.max_inflight <= PIPELINE_SLOTS && executor.errors == 0 && executor.inflight == 0;
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : -1;
+}
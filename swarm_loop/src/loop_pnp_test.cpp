@@ -0,0 +1,126 @@
+#include "swarm_loop/pnp_prosac.h"
+#include "swarm_msgs/swarm_types.hpp"
+
+#define PNP_TRIALS 200
+#define PNP_POINTS 150
+#define PNP_ITERATIONS 100
+//Noise of the inliers on the normalized plane, about 0.5px
+#define PNP_NOISE 0.002
+//A solution within these errors counts as success
+#define PNP_ROT_ERR_DEG 2.0
+#define PNP_POS_ERR 0.1
+
+struct PnPProblem {
+    std::vector<cv::Point3f> pts_3d;
+    std::vector<cv::Point2f> pts_2d;
+    std::vector<float> scores;
+    cv::Mat rvec, tvec;
+};
+
+//Landmarks 2-10m ahead seen by a second camera with outlier_ratio wrong matches.
+//As the descriptor distances, the scores of the outliers are higher on average but overlap with the inliers
+PnPProblem synthetic_problem(cv::RNG & rng, int num, double outlier_ratio) {
+    PnPProblem prob;
+    prob.rvec = (cv::Mat_<double>(3, 1) << rng.uniform(-0.2, 0.2), rng.uniform(-1.0, 1.0), rng.uniform(-0.2, 0.2));
+    prob.tvec = (cv::Mat_<double>(3, 1) << rng.uniform(-1.0, 1.0), rng.uniform(-0.3, 0.3), rng.uniform(-1.0, 1.0));
+    cv::Matx33d R;
+    cv::Rodrigues(prob.rvec, R);
+    cv::Vec3d t(prob.tvec.at<double>(0), prob.tvec.at<double>(1), prob.tvec.at<double>(2));
+    while ((int) prob.pts_3d.size() < num) {
+        cv::Vec3d p(rng.uniform(-4.0, 4.0), rng.uniform(-2.0, 2.0), rng.uniform(2.0, 10.0));
+        cv::Vec3d pc = R * p + t;
+        if (pc[2] < 1.0 || fabs(pc[0]/pc[2]) > 1.0 || fabs(pc[1]/pc[2]) > 1.0) {
+            continue;
+        }
+        cv::Point2f pt(pc[0]/pc[2] + rng.gaussian(PNP_NOISE), pc[1]/pc[2] + rng.gaussian(PNP_NOISE));
+        float score = rng.uniform(0.2f, 0.9f);
+        if (rng.uniform(0.0, 1.0) < outlier_ratio) {
+            pt = cv::Point2f(rng.uniform(-1.0f, 1.0f), rng.uniform(-1.0f, 1.0f));
+            score = rng.uniform(0.5f, 1.2f);
+        }
+        prob.pts_3d.push_back(cv::Point3f(p[0], p[1], p[2]));
+        prob.pts_2d.push_back(pt);
+        prob.scores.push_back(score);
+    }
+    return prob;
+}
+
+bool pose_correct(const PnPProblem & prob, const cv::Mat & rvec, const cv::Mat & tvec) {
+    if (rvec.empty() || tvec.empty()) {
+        return false;
+    }
+    cv::Matx33d R_gt, R;
+    cv::Rodrigues(prob.rvec, R_gt);
+    cv::Rodrigues(rvec, R);
+    cv::Mat dr;
+    cv::Rodrigues(cv::Mat(R_gt.t() * R), dr);
+    return cv::norm(dr) * 57.3 < PNP_ROT_ERR_DEG && cv::norm(tvec - prob.tvec) < PNP_POS_ERR;
+}
+
+struct SolverResult {
+    double time_sum = 0;
+    int success = 0;
+    long iterations = 0;
+};
+
+//Usage: loop_pnp_test
+//Time to solution and success rate of the loop PnP on synthetic 2D-3D correspondences:
+//cv::solvePnPRansac as called by compute_relative_pose, the same with the PROSAC threshold,
+//RANSAC sampling with local optimization, and PROSAC with local optimization.
+int main(int argc, char* argv[]) {
+    cv::Mat K = cv::Mat::eye(3, 3, CV_64F);
+    PnPProsacParams params;
+    params.max_iterations = PNP_ITERATIONS;
+    printf("%d correspondences, %d trials, at most %d iterations, threshold %.3f\n", PNP_POINTS, PNP_TRIALS, PNP_ITERATIONS, params.reproj_thres);
+    for (double outlier_ratio : {0.3, 0.5, 0.7, 0.8}) {
+        cv::RNG rng(0);
+        SolverResult res_cv, res_cv_thres, res_lo, res_prosac;
+        for (int trial = 0; trial < PNP_TRIALS; trial ++) {
+            auto prob = synthetic_problem(rng, PNP_POINTS, outlier_ratio);
+            params.seed = trial;
+
+            cv::Mat rvec, tvec, inliers;
+            TicToc tic;
+            solvePnPRansac(prob.pts_3d, prob.pts_2d, K, cv::Mat(), rvec, tvec, false, PNP_ITERATIONS, 3, 0.99, inliers);
+            res_cv.time_sum += tic.toc();
+            res_cv.success += pose_correct(prob, rvec, tvec);
+            res_cv.iterations += PNP_ITERATIONS;
+
+            rvec = cv::Mat();
+            tvec = cv::Mat();
+            TicToc tic2;
+            solvePnPRansac(prob.pts_3d, prob.pts_2d, K, cv::Mat(), rvec, tvec, false, PNP_ITERATIONS, params.reproj_thres, 0.99, inliers);
+            res_cv_thres.time_sum += tic2.toc();
+            res_cv_thres.success += pose_correct(prob, rvec, tvec);
+            res_cv_thres.iterations += PNP_ITERATIONS;
+
+            std::vector<int> _inliers;
+            PnPProsacStats stats;
+            rvec = cv::Mat();
+            tvec = cv::Mat();
+            TicToc tic3;
+            solvePnPProsac(prob.pts_3d, prob.pts_2d, std::vector<float>(), rvec, tvec, _inliers, params, nullptr, &stats);
+            res_lo.time_sum += tic3.toc();
+            res_lo.success += pose_correct(prob, rvec, tvec);
+            res_lo.iterations += stats.iterations;
+
+            rvec = cv::Mat();
+            tvec = cv::Mat();
+            TicToc tic4;
+            solvePnPProsac(prob.pts_3d, prob.pts_2d, prob.scores, rvec, tvec, _inliers, params, nullptr, &stats);
+            res_prosac.time_sum += tic4.toc();
+            res_prosac.success += pose_correct(prob, rvec, tvec);
+            res_prosac.iterations += stats.iterations;
+        }
+        printf("outliers %.0f%%:\n", outlier_ratio*100);
+        auto report = [](const char * name, const SolverResult & res) {
+            printf("    %-28s %.3fms success %5.1f%% iterations %.1f\n", name, res.time_sum/PNP_TRIALS,
+                res.success*100.0/PNP_TRIALS, (double) res.iterations/PNP_TRIALS);
+        };
+        report("solvePnPRansac (thres 3)", res_cv);
+        report("solvePnPRansac", res_cv_thres);
+        report("LO-RANSAC", res_lo);
+        report("PROSAC + LO", res_prosac);
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include "swarm_loop/image_preprocess.h"
+#include "swarm_msgs/swarm_types.hpp"
+using namespace Swarm;
+
+#define PREPROCESS_ITERS 1000
+//cv::resize rounds to uint8 in between, allow one gray level
+#define PREPROCESS_TOLERANCE (1.0/255.0 + 1e-6)
+
+//The sequence used by SuperPointTensorRT/MobileNetVLADTensorRT before: resize, convertTo, split to planes
+void opencv_preprocess(const cv::Mat & input, int width, int height, float scale, float * dst) {
+    cv::Mat _input;
+    if (input.rows != height || input.cols != width) {
+        cv::resize(input, _input, cv::Size(width, height));
+        _input.convertTo(_input, CV_32F, scale);
+    } else {
+        input.convertTo(_input, CV_32F, scale);
+    }
+    int plane = width*height;
+    if (_input.channels() == 1) {
+        memcpy(dst, _input.data, plane*sizeof(float));
+    } else {
+        cv::Mat bgr[3];
+        cv::split(_input, bgr);
+        memcpy(dst, bgr[2].data, plane*sizeof(float));
+        memcpy(dst + plane, bgr[1].data, plane*sizeof(float));
+        memcpy(dst + plane*2, bgr[0].data, plane*sizeof(float));
+    }
+}
+
+bool run_case(int src_width, int src_height, int channels, int width, int height) {
+    cv::Mat img(src_height, src_width, CV_8UC(channels));
+    cv::randu(img, cv::Scalar::all(0), cv::Scalar::all(255));
+    cv::GaussianBlur(img, img, cv::Size(5, 5), 0);
+    std::vector<float> ref(width*height*channels), out(width*height*channels);
+
+    TicToc tic;
+    for (int i = 0; i < PREPROCESS_ITERS; i ++) {
+        opencv_preprocess(img, width, height, 1/255.0, ref.data());
+    }
+    double dt_cv = tic.toc()/PREPROCESS_ITERS;
+
+    TicToc tic2;
+    for (int i = 0; i < PREPROCESS_ITERS; i ++) {
+        preprocessImage(img, width, height, 1/255.0, out.data());
+    }
+    double dt_fused = tic2.toc()/PREPROCESS_ITERS;
+
+    double max_err = 0;
+    for (size_t i = 0; i < ref.size(); i ++) {
+        max_err = std::max(max_err, (double) fabs(ref[i] - out[i]));
+    }
+
+    bool ok = max_err <= PREPROCESS_TOLERANCE;
+    printf("%dx%dx%d -> %dx%d: OpenCV %.3fms fused %.3fms speedup %.1fx max err %e %s\n",
+        src_width, src_height, channels, width, height, dt_cv, dt_fused, dt_cv/dt_fused, max_err, ok ? "OK" : "FAILED");
+    return ok;
+}
+
+//Usage: loop_preprocess_test
+//Benchmark the fused preprocessing against the OpenCV sequence and check their outputs match
+int main(int argc, char* argv[]) {
+    bool ok = true;
+    ok = run_case(400, 208, 1, 400, 208) && ok;
+    ok = run_case(400, 208, 3, 400, 208) && ok;
+    ok = run_case(640, 480, 1, 400, 208) && ok;
+    ok = run_case(640, 480, 3, 400, 208) && ok;
+    ok = run_case(1280, 720, 1, 400, 208) && ok;
+    return ok ? 0 : -1;
+}
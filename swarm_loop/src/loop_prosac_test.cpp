@@ -0,0 +1,130 @@
+#include "swarm_loop/pnp_prosac.h"
+#include <set>
+#include <stdio.h>
+
+#define PROSAC_TRIALS 20
+#define PROSAC_POINTS 100
+//Noise of the inliers on the normalized plane, well within the threshold
+#define PROSAC_NOISE 0.002
+//Outliers are at least this far from their true projection, well out of the threshold
+#define PROSAC_OUTLIER_DIST 0.1
+#define PROSAC_ROT_ERR_DEG 1.0
+#define PROSAC_POS_ERR 0.05
+
+int failed = 0;
+
+void check(bool ok, const char * what) {
+    if (!ok) {
+        printf("FAILED: %s\n", what);
+        failed ++;
+    }
+}
+
+struct PnPProblem {
+    std::vector<cv::Point3f> pts_3d;
+    std::vector<cv::Point2f> pts_2d;
+    std::vector<float> scores;
+    std::vector<int> inliers;
+    cv::Mat rvec, tvec;
+};
+
+//Landmarks 2-10m ahead with unambiguous outliers, so the inlier set of the true pose is known.
+//Scores of the outliers overlap with the inliers, so PROSAC reorders the correspondences
+PnPProblem synthetic_problem(cv::RNG & rng, int num, double outlier_ratio) {
+    PnPProblem prob;
+    prob.rvec = (cv::Mat_<double>(3, 1) << rng.uniform(-0.2, 0.2), rng.uniform(-1.0, 1.0), rng.uniform(-0.2, 0.2));
+    prob.tvec = (cv::Mat_<double>(3, 1) << rng.uniform(-1.0, 1.0), rng.uniform(-0.3, 0.3), rng.uniform(-1.0, 1.0));
+    cv::Matx33d R;
+    cv::Rodrigues(prob.rvec, R);
+    cv::Vec3d t(prob.tvec.at<double>(0), prob.tvec.at<double>(1), prob.tvec.at<double>(2));
+    while ((int) prob.pts_3d.size() < num) {
+        cv::Vec3d p(rng.uniform(-4.0, 4.0), rng.uniform(-2.0, 2.0), rng.uniform(2.0, 10.0));
+        cv::Vec3d pc = R * p + t;
+        if (pc[2] < 1.0 || fabs(pc[0]/pc[2]) > 1.0 || fabs(pc[1]/pc[2]) > 1.0) {
+            continue;
+        }
+        cv::Point2f proj(pc[0]/pc[2], pc[1]/pc[2]);
+        cv::Point2f pt(proj.x + rng.gaussian(PROSAC_NOISE), proj.y + rng.gaussian(PROSAC_NOISE));
+        float score = rng.uniform(0.2f, 0.9f);
+        if (rng.uniform(0.0, 1.0) < outlier_ratio) {
+            do {
+                pt = cv::Point2f(rng.uniform(-1.0f, 1.0f), rng.uniform(-1.0f, 1.0f));
+            } while (cv::norm(pt - proj) < PROSAC_OUTLIER_DIST);
+            score = rng.uniform(0.5f, 1.2f);
+        } else {
+            prob.inliers.push_back(prob.pts_3d.size());
+        }
+        prob.pts_3d.push_back(cv::Point3f(p[0], p[1], p[2]));
+        prob.pts_2d.push_back(pt);
+        prob.scores.push_back(score);
+    }
+    return prob;
+}
+
+bool pose_correct(const PnPProblem & prob, const cv::Mat & rvec, const cv::Mat & tvec) {
+    if (rvec.empty() || tvec.empty()) {
+        return false;
+    }
+    cv::Matx33d R_gt, R;
+    cv::Rodrigues(prob.rvec, R_gt);
+    cv::Rodrigues(rvec, R);
+    cv::Mat dr;
+    cv::Rodrigues(cv::Mat(R_gt.t() * R), dr);
+    return cv::norm(dr) * 57.3 < PROSAC_ROT_ERR_DEG && cv::norm(tvec - prob.tvec) < PROSAC_POS_ERR;
+}
+
+//Pose and inliers, as indices of the input order, must be exactly the true ones
+void check_solve(const PnPProblem & prob, bool use_scores, const PnPProsacParams & params, const char * what) {
+    cv::Mat rvec, tvec;
+    std::vector<int> inliers;
+    bool ok = solvePnPProsac(prob.pts_3d, prob.pts_2d, use_scores ? prob.scores : std::vector<float>(),
+        rvec, tvec, inliers, params);
+    check(ok && pose_correct(prob, rvec, tvec) && inliers == prob.inliers, what);
+
+    //Repeatable with the same seed
+    cv::Mat rvec2, tvec2;
+    std::vector<int> inliers2;
+    solvePnPProsac(prob.pts_3d, prob.pts_2d, use_scores ? prob.scores : std::vector<float>(),
+        rvec2, tvec2, inliers2, params);
+    check(ok && inliers2 == inliers && cv::norm(rvec2 - rvec) == 0 && cv::norm(tvec2 - tvec) == 0, "same seed same result");
+}
+
+//Usage: loop_prosac_test
+//Check that solvePnPProsac finds the true pose and exactly the true inliers of synthetic problems with and without scores,
+//repeatably, and that it fails cleanly on too few points and on hypotheses all rejected by the check.
+int main(int argc, char* argv[]) {
+    PnPProsacParams params;
+    params.max_iterations = 200;
+    for (double outlier_ratio : {0.0, 0.3, 0.5}) {
+        cv::RNG rng(0);
+        for (int trial = 0; trial < PROSAC_TRIALS; trial ++) {
+            auto prob = synthetic_problem(rng, PROSAC_POINTS, outlier_ratio);
+            params.seed = trial;
+            char what[100];
+            snprintf(what, sizeof(what), "PROSAC outliers %.0f%% trial %d", outlier_ratio*100, trial);
+            check_solve(prob, true, params, what);
+            snprintf(what, sizeof(what), "uniform sampling outliers %.0f%% trial %d", outlier_ratio*100, trial);
+            check_solve(prob, false, params, what);
+        }
+    }
+
+    cv::RNG rng(1);
+    auto prob = synthetic_problem(rng, PROSAC_POINTS, 0.3);
+    cv::Mat rvec, tvec;
+    std::vector<int> inliers{1, 2, 3};
+
+    std::vector<cv::Point3f> few_3d(prob.pts_3d.begin(), prob.pts_3d.begin() + 3);
+    std::vector<cv::Point2f> few_2d(prob.pts_2d.begin(), prob.pts_2d.begin() + 3);
+    check(!solvePnPProsac(few_3d, few_2d, std::vector<float>(), rvec, tvec, inliers, params) && inliers.empty(),
+        "fewer than 4 correspondences fail");
+
+    PnPProsacStats stats;
+    auto reject_all = [](const cv::Mat & rvec, const cv::Mat & tvec) { return false; };
+    inliers = std::vector<int>{1, 2, 3};
+    bool ok = solvePnPProsac(prob.pts_3d, prob.pts_2d, prob.scores, rvec, tvec, inliers, params, reject_all, &stats);
+    check(!ok && inliers.empty() && stats.rejected > 0 && stats.iterations == params.max_iterations,
+        "all hypotheses rejected fail");
+
+    printf("%s\n", failed == 0 ? "OK" : "FAILED");
+    return failed == 0 ? 0 : -1;
+}
@@ -0,0 +1,209 @@
+#include "swarm_loop/descriptor_codec.h"
+#include "swarm_loop/landmark_batch.h"
+#include "swarm_loop/feature_matcher.h"
+#include "swarm_loop/loop_defines.h"
+#include <swarm_msgs/LandmarkDescriptor_t.hpp>
+#include <Eigen/Dense>
+#include <random>
+#include <stdio.h>
+
+using namespace swarm_msgs;
+
+#define QUANT_DESC_SIZE 4096
+#define QUANT_LATENT_SIZE 64
+#define QUANT_DB_SIZE 2000
+#define QUANT_QUERIES 500
+#define QUANT_TOPK 5
+#define QUANT_LANDMARKS 200
+//Landmarks are drawn around a few clusters, as the repeated textures of a scene
+#define QUANT_LANDMARK_CLUSTERS 20
+//Keyframe in the default wire format against one packet per float32 landmark
+#define QUANT_MIN_RATIO 4.0
+//Largest recall lost by the formats sent by default: int8 NetVLAD recall@1 and int4 landmark matching recall
+#define QUANT_MAX_RETRIEVAL_LOSS 0.05
+#define QUANT_MAX_MATCHING_LOSS 0.05
+
+int failed = 0;
+
+void check(bool ok, const char * what) {
+    if (!ok) {
+        printf("FAILED: %s\n", what);
+        failed ++;
+    }
+}
+
+std::mt19937 rng(0);
+std::normal_distribution<float> normal(0, 1);
+
+Eigen::MatrixXf random_matrix(int rows, int cols, float sigma) {
+    return Eigen::MatrixXf::NullaryExpr(rows, cols, [&]() { return normal(rng)*sigma; });
+}
+
+Eigen::MatrixXf roundtrip(const Eigen::MatrixXf & x, int format) {
+    Eigen::MatrixXf y(x.rows(), x.cols());
+    std::vector<uint8_t> buf(quantized_desc_size(x.rows(), format));
+    for (int i = 0; i < x.cols(); i ++) {
+        quantize_desc(x.col(i).data(), x.rows(), format, buf.data());
+        dequantize_desc(buf.data(), x.rows(), format, y.col(i).data());
+    }
+    return y;
+}
+
+//Fraction of the queries whose nearest database descriptor by the float descriptors is in the top k of db_q
+double retrieval_recall(const Eigen::MatrixXf & db, const Eigen::MatrixXf & db_q, const Eigen::MatrixXf & queries, int k) {
+    Eigen::MatrixXf ip = queries.transpose()*db, ip_q = queries.transpose()*db_q;
+    int hit = 0;
+    for (int i = 0; i < queries.cols(); i ++) {
+        int gt;
+        ip.row(i).maxCoeff(&gt);
+        int rank = 0;
+        for (int j = 0; j < db.cols(); j ++) {
+            rank += ip_q(i, j) > ip_q(i, gt);
+        }
+        hit += rank < k;
+    }
+    return (double) hit / queries.cols();
+}
+
+//Correct and all matches of landmarks a against a second view b of them with the descriptors of b in format,
+//the first quarter of b are unrelated landmarks
+void local_matching(const Eigen::MatrixXf & a, const Eigen::MatrixXf & b, int format, int & correct, int & matched, int & expected) {
+    Eigen::MatrixXf b_q = roundtrip(b, format);
+
+    std::vector<cv::DMatch> matches;
+    Swarm::matchDescriptors(a.data(), QUANT_LANDMARKS, b_q.data(), QUANT_LANDMARKS, matches);
+    correct = 0;
+    for (auto & m : matches) {
+        correct += m.queryIdx == m.trainIdx && m.queryIdx >= QUANT_LANDMARKS/4;
+    }
+    matched = matches.size();
+    expected = QUANT_LANDMARKS - QUANT_LANDMARKS/4;
+}
+
+ImageDescriptor_t synthetic_image() {
+    ImageDescriptor_t img;
+    img.landmark_num = QUANT_LANDMARKS;
+    img.image_desc.resize(QUANT_DESC_SIZE);
+    img.image_desc_size = QUANT_DESC_SIZE;
+    img.feature_descriptor.resize(QUANT_LANDMARKS*FEATURE_DESC_SIZE);
+    img.feature_descriptor_size = img.feature_descriptor.size();
+    img.landmarks_2d_norm.resize(QUANT_LANDMARKS);
+    img.landmarks_2d.resize(QUANT_LANDMARKS);
+    img.landmarks_3d.resize(QUANT_LANDMARKS);
+    img.landmarks_flag.resize(QUANT_LANDMARKS);
+    std::fill(img.landmarks_flag.begin(), img.landmarks_flag.end(), 1);
+    return img;
+}
+
+//Bytes of a keyframe as sent by LoopNet::broadcast_img_desc
+int keyframe_bytes(const ImageDescriptor_t & img, bool batch, int format) {
+    ImageDescriptorHeader_t header;
+    header.image_desc = img.image_desc;
+    header.image_desc_size = img.image_desc_size;
+    header.feature_num = img.landmark_num;
+    //As LoopNet, the NetVLAD descriptor of a quantized format is int8
+    int bytes = format == DESC_FLOAT32 ? header.getEncodedSize() : encode_quantized_header(header, DESC_INT8).size();
+    if (batch) {
+        for (auto & chunk : encode_landmark_batches(img, false, LANDMARK_BATCH_DEFAULT_BYTES, format)) {
+            bytes += chunk.size();
+        }
+    } else {
+        LandmarkDescriptor_t lm;
+        lm.desc_len = FEATURE_DESC_SIZE;
+        lm.feature_descriptor.resize(FEATURE_DESC_SIZE);
+        bytes += img.landmark_num * lm.getEncodedSize();
+    }
+    return bytes;
+}
+
+//Usage: loop_quant_test
+//Bytes per keyframe of the descriptor wire formats and the recall lost by them on synthetic NetVLAD retrieval
+//and landmark matching, against the float32 descriptors. Check that the default format is QUANT_MIN_RATIO times
+//smaller than one packet per float32 landmark and that the int formats lose little recall.
+int main(int argc, char* argv[]) {
+    auto img = synthetic_image();
+    int legacy = keyframe_bytes(img, false, DESC_FLOAT32);
+    printf("Keyframe with %d landmarks: one packet per landmark %d bytes\n", QUANT_LANDMARKS, legacy);
+    const char * names[] = {"float32", "int8", "binary", "int4"};
+    for (int format : {DESC_FLOAT32, DESC_INT8, DESC_BINARY, DESC_INT4}) {
+        int bytes = keyframe_bytes(img, true, format);
+        printf("    batch %-8s %6d bytes, %.1fx smaller\n", names[format], bytes, (double) legacy / bytes);
+    }
+    check((double) legacy / keyframe_bytes(img, true, DESC_WIRE_FORMAT_DEFAULT) >= QUANT_MIN_RATIO,
+        "default wire format QUANT_MIN_RATIO times smaller");
+
+    //Landmarks sent in each format are decoded within half a quantization step, the sign of int4 included
+    for (auto & v : img.feature_descriptor) {
+        v = normal(rng);
+    }
+    for (int format : {DESC_FLOAT32, DESC_INT8, DESC_INT4}) {
+        ImageDescriptor_t recv;
+        for (auto & chunk : encode_landmark_batches(img, false, LANDMARK_BATCH_DEFAULT_BYTES, format)) {
+            LandmarkBatchInfo info;
+            check(parse_landmark_batch(chunk.data(), chunk.size(), info), names[format]);
+            append_landmark_batch(chunk.data(), chunk.size(), recv);
+        }
+        bool ok = recv.feature_descriptor.size() == img.feature_descriptor.size();
+        for (int i = 0; i < QUANT_LANDMARKS && ok; i ++) {
+            const float * v = img.feature_descriptor.data() + i*FEATURE_DESC_SIZE;
+            float max_abs = 0;
+            for (int k = 0; k < FEATURE_DESC_SIZE; k ++) {
+                max_abs = std::max(max_abs, fabsf(v[k]));
+            }
+            float step = format == DESC_INT8 ? max_abs/127 : format == DESC_INT4 ? max_abs/7 : 0;
+            for (int k = 0; k < FEATURE_DESC_SIZE; k ++) {
+                ok = ok && fabsf(recv.feature_descriptor[i*FEATURE_DESC_SIZE + k] - v[k]) <= step/2 + 1e-6;
+            }
+        }
+        check(ok, names[format]);
+    }
+
+    //Normalized descriptors near a low dimensional manifold, as the NetVLAD descriptors of a trajectory:
+    //consecutive keyframes are close, so the nearest one is easily lost by quantization
+    Eigen::MatrixXf basis = random_matrix(QUANT_DESC_SIZE, QUANT_LATENT_SIZE, 1);
+    Eigen::MatrixXf z = random_matrix(QUANT_LATENT_SIZE, QUANT_DB_SIZE, 0.1);
+    for (int i = 1; i < QUANT_DB_SIZE; i ++) {
+        z.col(i) += z.col(i - 1);
+    }
+    Eigen::MatrixXf db = basis*z + random_matrix(QUANT_DESC_SIZE, QUANT_DB_SIZE, 0.3);
+    Eigen::MatrixXf queries = basis*(z.leftCols(QUANT_QUERIES) + random_matrix(QUANT_LATENT_SIZE, QUANT_QUERIES, 0.1)) +
+        random_matrix(QUANT_DESC_SIZE, QUANT_QUERIES, 0.3);
+    db.colwise().normalize();
+    queries.colwise().normalize();
+    printf("NetVLAD retrieval of %d queries in %d keyframes, nearest float32 keyframe found in:\n", QUANT_QUERIES, QUANT_DB_SIZE);
+    for (int format : {DESC_INT8, DESC_INT4, DESC_BINARY}) {
+        Eigen::MatrixXf db_q = roundtrip(db, format);
+        double recall = retrieval_recall(db, db_q, queries, 1);
+        printf("    %-8s recall@1 %.1f%% recall@%d %.1f%%\n", names[format],
+            recall*100, QUANT_TOPK, retrieval_recall(db, db_q, queries, QUANT_TOPK)*100);
+        //NetVLAD is sent as int8 by LoopNet
+        if (format == DESC_INT8) {
+            check(recall >= 1 - QUANT_MAX_RETRIEVAL_LOSS, "int8 NetVLAD retrieval");
+        }
+    }
+
+    Eigen::MatrixXf centers = random_matrix(MATCH_DESC_SIZE, QUANT_LANDMARK_CLUSTERS, 1);
+    Eigen::MatrixXf a = random_matrix(MATCH_DESC_SIZE, QUANT_LANDMARKS, 0.15);
+    for (int i = 0; i < QUANT_LANDMARKS; i ++) {
+        a.col(i) += centers.col(i % QUANT_LANDMARK_CLUSTERS);
+    }
+    Eigen::MatrixXf b = a + random_matrix(MATCH_DESC_SIZE, QUANT_LANDMARKS, 0.2);
+    b.leftCols(QUANT_LANDMARKS/4) = random_matrix(MATCH_DESC_SIZE, QUANT_LANDMARKS/4, 1);
+    a.colwise().normalize();
+    b.colwise().normalize();
+    printf("Landmark matching, %d landmarks:\n", QUANT_LANDMARKS);
+    int correct_float = 0;
+    for (int format : {DESC_FLOAT32, DESC_INT8, DESC_INT4, DESC_BINARY}) {
+        int correct, matched, expected;
+        local_matching(a, b, format, correct, matched, expected);
+        printf("    %-8s correct %d/%d recall %.1f%% precision %.1f%%\n", names[format], correct, expected,
+            correct*100.0/expected, correct*100.0/std::max(matched, 1));
+        if (format == DESC_FLOAT32) {
+            correct_float = correct;
+        } else if (format == DESC_INT8 || format == DESC_WIRE_FORMAT_DEFAULT) {
+            check(correct >= correct_float - QUANT_MAX_MATCHING_LOSS*expected, names[format]);
+        }
+    }
+    printf("%s\n", failed == 0 ? "OK" : "FAILED");
+    return failed == 0 ? 0 : -1;
+}
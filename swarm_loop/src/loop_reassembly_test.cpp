@@ -0,0 +1,173 @@
+#include "swarm_loop/packet_reassembler.h"
+#include "swarm_loop/loop_defines.h"
+#include "swarm_msgs/swarm_types.hpp"
+#include <random>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <stdio.h>
+
+using namespace swarm_msgs;
+
+#define TEST_RECV_PERIOD 0.5
+//Packets between two timer scans, 10ms at 10k packets/s
+#define TEST_SCAN_PACKETS 100
+#define TEST_PACKET_DT 1e-4
+
+struct Packet {
+    int64_t id;
+    //-1 for the header
+    int seq;
+    std::vector<uint8_t> data;
+};
+
+struct StreamConfig {
+    bool shuffle;
+    double loss;
+    double duplicate;
+};
+
+struct SentImage {
+    ImageDescriptorHeader_t header;
+    int landmark_num;
+    std::vector<int> chunk_landmarks;
+};
+
+std::mt19937 rng(0);
+
+std::vector<Packet> synthetic_stream(int image_num, const StreamConfig & config, std::map<int64_t, SentImage> & sent) {
+    std::vector<Packet> packets;
+    std::uniform_int_distribution<int> landmark_dist(50, 200);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    for (int i = 0; i < image_num; i ++) {
+        ImageDescriptor_t img;
+        img.msg_id = i + 1;
+        img.frame_id = i;
+        img.drone_id = 1;
+        img.direction = i % 4;
+        img.landmark_num = landmark_dist(rng);
+        img.feature_descriptor.resize(img.landmark_num*FEATURE_DESC_SIZE);
+        img.landmarks_2d_norm.resize(img.landmark_num);
+        img.landmarks_2d.resize(img.landmark_num);
+        img.landmarks_3d.resize(img.landmark_num);
+        img.landmarks_flag.resize(img.landmark_num, 1);
+
+        SentImage & s = sent[img.msg_id];
+        s.header.msg_id = img.msg_id;
+        s.header.frame_id = img.frame_id;
+        s.header.drone_id = img.drone_id;
+        s.header.direction = img.direction;
+        s.header.feature_num = img.landmark_num;
+        s.header.image_desc_size = 0;
+        s.header.prevent_adding_db = false;
+        s.landmark_num = img.landmark_num;
+        packets.push_back(Packet{img.msg_id, -1, {}});
+        auto chunks = encode_landmark_batches(img, false);
+        for (size_t seq = 0; seq < chunks.size(); seq ++) {
+            LandmarkBatchInfo info;
+            parse_landmark_batch(chunks[seq].data(), chunks[seq].size(), info);
+            s.chunk_landmarks.push_back(info.landmark_num);
+            packets.push_back(Packet{img.msg_id, (int) seq, chunks[seq]});
+        }
+    }
+
+    std::vector<Packet> stream;
+    for (auto & p : packets) {
+        if (uniform(rng) < config.loss) {
+            continue;
+        }
+        stream.push_back(p);
+        if (uniform(rng) < config.duplicate) {
+            stream.push_back(p);
+        }
+    }
+    if (config.shuffle) {
+        std::shuffle(stream.begin(), stream.end(), rng);
+    }
+    return stream;
+}
+
+//Feed the stream and check every image with a received header is finished once with exactly the delivered landmarks,
+//and nothing is left behind after the deadlines
+bool run_stream(const char * name, int image_num, const StreamConfig & config) {
+    std::map<int64_t, SentImage> sent;
+    auto stream = synthetic_stream(image_num, config, sent);
+
+    PacketReassembler reassembler(TEST_RECV_PERIOD, 1);
+    std::map<int64_t, std::pair<int, int>> finished;
+    int duplicated_finish = 0, frames = 0;
+    reassembler.image_callback = [&](const ImageDescriptor_t & img, int announced) {
+        duplicated_finish += finished.count(img.msg_id);
+        finished[img.msg_id] = std::make_pair(img.landmark_num, announced);
+    };
+    reassembler.frame_callback = [&](const FisheyeFrameDescriptor_t & frame) {
+        frames ++;
+    };
+
+    std::set<int64_t> header_delivered;
+    std::map<int64_t, std::set<int>> chunks_delivered;
+    double t = 0;
+    int finished_before_timeout = 0;
+    TicToc tic;
+    for (size_t i = 0; i < stream.size(); i ++) {
+        auto & p = stream[i];
+        //LoopNet blacklists the finished images
+        if (finished.count(p.id)) {
+            continue;
+        }
+        if (p.seq < 0) {
+            reassembler.on_header(sent[p.id].header, t);
+            header_delivered.insert(p.id);
+        } else {
+            LandmarkBatchInfo info;
+            parse_landmark_batch(p.data.data(), p.data.size(), info);
+            reassembler.on_landmark_batch(p.data.data(), p.data.size(), info, t);
+            chunks_delivered[p.id].insert(p.seq);
+        }
+        t += TEST_PACKET_DT;
+        if (i % TEST_SCAN_PACKETS == 0) {
+            reassembler.expire(t);
+        }
+    }
+    double dt = tic.toc();
+    finished_before_timeout = finished.size();
+    int active_images = reassembler.active_images();
+    reassembler.expire(t + 3*TEST_RECV_PERIOD);
+
+    int wrong = 0, expected = 0;
+    for (auto & it : sent) {
+        int64_t id = it.first;
+        if (!header_delivered.count(id)) {
+            wrong += finished.count(id);
+            continue;
+        }
+        expected ++;
+        int delivered = 0;
+        for (int seq : chunks_delivered[id]) {
+            delivered += it.second.chunk_landmarks[seq];
+        }
+        if (!finished.count(id) || finished[id].second != it.second.landmark_num || finished[id].first > delivered ||
+            (config.loss == 0 && !config.shuffle && finished[id].first != delivered)) {
+            wrong ++;
+        }
+    }
+    bool ok = wrong == 0 && duplicated_finish == 0 && (int) finished.size() == expected &&
+        reassembler.active_images() == 0 && reassembler.active_frames() == 0;
+    printf("%-28s %6ld packets %.3fus/packet, %d/%d images finished, %d before timeout (%d pending), %d frames %s\n",
+        name, stream.size(), dt*1000/stream.size(), (int) finished.size(), expected, finished_before_timeout, active_images,
+        frames, ok ? "OK" : "FAILED");
+    return ok;
+}
+
+//Usage: loop_reassembly_test
+//Drive PacketReassembler with synthetic landmark batch streams: in order, out of order, lossy and duplicated.
+int main(int argc, char* argv[]) {
+    int failed = 0;
+    failed += !run_stream("in order", 1000, StreamConfig{false, 0, 0});
+    failed += !run_stream("shuffled", 1000, StreamConfig{true, 0, 0});
+    failed += !run_stream("shuffled, 10% duplicated", 1000, StreamConfig{true, 0, 0.1});
+    failed += !run_stream("in order, 20% lost", 1000, StreamConfig{false, 0.2, 0});
+    failed += !run_stream("shuffled, 20% lost, 10% dup", 1000, StreamConfig{true, 0.2, 0.1});
+    failed += !run_stream("shuffled, 10000 images", 10000, StreamConfig{true, 0.05, 0.05});
+    return failed > 0 ? -1 : 0;
+}
@@ -0,0 +1,134 @@
+#include "swarm_loop/pipeline_stage.h"
+#include <atomic>
+#include <vector>
+#include <stdio.h>
+
+#define STAGE_CAPACITY 2
+#define STAGE_ITEMS 8
+
+int failed = 0;
+
+void check(bool ok, const char * what) {
+    if (!ok) {
+        printf("FAILED: %s\n", what);
+        failed ++;
+    }
+}
+
+//Items are held in process until the gate is opened, so the queue fills up deterministically
+class GatedConsumer {
+    std::mutex lock;
+    std::condition_variable cond;
+    bool open = false;
+    int started = 0;
+public:
+    std::vector<int> processed;
+
+    void process(int & item) {
+        std::unique_lock<std::mutex> lk(lock);
+        started ++;
+        cond.notify_all();
+        cond.wait(lk, [&] { return open; });
+        processed.push_back(item);
+    }
+
+    void wait_started(int num) {
+        std::unique_lock<std::mutex> lk(lock);
+        cond.wait(lk, [&] { return started >= num; });
+    }
+
+    void release() {
+        std::lock_guard<std::mutex> lk(lock);
+        open = true;
+        cond.notify_all();
+    }
+};
+
+//The first item is taken by the worker, the queue holds STAGE_CAPACITY, the rest are dropped by the policy
+void check_drop(StageDropPolicy policy) {
+    GatedConsumer consumer;
+    std::vector<int> expect;
+    int rejected = 0;
+    {
+        PipelineStage<int> stage("drop", STAGE_CAPACITY, policy, [&] (int & item) { consumer.process(item); });
+        stage.push(0);
+        consumer.wait_started(1);
+        for (int i = 1; i < STAGE_ITEMS; i ++) {
+            rejected += !stage.push(i);
+        }
+        consumer.release();
+        while (stage.stats().processed < 1 + STAGE_CAPACITY) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        auto s = stage.stats();
+        check(s.pushed == STAGE_ITEMS && s.dropped == STAGE_ITEMS - 1 - STAGE_CAPACITY, "drop stats");
+    }
+    expect.push_back(0);
+    for (int i = 0; i < STAGE_CAPACITY; i ++) {
+        expect.push_back(policy == STAGE_DROP_OLDEST ? STAGE_ITEMS - STAGE_CAPACITY + i : 1 + i);
+    }
+    check(consumer.processed == expect, policy == STAGE_DROP_OLDEST ? "drop oldest keeps the newest" : "drop newest keeps the oldest");
+    check(rejected == STAGE_ITEMS - 1 - STAGE_CAPACITY, "push reports the drops");
+}
+
+//Nothing is dropped, the producer waits for room
+void check_block() {
+    GatedConsumer consumer;
+    std::atomic<int> pushed(0);
+    PipelineStage<int> stage("block", STAGE_CAPACITY, STAGE_BLOCK, [&] (int & item) { consumer.process(item); });
+    std::thread producer([&] {
+        for (int i = 0; i < STAGE_ITEMS; i ++) {
+            stage.push(i);
+            pushed ++;
+        }
+    });
+    consumer.wait_started(1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    //One in process and STAGE_CAPACITY queued, the next push waits
+    check(pushed == 1 + STAGE_CAPACITY && stage.size() == STAGE_CAPACITY, "block waits for room");
+    consumer.release();
+    producer.join();
+    while (stage.stats().processed < STAGE_ITEMS) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::vector<int> expect;
+    for (int i = 0; i < STAGE_ITEMS; i ++) {
+        expect.push_back(i);
+    }
+    check(consumer.processed == expect && stage.stats().dropped == 0, "block processes all in order");
+}
+
+//stop waits for the item in process, discards the queued ones and wakes a blocked producer
+void check_stop() {
+    GatedConsumer consumer;
+    PipelineStage<int> stage("stop", STAGE_CAPACITY, STAGE_BLOCK, [&] (int & item) { consumer.process(item); });
+    std::atomic<int> rejected(0);
+    std::thread producer([&] {
+        for (int i = 0; i < STAGE_ITEMS; i ++) {
+            rejected += !stage.push(i);
+        }
+    });
+    consumer.wait_started(1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::thread stopper([&] { stage.stop(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    consumer.release();
+    stopper.join();
+    producer.join();
+    check(consumer.processed == std::vector<int>{0}, "stop discards the queued items");
+    check(rejected == STAGE_ITEMS - 1 - STAGE_CAPACITY, "stop wakes the blocked producer");
+    check(!stage.push(STAGE_ITEMS), "push after stop is rejected");
+    //Stopped again by the destructor
+    stage.stop();
+}
+
+//Usage: loop_stage_test
+//Check the block, drop oldest and drop newest policies of PipelineStage and its stop.
+int main(int argc, char* argv[]) {
+    check_block();
+    check_drop(STAGE_DROP_OLDEST);
+    check_drop(STAGE_DROP_NEWEST);
+    check_stop();
+    printf("%s\n", failed == 0 ? "OK" : "FAILED");
+    return failed == 0 ? 0 : -1;
+}
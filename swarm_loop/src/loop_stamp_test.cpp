@@ -0,0 +1,130 @@
+#include "swarm_loop/stamped_buffer.h"
+#include <swarm_msgs/swarm_types.hpp>
+#include <random>
+#include <algorithm>
+#include <queue>
+#include <stdio.h>
+
+#define STAMP_RATE 30.0
+#define STAMP_FRAMES 30000
+#define STAMP_TOLERANCE 1e-3
+//Keyframe odometry comes with the delay of the sliding window of the estimator
+#define STAMP_KF_DELAY 0.5
+#define STAMP_KF_EVERY 10
+
+struct Query {
+    double t_arrive;
+    double stamp;
+    bool keyframe;
+};
+
+//find_images_raw before: drop the frames older than the query, take the first one if it matches
+bool queue_find(std::queue<double> & raw, double stamp) {
+    while (raw.size() > 0 && stamp - raw.front() > STAMP_TOLERANCE) {
+        raw.pop();
+    }
+    if (raw.size() > 0 && fabs(stamp - raw.front()) < STAMP_TOLERANCE) {
+        raw.pop();
+        return true;
+    }
+    return false;
+}
+
+bool brute_find(const std::vector<double> & stamps, double stamp, double & found) {
+    double best = STAMP_TOLERANCE;
+    bool ret = false;
+    for (auto t : stamps) {
+        if (fabs(t - stamp) < best) {
+            best = fabs(t - stamp);
+            found = t;
+            ret = true;
+        }
+    }
+    return ret;
+}
+
+//Usage: loop_stamp_test
+//Match odometry and keyframe odometry to raw frames at 30Hz with StampedBuffer and with the queue used before,
+//with jittered frame stamps and delayed keyframe odometry.
+int main(int argc, char* argv[]) {
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<double> jitter(-2e-4, 2e-4);
+    std::vector<double> stamps;
+    for (int i = 0; i < STAMP_FRAMES; i ++) {
+        stamps.push_back(1000 + i/STAMP_RATE + jitter(rng));
+    }
+
+    //Odometry of every frame shortly after it, keyframe odometry of every STAMP_KF_EVERY frame after STAMP_KF_DELAY
+    std::vector<Query> queries;
+    for (int i = 0; i < STAMP_FRAMES; i ++) {
+        queries.push_back(Query{stamps[i] + 0.01, stamps[i], false});
+        if (i % STAMP_KF_EVERY == 0) {
+            queries.push_back(Query{stamps[i] + STAMP_KF_DELAY + jitter(rng), stamps[i], true});
+        }
+    }
+    std::sort(queries.begin(), queries.end(), [](const Query & a, const Query & b) { return a.t_arrive < b.t_arrive; });
+
+    StampedBuffer<int> buffer(100, 2.0);
+    std::queue<double> raw;
+    int found_buffer = 0, found_queue = 0, kf_buffer = 0, kf_queue = 0, kf_num = 0, wrong = 0;
+    size_t next_frame = 0;
+    double dt_find = 0;
+    for (auto & q : queries) {
+        while (next_frame < stamps.size() && stamps[next_frame] <= q.t_arrive) {
+            buffer.push(stamps[next_frame], next_frame);
+            raw.push(stamps[next_frame]);
+            next_frame ++;
+        }
+        int id = -1;
+        TicToc tic;
+        bool ok = buffer.find_nearest(q.stamp, STAMP_TOLERANCE, id);
+        dt_find += tic.toc();
+        wrong += !ok || stamps[id] != q.stamp;
+        found_buffer += ok;
+        bool ok_queue = queue_find(raw, q.stamp);
+        found_queue += ok_queue;
+        if (q.keyframe) {
+            kf_num ++;
+            kf_buffer += ok;
+            kf_queue += ok_queue;
+        }
+    }
+    printf("%ld queries (%d keyframes) on %d frames, buffer of %d frames\n", queries.size(), kf_num, STAMP_FRAMES, buffer.size());
+    printf("StampedBuffer: %d matched, keyframes %d/%d, %.3fus per lookup\n", found_buffer, kf_buffer, kf_num,
+        dt_find*1000/queries.size());
+    printf("queue:         %d matched, keyframes %d/%d\n", found_queue, kf_queue, kf_num);
+
+    //Random stamps pushed out of order against brute force
+    StampedBuffer<double> small(50, 1.0);
+    std::vector<double> pushed;
+    std::uniform_real_distribution<double> uniform(0, 1);
+    double t = 0;
+    for (int i = 0; i < 10000; i ++) {
+        t += 0.01;
+        double s = t - (uniform(rng) < 0.2 ? 0.05 : 0);
+        small.push(s, s);
+        pushed.push_back(s);
+        //What the buffer must hold: the newest 50, within 1 second of the newest
+        std::vector<double> kept = pushed;
+        std::sort(kept.begin(), kept.end());
+        kept.erase(kept.begin(), kept.end() - std::min<size_t>(kept.size(), 50));
+        double q = t - uniform(rng)*1.2;
+        double expect = 0, got = 0;
+        bool expect_ok = brute_find(kept, q, expect);
+        bool got_ok = small.find_nearest(q, STAMP_TOLERANCE, got);
+        //Items past retention are dropped, the brute force keeps them
+        if (got_ok != expect_ok && !(expect_ok && expect < small.newest_stamp() - 1.0)) {
+            wrong ++;
+        } else if (got_ok && got != expect) {
+            wrong ++;
+        }
+        if (small.size() > 50 || small.oldest_stamp() < small.newest_stamp() - 1.0) {
+            wrong ++;
+        }
+        pushed = kept;
+    }
+
+    bool ok = wrong == 0 && kf_buffer == kf_num;
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : -1;
+}
@@ -38,6 +38,16 @@ cv_bridge::CvImageConstPtr getImageFromMsg(const sensor_msgs::ImageConstPtr &img
     return ptr;
 }
 
+cv_bridge::CvImageConstPtr getImageShareFromMsg(const sensor_msgs::Image &img_msg, const boost::shared_ptr<void const> & tracked_object)
+{
+    //toCvShare copies when the requested encoding differs from the message, so keep the encoding of the message
+    if (img_msg.encoding == "8UC1" || img_msg.encoding == "mono8" || img_msg.encoding == "16UC1" ||
+            img_msg.encoding == sensor_msgs::image_encodings::BGR8) {
+        return cv_bridge::toCvShare(img_msg, tracked_object);
+    }
+    return cv_bridge::toCvCopy(img_msg, sensor_msgs::image_encodings::BGR8);
+}
+
 Swarm::Pose AffineRestoCamPose(Eigen::Matrix4d affine) {
     Eigen::Matrix3d R;
     Eigen::Vector3d T;
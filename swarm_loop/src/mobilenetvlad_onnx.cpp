@@ -0,0 +1,15 @@
+#include "swarm_loop/mobilenetvlad_onnx.h"
+#include "swarm_loop/utils.h"
+#include "swarm_msgs/swarm_types.hpp"
+using namespace Swarm;
+
+std::vector<float> MobileNetVLADONNX::inference(const cv::Mat & input) {
+    TicToc tic;
+    doInference(input);
+
+    if (enable_perf) {
+        std::cout << "MobileNetVLADONNX inference " << tic.toc() << "ms" << std::endl;
+    }
+
+    return std::vector<float>(m_OutputTensors[0].hostBuffer, m_OutputTensors[0].hostBuffer+descriptor_size);
+}
@@ -2,14 +2,24 @@
 using namespace Swarm;
 
 std::vector<float> MobileNetVLADTensorRT::inference(const cv::Mat & input) {
-    cv::Mat _input;
-    if (input.rows != height || input.cols != width) {
-        cv::resize(input, _input, cv::Size(width, height));
-        _input.convertTo(_input, CV_32F);
-    } else {
-        input.convertTo(_input, CV_32F);
-    }
-    doInference(_input);
-
+    doInference(input);
     return std::vector<float>(m_OutputTensors[0].hostBuffer, m_OutputTensors[0].hostBuffer+descriptor_size);
-}
\ No newline at end of file
+}
+
+std::vector<std::vector<float>> MobileNetVLADTensorRT::inference(const std::vector<cv::Mat> & inputs) {
+    std::vector<std::vector<float>> ret(inputs.size());
+    doInference(inputs, [&](int start, int batch) {
+        for (int i = 0; i < batch; i ++) {
+            float * desc = m_OutputTensors[0].hostBuffer + i*m_OutputTensors[0].volume;
+            ret[start + i] = std::vector<float>(desc, desc + descriptor_size);
+        }
+    });
+    return ret;
+}
+
+std::future<std::vector<float>> MobileNetVLADTensorRT::inferenceAsync(const cv::Mat & input) {
+    int size = descriptor_size;
+    return doInferenceAsync<std::vector<float>>(input, [size](const std::vector<float*> & outputs) {
+        return std::vector<float>(outputs[0], outputs[0] + size);
+    });
+}
@@ -0,0 +1,82 @@
+#include "swarm_loop/onnx_generic.h"
+#include "swarm_loop/loop_defines.h"
+#include "swarm_loop/utils.h"
+#include "swarm_msgs/swarm_types.hpp"
+using namespace Swarm;
+
+ONNXInferenceGeneric::ONNXInferenceGeneric(std::string input_blob_name, int _width, int _height, int _num_threads):
+    m_Env(ORT_LOGGING_LEVEL_WARNING, "swarm_loop"),
+    m_MemoryInfo(Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault)),
+    m_InputBlobName(input_blob_name), m_NumThreads(_num_threads), width(_width), height(_height) {
+    m_InputShape = {1, 1, height, width};
+}
+
+ONNXInferenceGeneric::~ONNXInferenceGeneric() {
+    delete m_Session;
+    delete [] m_InputBuffer;
+    for (auto & tensor : m_OutputTensors) {
+        delete [] tensor.hostBuffer;
+    }
+}
+
+void ONNXInferenceGeneric::init(const std::string & onnx_path) {
+    Ort::SessionOptions options;
+    options.SetIntraOpNumThreads(m_NumThreads);
+    options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
+    m_Session = new Ort::Session(m_Env, onnx_path.c_str(), options);
+
+    std::cout << "ONNX model " << onnx_path << " inputs " << m_Session->GetInputCount() 
+        << " outputs " << m_Session->GetOutputCount() << std::endl;
+    assert(m_Session->GetOutputCount() == m_OutputTensors.size() && "Output info doesn't match between code and onnx file");
+
+    allocateBuffers();
+    std::cout << "ONNX session ready with " << m_NumThreads << " intra-op threads" << std::endl;
+}
+
+void ONNXInferenceGeneric::allocateBuffers() {
+    m_InputBuffer = new float[m_InputSize];
+    m_InputTensor = Ort::Value::CreateTensor<float>(m_MemoryInfo, m_InputBuffer, m_InputSize,
+        m_InputShape.data(), m_InputShape.size());
+
+    for (auto & tensor : m_OutputTensors) {
+        uint64_t volume = 1;
+        for (auto d : tensor.shape) {
+            volume *= d;
+        }
+        assert(volume == tensor.volume && "Tensor volume doesn't match its shape");
+        tensor.hostBuffer = new float[tensor.volume];
+        m_OutputValues.emplace_back(Ort::Value::CreateTensor<float>(m_MemoryInfo, tensor.hostBuffer, tensor.volume,
+            tensor.shape.data(), tensor.shape.size()));
+    }
+}
+
+void ONNXInferenceGeneric::doInference(const cv::Mat & input) {
+    cv::Mat _input = input;
+    if (input.channels() == 3 && m_InputSize == (uint64_t) width*height) {
+        //Color image to a gray network
+        cv::cvtColor(input, _input, cv::COLOR_BGR2GRAY);
+    }
+    assert((uint64_t) _input.channels()*width*height == m_InputSize && "Input channels must match network input");
+    if (_input.depth() == CV_8U) {
+        preprocessImage(_input, width, height, m_InputScale, m_InputBuffer);
+    } else {
+        if (_input.rows != height || _input.cols != width) {
+            cv::resize(_input, _input, cv::Size(width, height));
+        }
+        if (_input.depth() != CV_32F) {
+            _input.convertTo(_input, CV_32F, m_InputScale);
+        }
+        assert(_input.type() == CV_32FC1 && "Only support 1 channel float input now");
+        assert(_input.isContinuous() && _input.total() == m_InputSize);
+        memcpy(m_InputBuffer, _input.data, m_InputSize*sizeof(float));
+    }
+
+    const char * input_names[] = {m_InputBlobName.c_str()};
+    std::vector<const char *> output_names;
+    for (auto & tensor : m_OutputTensors) {
+        output_names.push_back(tensor.blobName.c_str());
+    }
+
+    m_Session->Run(Ort::RunOptions{nullptr}, input_names, &m_InputTensor, 1,
+        output_names.data(), m_OutputValues.data(), m_OutputValues.size());
+}
@@ -0,0 +1,156 @@
+#include "swarm_loop/packet_reassembler.h"
+#include "swarm_loop/loop_defines.h"
+#include <swarm_msgs/swarm_lcm_converter.hpp>
+#include <algorithm>
+
+using namespace swarm_msgs;
+
+ImageDescriptor_t & PacketReassembler::image_of(int64_t id, double tnow) {
+    auto it = images.find(id);
+    if (it == images.end()) {
+        it = images.emplace(id, ImageDescriptor_t()).first;
+        it->second.msg_id = id;
+        it->second.landmark_num = 0;
+        it->second.feature_descriptor_size = 0;
+        //Also bounds the landmarks whose header is lost
+        image_deadlines.schedule(id, tnow + recv_period);
+    }
+    return it->second;
+}
+
+void PacketReassembler::check_image(int64_t id, double tnow) {
+    auto it = images.find(id);
+    if (it != images.end() && header_time.find(id) != header_time.end() &&
+            (int) it->second.landmarks_2d.size() >= it->second.landmark_num) {
+        finish_image(id, tnow);
+    }
+}
+
+void PacketReassembler::on_header(const ImageDescriptorHeader_t & msg, double tnow) {
+    auto & tmp = image_of(msg.msg_id, tnow);
+    tmp.timestamp = msg.timestamp;
+    tmp.drone_id = msg.drone_id;
+    tmp.image_desc_size = msg.image_desc_size;
+    tmp.image_desc = msg.image_desc;
+    tmp.pose_drone = msg.pose_drone;
+    tmp.camera_extrinsic = msg.camera_extrinsic;
+    tmp.landmark_num = msg.feature_num;
+    tmp.frame_id = msg.frame_id;
+    tmp.msg_id = msg.msg_id;
+    tmp.prevent_adding_db = msg.prevent_adding_db;
+    tmp.direction = msg.direction;
+    header_time[msg.msg_id] = tnow;
+    check_image(msg.msg_id, tnow);
+}
+
+void PacketReassembler::on_landmark(const LandmarkDescriptor_t & msg, double tnow) {
+    auto & tmp = image_of(msg.header_id, tnow);
+    tmp.landmarks_2d_norm.push_back(msg.landmark_2d_norm);
+    tmp.landmarks_2d.push_back(msg.landmark_2d);
+    tmp.landmarks_3d.push_back(msg.landmark_3d);
+    tmp.landmarks_flag.push_back(msg.landmark_flag);
+    tmp.feature_descriptor.insert(tmp.feature_descriptor.end(),
+        msg.feature_descriptor.begin(),
+        msg.feature_descriptor.begin()+FEATURE_DESC_SIZE
+    );
+    tmp.feature_descriptor_size = tmp.feature_descriptor.size();
+    check_image(msg.header_id, tnow);
+}
+
+void PacketReassembler::on_landmark_batch(const void * data, int size, const LandmarkBatchInfo & info, double tnow) {
+    auto & tmp = image_of(info.header_id, tnow);
+    auto & chunks = batch_chunks[info.header_id];
+    chunks.resize(std::max((int) chunks.size(), info.chunk_num), false);
+    //A chunk repeated by the network must not duplicate its landmarks
+    if (!chunks[info.seq]) {
+        chunks[info.seq] = true;
+        append_landmark_batch(data, size, tmp);
+        check_image(info.header_id, tnow);
+    }
+}
+
+void PacketReassembler::on_image(const ImageDescriptor_t & image, double tnow) {
+    add_to_frame(image, tnow);
+}
+
+void PacketReassembler::finish_image(int64_t id, double tnow) {
+    image_deadlines.cancel(id);
+    batch_chunks.erase(id);
+    auto it = images.find(id);
+    auto it_header = header_time.find(id);
+    if (it_header == header_time.end()) {
+        //Landmarks without header can not be used
+        images.erase(it);
+        return;
+    }
+    ImageDescriptor_t msg = std::move(it->second);
+    double t_header = it_header->second;
+    images.erase(it);
+    header_time.erase(it_header);
+
+    int announced = msg.landmark_num;
+    msg.landmark_num = msg.landmarks_2d.size();
+    image_callback(msg, announced);
+    if (msg.landmark_num > 0) {
+        add_to_frame(msg, t_header);
+    }
+}
+
+void PacketReassembler::add_to_frame(const ImageDescriptor_t & image, double t_header) {
+    int64_t frame_hash = image.msg_id;
+    auto it = frames.find(frame_hash);
+    if (it == frames.end()) {
+        FisheyeFrameDescriptor_t frame_desc;
+
+        frame_desc.image_num = 4;
+        frame_desc.timestamp = image.timestamp;
+        for (size_t i = 0; i < frame_desc.image_num; i ++) {
+            if (i != image.direction) {
+                auto img_desc = generate_null_img_desc();
+                frame_desc.images.push_back(img_desc);
+            } else {
+                frame_desc.images.push_back(image);
+            }
+        }
+
+        frame_desc.msg_id = image.frame_id;
+        frame_desc.pose_drone = image.pose_drone;
+        frame_desc.landmark_num = 0;
+        frame_desc.drone_id = image.drone_id;
+        it = frames.emplace(frame_hash, frame_desc).first;
+        frame_deadlines.schedule(frame_hash, t_header + 2.0*recv_period);
+    } else {
+        it->second.images[image.direction] = image;
+    }
+
+    int count_images = 0;
+    for (auto & img : it->second.images) {
+        if (img.landmark_num > 0) {
+            count_images ++;
+        }
+    }
+    if (count_images >= min_directions) {
+        finish_frame(frame_hash);
+    }
+}
+
+void PacketReassembler::finish_frame(int64_t frame_hash) {
+    frame_deadlines.cancel(frame_hash);
+    auto it = frames.find(frame_hash);
+    auto & frame_desc = it->second;
+    frame_desc.landmark_num = 0;
+    for (size_t i = 0; i < frame_desc.images.size(); i ++) {
+        frame_desc.landmark_num += frame_desc.images[i].landmark_num;
+    }
+    frame_callback(frame_desc);
+    frames.erase(it);
+}
+
+void PacketReassembler::expire(double tnow) {
+    for (auto id : image_deadlines.expire(tnow)) {
+        finish_image(id, tnow);
+    }
+    for (auto frame_hash : frame_deadlines.expire(tnow)) {
+        finish_frame(frame_hash);
+    }
+}
@@ -0,0 +1,203 @@
+#include "swarm_loop/pnp_prosac.h"
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <math.h>
+
+//Minimal sample, cv::SOLVEPNP_P3P takes exactly 4 points, the 4th picks one of the P3P solutions
+#define PNP_SAMPLE_SIZE 4
+
+struct PnPModel {
+    cv::Mat rvec, tvec;
+    //Truncated squared error (MSAC) over all correspondences, lower is better
+    double cost = INFINITY;
+    int inlier_num = 0;
+};
+
+static void evaluate_model(const std::vector<cv::Point3f> & pts_3d, const std::vector<cv::Point2f> & pts_2d,
+        double thres2, PnPModel & model, std::vector<int> * inliers = nullptr) {
+    cv::Matx33d R;
+    cv::Rodrigues(model.rvec, R);
+    cv::Vec3d t(model.tvec.at<double>(0), model.tvec.at<double>(1), model.tvec.at<double>(2));
+    model.cost = 0;
+    model.inlier_num = 0;
+    if (inliers != nullptr) {
+        inliers->clear();
+    }
+    for (size_t i = 0; i < pts_3d.size(); i ++) {
+        cv::Vec3d p = R * cv::Vec3d(pts_3d[i].x, pts_3d[i].y, pts_3d[i].z) + t;
+        double err2 = thres2;
+        if (p[2] > 1e-6) {
+            double dx = p[0] / p[2] - pts_2d[i].x;
+            double dy = p[1] / p[2] - pts_2d[i].y;
+            err2 = dx*dx + dy*dy;
+        }
+        if (err2 < thres2) {
+            model.cost += err2;
+            model.inlier_num ++;
+            if (inliers != nullptr) {
+                inliers->push_back(i);
+            }
+        } else {
+            model.cost += thres2;
+        }
+    }
+}
+
+//Iterations needed to draw an all inlier sample with the confidence
+static int adaptive_iterations(int inlier_num, int num, double confidence, int max_iterations) {
+    double w = (double) inlier_num / num;
+    double p_good = pow(w, PNP_SAMPLE_SIZE);
+    if (p_good >= 1 - 1e-9) {
+        return 1;
+    }
+    if (p_good < 1e-9) {
+        return max_iterations;
+    }
+    double k = log(1 - confidence) / log(1 - p_good);
+    return (int) std::min((double) max_iterations, ceil(k));
+}
+
+static bool fit_model(const std::vector<cv::Point3f> & pts_3d, const std::vector<cv::Point2f> & pts_2d,
+        const std::vector<int> & ids, int flag, bool use_guess, cv::Mat & rvec, cv::Mat & tvec) {
+    static const cv::Mat K = cv::Mat::eye(3, 3, CV_64F);
+    std::vector<cv::Point3f> _3d(ids.size());
+    std::vector<cv::Point2f> _2d(ids.size());
+    for (size_t i = 0; i < ids.size(); i ++) {
+        _3d[i] = pts_3d[ids[i]];
+        _2d[i] = pts_2d[ids[i]];
+    }
+    try {
+        if (!cv::solvePnP(_3d, _2d, K, cv::noArray(), rvec, tvec, use_guess, flag)) {
+            return false;
+        }
+    } catch (cv::Exception & e) {
+        //Degenerated sample
+        return false;
+    }
+    return cv::checkRange(rvec) && cv::checkRange(tvec);
+}
+
+bool solvePnPProsac(const std::vector<cv::Point3f> & _pts_3d, const std::vector<cv::Point2f> & _pts_2d,
+        const std::vector<float> & scores, cv::Mat & rvec, cv::Mat & tvec, std::vector<int> & inliers,
+        const PnPProsacParams & params, const PnPHypothesisCheck & check, PnPProsacStats * stats) {
+    int num = _pts_3d.size();
+    inliers.clear();
+    if (num < PNP_SAMPLE_SIZE || _pts_2d.size() != _pts_3d.size()) {
+        return false;
+    }
+
+    //Best ranked correspondences first, PROSAC draws from a growing prefix of them.
+    //Without a score per correspondence samples are drawn uniformly from all of them
+    bool prosac = (int) scores.size() == num;
+    std::vector<int> order(num);
+    std::iota(order.begin(), order.end(), 0);
+    if (prosac) {
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return scores[a] < scores[b]; });
+    }
+    std::vector<cv::Point3f> pts_3d(num);
+    std::vector<cv::Point2f> pts_2d(num);
+    for (int i = 0; i < num; i ++) {
+        pts_3d[i] = _pts_3d[order[i]];
+        pts_2d[i] = _pts_2d[order[i]];
+    }
+
+    double thres2 = params.reproj_thres * params.reproj_thres;
+    std::mt19937 rng(params.seed);
+    PnPProsacStats _stats;
+    PnPModel best;
+
+    //PROSAC growth function (Chum and Matas 2005), the sampling reaches all correspondences by max_iterations
+    const int m = PNP_SAMPLE_SIZE;
+    double Tn = params.max_iterations;
+    for (int i = 0; i < m; i ++) {
+        Tn *= (double)(m - i) / (num - i);
+    }
+    int Tn_prime = prosac ? 1 : 0;
+    int n = prosac ? m : num;
+    int max_iterations = params.max_iterations;
+
+    std::vector<int> sample(m);
+    std::vector<int> inlier_ids;
+    for (int t = 1; t <= max_iterations; t ++) {
+        if (t > Tn_prime && n < num) {
+            double Tn_next = Tn * (n + 1) / (n + 1 - m);
+            n ++;
+            Tn_prime += (int) ceil(Tn_next - Tn);
+            Tn = Tn_next;
+        }
+
+        //m-1 points from the first n-1 and the n-th, or uniformly from the first n once the schedule is passed
+        int drawn = 0;
+        int range = n;
+        if (Tn_prime >= t) {
+            sample[drawn ++] = n - 1;
+            range = n - 1;
+        }
+        while (drawn < m) {
+            int id = std::uniform_int_distribution<int>(0, range - 1)(rng);
+            if (std::find(sample.begin(), sample.begin() + drawn, id) == sample.begin() + drawn) {
+                sample[drawn ++] = id;
+            }
+        }
+        _stats.iterations ++;
+
+        PnPModel model;
+        if (!fit_model(pts_3d, pts_2d, sample, cv::SOLVEPNP_P3P, false, model.rvec, model.tvec)) {
+            continue;
+        }
+        if (check && !check(model.rvec, model.tvec)) {
+            _stats.rejected ++;
+            continue;
+        }
+        evaluate_model(pts_3d, pts_2d, thres2, model, &inlier_ids);
+        if (model.cost >= best.cost || model.inlier_num < m) {
+            continue;
+        }
+
+        //Local optimization: refit on the inliers while it gains inliers
+        for (int lo = 0; lo < params.lo_iterations; lo ++) {
+            PnPModel refined;
+            refined.rvec = model.rvec.clone();
+            refined.tvec = model.tvec.clone();
+            if (!fit_model(pts_3d, pts_2d, inlier_ids, cv::SOLVEPNP_ITERATIVE, true, refined.rvec, refined.tvec)) {
+                break;
+            }
+            if (check && !check(refined.rvec, refined.tvec)) {
+                break;
+            }
+            std::vector<int> refined_ids;
+            evaluate_model(pts_3d, pts_2d, thres2, refined, &refined_ids);
+            _stats.lo_runs ++;
+            if (refined.cost >= model.cost) {
+                break;
+            }
+            bool grown = refined.inlier_num > model.inlier_num;
+            model = refined;
+            inlier_ids.swap(refined_ids);
+            if (!grown) {
+                break;
+            }
+        }
+
+        best = model;
+        max_iterations = std::min(params.max_iterations,
+            std::max(t, adaptive_iterations(best.inlier_num, num, params.confidence, params.max_iterations)));
+    }
+
+    if (stats != nullptr) {
+        *stats = _stats;
+    }
+    if (best.rvec.empty()) {
+        return false;
+    }
+
+    evaluate_model(pts_3d, pts_2d, thres2, best, &inlier_ids);
+    for (int id : inlier_ids) {
+        inliers.push_back(order[id]);
+    }
+    std::sort(inliers.begin(), inliers.end());
+    rvec = best.rvec;
+    tvec = best.tvec;
+    return true;
+}
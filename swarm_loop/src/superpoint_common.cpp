@@ -0,0 +1,162 @@
+#include "swarm_loop/superpoint_common.h"
+#include "swarm_loop/keypoint_nms.h"
+#include "swarm_loop/loop_defines.h"
+#include "swarm_loop/utils.h"
+#include "swarm_msgs/swarm_types.hpp"
+#include <fstream>
+
+#define USE_PCA
+using namespace Swarm;
+
+#define MAXBUFSIZE 100000
+Eigen::MatrixXf Swarm::load_csv_mat_eigen(std::string csv) {
+    int cols = 0, rows = 0;
+    double buff[MAXBUFSIZE];
+
+    // Read numbers from file into buffer.
+    std::ifstream infile;
+    infile.open(csv);
+    std::string line;
+
+    while (getline(infile, line))
+    {
+        int temp_cols = 0;
+        std::stringstream          lineStream(line);
+        std::string                cell;
+
+        while (std::getline(lineStream, cell, ','))
+        {
+            buff[rows * cols + temp_cols] = std::stod(cell);
+            temp_cols ++;
+        }
+
+        rows ++;
+        if (cols > 0) {
+            assert(cols == temp_cols && "Matrix must have same cols on each rows!");
+        } else {
+            cols = temp_cols;
+        }
+    }
+
+    infile.close();
+
+    Eigen::MatrixXf result(rows,cols);
+    for (int i = 0; i < rows; i++)
+        for (int j = 0; j < cols; j++)
+            result(i,j) = buff[ cols*i+j ];
+
+    return result;
+}
+
+Eigen::VectorXf Swarm::load_csv_vec_eigen(std::string csv) {
+    int cols = 0, rows = 0;
+    double buff[MAXBUFSIZE];
+
+    // Read numbers from file into buffer.
+    std::ifstream infile;
+    infile.open(csv);
+    while (! infile.eof())
+    {
+        std::string line;
+        getline(infile, line);
+
+        int temp_cols = 0;
+        std::stringstream stream(line);
+        while(! stream.eof())
+            stream >> buff[cols*rows+temp_cols++];
+
+        if (temp_cols == 0)
+            continue;
+
+        if (cols == 0)
+            cols = temp_cols;
+
+        rows++;
+    }
+
+    infile.close();
+
+    rows--;
+
+    // Populate matrix with numbers.
+    Eigen::VectorXf result(rows,cols);
+    for (int i = 0; i < rows; i++)
+            result(i) = buff[ i ];
+
+    return result;
+}
+
+void Swarm::getKeyPoints(const cv::Mat & prob, float threshold, std::vector<cv::Point2f> &keypoints, int width, int height, int max_num, int bucket_num)
+{
+    assert(prob.type() == CV_32FC1 && prob.isContinuous() && "Heatmap must be continuous float");
+    int dist_thresh = 4;
+    gridNMS((const float*) prob.data, width, height, threshold, dist_thresh, max_num, keypoints, bucket_num);
+}
+
+void Swarm::computeDescriptors(const float * desc_map, const std::vector<cv::Point2f> &keypoints,
+    std::vector<float> & local_descriptors, int width, int height, const Eigen::MatrixXf & pca_comp_T, const Eigen::RowVectorXf & pca_mean) {
+    thread_local std::vector<int> offsets;
+    thread_local std::vector<float> weights;
+    thread_local std::vector<float> sampled;
+    int num = keypoints.size();
+    int desc_w = width/8;
+    int desc_h = height/8;
+    int plane = desc_w*desc_h;
+    local_descriptors.clear();
+    if (num == 0) {
+        return;
+    }
+    offsets.resize(num*4);
+    weights.resize(num*4);
+    sampled.resize(SP_DESC_RAW_LEN*num);
+
+    //Bilinear taps on the coarse map, same arithmetic as grid_sampler with zero padding and align_corners = false
+    for (int k = 0; k < num; k ++) {
+        float gx = 2.0f * keypoints[k].x / width - 1;
+        float gy = 2.0f * keypoints[k].y / height - 1;
+        float ix = ((gx + 1) * desc_w - 1) / 2;
+        float iy = ((gy + 1) * desc_h - 1) / 2;
+        int x0 = floor(ix);
+        int y0 = floor(iy);
+        int xs[4] = {x0, x0 + 1, x0, x0 + 1};
+        int ys[4] = {y0, y0, y0 + 1, y0 + 1};
+        float ws[4] = {
+            (x0 + 1 - ix) * (y0 + 1 - iy),
+            (ix - x0) * (y0 + 1 - iy),
+            (x0 + 1 - ix) * (iy - y0),
+            (ix - x0) * (iy - y0)
+        };
+        for (int j = 0; j < 4; j ++) {
+            bool inside = xs[j] >= 0 && xs[j] < desc_w && ys[j] >= 0 && ys[j] < desc_h;
+            offsets[k*4 + j] = inside ? ys[j]*desc_w + xs[j] : 0;
+            weights[k*4 + j] = inside ? ws[j] : 0;
+        }
+    }
+
+    //Channel by channel, so one pass only touches one plane of the coarse map.
+    //Each channel is normalized over the keypoints as torch::norm(desc, 2, 1) did on the [256, N] samples,
+    //the PCA model is fitted on descriptors normalized this way.
+    for (int c = 0; c < SP_DESC_RAW_LEN; c ++) {
+        const float * map = desc_map + c*plane;
+        float * out = sampled.data() + c*num;
+        float sq = 0;
+        for (int k = 0; k < num; k ++) {
+            const int * o = offsets.data() + k*4;
+            const float * w = weights.data() + k*4;
+            out[k] = map[o[0]]*w[0] + map[o[1]]*w[1] + map[o[2]]*w[2] + map[o[3]]*w[3];
+            sq += out[k]*out[k];
+        }
+        float norm = sqrt(sq);
+        for (int k = 0; k < num; k ++) {
+            out[k] /= norm;
+        }
+    }
+
+    Eigen::Map<Eigen::Matrix<float,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor>> _desc(sampled.data(), SP_DESC_RAW_LEN, num);
+#ifdef USE_PCA
+    Eigen::Matrix<float,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> _desc_new = (_desc.transpose().rowwise() - pca_mean) *pca_comp_T;
+#else
+    Eigen::Matrix<float,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> _desc_new = _desc.transpose();
+#endif
+    local_descriptors = std::vector<float>(_desc_new.data(), _desc_new.data()+_desc_new.cols()*_desc_new.rows());
+}
@@ -0,0 +1,63 @@
+#include "swarm_loop/superpoint_onnx.h"
+#include "swarm_loop/loop_defines.h"
+#include "swarm_loop/utils.h"
+#include "swarm_msgs/swarm_types.hpp"
+
+using namespace Swarm;
+
+SuperPointONNX::SuperPointONNX(std::string engine_path,
+    std::string _pca_comp,
+    std::string _pca_mean,
+    int _width, int _height,
+    float _thres, int _max_num, int _num_threads,
+    bool _enable_perf):
+    ONNXInferenceGeneric("image", _width, _height, _num_threads), thres(_thres), max_num(_max_num), enable_perf(_enable_perf) {
+    ONNXTensorInfo outputTensorSemi, outputTensorDesc;
+    outputTensorSemi.blobName = "semi";
+    outputTensorDesc.blobName = "desc";
+    outputTensorSemi.volume = height*width;
+    outputTensorSemi.shape = {1, height, width};
+    outputTensorDesc.volume = 1*SP_DESC_RAW_LEN*height/8*width/8;
+    outputTensorDesc.shape = {1, SP_DESC_RAW_LEN, height/8, width/8};
+    m_InputSize = height*width;
+    m_InputScale = 1/255.0;
+    m_OutputTensors.push_back(outputTensorSemi);
+    m_OutputTensors.push_back(outputTensorDesc);
+    std::cout << "Trying to init ONNX model of SuperPointONNX " << engine_path << std::endl;
+    init(engine_path);
+
+    pca_comp_T = load_csv_mat_eigen(_pca_comp).transpose();
+    pca_mean = load_csv_vec_eigen(_pca_mean).transpose();
+
+    std::cout << "pca_comp rows " << pca_comp_T.rows() << "cols " << pca_comp_T.cols() << std::endl;
+    std::cout << "pca_mean " << pca_mean.size() << std::endl;
+}
+
+void SuperPointONNX::inference(const cv::Mat & input, std::vector<cv::Point2f> & keypoints, std::vector<float> & local_descriptors) {
+    TicToc tic;
+    keypoints.clear();
+    local_descriptors.clear();
+    doInference(input);
+    if (enable_perf) {
+        std::cout << "Inference Time " << tic.toc();
+    }
+
+    cv::Mat Prob = cv::Mat(height, width, CV_32F, m_OutputTensors[0].hostBuffer);
+
+    TicToc tic2;
+    getKeyPoints(Prob, thres, keypoints, width, height, max_num, nms_bucket_num);
+    computeDescriptors(m_OutputTensors[1].hostBuffer, keypoints, local_descriptors, width, height, pca_comp_T, pca_mean);
+
+    if (enable_perf) {
+        std::cout << " getKeyPoints+computeDescriptors " << tic2.toc() << "inference all" << tic.toc() << "features" << keypoints.size() << "desc size" << local_descriptors.size() << std::endl;
+    }
+}
+
+void SuperPointONNX::inference(const std::vector<cv::Mat> & inputs, std::vector<std::vector<cv::Point2f>> & keypoints, 
+        std::vector<std::vector<float>> & local_descriptors) {
+    keypoints.resize(inputs.size());
+    local_descriptors.resize(inputs.size());
+    for (size_t i = 0; i < inputs.size(); i ++) {
+        inference(inputs[i], keypoints[i], local_descriptors[i]);
+    }
+}
@@ -4,6 +4,7 @@
 #include "ros/ros.h"
 #include <iostream>
 #include "swarm_loop/loop_net.h"
+#include "swarm_loop/landmark_batch.h"
 #include "swarm_loop/loop_cam.h"
 #include "swarm_loop/loop_detector.h"
 #include <Eigen/Eigen>
@@ -33,67 +34,70 @@ StereoFrame SwarmLoop::find_images_raw(const nav_msgs::Odometry & odometry) {
     // ROS_INFO("find_images_raw %f", odometry.header.stamp.toSec());
     auto stamp = odometry.header.stamp;
     StereoFrame ret;
+    //Frames stay in the buffer until retention, both the odometry and the keyframe odometry of a stamp find them
     raw_stereo_image_lock.lock();
-    while (raw_stereo_images.size() > 0 && stamp.toSec() - raw_stereo_images.front().stamp.toSec() > 1e-3) {
-        // ROS_INFO("Removing d stamp %f", stamp.toSec() - raw_stereo_images.front().stamp.toSec());
-        raw_stereo_images.pop();
-    }
-
-    if (raw_stereo_images.size() > 0 && fabs(stamp.toSec() - raw_stereo_images.front().stamp.toSec()) < 1e-3) {
-        auto ret = raw_stereo_images.front();
-        raw_stereo_images.pop();
+    bool found = raw_stereo_images.find_nearest(stamp.toSec(), raw_image_tolerance, ret);
+    raw_stereo_image_lock.unlock();
+    if (found) {
         ret.pose_drone = odometry.pose.pose;
         // ROS_INFO("VIO KF found, returning...");
-        raw_stereo_image_lock.unlock();
-        return ret;
-    } 
-
-    raw_stereo_image_lock.unlock();
+    }
     return ret;
 }
 
-void SwarmLoop::flatten_raw_callback(const vins::FlattenImages & stereoframe) {
+//The callbacks only keep the messages, images are shared or decoded by StereoFrame::load_images
+//when the frame is taken as keyframe
+void SwarmLoop::flatten_raw_callback(const vins::FlattenImagesConstPtr & stereoframe) {
+    StereoFrame frame(stereoframe, self_id);
     raw_stereo_image_lock.lock();
-    // ROS_INFO("(SwarmLoop::flatten_raw_callback) Received flatten_raw %f", stereoframe.header.stamp.toSec());
-    raw_stereo_images.push(StereoFrame(stereoframe, self_id));
+    // ROS_INFO("(SwarmLoop::flatten_raw_callback) Received flatten_raw %f", stereoframe->header.stamp.toSec());
+    raw_stereo_images.push(frame.stamp.toSec(), std::move(frame));
     raw_stereo_image_lock.unlock();
 }
 
 void SwarmLoop::stereo_images_callback(const sensor_msgs::ImageConstPtr left, const sensor_msgs::ImageConstPtr right) {
-    auto _l = getImageFromMsg(left);
-    auto _r = getImageFromMsg(right);
+    StereoFrame frame(left->header.stamp, cv::Mat(), cv::Mat(), left_extrinsic, right_extrinsic, self_id);
+    frame.image_loader = [left, right] (StereoFrame & frame) {
+        frame.share_image(frame.left_images[0], *left, left);
+        frame.share_image(frame.right_images[0], *right, right);
+    };
     raw_stereo_image_lock.lock();
-    raw_stereo_images.push(StereoFrame(_l->header.stamp, 
-        _l->image, _r->image, left_extrinsic, right_extrinsic, self_id));
+    raw_stereo_images.push(frame.stamp.toSec(), std::move(frame));
     raw_stereo_image_lock.unlock();
 }
 
 
 void SwarmLoop::comp_stereo_images_callback(const sensor_msgs::CompressedImageConstPtr left, const sensor_msgs::CompressedImageConstPtr right) {
-    auto _l = getImageFromMsg(left, cv::IMREAD_GRAYSCALE);
-    auto _r = getImageFromMsg(right, cv::IMREAD_GRAYSCALE);
+    StereoFrame frame(left->header.stamp, cv::Mat(), cv::Mat(), left_extrinsic, right_extrinsic, self_id);
+    frame.image_loader = [left, right] (StereoFrame & frame) {
+        frame.left_images[0] = getImageFromMsg(left, cv::IMREAD_GRAYSCALE);
+        frame.right_images[0] = getImageFromMsg(right, cv::IMREAD_GRAYSCALE);
+    };
     raw_stereo_image_lock.lock();
-    raw_stereo_images.push(StereoFrame(left->header.stamp, 
-        _l, _r, left_extrinsic, right_extrinsic, self_id));
+    raw_stereo_images.push(frame.stamp.toSec(), std::move(frame));
     raw_stereo_image_lock.unlock();
 }
 
 
 void SwarmLoop::comp_depth_images_callback(const sensor_msgs::CompressedImageConstPtr left, const sensor_msgs::ImageConstPtr depth) {
-    auto _l = getImageFromMsg(left, cv::IMREAD_GRAYSCALE);
-    auto _d = getImageFromMsg(depth);
+    StereoFrame frame(left->header.stamp, cv::Mat(), cv::Mat(), left_extrinsic, self_id);
+    frame.image_loader = [left, depth] (StereoFrame & frame) {
+        frame.left_images[0] = getImageFromMsg(left, cv::IMREAD_GRAYSCALE);
+        frame.share_image(frame.depth_images[0], *depth, depth);
+    };
     raw_stereo_image_lock.lock();
-    raw_stereo_images.push(StereoFrame(left->header.stamp, 
-        _l, _d->image, left_extrinsic, self_id));
+    raw_stereo_images.push(frame.stamp.toSec(), std::move(frame));
     raw_stereo_image_lock.unlock();
 }
 
 void SwarmLoop::depth_images_callback(const sensor_msgs::ImageConstPtr left, const sensor_msgs::ImageConstPtr depth) {
-    auto _l = getImageFromMsg(left);
-    auto _d = getImageFromMsg(depth);
+    StereoFrame frame(left->header.stamp, cv::Mat(), cv::Mat(), left_extrinsic, self_id);
+    frame.image_loader = [left, depth] (StereoFrame & frame) {
+        frame.share_image(frame.left_images[0], *left, left);
+        frame.share_image(frame.depth_images[0], *depth, depth);
+    };
     raw_stereo_image_lock.lock();
-    raw_stereo_images.push(StereoFrame(left->header.stamp, 
-        _l->image, _d->image, left_extrinsic, self_id));
+    raw_stereo_images.push(frame.stamp.toSec(), std::move(frame));
     raw_stereo_image_lock.unlock();
 }
 
@@ -138,9 +142,6 @@ void SwarmLoop::VIOnonKF_callback(const StereoFrame & stereoframe) {
 }
 
 void SwarmLoop::VIOKF_callback(const StereoFrame & stereoframe, bool nonkeyframe) {
-    Eigen::Vector3d drone_pos(stereoframe.pose_drone.position.x, stereoframe.pose_drone.position.y, stereoframe.pose_drone.position.z);
-    double dpos = (last_keyframe_position - drone_pos).norm();
-
     if (stereoframe.stamp.toSec() - last_invoke < 1/max_freq) {
         return;
     }
@@ -149,12 +150,22 @@ void SwarmLoop::VIOKF_callback(const StereoFrame & stereoframe, bool nonkeyframe
     
     last_kftime = stereoframe.stamp;
 
-    auto start = high_resolution_clock::now();
+    if (!extraction_stage->push(KeyframeJob{stereoframe, nonkeyframe})) {
+        ROS_WARN("[SWARM_LOOP] Extraction is behind, dropped keyframe");
+    }
+}
+
+void SwarmLoop::process_keyframe(KeyframeJob & job) {
+    auto & stereoframe = job.frame;
+    stereoframe.load_images();
+    Eigen::Vector3d drone_pos(stereoframe.pose_drone.position.x, stereoframe.pose_drone.position.y, stereoframe.pose_drone.position.z);
+    double dpos = (last_keyframe_position - drone_pos).norm();
+
     std::vector<cv::Mat> imgs;
     
     auto ret = loop_cam->on_flattened_images(stereoframe, imgs);
     
-    ret.prevent_adding_db = nonkeyframe && dpos < min_movement_keyframe;
+    ret.prevent_adding_db = job.nonkeyframe && dpos < min_movement_keyframe;
 
     if (ret.landmark_num == 0) {
         ROS_WARN("[SWARM_LOOP] Null img desc, CNN no ready");
@@ -164,9 +175,21 @@ void SwarmLoop::VIOKF_callback(const StereoFrame & stereoframe, bool nonkeyframe
     received_image = true;
     last_keyframe_position = drone_pos;
 
-    loop_net->broadcast_fisheye_desc(ret);
-    loop_detector->on_image_recv(ret, imgs);
-    pub_node_frame(ret);
+    if (!broadcast_stage->push(ret)) {
+        ROS_WARN("[SWARM_LOOP] Broadcast is behind, dropped keyframe");
+    }
+    if (!detection_stage->push(DetectionJob{ret, imgs, true})) {
+        ROS_WARN("[SWARM_LOOP] Detection is behind, dropped keyframe");
+    }
+}
+
+void SwarmLoop::process_detection(DetectionJob & job) {
+    if (job.is_local) {
+        loop_detector->on_image_recv(job.frame_desc, job.imgs);
+        pub_node_frame(job.frame_desc);
+    } else {
+        loop_detector->on_image_recv(job.frame_desc);
+    }
 }
 
 void SwarmLoop::pub_node_frame(const FisheyeFrameDescriptor_t & viokf) {
@@ -195,11 +218,33 @@ void SwarmLoop::on_remote_frame_ros(const swarm_msgs::FisheyeFrameDescriptor & r
 }
 
 void SwarmLoop::on_remote_image(const FisheyeFrameDescriptor_t & frame_desc) {
-    loop_detector->on_image_recv(frame_desc);
+    if (!detection_stage->push(DetectionJob{frame_desc, std::vector<cv::Mat>(), false})) {
+        ROS_WARN("[SWARM_LOOP] Detection is behind, dropped remote frame from drone %d", frame_desc.drone_id);
+    }
 }
 
 
-SwarmLoop::SwarmLoop () {}
+SwarmLoop::SwarmLoop (): received_image(false) {}
+
+SwarmLoop::~SwarmLoop () {
+    timer.stop();
+    pipeline_report_timer.stop();
+    //Extraction feeds broadcast and detection, so it is stopped first and no stage waits on a stopped one.
+    //The stages are not deleted: ROS callbacks and the LCM thread may still push, which a stopped stage rejects
+    if (extraction_stage != nullptr) {
+        extraction_stage->stop();
+    }
+    if (broadcast_stage != nullptr) {
+        broadcast_stage->stop();
+    }
+    if (detection_stage != nullptr) {
+        detection_stage->stop();
+    }
+    //lcm.handle has no timeout to join on
+    if (th.joinable()) {
+        th.detach();
+    }
+}
 
 void SwarmLoop::Init(ros::NodeHandle & nh) {
     //Init Loop Net
@@ -233,13 +278,24 @@ void SwarmLoop::Init(ros::NodeHandle & nh) {
     nh.param<bool>("is_pc_replay", IS_PC_REPLAY, false);
     nh.param<bool>("send_whole_img_desc", send_whole_img_desc, false);
     nh.param<bool>("send_all_features", SEND_ALL_FEATURES, false);
+    //Landmarks are packed into datagrams of this size, 0 for one LandmarkDescriptor_t per landmark as old versions
+    nh.param<int>("landmark_batch_bytes", LANDMARK_BATCH_BYTES, LANDMARK_BATCH_DEFAULT_BYTES);
+    //Descriptors on the network 0: float32, 1: int8, 2: binary landmark descriptors (DescFormat), with landmark batches only
+    nh.param<int>("desc_wire_format", DESC_WIRE_FORMAT, DESC_WIRE_FORMAT_DEFAULT);
     nh.param<double>("query_thres", INNER_PRODUCT_THRES, 0.6);
     nh.param<double>("init_query_thres", INIT_MODE_PRODUCT_THRES, 0.3);
     nh.param<double>("max_freq", max_freq, 1.0);
+    //Raw frames are matched to the odometry with the nearest stamp within the tolerance, and kept for the retention in seconds
+    nh.param<double>("raw_image_tolerance", raw_image_tolerance, 1e-3);
+    nh.param<double>("raw_image_retention", raw_image_retention, 2.0);
+    nh.param<int>("raw_image_buffer_size", raw_image_buffer_size, 100);
     nh.param<double>("recv_msg_duration", recv_msg_duration, 0.5);
     nh.param<double>("superpoint_thres", superpoint_thres, 0.012);
     nh.param<int>("superpoint_max_num", superpoint_max_num, 200);
+    nh.param<int>("superpoint_nms_buckets", SUPERPOINT_NMS_BUCKETS, 0);
     nh.param<double>("detector_match_thres", DETECTOR_MATCH_THRES, 0.9);
+    //Ratio test of the landmark matching, 1 to disable
+    nh.param<double>("detector_match_ratio", DETECTOR_MATCH_RATIO, 1.0);
     nh.param<bool>("lower_cam_as_main", LOWER_CAM_AS_MAIN, false);
     nh.param<bool>("output_raw_superpoint_desc", OUTPUT_RAW_SUPERPOINT_DESC, false);
 
@@ -256,6 +312,32 @@ void SwarmLoop::Init(ros::NodeHandle & nh) {
     nh.param<int>("min_direction_loop", MIN_DIRECTION_LOOP, 3);
     nh.param<int>("width", width, 400);
     nh.param<int>("height", height, 208);
+    nh.param<int>("onnx_num_threads", ONNX_NUM_THREADS, 4);
+    nh.param<int>("extraction_threads", extraction_threads, 1);
+    //Queues between the keyframe stages. Policy 0: block the producer, 1: drop the oldest, 2: drop the newest
+    nh.param<int>("extraction_queue_size", extraction_queue_size, 2);
+    nh.param<int>("broadcast_queue_size", broadcast_queue_size, 10);
+    nh.param<int>("detection_queue_size", detection_queue_size, 10);
+    nh.param<int>("extraction_queue_policy", extraction_queue_policy, STAGE_DROP_OLDEST);
+    nh.param<int>("broadcast_queue_policy", broadcast_queue_policy, STAGE_BLOCK);
+    nh.param<int>("detection_queue_policy", detection_queue_policy, STAGE_BLOCK);
+    //Keyframe database budget, 0 for unlimited. Eviction 0: LRU by last match, 1: spatially redundant first
+    nh.param<double>("keyframe_db_max_mb", KEYFRAME_DB_MAX_MB, 0);
+    nh.param<int>("keyframe_db_max_frames", KEYFRAME_DB_MAX_FRAMES, 0);
+    nh.param<int>("keyframe_db_eviction", KEYFRAME_DB_EVICTION, 0);
+    nh.param<double>("keyframe_db_spatial_radius", KEYFRAME_DB_SPATIAL_RADIUS, 1.0);
+    //NetVLAD index as faiss factory string, Flat for exact search or e.g. PCA256,HNSW32 / PCA512,IVF256,PQ64
+    nh.param<std::string>("loop_index_factory", LOOP_INDEX_FACTORY, "Flat");
+    nh.param<std::string>("loop_index_search_params", LOOP_INDEX_SEARCH_PARAMS, "");
+    nh.param<int>("loop_index_train_size", LOOP_INDEX_TRAIN_SIZE, 2000);
+    //Indexes that can't remove evicted keyframes (HNSW) are rebuilt once this fraction of them is stale
+    nh.param<double>("loop_index_rebuild_stale", LOOP_INDEX_REBUILD_STALE, 0.1);
+    //Keyframes from all directions verified per query, in parallel with loop_verify_threads
+    nh.param<int>("loop_candidate_num", LOOP_CANDIDATE_NUM, 1);
+    nh.param<int>("loop_verify_threads", LOOP_VERIFY_THREADS, 1);
+    //Loop PnP 0: solvePnPRansac, 1: PROSAC ranked by descriptor distance with local optimization
+    nh.param<int>("pnp_solver", PNP_SOLVER, 0);
+    nh.param<double>("pnp_prosac_thres", PNP_PROSAC_THRES, 0.02);
     int _camconfig;
     nh.param<int>("camera_configuration", _camconfig, 1);
     camera_configuration = (CameraConfig) _camconfig;
@@ -306,15 +388,24 @@ void SwarmLoop::Init(ros::NodeHandle & nh) {
     right_extrinsic = toROSPose(Swarm::Pose(T.block<3, 3>(0, 0), T.block<3, 1>(0, 3)));
 
     
+    raw_stereo_images = StampedBuffer<StereoFrame>(raw_image_buffer_size, raw_image_retention);
+
     loop_net = new LoopNet(_lcm_uri, send_img, send_whole_img_desc, recv_msg_duration);
     loop_cam = new LoopCam(camera_configuration, camera_config_path, superpoint_model_path, _pca_comp_path, _pca_mean_path, 
-        superpoint_thres, superpoint_max_num, netvlad_model_path, width, height, self_id, send_img, nh);
+        superpoint_thres, superpoint_max_num, netvlad_model_path, width, height, self_id, send_img, nh, extraction_threads);
         
     loop_cam->show = debug_image; 
     loop_detector = new LoopDetector(self_id);
     loop_detector->loop_cam = loop_cam;
     loop_detector->enable_visualize = debug_image;
 
+    extraction_stage = new PipelineStage<KeyframeJob>("extraction", extraction_queue_size, (StageDropPolicy) extraction_queue_policy,
+        [&] (KeyframeJob & job) { this->process_keyframe(job); });
+    broadcast_stage = new PipelineStage<FisheyeFrameDescriptor_t>("broadcast", broadcast_queue_size, (StageDropPolicy) broadcast_queue_policy,
+        [&] (FisheyeFrameDescriptor_t & frame_desc) { loop_net->broadcast_fisheye_desc(frame_desc); });
+    detection_stage = new PipelineStage<DetectionJob>("detection", detection_queue_size, (StageDropPolicy) detection_queue_policy,
+        [&] (DetectionJob & job) { this->process_detection(job); });
+
     loop_detector->on_loop_cb = [&] (LoopEdge & loop_con) {
         this->on_loop_connection(loop_con, true);
     };
@@ -391,6 +482,12 @@ void SwarmLoop::Init(ros::NodeHandle & nh) {
         loop_net->scan_recv_packets();
     });
 
+    pipeline_report_timer = nh.createTimer(ros::Duration(10.0), [&](const ros::TimerEvent & e) {
+        ROS_INFO("[SWARM_LOOP] Pipeline %s", extraction_stage->report().c_str());
+        ROS_INFO("[SWARM_LOOP] Pipeline %s", broadcast_stage->report().c_str());
+        ROS_INFO("[SWARM_LOOP] Pipeline %s", detection_stage->report().c_str());
+    });
+
     th = std::thread([&] {
         while(0 == loop_net->lcm_handle()) {
         }
@@ -6,11 +6,43 @@ using namespace Swarm;
 using namespace nvinfer1;
 uint64_t get3DTensorVolume4(nvinfer1::Dims inputDims);
 
-TensorRTInferenceGeneric::TensorRTInferenceGeneric(std::string input_blob_name, int _width, int _height):
-    m_InputBlobName(input_blob_name), width(_width), height(_height){
+TensorRTInferenceGeneric::TensorRTInferenceGeneric(std::string input_blob_name, int _width, int _height, int _batch_size):
+    m_BatchSize(_batch_size), m_InputBlobName(input_blob_name), width(_width), height(_height){
 
 }
 
+TensorRTInferenceGeneric::~TensorRTInferenceGeneric() {
+    //Joins the completion thread, the postprocess of inflight slots still reads the slot buffers
+    delete m_Pipeline;
+    m_Pipeline = nullptr;
+    for (auto & slot : m_Slots) {
+        for (auto buffer : slot.deviceBuffers) {
+            cudaFree(buffer);
+        }
+        cudaFreeHost(slot.inputHostBuffer);
+        for (auto buffer : slot.outputHostBuffers) {
+            cudaFreeHost(buffer);
+        }
+        cudaStreamDestroy(slot.stream);
+        slot.context->destroy();
+    }
+    m_Slots.clear();
+
+    if (m_Engine == nullptr) {
+        return;
+    }
+    for (auto buffer : m_DeviceBuffers) {
+        cudaFree(buffer);
+    }
+    cudaFreeHost(m_InputHostBuffer);
+    for (auto & tensor : m_OutputTensors) {
+        cudaFreeHost(tensor.hostBuffer);
+    }
+    cudaStreamDestroy(m_CudaStream);
+    m_Context->destroy();
+    m_Engine->destroy();
+}
+
 void TensorRTInferenceGeneric::init(const std::string & engine_path) {
 
     m_Engine = loadTRTEngine(engine_path, nullptr, m_Logger);
@@ -27,7 +59,10 @@ void TensorRTInferenceGeneric::init(const std::string & engine_path) {
 	m_InputBindingIndex = m_Engine->getBindingIndex(m_InputBlobName.c_str());
 	assert(m_InputBindingIndex != -1);
     std::cout << "MaxBatchSize" << m_Engine->getMaxBatchSize() << std::endl;
-	assert(m_BatchSize <= static_cast<uint32_t>(m_Engine->getMaxBatchSize()));
+    if (m_BatchSize > m_Engine->getMaxBatchSize()) {
+        std::cout << "Batch size " << m_BatchSize << " exceeds engine, use " << m_Engine->getMaxBatchSize() << std::endl;
+        m_BatchSize = m_Engine->getMaxBatchSize();
+    }
 	allocateBuffers();
 	NV_CUDA_CHECK(cudaStreamCreate(&m_CudaStream));
 	assert(verifyEngine());
@@ -35,25 +70,40 @@ void TensorRTInferenceGeneric::init(const std::string & engine_path) {
     std::cout << "TensorRT workspace " << m_Engine->getWorkspaceSize () /1024.0/1024.0 << "mb" << std::endl;
 }
 
-void TensorRTInferenceGeneric::doInference(const cv::Mat & input) {
-    // assert(input.channels() == 1 && "Only support 1 channel now");
-    TicToc inference;
-    //This function is very slow event on i7, we need to optimize it
-    //But not now.
-    if (input.channels() == 1) {
-        doInference(input.data, 1);
+void TensorRTInferenceGeneric::packInput(const cv::Mat & input, float * dst) {
+    cv::Mat _input = input;
+    if (input.channels() == 3 && m_InputSize == (uint64_t) width*height) {
+        //Color image to a gray network
+        cv::cvtColor(input, _input, cv::COLOR_BGR2GRAY);
+    }
+    assert((uint64_t) _input.channels()*width*height == m_InputSize && "Input channels must match network input");
+    if (_input.depth() == CV_8U) {
+        preprocessImage(_input, width, height, m_InputScale, dst);
     } else {
-        cv::Mat bgr[3];
-        cv::split(input, bgr);
-        static float * data_buf = new float[3*input.rows*input.cols];
-        memcpy(data_buf, bgr[2].data, input.rows*input.cols*sizeof(float));
-        memcpy(data_buf+input.rows*input.cols, bgr[1].data, input.rows*input.cols*sizeof(float));
-        memcpy(data_buf+input.rows*input.cols*2, bgr[0].data, input.rows*input.cols*sizeof(float));
-        doInference((unsigned char*)data_buf, 1);
+        if (_input.rows != height || _input.cols != width) {
+            cv::resize(_input, _input, cv::Size(width, height));
+        }
+        if (_input.depth() != CV_32F) {
+            _input.convertTo(_input, CV_32F, m_InputScale);
+        }
+        packImageBatch(std::vector<cv::Mat>{_input}, 0, 1, m_InputSize, dst);
     }
-    //printf("doInference %fms\n", inference.toc());
 }
 
+void TensorRTInferenceGeneric::doInference(const cv::Mat & input) {
+    packInput(input, m_InputHostBuffer);
+    doInference((unsigned char*)m_InputHostBuffer, 1);
+}
+
+void TensorRTInferenceGeneric::doInference(const std::vector<cv::Mat> & inputs, std::function<void(int, int)> on_batch) {
+    splitBatches(inputs.size(), m_BatchSize, [&](int start, int batch) {
+        for (int i = 0; i < batch; i ++) {
+            packInput(inputs[start + i], m_InputHostBuffer + i*m_InputSize);
+        }
+        doInference((unsigned char*)m_InputHostBuffer, batch);
+        on_batch(start, batch);
+    });
+}
 
 void TensorRTInferenceGeneric::doInference(const unsigned char* input, const uint32_t batchSize)
 {
@@ -74,6 +124,43 @@ void TensorRTInferenceGeneric::doInference(const unsigned char* input, const uin
 //	timer.out("inference");
 }
 
+void TensorRTInferenceGeneric::initAsync(int slot_num) {
+    m_Slots.resize(slot_num);
+    for (auto & slot : m_Slots) {
+        slot.context = m_Engine->createExecutionContext();
+        assert(slot.context != nullptr);
+        NV_CUDA_CHECK(cudaStreamCreate(&slot.stream));
+        slot.deviceBuffers.resize(m_Engine->getNbBindings(), nullptr);
+        NV_CUDA_CHECK(cudaMalloc(&slot.deviceBuffers.at(m_InputBindingIndex), m_InputSize * sizeof(float)));
+        NV_CUDA_CHECK(cudaMallocHost(&slot.inputHostBuffer, m_InputSize * sizeof(float)));
+        for (auto& tensor : m_OutputTensors) {
+            float * host_buffer = nullptr;
+            NV_CUDA_CHECK(cudaMalloc(&slot.deviceBuffers.at(tensor.bindingIndex), tensor.volume * sizeof(float)));
+            NV_CUDA_CHECK(cudaMallocHost(&host_buffer, tensor.volume * sizeof(float)));
+            slot.outputHostBuffers.push_back(host_buffer);
+        }
+    }
+    m_Pipeline = new InferencePipeline(this);
+    std::cout << "TensorRT async inference with " << slot_num << " slots" << std::endl;
+}
+
+void TensorRTInferenceGeneric::enqueueSlot(int slot_id, int batch) {
+    auto & slot = m_Slots[slot_id];
+    assert(batch == 1 && "Async slots are allocated for one image");
+    NV_CUDA_CHECK(cudaMemcpyAsync(slot.deviceBuffers.at(m_InputBindingIndex), slot.inputHostBuffer,
+                                  batch * m_InputSize * sizeof(float), cudaMemcpyHostToDevice, slot.stream));
+    slot.context->enqueue(batch, slot.deviceBuffers.data(), slot.stream, nullptr);
+    for (unsigned int i = 0; i < m_OutputTensors.size(); i ++) {
+        auto & tensor = m_OutputTensors[i];
+        NV_CUDA_CHECK(cudaMemcpyAsync(slot.outputHostBuffers[i], slot.deviceBuffers.at(tensor.bindingIndex),
+                                      batch * tensor.volume * sizeof(float), cudaMemcpyDeviceToHost, slot.stream));
+    }
+}
+
+void TensorRTInferenceGeneric::synchronizeSlot(int slot_id) {
+    cudaStreamSynchronize(m_Slots[slot_id].stream);
+}
+
 bool TensorRTInferenceGeneric::verifyEngine()
 {
     assert((m_Engine->getNbBindings() == (1 + m_OutputTensors.size())
@@ -102,6 +189,7 @@ void TensorRTInferenceGeneric::allocateBuffers()
     assert(m_InputBindingIndex != -1 && "Invalid input binding index");
     NV_CUDA_CHECK(cudaMalloc(&m_DeviceBuffers.at(m_InputBindingIndex),
                              m_BatchSize * m_InputSize * sizeof(float)));
+    NV_CUDA_CHECK(cudaMallocHost(&m_InputHostBuffer, m_BatchSize * m_InputSize * sizeof(float)));
 
     for (auto& tensor : m_OutputTensors)
     {